@@ -0,0 +1,45 @@
+#!/bin/sh
+# Batch throughput report for the CAM interpreter.
+# Generates a directory of camgen scripts and runs it with --batch on 1, 2, 4, ... up to MAX threads,
+# printing the scripts per second of each run (the best of RUNS), the speedup over one thread and
+# whether the output matched the one thread run. Speedup needs as many cores as threads; the core
+# count is printed first. Build with 'make release gen' first.
+#
+# Usage: bench/batch.sh
+# SCRIPTS sets the number of scripts (default 100), MAX the most threads (default 16), RUNS the runs
+# per thread count (default 3) and SEED the first generator seed (default 1).
+
+CAM=${CAM:-./cam}
+GEN=${GEN:-./camgen}
+SCRIPTS=${SCRIPTS:-100}
+MAX=${MAX:-16}
+RUNS=${RUNS:-3}
+SEED=${SEED:-1}
+TMP=${TMPDIR:-/tmp}/cambatchbench.$$
+
+mkdir -p "$TMP.dir"
+n=0
+while [ $n -lt "$SCRIPTS" ]; do
+    $GEN --seed $((SEED + n)) --statements 200 --whiles 20 --trips 10 > "$TMP.dir/$(printf 's%05d.cam' $n)"
+    n=$((n + 1))
+done
+echo "cores: $(getconf _NPROCESSORS_ONLN), scripts: $SCRIPTS"
+printf "%8s %12s %8s %6s\n" "threads" "scripts/sec" "speedup" "same"
+threads=1
+base=
+while [ $threads -le "$MAX" ]; do
+    best=0
+    run=0
+    while [ $run -lt "$RUNS" ]; do
+        $CAM --batch "$TMP.dir" --threads $threads > "$TMP.out" 2> "$TMP.err"
+        rate=$(sed -n 's/.*s, \([0-9.]*\) scripts\/sec.*/\1/p' "$TMP.err")
+        best=$(echo "$best $rate" | awk '{ print ($2 > $1 ? $2 : $1) }')
+        run=$((run + 1))
+    done
+    [ -n "$base" ] || { base=$best; cp "$TMP.out" "$TMP.first"; }
+    same=yes
+    cmp -s "$TMP.first" "$TMP.out" || same=no
+    echo "$threads $best $base $same" | awk '{ printf "%8d %12.1f %8.2f %6s\n", $1, $2, $2 / $3, $4 }'
+    threads=$((threads * 2))
+done
+rm -rf "$TMP.dir" "$TMP.out" "$TMP.err" "$TMP.first"
@@ -0,0 +1,40 @@
+#!/bin/sh
+# Parallel lexing report for the CAM interpreter.
+# Generates one large program with camgen and lexes it on 1, 2, 4, ... up to MAX threads, printing the
+# lex time of each run (the best of RUNS), its speedup over one thread and whether the output of the
+# run matched the one thread run. Speedup needs as many cores as threads; the core count is printed
+# first. Build with 'make release gen' first.
+#
+# Usage: bench/lex.sh
+# BYTES sets the program size (default 10000000), MAX the most threads (default 16), RUNS the runs
+# per thread count (default 3) and SEED the generator seed (default 1).
+
+CAM=${CAM:-./cam}
+GEN=${GEN:-./camgen}
+BYTES=${BYTES:-10000000}
+MAX=${MAX:-16}
+RUNS=${RUNS:-3}
+SEED=${SEED:-1}
+TMP=${TMPDIR:-/tmp}/camlexbench.$$
+
+$GEN --seed "$SEED" --bytes "$BYTES" --whiles 0 > "$TMP.cam"
+echo "cores: $(getconf _NPROCESSORS_ONLN), program: $(wc -c < "$TMP.cam") bytes"
+printf "%8s %10s %8s %6s\n" "threads" "lex ms" "speedup" "same"
+threads=1
+base=
+while [ $threads -le "$MAX" ]; do
+    best=1000000000
+    run=0
+    while [ $run -lt "$RUNS" ]; do
+        $CAM --perf-counters --lex-threads $threads "$TMP.cam" > "$TMP.out" 2> "$TMP.err"
+        ms=$(awk '$1 == "lex" { print $2 }' "$TMP.err")
+        best=$(echo "$best $ms" | awk '{ print $2 < $1 ? $2 : $1 }')
+        run=$((run + 1))
+    done
+    [ -n "$base" ] || { base=$best; cp "$TMP.out" "$TMP.first"; }
+    same=yes
+    cmp -s "$TMP.first" "$TMP.out" || same=no
+    echo "$threads $best $base $same" | awk '{ printf "%8d %10.2f %8.2f %6s\n", $1, $2, $3 / $2, $4 }'
+    threads=$((threads * 2))
+done
+rm -f "$TMP.cam" "$TMP.out" "$TMP.err" "$TMP.first"
@@ -0,0 +1,76 @@
+#!/bin/sh
+# Scaling report for the CAM interpreter.
+# Sweeps one camgen knob at a time while the others stay fixed, and prints the lex, parse, prepare and
+# execute times and peak RSS of each program, with a bar of the total time. Size knobs double each
+# step, expr-depth and nesting go up by one (each level about doubles the program). "grow" is how
+# much the total time grew over the row before. The work should grow with the program size, or with
+# the trip count for trips, so a row growing over 1.25 times faster than that is flagged superlinear.
+# Build with 'make release gen' first.
+#
+# Usage: bench/scale.sh [knob ...]    knobs: statements vars expr-depth nesting trips bytes
+# STEPS sets the number of steps (default 6) and SEED the generator seed (default 1).
+
+CAM=${CAM:-./cam}
+GEN=${GEN:-./camgen}
+STEPS=${STEPS:-6}
+SEED=${SEED:-1}
+TMP=${TMPDIR:-/tmp}/camscale.$$
+KNOBS=${*:-statements vars expr-depth nesting trips bytes}
+
+# Starting value of each knob and the fixed knobs it is swept with.
+start() {
+    case $1 in
+        statements) echo 2000 ;;
+        vars) echo 64 ;;
+        expr-depth) echo 1 ;;
+        nesting) echo 1 ;;
+        trips) echo 4 ;;
+        bytes) echo 1000000 ;;
+    esac
+}
+
+fixed() {
+    case $1 in
+        statements|vars|bytes) echo "--whiles 0 --ifs 20 --nesting 2" ;;
+        expr-depth) echo "--statements 2000 --whiles 0" ;;
+        nesting) echo "--statements 2000 --trips 1 --whiles 30 --ifs 30" ;;
+        trips) echo "--statements 200 --nesting 1 --whiles 20" ;;
+    esac
+}
+
+for knob in $KNOBS; do
+    value=$(start "$knob")
+    [ -n "$value" ] || { echo "unknown knob $knob"; exit 1; }
+    echo
+    printf "%-12s %10s %9s %9s %9s %9s %9s %6s\n" "$knob" "bytes" "lex ms" "parse ms" "prep ms" "exec ms" "rss KB" "grow"
+    prev=
+    prevSize=
+    step=0
+    while [ $step -lt "$STEPS" ]; do
+        $GEN --seed "$SEED" $(fixed "$knob") --"$knob" "$value" > "$TMP.cam"
+        $CAM --mem-stats --perf-counters "$TMP.cam" > /dev/null 2> "$TMP.err"
+        size=$(wc -c < "$TMP.cam")
+        line=$(awk -v knob="$knob" -v value="$value" -v size="$size" -v prev="$prev" -v prevSize="$prevSize" '
+            $1 == "lex" || $1 == "parse" || $1 == "prepare" || $1 == "execute" { ms[$1] = $2; total += $2 }
+            /peak RSS/ { rss = $4 }
+            END {
+                ratio = prev > 0 ? sprintf("%.2f", total / prev) : "-"
+                expect = knob == "trips" ? 2 : prevSize > 0 ? size / prevSize : 1
+                flag = prev > 0 && total / prev > 1.25 * expect && total > 5 ? " superlinear" : ""
+                bar = ""
+                for (i = 0; i < 40 && i < log(total + 1) * 4; i++) bar = bar "#"
+                printf "%-12s %10d %9.2f %9.2f %9.2f %9.2f %9d %6s %s%s\n", value, size, ms["lex"], ms["parse"],
+                       ms["prepare"], ms["execute"], rss, ratio, bar, flag
+                printf "%f\n", (total > 0 ? total : 0.001)
+            }' "$TMP.err")
+        echo "$line" | head -1
+        prev=$(echo "$line" | tail -1)
+        prevSize=$size
+        case $knob in
+            expr-depth|nesting) value=$((value + 1)) ;;
+            *) value=$((value * 2)) ;;
+        esac
+        step=$((step + 1))
+    done
+done
+rm -f "$TMP.cam" "$TMP.err"
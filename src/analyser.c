@@ -0,0 +1,475 @@
+// Semantic analyser for the CAM programming langauge.
+// Resolves every variable declaration and use to a symbol slot and decodes literals, so the
+// interpreter never has to search for a name or parse a value string while running.
+// Each procedure gets a table of its own for its frame and every call is linked to its procedure.
+
+#include "analyser.h"
+#include "memstats.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Procedures hashed by name, for linking calls.
+typedef struct ProcIndex {
+    SymbolTable *table;
+    int bucketCount;
+    int *buckets;
+    int *chain;
+} ProcIndex;
+
+// -----------------
+// Private Functions
+// -----------------
+
+void initTable(SymbolTable *table);
+void addProc(SymbolTable *table, ProcStmt *stmt);
+void resolveProc(SymbolTable *table, Procedure *proc);
+void linkCall(void *node, int scope, int depth, void *data);
+void declareNode(void *node, int scope, int depth, void *data);
+void resolveNode(void *node, int scope, int depth, void *data);
+int declareSymbol(SymbolTable *table, char *id, int scope, Type type);
+int resolveUse(SymbolTable *table, char *id, int depth);
+int topSymbol(SymbolTable *table, char *id);
+void rehash(SymbolTable *table);
+unsigned int hashName(char *id);
+void decodeLiteral(LiteralExpr *lit);
+void inferIntegral(SymbolTable *table, ParseTree tree);
+bool findFloating(ParseTree tree, bool *floating, int *root);
+void markIntegral(ParseTree tree, bool *floating, int *root);
+bool integralExpr(void *expr, bool *floating, int *root);
+void markExpr(void *expr, bool *floating, int *root);
+
+// -----------------
+// Main Funcs
+// -----------------
+
+// Build the symbol table for a tree and resolve every variable node against it.
+// Declarations are collected first so a use may resolve to a declaration that appears later in a loop body.
+// Procedure bodies are resolved against their own frames and calls may come before the procedure.
+void resolve(ParseTree tree, SymbolTable *table) {
+    initTable(table);
+    ParseTree outside = {0, tree.index, malloc(sizeof(void *) * (tree.index ? tree.index : 1))};
+    for (int j = 0; j < tree.index; j++) {
+        if (((VarExpr *) tree.stmts[j])->s == PROC) {
+            addProc(table, tree.stmts[j]);
+        } else {
+            outside.stmts[outside.index++] = tree.stmts[j];
+        }
+    }
+    walkTree(outside, declareNode, table);
+    walkTree(outside, resolveNode, table);
+    for (int k = 0; k < table->procCount; k++) resolveProc(table, &table->procs[k]);
+
+    // The first procedure with a name is the one its calls reach.
+    ProcIndex index = {table, table->procCount * 2 + 1, NULL, NULL};
+    index.buckets = malloc(sizeof(int) * index.bucketCount);
+    index.chain = malloc(sizeof(int) * (table->procCount ? table->procCount : 1));
+    for (int b = 0; b < index.bucketCount; b++) index.buckets[b] = -1;
+    for (int k = table->procCount - 1; k >= 0; k--) {
+        ProcStmt *proc = table->procs[k].stmt;
+        unsigned int b = hashName(proc->id) % index.bucketCount;
+        for (int other = index.buckets[b]; other != -1; other = index.chain[other]) {
+            if (!strcmp(table->procs[other].stmt->id, proc->id)) table->procs[other].stmt->redeclared = true;
+        }
+        index.chain[k] = index.buckets[b];
+        index.buckets[b] = k;
+    }
+    walkTree(tree, linkCall, &index);
+    free(index.buckets);
+    free(index.chain);
+
+    if (table->depth <= DEPTH_LIMIT) inferIntegral(table, outside);
+    free(outside.stmts);
+}
+
+// Start an empty table.
+void initTable(SymbolTable *table) {
+    table->size = 8;
+    table->index = 0;
+    table->syms = malloc(sizeof(Symbol) * table->size);
+    table->names = 0;
+    table->temps = 0;
+    table->depth = 0;
+    table->arrays = false;
+    table->bucketCount = 64;
+    table->buckets = malloc(sizeof(int) * table->bucketCount);
+    table->chain = malloc(sizeof(int) * table->size);
+    for (int b = 0; b < table->bucketCount; b++) table->buckets[b] = -1;
+    MEM_COUNT(MEM_SYMBOLS, sizeof(Symbol) * table->size);
+    MEM_COUNT(MEM_SYMBOLS, sizeof(int) * table->bucketCount);
+    MEM_COUNT(MEM_SYMBOLS, sizeof(int) * table->size);
+    table->procs = NULL;
+    table->procCount = 0;
+    table->procSize = 0;
+}
+
+// Find the slot for a name declared at exactly the given scope depth, or -1.
+int findSymbol(SymbolTable *table, char *id, int scope) {
+    for (int s = topSymbol(table, id); s != -1; s = table->syms[s].outer) {
+        if (table->syms[s].scope == scope) return s;
+        if (table->syms[s].scope < scope) break;
+    }
+    return -1;
+}
+
+// Release the table and the tables of its procedures.
+void freeSymbolTable(SymbolTable *table) {
+    for (int k = 0; k < table->procCount; k++) freeSymbolTable(&table->procs[k].frame);
+    free(table->procs);
+    free(table->syms);
+    free(table->buckets);
+    free(table->chain);
+}
+
+// -----------------
+// Procedures
+// -----------------
+
+// Add a procedure to the table, numbering it in declaration order.
+void addProc(SymbolTable *table, ProcStmt *stmt) {
+    if (table->procCount == table->procSize) {
+        MEM_COUNT(MEM_SYMBOLS, sizeof(Procedure) * (table->procSize ? table->procSize : 4));
+        table->procSize = table->procSize ? table->procSize * 2 : 4;
+        table->procs = realloc(table->procs, sizeof(Procedure) * table->procSize);
+    }
+    stmt->index = table->procCount;
+    stmt->redeclared = false;
+    table->procs[table->procCount++] = (Procedure) {stmt, stmt->params.index};
+}
+
+// Resolve a procedure's parameters and body against its frame, parameters first so they take the
+// first slots. The program's depth covers the deepest procedure too.
+void resolveProc(SymbolTable *table, Procedure *proc) {
+    SymbolTable *frame = &proc->frame;
+    initTable(frame);
+    walkTree(proc->stmt->params, declareNode, frame);
+    walkTree(proc->stmt->body, declareNode, frame);
+    walkTree(proc->stmt->body, resolveNode, frame);
+    if (frame->depth + 1 > table->depth) table->depth = frame->depth + 1;
+    if (frame->depth <= DEPTH_LIMIT) inferIntegral(frame, proc->stmt->body);
+}
+
+// Visitor linking a call to the first procedure with its name, NULL when there is none.
+void linkCall(void *node, int scope, int depth, void *data) {
+    if (((VarExpr *) node)->s != CALL) return;
+    ProcIndex *index = data;
+    CallExpr *call = node;
+    call->proc = NULL;
+    for (int k = index->buckets[hashName(call->id) % index->bucketCount]; k != -1; k = index->chain[k]) {
+        if (!strcmp(index->table->procs[k].stmt->id, call->id)) {
+            call->proc = index->table->procs[k].stmt;
+            return;
+        }
+    }
+}
+
+// -----------------
+// Tree walks
+// -----------------
+
+// Give a declaration a slot and track the depth of the tree and any use of arrays.
+// If and while bodies are one scope deeper.
+void declareNode(void *node, int scope, int depth, void *data) {
+    SymbolTable *table = data;
+    if (depth > table->depth) table->depth = depth;
+    switch (((VarExpr *) node)->s) {
+        case VARDEC: {
+            VarDecStmt *dec = node;
+            dec->slot = declareSymbol(table, dec->id, scope, dec->type);
+            if (dec->type == ARRAY) table->arrays = true;
+            break;
+        }
+        case STORE:
+        case INDEX:
+        case REDUCE:
+            table->arrays = true;
+            break;
+        default:
+            break;
+    }
+}
+
+// Resolve the uses in a node and decode literals.
+// The condition of an if or while is evaluated inside its scope, so it is resolved one deeper too.
+void resolveNode(void *node, int scope, int depth, void *data) {
+    SymbolTable *table = data;
+    switch (((VarExpr *) node)->s) {
+        case VARASSIGN:
+            ((VarAssignStmt *) node)->slot = resolveUse(table, ((VarAssignStmt *) node)->id, scope);
+            break;
+        case STORE:
+            ((StoreStmt *) node)->slot = resolveUse(table, ((StoreStmt *) node)->id, scope);
+            break;
+        case INDEX:
+            ((IndexExpr *) node)->slot = resolveUse(table, ((IndexExpr *) node)->id, scope);
+            break;
+        case LITERAL:
+            decodeLiteral((LiteralExpr *) node);
+            break;
+        case VAR:
+        case READ:
+            ((VarExpr *) node)->slot = resolveUse(table, ((VarExpr *) node)->id, scope);
+            break;
+        default:
+            break;
+    }
+}
+
+// -----------------
+// Symbol table Funcs
+// -----------------
+
+// Return the slot for a name at a scope depth, adding it if it is new.
+// Slots of one name are kept ordered from deepest to outermost.
+int declareSymbol(SymbolTable *table, char *id, int scope, Type type) {
+    int existing = findSymbol(table, id, scope);
+    if (existing != -1) return existing;
+
+    if (table->index == table->size) {
+        MEM_COUNT(MEM_SYMBOLS, sizeof(Symbol) * table->size);
+        MEM_COUNT(MEM_SYMBOLS, sizeof(int) * table->size);
+        table->size *= 2;
+        table->syms = realloc(table->syms, sizeof(Symbol) * table->size);
+        table->chain = realloc(table->chain, sizeof(int) * table->size);
+    }
+    int slot = table->index++;
+    Symbol sym = {scope, ((Token) {0, 0, END, ""}), -1, type};
+    strcpy(sym.tok.lexeme, id);
+
+    int top = topSymbol(table, id);
+    if (top == -1 || table->syms[top].scope < scope) {
+        // New deepest slot for this name, it becomes the entry in the hash.
+        sym.outer = top;
+        table->syms[slot] = sym;
+        unsigned int b = hashName(id) % table->bucketCount;
+        if (top == -1) {
+            table->chain[slot] = table->buckets[b];
+            table->buckets[b] = slot;
+            if (++table->names > table->bucketCount) rehash(table);
+        } else {
+            for (int *at = &table->buckets[b]; *at != -1; at = &table->chain[*at]) {
+                if (*at == top) {
+                    table->chain[slot] = table->chain[top];
+                    *at = slot;
+                    break;
+                }
+            }
+        }
+    } else {
+        int before = top;
+        while (table->syms[before].outer != -1 && table->syms[table->syms[before].outer].scope > scope) {
+            before = table->syms[before].outer;
+        }
+        sym.outer = table->syms[before].outer;
+        table->syms[slot] = sym;
+        table->syms[before].outer = slot;
+        table->chain[slot] = -1;
+    }
+    return slot;
+}
+
+// Resolve a use at a scope depth to the deepest slot that could be visible there, or -1.
+// At run time the interpreter follows outer from this slot to the first one that has been declared.
+int resolveUse(SymbolTable *table, char *id, int depth) {
+    int s = topSymbol(table, id);
+    while (s != -1 && table->syms[s].scope > depth) s = table->syms[s].outer;
+    return s;
+}
+
+// Return the deepest slot with the given name, or -1.
+int topSymbol(SymbolTable *table, char *id) {
+    for (int s = table->buckets[hashName(id) % table->bucketCount]; s != -1; s = table->chain[s]) {
+        if (!strcmp(table->syms[s].tok.lexeme, id)) return s;
+    }
+    return -1;
+}
+
+// Double the number of hash buckets and re-insert every name.
+void rehash(SymbolTable *table) {
+    int *tops = malloc(sizeof(int) * table->names);
+    int n = 0;
+    for (int b = 0; b < table->bucketCount; b++) {
+        for (int s = table->buckets[b]; s != -1; s = table->chain[s]) tops[n++] = s;
+    }
+    MEM_COUNT(MEM_SYMBOLS, sizeof(int) * table->bucketCount);
+    table->bucketCount *= 2;
+    table->buckets = realloc(table->buckets, sizeof(int) * table->bucketCount);
+    for (int b = 0; b < table->bucketCount; b++) table->buckets[b] = -1;
+    for (int k = 0; k < n; k++) {
+        unsigned int b = hashName(table->syms[tops[k]].tok.lexeme) % table->bucketCount;
+        table->chain[tops[k]] = table->buckets[b];
+        table->buckets[b] = tops[k];
+    }
+    free(tops);
+}
+
+// -----------------
+// Helper Funcs
+// -----------------
+
+// FNV-1a hash of a name.
+unsigned int hashName(char *id) {
+    unsigned int h = 2166136261u;
+    for (; *id; id++) {
+        h ^= (unsigned char) *id;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Convert the literal text to a type and value.
+void decodeLiteral(LiteralExpr *lit) {
+    if (!strcmp(lit->val, "true")) {
+        lit->type = BOOL;
+        lit->value = 1;
+    } else if (!strcmp(lit->val, "false")) {
+        lit->type = BOOL;
+        lit->value = 0;
+    } else {
+        lit->type = NUM;
+        lit->value = atof(lit->val);
+        if (strchr(lit->val, '.') == NULL) {
+            errno = 0;
+            lit->integer = strtoll(lit->val, NULL, 10);
+            lit->exact = errno == 0;
+        }
+    }
+}
+
+// -----------------
+// Integer inference
+// A name is integral while every assignment to it is built from integer literals, integral names and
+// + - *. Binary operators over integral operands are marked so the interpreter tries its int64 path
+// first. This only picks the order of checks: every value still carries its own exactness, since
+// integers overflow into doubles and values bound through libcam are always doubles.
+// -----------------
+
+// Mark the binary operators whose operands are integral, names being identified by their outermost slot.
+void inferIntegral(SymbolTable *table, ParseTree tree) {
+    int n = table->index ? table->index : 1;
+    bool *floating = calloc(n, sizeof(bool));
+    int *root = malloc(sizeof(int) * n);
+    for (int s = 0; s < table->index; s++) {
+        int r = s;
+        while (table->syms[r].outer != -1) r = table->syms[r].outer;
+        root[s] = r;
+        if (table->syms[s].type != NUM) floating[r] = true;
+    }
+    while (findFloating(tree, floating, root));
+    markIntegral(tree, floating, root);
+    free(floating);
+    free(root);
+}
+
+// One pass marking names assigned a non integral expression. Returns whether anything changed.
+bool findFloating(ParseTree tree, bool *floating, int *root) {
+    bool changed = false;
+    for (int j = 0; j < tree.index; j++) {
+        void *stmt = tree.stmts[j];
+        switch (((VarExpr *) stmt)->s) {
+            case IF:
+            case WHILE:
+                if (findFloating(((IfStmt *) stmt)->trueBranch, floating, root)) changed = true;
+                break;
+            case VARASSIGN: {
+                int slot = ((VarAssignStmt *) stmt)->slot;
+                if (slot == -1 || floating[root[slot]]) break;
+                if (!integralExpr(((VarAssignStmt *) stmt)->expr, floating, root)) {
+                    floating[root[slot]] = true;
+                    changed = true;
+                }
+                break;
+            }
+            case READ: {
+                int slot = ((ReadStmt *) stmt)->slot;
+                if (slot == -1 || floating[root[slot]]) break;
+                floating[root[slot]] = true;
+                changed = true;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    return changed;
+}
+
+// Set the integral flag on every binary operator in a tree.
+void markIntegral(ParseTree tree, bool *floating, int *root) {
+    for (int j = 0; j < tree.index; j++) {
+        void *stmt = tree.stmts[j];
+        switch (((VarExpr *) stmt)->s) {
+            case IF:
+            case WHILE:
+                markExpr(((IfStmt *) stmt)->cond, floating, root);
+                markIntegral(((IfStmt *) stmt)->trueBranch, floating, root);
+                break;
+            case SHOW:
+            case RETURN:
+            case INVOKE:
+                markExpr(((ShowStmt *) stmt)->expr, floating, root);
+                break;
+            case VARASSIGN:
+                markExpr(((VarAssignStmt *) stmt)->expr, floating, root);
+                break;
+            case STORE:
+                markExpr(((StoreStmt *) stmt)->index, floating, root);
+                markExpr(((StoreStmt *) stmt)->expr, floating, root);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// Whether an expression only ever produces integers from integral names.
+bool integralExpr(void *expr, bool *floating, int *root) {
+    switch (((VarExpr *) expr)->s) {
+        case LITERAL:
+            return ((LiteralExpr *) expr)->exact;
+        case VAR:
+            return ((VarExpr *) expr)->slot != -1 && !floating[root[((VarExpr *) expr)->slot]];
+        case BRACKET:
+            return integralExpr(((BracketExpr *) expr)->expr, floating, root);
+        case BINOP: {
+            BinOpExpr *bin = expr;
+            if (bin->opType != PLUS && bin->opType != MINUS && bin->opType != STAR) return false;
+            return integralExpr(bin->left, floating, root) && integralExpr(bin->right, floating, root);
+        }
+        default:
+            return false;
+    }
+}
+
+// Mark the binary operators in an expression.
+void markExpr(void *expr, bool *floating, int *root) {
+    switch (((VarExpr *) expr)->s) {
+        case BRACKET:
+            markExpr(((BracketExpr *) expr)->expr, floating, root);
+            break;
+        case UNOP:
+            markExpr(((UnOpExpr *) expr)->right, floating, root);
+            break;
+        case INDEX:
+            markExpr(((IndexExpr *) expr)->index, floating, root);
+            break;
+        case REDUCE:
+            markExpr(((ReduceExpr *) expr)->expr, floating, root);
+            break;
+        case CALL: {
+            ParseTree args = ((CallExpr *) expr)->args;
+            for (int j = 0; j < args.index; j++) markExpr(args.stmts[j], floating, root);
+            break;
+        }
+        case BINOP: {
+            BinOpExpr *bin = expr;
+            markExpr(bin->left, floating, root);
+            markExpr(bin->right, floating, root);
+            bin->integral = bin->opType != OR && bin->opType != AND &&
+                            integralExpr(bin->left, floating, root) && integralExpr(bin->right, floating, root);
+            break;
+        }
+        default:
+            break;
+    }
+}
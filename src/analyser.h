@@ -0,0 +1,60 @@
+#ifndef ANALYSER_H
+#define ANALYSER_H
+
+#include "parser.h"
+
+// -----------------
+// Public Objects
+// -----------------
+
+// A variable declared somewhere in the program, with the type of its first declaration.
+// Every distinct name and scope depth gets its own slot. Slots of the same name are chained
+// from the deepest scope outwards through outer, mirroring how lookups search the scopes.
+typedef struct Symbol {
+    int scope;
+    Token tok;
+    int outer;
+    Type type;
+} Symbol;
+
+// Trees nested deeper than this skip the optional passes that recurse over the tree: integer
+// inference, the optimiser and row mode. Parsing, resolving and running never recurse.
+#define DEPTH_LIMIT 512
+
+// All slots in the program plus a hash of names to the deepest slot with that name.
+// temps counts the temporaries the optimiser has allocated and depth is the nesting of the deepest node.
+// arrays is set when the program declares, indexes or reduces an array, which the optimiser and row
+// mode leave alone. procs lists the procedures in the order they are declared.
+typedef struct SymbolTable {
+    int size;
+    int index;
+    Symbol *syms;
+    int names;
+    int bucketCount;
+    int *buckets;
+    int *chain;
+    int temps;
+    int depth;
+    bool arrays;
+    struct Procedure *procs;
+    int procCount;
+    int procSize;
+} SymbolTable;
+
+// A procedure and the table of its frame. A procedure only sees its own names, so its slots are
+// offsets into a frame of frame.index slots, the parameters taking the first params of them.
+typedef struct Procedure {
+    ProcStmt *stmt;
+    int params;
+    SymbolTable frame;
+} Procedure;
+
+// -----------------
+// Public Functions
+// -----------------
+
+void resolve(ParseTree tree, SymbolTable *table);
+int findSymbol(SymbolTable *table, char *id, int scope);
+void freeSymbolTable(SymbolTable *table);
+
+#endif
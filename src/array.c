@@ -0,0 +1,154 @@
+// Fixed size numeric arrays for the CAM programming langauge.
+// A num[N] is a block aligned run of doubles. Whole array operators run as one SIMD kernel per
+// operator over the elements, with a NUM operand broadcast to every lane, and comparisons give 1.0
+// or 0.0 elements. The interpreter keeps the arrays and checks lengths and types before calling in.
+
+#include "array.h"
+#include "memstats.h"
+#include <stdlib.h>
+#include <string.h>
+
+// -----------------
+// Private Functions
+// -----------------
+
+int vectorCount(int length);
+
+// -----------------
+// Main Funcs
+// -----------------
+
+// Give an array room for length elements, keeping its storage when it is already big enough.
+// New storage starts zeroed, reused storage keeps whatever it held.
+void sizeArray(Array *a, int length) {
+    if (length > a->size) {
+        long block = ARRAY_ALIGN / sizeof(double);
+        free(a->data);
+        a->size = (int) ((length + block - 1) / block * block);
+        a->data = aligned_alloc(ARRAY_ALIGN, sizeof(double) * a->size);
+        memset(a->data, 0, sizeof(double) * a->size);
+        MEM_COUNT(MEM_RUNTIME, sizeof(double) * a->size);
+    }
+    a->length = length;
+}
+
+// Set every element to v.
+void fillArray(Array *a, double v) {
+    VNum s = splat(v);
+    VNum *out = (VNum *) a->data;
+    for (int k = vectorCount(a->length) - 1; k >= 0; k--) out[k] = s;
+}
+
+// Apply a binary operator element by element, writing out. An operand without storage, x or y NULL,
+// is the NUM xs or ys in every element. out may be either operand.
+void arrayKernel(TokenType op, const double *x, double xs, const double *y, double ys, double *out, int length) {
+    const VNum *l = (const VNum *) x;
+    const VNum *r = (const VNum *) y;
+    VNum *o = (VNum *) out;
+    VNum ls = splat(xs);
+    VNum rs = splat(ys);
+    int n = vectorCount(length);
+
+// One loop per operand shape, so the loops carry no test of their own.
+#define KERNEL(expr) \
+    if (l != NULL && r != NULL) { \
+        for (int k = 0; k < n; k++) { VNum a = l[k], b = r[k]; o[k] = (expr); } \
+    } else if (l != NULL) { \
+        for (int k = 0; k < n; k++) { VNum a = l[k], b = rs; o[k] = (expr); } \
+    } else { \
+        for (int k = 0; k < n; k++) { VNum a = ls, b = r[k]; o[k] = (expr); } \
+    }
+
+    switch (op) {
+        case PLUS:
+            KERNEL(a + b);
+            break;
+        case MINUS:
+            KERNEL(a - b);
+            break;
+        case STAR:
+            KERNEL(a * b);
+            break;
+        case SLASH:
+            KERNEL(a / b);
+            break;
+        case EQEQUALS:
+            KERNEL(fromMask(a == b));
+            break;
+        case BANGEQ:
+            KERNEL(fromMask(a != b));
+            break;
+        case GTHAN:
+            KERNEL(fromMask(a > b));
+            break;
+        case GTHANEQ:
+            KERNEL(fromMask(a >= b));
+            break;
+        case LTHAN:
+            KERNEL(fromMask(a < b));
+            break;
+        case LTHANEQ:
+            KERNEL(fromMask(a <= b));
+            break;
+        default:
+            break;
+    }
+#undef KERNEL
+}
+
+// Reduce the first length elements to their sum, least or greatest. Whole vectors are combined lane
+// by lane first, then the lanes and the elements past the last whole vector in order. min and max
+// skip NaN elements after the first.
+double reduceArray(Reduction kind, const double *x, int length) {
+    const VNum *v = (const VNum *) x;
+    int whole = length / LANES;
+    double acc = x[0];
+    if (kind == SUM_OF) {
+        VNum sum = splat(0);
+        for (int k = 0; k < whole; k++) sum += v[k];
+        acc = 0;
+        for (int l = 0; l < LANES; l++) acc += sum[l];
+        for (int e = whole * LANES; e < length; e++) acc += x[e];
+        return acc;
+    }
+    VNum best = splat(x[0]);
+    for (int k = 0; k < whole; k++) {
+        VMask take = kind == MIN_OF ? v[k] < best : v[k] > best;
+        best = (VNum) ((take & (VMask) v[k]) | (~take & (VMask) best));
+    }
+    for (int l = 0; l < LANES; l++) {
+        if (kind == MIN_OF ? best[l] < acc : best[l] > acc) acc = best[l];
+    }
+    for (int e = whole * LANES; e < length; e++) {
+        if (kind == MIN_OF ? x[e] < acc : x[e] > acc) acc = x[e];
+    }
+    return acc;
+}
+
+// Release an array's storage.
+void freeArray(Array *a) {
+    free(a->data);
+    a->data = NULL;
+    a->length = a->size = 0;
+}
+
+// -----------------
+// Helpers
+// -----------------
+
+// Whole vectors covering length elements, all inside the padded storage.
+int vectorCount(int length) {
+    return (length + LANES - 1) / LANES;
+}
+
+// Broadcast a value to every lane.
+VNum splat(double v) {
+    VNum r;
+    for (int l = 0; l < LANES; l++) r[l] = v;
+    return r;
+}
+
+// Turn an all-ones/all-zeros lane mask into 1.0/0.0.
+VNum fromMask(VMask m) {
+    return (VNum) (m & (VMask) splat(1.0));
+}
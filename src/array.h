@@ -0,0 +1,47 @@
+#ifndef ARRAY_H
+#define ARRAY_H
+
+#include "parser.h"
+
+// -----------------
+// Public Objects
+// -----------------
+
+// One machine vector of doubles and the matching lane mask, as wide as the target allows:
+// 8 lanes with AVX-512, 4 with AVX/AVX2 and 2 with the SSE2 baseline.
+#if defined(__AVX512F__)
+#define LANES 8
+#elif defined(__AVX__)
+#define LANES 4
+#else
+#define LANES 2
+#endif
+
+typedef double VNum __attribute__((vector_size(LANES * 8)));
+typedef long long VMask __attribute__((vector_size(LANES * 8)));
+
+// Storage is allocated in whole blocks of this many bytes, aligned to a block.
+#define ARRAY_ALIGN 64
+
+// The elements of a num[N]. data holds size doubles, length rounded up to whole blocks, so the
+// element-wise kernels run over whole vectors and never need a scalar tail. The padding is zeroed
+// when allocated and holds junk after that.
+typedef struct Array {
+    double *data;
+    int length;
+    int size;
+} Array;
+
+// -----------------
+// Public Functions
+// -----------------
+
+void sizeArray(Array *a, int length);
+void fillArray(Array *a, double v);
+void arrayKernel(TokenType op, const double *x, double xs, const double *y, double ys, double *out, int length);
+double reduceArray(Reduction kind, const double *x, int length);
+void freeArray(Array *a);
+VNum splat(double v);
+VNum fromMask(VMask m);
+
+#endif
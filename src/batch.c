@@ -0,0 +1,235 @@
+// Parallel batch runner for the CAM programming langauge.
+// Runs every script in a directory (or listed in a file, one path per line) on a
+// work-stealing pool of threads. Each script writes into its own Output buffer and the
+// buffers are emitted to stdout strictly in job order, so the output is the same for any
+// thread count. A throughput report is written to stderr.
+
+#include "batch.h"
+#include "interpreter.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// A single script to run.
+typedef struct Job {
+    char *path;
+    Output out;
+    bool done;
+} Job;
+
+// Per-worker queue of job indices. The owner takes from the bottom, thieves from the top.
+typedef struct Deque {
+    pthread_mutex_t lock;
+    int *jobs;
+    int top;
+    int bottom;
+} Deque;
+
+typedef struct Pool {
+    Job *jobs;
+    int jobCount;
+    Deque *deques;
+    int threads;
+    pthread_mutex_t doneLock;
+    pthread_cond_t doneCond;
+    Limits limits;
+} Pool;
+
+typedef struct Worker {
+    Pool *pool;
+    int id;
+} Worker;
+
+// -----------------
+// Private Functions
+// -----------------
+
+Job *collectJobs(char *source, int *count);
+void addJob(Job **jobs, int *count, int *size, char *path);
+int compareJobs(const void *a, const void *b);
+void *worker(void *arg);
+int takeJob(Pool *pool, int id);
+double now(void);
+
+// -----------------
+// Main Funcs
+// -----------------
+
+// Run all scripts named by source using the given number of threads (0 means one per core),
+// each under the given limits. Returns false if no scripts could be found.
+bool runBatch(char *source, int threads, Limits *limits) {
+    int count;
+    Job *jobs = collectJobs(source, &count);
+    if (jobs == NULL) {
+        fprintf(stderr, "Error: Could not read batch '%s'.\n", source);
+        return false;
+    }
+    if (threads <= 0) threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0) threads = 1;
+    if (threads > count && count > 0) threads = count;
+
+    Pool pool = {jobs, count, malloc(sizeof(Deque) * threads), threads};
+    pthread_mutex_init(&pool.doneLock, NULL);
+    pthread_cond_init(&pool.doneCond, NULL);
+    pool.limits = *limits;
+
+    // Deal out contiguous blocks so neighbouring scripts start on the same worker.
+    for (int t = 0; t < threads; t++) {
+        Deque *d = &pool.deques[t];
+        pthread_mutex_init(&d->lock, NULL);
+        int from = (int) ((long) count * t / threads);
+        int to = (int) ((long) count * (t + 1) / threads);
+        d->jobs = malloc(sizeof(int) * (to - from + 1));
+        d->top = 0;
+        d->bottom = to - from;
+        for (int j = from; j < to; j++) d->jobs[j - from] = to - 1 - (j - from);
+    }
+
+    double start = now();
+    pthread_t *ids = malloc(sizeof(pthread_t) * threads);
+    Worker *workers = malloc(sizeof(Worker) * threads);
+    for (int t = 0; t < threads; t++) {
+        workers[t] = (Worker) {&pool, t};
+        pthread_create(&ids[t], NULL, worker, &workers[t]);
+    }
+
+    // Emit outputs in job order as soon as each one is finished.
+    for (int j = 0; j < count; j++) {
+        pthread_mutex_lock(&pool.doneLock);
+        while (!jobs[j].done) pthread_cond_wait(&pool.doneCond, &pool.doneLock);
+        pthread_mutex_unlock(&pool.doneLock);
+        fwrite(jobs[j].out.data, 1, jobs[j].out.used, stdout);
+        freeOutput(&jobs[j].out);
+        free(jobs[j].path);
+    }
+    fflush(stdout);
+
+    for (int t = 0; t < threads; t++) {
+        pthread_join(ids[t], NULL);
+        pthread_mutex_destroy(&pool.deques[t].lock);
+        free(pool.deques[t].jobs);
+    }
+    double elapsed = now() - start;
+    fprintf(stderr, "Batch: %d scripts, %d threads, %.3f s, %.1f scripts/sec\n",
+            count, threads, elapsed, elapsed > 0 ? count / elapsed : 0.0);
+
+    pthread_mutex_destroy(&pool.doneLock);
+    pthread_cond_destroy(&pool.doneCond);
+    free(ids);
+    free(workers);
+    free(pool.deques);
+    free(jobs);
+    return true;
+}
+
+// Worker thread: run jobs from its own queue, then steal from the others until none remain.
+void *worker(void *arg) {
+    Worker *w = arg;
+    Pool *pool = w->pool;
+    int j;
+    while ((j = takeJob(pool, w->id)) != -1) {
+        Job *job = &pool->jobs[j];
+        initOutput(&job->out, NULL);
+        RunOptions opts = {.cacheDir = NULL, .lexThreads = 1, .noOpt = false, .stats = false, .limits = pool->limits,
+                           .perfCounters = false, .input = NULL, .format = SHOW_TEXT, .tagLines = false, .trace = NULL,
+                           .threads = 1, .tierAfter = 0, .checkpoint = NULL, .checkpointEvery = 0, .resume = NULL};
+        execute(job->path, &opts, &job->out);
+
+        pthread_mutex_lock(&pool->doneLock);
+        job->done = true;
+        pthread_cond_broadcast(&pool->doneCond);
+        pthread_mutex_unlock(&pool->doneLock);
+    }
+    return NULL;
+}
+
+// Take the next job for worker id, stealing the oldest job of another worker when its own queue is empty.
+// Jobs never create jobs, so once every queue is empty the worker can stop.
+int takeJob(Pool *pool, int id) {
+    Deque *own = &pool->deques[id];
+    int j = -1;
+    pthread_mutex_lock(&own->lock);
+    if (own->bottom > own->top) j = own->jobs[--own->bottom];
+    pthread_mutex_unlock(&own->lock);
+    for (int k = 1; j == -1 && k < pool->threads; k++) {
+        Deque *victim = &pool->deques[(id + k) % pool->threads];
+        pthread_mutex_lock(&victim->lock);
+        if (victim->bottom > victim->top) j = victim->jobs[victim->top++];
+        pthread_mutex_unlock(&victim->lock);
+    }
+    return j;
+}
+
+// -----------------
+// Helpers
+// -----------------
+
+// Build the job list from a directory of .cam files (sorted by name) or a list file.
+Job *collectJobs(char *source, int *count) {
+    int size = 64;
+    Job *jobs = malloc(sizeof(Job) * size);
+    *count = 0;
+
+    struct stat st;
+    if (stat(source, &st) != 0) {
+        free(jobs);
+        return NULL;
+    }
+    char path[4096];
+    if (S_ISDIR(st.st_mode)) {
+        DIR *dir = opendir(source);
+        if (dir == NULL) {
+            free(jobs);
+            return NULL;
+        }
+        struct dirent *e;
+        while ((e = readdir(dir)) != NULL) {
+            long n = strlen(e->d_name);
+            if (n < 5 || strcmp(e->d_name + n - 4, ".cam")) continue;
+            snprintf(path, sizeof(path), "%s/%s", source, e->d_name);
+            addJob(&jobs, count, &size, path);
+        }
+        closedir(dir);
+        qsort(jobs, *count, sizeof(Job), compareJobs);
+    } else {
+        FILE *f = fopen(source, "r");
+        if (f == NULL) {
+            free(jobs);
+            return NULL;
+        }
+        while (fgets(path, sizeof(path), f) != NULL) {
+            path[strcspn(path, "\r\n")] = '\0';
+            if (path[0] != '\0') addJob(&jobs, count, &size, path);
+        }
+        fclose(f);
+    }
+    return jobs;
+}
+
+// Append a job for path.
+void addJob(Job **jobs, int *count, int *size, char *path) {
+    if (*count == *size) {
+        *size *= 2;
+        *jobs = realloc(*jobs, sizeof(Job) * *size);
+    }
+    Job job = {malloc(strlen(path) + 1), {NULL, 0, 0, 0, NULL}, false};
+    strcpy(job.path, path);
+    (*jobs)[(*count)++] = job;
+}
+
+// Order jobs by path.
+int compareJobs(const void *a, const void *b) {
+    return strcmp(((Job *) a)->path, ((Job *) b)->path);
+}
+
+// Monotonic time in seconds.
+double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
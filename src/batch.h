@@ -0,0 +1,13 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "interpreter.h"
+#include <stdbool.h>
+
+// -----------------
+// Public Functions
+// -----------------
+
+bool runBatch(char *source, int threads, Limits *limits);
+
+#endif
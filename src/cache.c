@@ -0,0 +1,383 @@
+// Compiled program cache for the CAM programming langauge.
+// A parsed ParseTree is stored as a relocatable image. Nodes are copied verbatim with their
+// pointers replaced by image offsets, and a relocation table records where those offsets live.
+// Loading maps the image privately and patches the offsets back into pointers in place,
+// so the interpreter runs straight out of the mapping without lexing or parsing. An image is only
+// trusted when its checksum holds, its source matches byte for byte and every relocation stays
+// inside the nodes; anything else is compiled afresh.
+
+#include "cache.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CACHE_MAGIC 0x43414d43
+
+// A node still to be copied and the image offset of the pointer that should point at its copy.
+typedef struct CopyItem {
+    void *node;
+    long slot;
+} CopyItem;
+
+// Image under construction. Nodes are copied from an explicit stack so deep trees do not recurse.
+typedef struct Image {
+    char *data;
+    long size;
+    long used;
+    long long *relocs;
+    long relocSize;
+    long relocCount;
+    CopyItem *pending;
+    long pendingSize;
+    long pendingCount;
+} Image;
+
+// -----------------
+// Private Functions
+// -----------------
+
+unsigned long long hashBytes(unsigned long long h, const char *bytes, long len);
+unsigned long long layoutKey(void);
+void cachePath(char *out, long outLen, const char *dir, unsigned long long key);
+long reserve(Image *img, long bytes);
+void setPointer(Image *img, long at, long target);
+void queueCopy(Image *img, void *node, long slot);
+long writeNode(Image *img, void *stmt);
+void writeTree(Image *img, ParseTree t, long at);
+bool checkImage(const char *base, long size, const char *src, long len);
+bool inImage(CacheImage *image, void *p);
+void freeOutside(void *node, int scope, int depth, void *data);
+
+// -----------------
+// Main Funcs
+// -----------------
+
+// Hash the interpreter version and the source bytes into a cache key.
+unsigned long long sourceKey(const char *src, long len) {
+    unsigned long long h = 14695981039346656037ULL;
+    h = hashBytes(h, CAM_VERSION, strlen(CAM_VERSION));
+    return hashBytes(h, src, len);
+}
+
+// Try to load a cached image for the given source.
+// On success the relocated tree is written to tree, its mapping to image, and true is returned.
+bool loadCache(const char *dir, const char *src, long len, ParseTree *tree, CacheImage *image) {
+    unsigned long long key = sourceKey(src, len);
+    char path[4096];
+    cachePath(path, sizeof(path), dir, key);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(CacheHeader)) {
+        close(fd);
+        return false;
+    }
+    char *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return false;
+
+    CacheHeader *h = (CacheHeader *) base;
+    if (h->key != key || !checkImage(base, st.st_size, src, len)) {
+        munmap(base, st.st_size);
+        return false;
+    }
+
+    // Patch every stored offset into a pointer.
+    long long *relocs = (long long *) (base + h->relocs);
+    for (long long j = 0; j < h->relocCount; j++) {
+        uintptr_t *slot = (uintptr_t *) (base + relocs[j]);
+        *slot += (uintptr_t) base;
+    }
+    *tree = *(ParseTree *) (base + h->root);
+    *image = (CacheImage) {base, st.st_size};
+    return true;
+}
+
+// Free the nodes the optimiser added to a tree loaded from an image, then unmap the image. The tree
+// must not be used afterwards.
+void unloadCache(CacheImage *image, ParseTree tree) {
+    walkTree(tree, freeOutside, image);
+    if (!inImage(image, tree.stmts)) free(tree.stmts);
+    munmap(image->base, image->size);
+}
+
+// Write the image for a parsed tree into the cache directory.
+// The file is written under a temporary name and renamed so readers never see a partial image.
+bool storeCache(const char *dir, const char *src, long len, ParseTree tree) {
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) return false;
+
+    Image img = {NULL, 0, 0, NULL, 0, 0, NULL, 0, 0};
+    long header = reserve(&img, sizeof(CacheHeader));
+    long root = reserve(&img, sizeof(ParseTree));
+    memcpy(img.data + root, &tree, sizeof(ParseTree));
+    writeTree(&img, tree, root);
+    while (img.pendingCount) {
+        CopyItem item = img.pending[--img.pendingCount];
+        setPointer(&img, item.slot, writeNode(&img, item.node));
+    }
+    free(img.pending);
+    long relocs = reserve(&img, sizeof(long long) * img.relocCount);
+    if (img.relocCount) memcpy(img.data + relocs, img.relocs, sizeof(long long) * img.relocCount);
+    long source = reserve(&img, len);
+    memcpy(img.data + source, src, len);
+
+    CacheHeader h = {CACHE_MAGIC, CACHE_FORMAT, sourceKey(src, len), layoutKey(), len, img.used, root, relocs,
+                     img.relocCount, source, hashBytes(14695981039346656037ULL, img.data + sizeof(CacheHeader),
+                                                       img.used - (long) sizeof(CacheHeader))};
+    memcpy(img.data + header, &h, sizeof(CacheHeader));
+
+    char path[4096];
+    char tmp[4200];
+    cachePath(path, sizeof(path), dir, h.key);
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int) getpid());
+    FILE *f = fopen(tmp, "wb");
+    bool ok = f != NULL && fwrite(img.data, 1, img.used, f) == (size_t) img.used;
+    if (f != NULL && fclose(f) != 0) ok = false;
+    if (ok) ok = rename(tmp, path) == 0;
+    if (!ok) remove(tmp);
+
+    free(img.data);
+    free(img.relocs);
+    return ok;
+}
+
+// Whether a mapped image of size bytes is whole and was built from the len bytes of src. Every
+// relocation must sit inside the nodes, pointer aligned, and hold the offset of a place in them.
+bool checkImage(const char *base, long size, const char *src, long len) {
+    CacheHeader *h = (CacheHeader *) base;
+    long long nodes = sizeof(CacheHeader);
+    if (h->magic != CACHE_MAGIC || h->format != CACHE_FORMAT || h->layout != layoutKey() ||
+        h->srcLength != len || h->imageSize != size || h->relocCount < 0 || h->relocs < nodes ||
+        h->relocs % 8 != 0 || h->relocCount > (size - h->relocs) / (long long) sizeof(long long) ||
+        h->root < nodes || h->root % 8 != 0 || h->root + (long long) sizeof(ParseTree) > h->relocs ||
+        h->source < h->relocs + h->relocCount * (long long) sizeof(long long) || h->source > size - len) {
+        return false;
+    }
+    if (hashBytes(14695981039346656037ULL, base + nodes, size - nodes) != h->checksum) return false;
+    if (memcmp(base + h->source, src, len)) return false;
+    long long *relocs = (long long *) (base + h->relocs);
+    for (long long j = 0; j < h->relocCount; j++) {
+        long long at = relocs[j];
+        if (at < nodes || at % 8 != 0 || at + (long long) sizeof(uintptr_t) > h->relocs) return false;
+        uintptr_t target;
+        memcpy(&target, base + at, sizeof(target));
+        if (target < (uintptr_t) nodes || target >= (uintptr_t) h->relocs) return false;
+    }
+    return true;
+}
+
+// -----------------
+// Image building
+// -----------------
+
+// Reserve zeroed, pointer aligned space in the image and return its offset.
+long reserve(Image *img, long bytes) {
+    long at = (img->used + 7) & ~7L;
+    if (img->size < at + bytes) {
+        img->size = img->size ? img->size : 4096;
+        while (img->size < at + bytes) img->size *= 2;
+        img->data = realloc(img->data, img->size);
+    }
+    memset(img->data + img->used, 0, at + bytes - img->used);
+    img->used = at + bytes;
+    return at;
+}
+
+// Store the offset of target in the pointer at 'at' and record it for relocation.
+void setPointer(Image *img, long at, long target) {
+    uintptr_t value = (uintptr_t) target;
+    memcpy(img->data + at, &value, sizeof(value));
+    if (img->relocCount == img->relocSize) {
+        img->relocSize = img->relocSize ? img->relocSize * 2 : 256;
+        img->relocs = realloc(img->relocs, sizeof(long long) * img->relocSize);
+    }
+    img->relocs[img->relocCount++] = at;
+}
+
+// Queue a node to be copied, its offset to be stored in the pointer at 'slot'.
+void queueCopy(Image *img, void *node, long slot) {
+    if (img->pendingCount == img->pendingSize) {
+        img->pendingSize = img->pendingSize ? img->pendingSize * 2 : 256;
+        img->pending = realloc(img->pending, sizeof(CopyItem) * img->pendingSize);
+    }
+    img->pending[img->pendingCount++] = (CopyItem) {node, slot};
+}
+
+// Copy a statement or expression node into the image, returning its offset.
+// Its children are queued rather than copied here.
+long writeNode(Image *img, void *stmt) {
+    Stmt s = ((VarExpr *) stmt)->s;
+    long at;
+    switch (s) {
+        case IF:
+        case WHILE: {
+            at = reserve(img, sizeof(IfStmt));
+            memcpy(img->data + at, stmt, sizeof(IfStmt));
+            queueCopy(img, ((IfStmt *) stmt)->cond, at + offsetof(IfStmt, cond));
+            writeTree(img, ((IfStmt *) stmt)->trueBranch, at + offsetof(IfStmt, trueBranch));
+            break;
+        }
+        case PROC: {
+            at = reserve(img, sizeof(ProcStmt));
+            memcpy(img->data + at, stmt, sizeof(ProcStmt));
+            writeTree(img, ((ProcStmt *) stmt)->params, at + offsetof(ProcStmt, params));
+            writeTree(img, ((ProcStmt *) stmt)->body, at + offsetof(ProcStmt, body));
+            break;
+        }
+        case CALL: {
+            at = reserve(img, sizeof(CallExpr));
+            memcpy(img->data + at, stmt, sizeof(CallExpr));
+            writeTree(img, ((CallExpr *) stmt)->args, at + offsetof(CallExpr, args));
+            break;
+        }
+        case SHOW:
+        case RETURN:
+        case INVOKE: {
+            at = reserve(img, sizeof(ShowStmt));
+            memcpy(img->data + at, stmt, sizeof(ShowStmt));
+            queueCopy(img, ((ShowStmt *) stmt)->expr, at + offsetof(ShowStmt, expr));
+            break;
+        }
+        case VARASSIGN: {
+            at = reserve(img, sizeof(VarAssignStmt));
+            memcpy(img->data + at, stmt, sizeof(VarAssignStmt));
+            queueCopy(img, ((VarAssignStmt *) stmt)->expr, at + offsetof(VarAssignStmt, expr));
+            break;
+        }
+        case STORE: {
+            at = reserve(img, sizeof(StoreStmt));
+            memcpy(img->data + at, stmt, sizeof(StoreStmt));
+            queueCopy(img, ((StoreStmt *) stmt)->expr, at + offsetof(StoreStmt, expr));
+            queueCopy(img, ((StoreStmt *) stmt)->index, at + offsetof(StoreStmt, index));
+            break;
+        }
+        case INDEX: {
+            at = reserve(img, sizeof(IndexExpr));
+            memcpy(img->data + at, stmt, sizeof(IndexExpr));
+            queueCopy(img, ((IndexExpr *) stmt)->index, at + offsetof(IndexExpr, index));
+            break;
+        }
+        case REDUCE: {
+            at = reserve(img, sizeof(ReduceExpr));
+            memcpy(img->data + at, stmt, sizeof(ReduceExpr));
+            queueCopy(img, ((ReduceExpr *) stmt)->expr, at + offsetof(ReduceExpr, expr));
+            break;
+        }
+        case BRACKET: {
+            at = reserve(img, sizeof(BracketExpr));
+            memcpy(img->data + at, stmt, sizeof(BracketExpr));
+            queueCopy(img, ((BracketExpr *) stmt)->expr, at + offsetof(BracketExpr, expr));
+            break;
+        }
+        case BINOP: {
+            at = reserve(img, sizeof(BinOpExpr));
+            memcpy(img->data + at, stmt, sizeof(BinOpExpr));
+            queueCopy(img, ((BinOpExpr *) stmt)->left, at + offsetof(BinOpExpr, left));
+            queueCopy(img, ((BinOpExpr *) stmt)->right, at + offsetof(BinOpExpr, right));
+            break;
+        }
+        case UNOP: {
+            at = reserve(img, sizeof(UnOpExpr));
+            memcpy(img->data + at, stmt, sizeof(UnOpExpr));
+            queueCopy(img, ((UnOpExpr *) stmt)->right, at + offsetof(UnOpExpr, right));
+            break;
+        }
+        case VARDEC: {
+            at = reserve(img, sizeof(VarDecStmt));
+            memcpy(img->data + at, stmt, sizeof(VarDecStmt));
+            break;
+        }
+        case READ: {
+            at = reserve(img, sizeof(ReadStmt));
+            memcpy(img->data + at, stmt, sizeof(ReadStmt));
+            break;
+        }
+        case ATEND: {
+            at = reserve(img, sizeof(AtEndExpr));
+            memcpy(img->data + at, stmt, sizeof(AtEndExpr));
+            break;
+        }
+        case LITERAL: {
+            at = reserve(img, sizeof(LiteralExpr));
+            memcpy(img->data + at, stmt, sizeof(LiteralExpr));
+            break;
+        }
+        default: {
+            at = reserve(img, sizeof(VarExpr));
+            memcpy(img->data + at, stmt, sizeof(VarExpr));
+            break;
+        }
+    }
+    return at;
+}
+
+// Copy the statement list of a tree whose ParseTree struct lives at 'at' in the image, queueing the statements.
+void writeTree(Image *img, ParseTree t, long at) {
+    if (t.index == 0) {
+        memset(img->data + at + offsetof(ParseTree, stmts), 0, sizeof(void *));
+        return;
+    }
+    long stmts = reserve(img, sizeof(void *) * t.index);
+    for (int j = 0; j < t.index; j++) {
+        queueCopy(img, t.stmts[j], stmts + j * sizeof(void *));
+    }
+    ((ParseTree *) (img->data + at))->size = t.index;
+    setPointer(img, at + offsetof(ParseTree, stmts), stmts);
+}
+
+// -----------------
+// Helpers
+// -----------------
+
+// FNV-1a over a byte range.
+unsigned long long hashBytes(unsigned long long h, const char *bytes, long len) {
+    for (long j = 0; j < len; j++) {
+        h ^= (unsigned char) bytes[j];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Fingerprint of the node layouts so images from a differently built interpreter are rejected.
+unsigned long long layoutKey(void) {
+    long sizes[] = {sizeof(void *), sizeof(ParseTree), sizeof(IfStmt), sizeof(WhileStmt),
+                    sizeof(ShowStmt), sizeof(VarDecStmt), sizeof(VarAssignStmt), sizeof(BinOpExpr),
+                    sizeof(UnOpExpr), sizeof(BracketExpr), sizeof(LiteralExpr), sizeof(VarExpr),
+                    sizeof(StoreStmt), sizeof(IndexExpr), sizeof(ReduceExpr), sizeof(ProcStmt),
+                    sizeof(ReturnStmt), sizeof(InvokeStmt), sizeof(CallExpr), sizeof(ReadStmt),
+                    sizeof(AtEndExpr)};
+    return hashBytes(14695981039346656037ULL, (const char *) sizes, sizeof(sizes));
+}
+
+// Build the path of the image for a key.
+void cachePath(char *out, long outLen, const char *dir, unsigned long long key) {
+    snprintf(out, outLen, "%s/%016llx.camc", dir, key);
+}
+
+// Whether a pointer lies inside a loaded image.
+bool inImage(CacheImage *image, void *p) {
+    return (char *) p >= image->base && (char *) p < image->base + image->size;
+}
+
+// Visitor freeing a node of a loaded tree, or the statement arrays it holds, that lie outside the image.
+void freeOutside(void *node, int scope, int depth, void *data) {
+    CacheImage *image = data;
+    Stmt s = ((VarExpr *) node)->s;
+    if ((s == IF || s == WHILE) && !inImage(image, ((IfStmt *) node)->trueBranch.stmts)) {
+        free(((IfStmt *) node)->trueBranch.stmts);
+    }
+    if (s == PROC) {
+        if (!inImage(image, ((ProcStmt *) node)->params.stmts)) free(((ProcStmt *) node)->params.stmts);
+        if (!inImage(image, ((ProcStmt *) node)->body.stmts)) free(((ProcStmt *) node)->body.stmts);
+    }
+    if (s == CALL && !inImage(image, ((CallExpr *) node)->args.stmts)) free(((CallExpr *) node)->args.stmts);
+    if (!inImage(image, node)) free(node);
+}
@@ -0,0 +1,49 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include "parser.h"
+
+// -----------------
+// Public Objects
+// -----------------
+
+// Interpreter version, part of every cache key so a new build never runs an old image.
+#define CAM_VERSION "1.1"
+
+// Bump whenever the image layout changes.
+#define CACHE_FORMAT 6
+
+// Header found at the start of every cached image.
+// All offsets are relative to the start of the image. The nodes lie between the header and the
+// relocations, and a copy of the source follows them. checksum is FNV-1a over everything after the header.
+typedef struct CacheHeader {
+    unsigned int magic;
+    unsigned int format;
+    unsigned long long key;
+    unsigned long long layout;
+    long long srcLength;
+    long long imageSize;
+    long long root;
+    long long relocs;
+    long long relocCount;
+    long long source;
+    unsigned long long checksum;
+} CacheHeader;
+
+// The mapping a loaded tree lives in, released with unloadCache once the tree is no longer used.
+typedef struct CacheImage {
+    char *base;
+    long size;
+} CacheImage;
+
+// -----------------
+// Public Functions
+// -----------------
+
+unsigned long long sourceKey(const char *src, long len);
+bool loadCache(const char *dir, const char *src, long len, ParseTree *tree, CacheImage *image);
+void unloadCache(CacheImage *image, ParseTree tree);
+bool storeCache(const char *dir, const char *src, long len, ParseTree tree);
+
+#endif
@@ -0,0 +1,283 @@
+// Embeddable library API for the CAM programming langauge.
+
+#include "cam.h"
+#include "interpreter.h"
+#include "vector.h"
+#include "optimiser.h"
+#include "memstats.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A compiled program: the resolved tree, its compact form, its symbol table and whether rows can be
+// vectorised. Row mode walks its own unoptimised copy of the tree, resolved into rowTable.
+struct CamProgram {
+    ParseTree tree;
+    CompactTree code;
+    SymbolTable table;
+    bool vectorise;
+    ParseTree rows;
+    SymbolTable rowTable;
+};
+
+// Execution state for one program. inputs holds the slots every run starts from and input what
+// read statements take.
+struct CamContext {
+    CamProgram *prog;
+    Slot *inputs;
+    Output out;
+    Interpreter i;
+    Input input;
+};
+
+// -----------------
+// Private Functions
+// -----------------
+
+Slot *inputSlot(CamContext *ctx, const char *name, Type type);
+Slot *resultSlot(CamContext *ctx, const char *name);
+int topSlot(CamContext *ctx, const char *name);
+long runScalarRows(CamContext *ctx, long from, long to, int inCount, const int *inSlots, const double **inputs,
+                   int outCount, const int *outSlots, double **outputs);
+
+// -----------------
+// Programs
+// -----------------
+
+CamProgram *camCompile(const char *src, long len, char *err, long errLen) {
+    Output out;
+    initOutput(&out, NULL);
+    Lexer l;
+    initLexer(&l, src, len, &out);
+    tokenize(&l);
+    Parser p;
+    initParser(&p, &l);
+    parse(&p);
+
+    if (p.err) {
+        if (err != NULL && errLen > 0) {
+            long n = out.used < errLen - 1 ? out.used : errLen - 1;
+            memcpy(err, out.data, n);
+            err[n] = '\0';
+        }
+        freeOutput(&out);
+        free(l.tokens);
+        freeTree(p.tree);
+        return NULL;
+    }
+
+    CamProgram *prog = malloc(sizeof(CamProgram));
+    prog->tree = p.tree;
+    resolve(prog->tree, &prog->table);
+    prog->vectorise = canVectorise(prog->tree, &prog->table);
+
+    // Row mode walks the plain tree, so a program it can take is parsed again for it before the
+    // interpreter's copy is optimised.
+    if (prog->vectorise) {
+        Parser rows;
+        initParser(&rows, &l);
+        parse(&rows);
+        prog->rows = rows.tree;
+        resolve(prog->rows, &prog->rowTable);
+    }
+    free(l.tokens);
+    freeOutput(&out);
+
+    OptStats stats = {0};
+    optimise(prog->tree, &prog->table, &stats);
+    prog->code = compactTree(prog->tree);
+    return prog;
+}
+
+int camVariables(CamProgram *prog, const char **names, bool *isBool, int max) {
+    int n = 0;
+    for (int s = 0; s < prog->table.index; s++) {
+        if (prog->table.syms[s].scope != 0) continue;
+        if (n < max) {
+            names[n] = prog->table.syms[s].tok.lexeme;
+            isBool[n] = prog->table.syms[s].type == BOOL;
+        }
+        n++;
+    }
+    return n;
+}
+
+void camFreeProgram(CamProgram *prog) {
+    if (prog == NULL) return;
+    freeTree(prog->tree);
+    freeCompact(&prog->code);
+    freeSymbolTable(&prog->table);
+    if (prog->vectorise) {
+        freeTree(prog->rows);
+        freeSymbolTable(&prog->rowTable);
+    }
+    free(prog);
+}
+
+// -----------------
+// Contexts
+// -----------------
+
+CamContext *camNewContext(CamProgram *prog) {
+    CamContext *ctx = malloc(sizeof(CamContext));
+    ctx->prog = prog;
+    ctx->inputs = calloc(prog->table.index ? prog->table.index : 1, sizeof(Slot));
+    initOutput(&ctx->out, NULL);
+    ctx->out.data[0] = '\0';
+    initInterpreter(&ctx->i, &prog->code, &prog->table, &ctx->out);
+    return ctx;
+}
+
+void camFreeContext(CamContext *ctx) {
+    if (ctx == NULL) return;
+    freeInterpreter(&ctx->i);
+    freeOutput(&ctx->out);
+    free(ctx->inputs);
+    free(ctx);
+}
+
+bool camBindNum(CamContext *ctx, const char *name, double value) {
+    Slot *s = inputSlot(ctx, name, NUM);
+    if (s == NULL) return false;
+    *s = (Slot) {true, NUM, numLit(value)};
+    return true;
+}
+
+bool camBindBool(CamContext *ctx, const char *name, bool value) {
+    Slot *s = inputSlot(ctx, name, BOOL);
+    if (s == NULL) return false;
+    *s = (Slot) {true, BOOL, BOOL_LIT(value)};
+    return true;
+}
+
+void camSetInput(CamContext *ctx, const char *data, long len) {
+    memoryInput(&ctx->input, data, len);
+    ctx->i.in = &ctx->input;
+}
+
+void camSetLimits(CamContext *ctx, long statements, long iterations, double seconds, long outputBytes) {
+    ctx->i.limits = (Limits) {statements, iterations, seconds, outputBytes};
+}
+
+void camMemStats(CamMemStats *stats) {
+    _Static_assert(sizeof(CamMemStats) == sizeof(MemCounters), "CamMemStats mirrors MemCounters");
+    MemCounters c;
+    readMemStats(&c);
+    memcpy(stats, &c, sizeof(c));
+}
+
+bool camRun(CamContext *ctx) {
+    memcpy(ctx->i.env.slots, ctx->inputs, sizeof(Slot) * ctx->i.env.size);
+    ctx->out.used = 0;
+    ctx->i.err = false;
+    interpret(&ctx->i);
+    ctx->out.data[ctx->out.used] = '\0';
+    return !ctx->i.err;
+}
+
+bool camGetNum(CamContext *ctx, const char *name, double *value) {
+    Slot *s = resultSlot(ctx, name);
+    if (s == NULL || s->type != NUM) return false;
+    *value = numValue(&ctx->i, s->value);
+    return true;
+}
+
+bool camGetBool(CamContext *ctx, const char *name, bool *value) {
+    Slot *s = resultSlot(ctx, name);
+    if (s == NULL || s->type != BOOL) return false;
+    *value = s->value == LIT_TRUE;
+    return true;
+}
+
+const char *camOutput(CamContext *ctx, long *len) {
+    if (len != NULL) *len = ctx->out.used;
+    return ctx->out.data;
+}
+
+long camRunRows(CamContext *ctx, long rows, int inputCount, const char **inputNames,
+                const double **inputs, int outputCount, const char **outputNames, double **outputs) {
+    int *inSlots = malloc(sizeof(int) * (inputCount + outputCount + 1));
+    int *outSlots = inSlots + inputCount;
+    for (int k = 0; k < inputCount; k++) {
+        inSlots[k] = topSlot(ctx, inputNames[k]);
+        if (inSlots[k] == -1) {
+            free(inSlots);
+            return -1;
+        }
+    }
+    for (int k = 0; k < outputCount; k++) outSlots[k] = topSlot(ctx, outputNames[k]);
+
+    // Row mode has no limits, so a limited context runs every row through the interpreter.
+    Limits *l = &ctx->i.limits;
+    bool vectorise = ctx->prog->vectorise && !l->statements && !l->iterations && !l->seconds && !l->output;
+    long failed = 0;
+    const double **inCols = malloc(sizeof(double *) * (inputCount + 1));
+    double **outCols = malloc(sizeof(double *) * (outputCount + 1));
+    for (long from = 0; from < rows; from += VECTOR_BLOCK) {
+        long n = rows - from < VECTOR_BLOCK ? rows - from : VECTOR_BLOCK;
+        bool done = false;
+        if (vectorise) {
+            for (int k = 0; k < inputCount; k++) inCols[k] = inputs[k] + from;
+            for (int k = 0; k < outputCount; k++) outCols[k] = outputs[k] + from;
+            done = runVectorBlock(ctx->prog->rows, &ctx->prog->rowTable, ctx->inputs, n,
+                                  inputCount, inSlots, inCols, outputCount, outSlots, outCols);
+        }
+        if (!done) {
+            failed += runScalarRows(ctx, from, from + n, inputCount, inSlots, inputs, outputCount, outSlots, outputs);
+        }
+    }
+    free(inCols);
+    free(outCols);
+    free(inSlots);
+    return failed;
+}
+
+// -----------------
+// Helpers
+// -----------------
+
+// Run rows [from, to) one at a time through the tree walking interpreter.
+long runScalarRows(CamContext *ctx, long from, long to, int inCount, const int *inSlots, const double **inputs,
+                   int outCount, const int *outSlots, double **outputs) {
+    long failed = 0;
+    Slot *slots = ctx->i.env.slots;
+    for (long r = from; r < to; r++) {
+        memcpy(slots, ctx->inputs, sizeof(Slot) * ctx->i.env.size);
+        for (int k = 0; k < inCount; k++) {
+            Type type = ctx->prog->table.syms[inSlots[k]].type;
+            double v = type == BOOL ? inputs[k][r] != 0 : inputs[k][r];
+            slots[inSlots[k]] = (Slot) {true, type, type == BOOL ? BOOL_LIT(v) : numLit(v)};
+        }
+        ctx->out.used = 0;
+        ctx->i.err = false;
+        interpret(&ctx->i);
+        if (ctx->i.err) failed++;
+        for (int k = 0; k < outCount; k++) {
+            int s = outSlots[k];
+            bool ok = !ctx->i.err && s != -1 && slots[s].declared;
+            outputs[k][r] = ok ? numValue(&ctx->i, slots[s].value) : NAN;
+        }
+    }
+    ctx->out.used = 0;
+    ctx->out.data[0] = '\0';
+    return failed;
+}
+
+// Slot of a top level variable, or -1.
+int topSlot(CamContext *ctx, const char *name) {
+    if (strlen(name) >= sizeof(((Token *) 0)->lexeme)) return -1;
+    return findSymbol(&ctx->prog->table, (char *) name, 0);
+}
+
+// Input slot of a top level variable declared with the given type, or NULL.
+Slot *inputSlot(CamContext *ctx, const char *name, Type type) {
+    int slot = topSlot(ctx, name);
+    return slot == -1 || ctx->prog->table.syms[slot].type != type ? NULL : &ctx->inputs[slot];
+}
+
+// Declared top level variable after a run, or NULL.
+Slot *resultSlot(CamContext *ctx, const char *name) {
+    int slot = topSlot(ctx, name);
+    if (slot == -1 || !ctx->i.env.slots[slot].declared) return NULL;
+    return &ctx->i.env.slots[slot];
+}
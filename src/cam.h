@@ -0,0 +1,92 @@
+#ifndef CAM_H
+#define CAM_H
+
+// Embeddable API for the CAM programming langauge.
+// A program is compiled (lexed, parsed and resolved) once and can then be run any number of
+// times through execution contexts. Each context holds its own variables and output, so
+// different threads may run the same program through separate contexts.
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define CAM_API __attribute__((visibility("default")))
+#else
+#define CAM_API
+#endif
+
+typedef struct CamProgram CamProgram;
+typedef struct CamContext CamContext;
+
+// Compile source text. Returns NULL on a lex or parse error, with the messages copied into
+// err (truncated to errLen bytes) when err is not NULL.
+CAM_API CamProgram *camCompile(const char *src, long len, char *err, long errLen);
+CAM_API void camFreeProgram(CamProgram *prog);
+
+// List the top level variables in declaration order. Up to max names and types are written,
+// the total count is returned. The names live as long as the program.
+CAM_API int camVariables(CamProgram *prog, const char **names, bool *isBool, int max);
+
+// Create an execution context. The program must outlive it.
+CAM_API CamContext *camNewContext(CamProgram *prog);
+CAM_API void camFreeContext(CamContext *ctx);
+
+// Pre-bind a top level variable before running. The binding stays in place for every later
+// run until it is changed. Returns false if the program never declares the name at top level
+// with that type.
+CAM_API bool camBindNum(CamContext *ctx, const char *name, double value);
+CAM_API bool camBindBool(CamContext *ctx, const char *name, bool value);
+
+// Limit every later run of the context, 0 meaning no limit: statements executed, times any loop
+// goes round, wall clock seconds and bytes of output. Output is checked at each show and the rest as
+// loops go round; a run that exceeds one stops with a runtime error naming the line of the show or loop.
+CAM_API void camSetLimits(CamContext *ctx, long statements, long iterations, double seconds, long outputBytes);
+
+// Give the read statements of every later run len bytes of input. Each run carries on from where
+// the last one stopped reading. data is read in place and must stay unchanged while the context uses it.
+CAM_API void camSetInput(CamContext *ctx, const char *data, long len);
+
+// Run the program from the start with the current bindings.
+// Returns false if a runtime error occurred, the message is in the output.
+CAM_API bool camRun(CamContext *ctx);
+
+// Read a top level variable after a run. Returns false if it is undeclared or of another type.
+CAM_API bool camGetNum(CamContext *ctx, const char *name, double *value);
+CAM_API bool camGetBool(CamContext *ctx, const char *name, bool *value);
+
+// Output of the last run, NUL terminated. len may be NULL.
+CAM_API const char *camOutput(CamContext *ctx, long *len);
+
+// Run the program once for each of rows input rows, starting every row from the current bindings.
+// inputs[k] is the column bound to the top level variable inputNames[k] (BOOL variables take
+// value != 0). outputs[k] receives the final value of outputNames[k] for every row, BOOL as 1 or 0.
+// Show output is discarded. Where possible rows are evaluated several at a time with SIMD kernels,
+// though never under limits, which apply to each row as to a run.
+// Returns the number of rows that hit a runtime error, whose outputs are NaN, or -1 if an input
+// name is not a top level variable.
+CAM_API long camRunRows(CamContext *ctx, long rows, int inputCount, const char **inputNames,
+                        const double **inputs, int outputCount, const char **outputNames, double **outputs);
+
+// Process wide memory counters, indexed tokens, tree nodes, symbols, output buffers, run time stacks:
+// bytes asked for (a growing realloc counts what it adds) and allocations made. Then the high water
+// marks of the longest token stream, the largest tree and its deepest nesting, and the peak resident
+// set size in kilobytes. Counting is always on.
+typedef struct CamMemStats {
+    long long bytes[5];
+    long long allocs[5];
+    long long maxTokens;
+    long long maxNodes;
+    long long maxDepth;
+    long long peakRss;
+} CamMemStats;
+
+CAM_API void camMemStats(CamMemStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,278 @@
+// Checkpoints of long runs of the CAM programming langauge.
+// A run given a checkpoint file writes its whole state to it every so many back edges. It is only taken
+// at a back edge of a loop outside any call, where the frames of the blocks being run are all there is
+// of the position, and holds the slots with their arrays, the optimiser's temporaries, the frames, how
+// far the input was read, the current CSV row and how many bytes were shown. Output is flushed first,
+// so the file a run writes to always holds at least what its last checkpoint counts. Wide integers are
+// saved as their values and boxed again on loading. Like a trace, the file is written under a temporary
+// name and renamed, so a run killed while writing one leaves the previous checkpoint whole.
+// Resuming checks the program is the same one by a hash of its compact tree and, when output goes to a
+// regular file, that it is the same file and holds at least what the checkpoint counts after the offset
+// the first run started writing at. Whatever a killed run wrote after the checkpoint is cut from it, and
+// anything before that offset is left alone, so a run appending to a log keeps what the log held.
+
+#include "checkpoint.h"
+#include "interpreter.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Start of a checkpoint file. frameCount frames follow, then a SavedValue per slot and per temporary,
+// each declared array slot's length and elements in slot order and, for a CSV run, where each column's
+// cell starts and ends in the current row followed by cellsUsed bytes of it. output counts every byte
+// shown and shown the ones the output limit counts. input is how many bytes of input were taken, -1 for
+// a run without input. start, device and inode are those of the Checkpoint.
+typedef struct CheckpointHeader {
+    char magic[8];
+    int32_t version;
+    int32_t nodeCount;
+    uint64_t hash;
+    int64_t steps;
+    int64_t iterations;
+    int64_t output;
+    int64_t shown;
+    int64_t input;
+    int64_t start;
+    uint64_t device;
+    uint64_t inode;
+    int32_t slotCount;
+    int32_t tempCount;
+    int32_t frameCount;
+    int32_t pc;
+    int32_t end;
+    int32_t loop;
+    int32_t columns;
+    int64_t cellsUsed;
+} CheckpointHeader;
+
+// A slot or a temporary: declared and type of a slot, valid and base of a temporary, and the value,
+// the integer itself when wide is set.
+typedef struct SavedValue {
+    uint64_t value;
+    int64_t base;
+    uint8_t declared;
+    uint8_t type;
+    uint8_t valid;
+    uint8_t wide;
+} SavedValue;
+
+// -----------------
+// Private Functions
+// -----------------
+
+uint64_t hashTree(CompactTree *code);
+SavedValue saveValue(Interpreter *i, Lit v);
+Lit loadValue(Interpreter *i, SavedValue *v);
+bool writeCheckpoint(Interpreter *i, FILE *f, CheckpointHeader *h);
+bool readCheckpoint(Interpreter *i, FILE *f, CheckpointHeader *h);
+long sinkOffset(Output *o, uint64_t *device, uint64_t *inode);
+bool cutOutput(Checkpoint *cp, Output *o);
+
+// -----------------
+// Main Funcs
+// -----------------
+
+// Prepare a run of code showing values to shows to write a checkpoint to path every every back edges, or
+// only to resume with a NULL path.
+void initCheckpoint(Checkpoint *cp, CompactTree *code, Output *shows, const char *path, long every) {
+    *cp = (Checkpoint) {path, every, every, hashTree(code), false, 0, 0, 0, -1, 0, 0, 0, 0, -1, 0, 0};
+    long end = sinkOffset(shows, &cp->device, &cp->inode);
+    if (end >= 0) cp->start = end - (shows->total - shows->used);
+}
+
+// Write a checkpoint of a run stopped at a back edge outside any call, running the block pc .. end - 1
+// tested as loop with frameCount frames below it. A checkpoint that cannot be written is reported and
+// no more are tried.
+bool saveCheckpoint(Interpreter *i, int frameCount, int pc, int end, int loop) {
+    Checkpoint *cp = i->checkpoint;
+    i->saveDue = false;
+    flushOutput(i->shows);
+    if (i->out != i->shows) flushOutput(i->out);
+    CheckpointHeader h = {CHECKPOINT_MAGIC, CHECKPOINT_VERSION, i->code->count, cp->hash, i->steps, i->budget.iterations,
+                          cp->output + i->shows->total, i->shows->total - i->budget.output, i->in != NULL ? inputOffset(i->in) : -1,
+                          cp->start, cp->device, cp->inode, i->env.size,
+                          i->program->temps, frameCount, pc, end, loop, i->cellAt != NULL ? i->code->showCount : 0,
+                          i->cellAt != NULL ? i->cells.used : 0};
+
+    char tmp[4200];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", cp->path, (int) getpid());
+    FILE *f = fopen(tmp, "wb");
+    bool ok = f != NULL && writeCheckpoint(i, f, &h);
+    if (f != NULL) ok = fclose(f) == 0 && ok;
+    if (ok) ok = rename(tmp, cp->path) == 0;
+    if (!ok) {
+        remove(tmp);
+        outPrintf(i->out, "Error: Could not write checkpoint '%s'.\n", cp->path);
+        cp->path = NULL;
+    }
+    return ok;
+}
+
+// Load the checkpoint at path into an interpreter that has not run yet, leaving where to carry on in its
+// checkpoint. Returns false when the file is missing, damaged or from another program or input, or when
+// the output is not the file the checkpointed run wrote to or holds less than it had written.
+bool loadCheckpoint(Interpreter *i, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return false;
+    Checkpoint *cp = i->checkpoint;
+    CompactTree *code = i->code;
+    CheckpointHeader h;
+    bool ok = fread(&h, sizeof(h), 1, f) == 1 && !memcmp(h.magic, CHECKPOINT_MAGIC, 8) &&
+              h.version == CHECKPOINT_VERSION && h.nodeCount == code->count && h.hash == cp->hash &&
+              h.slotCount == i->env.size && h.tempCount == i->program->temps && h.frameCount >= 0 &&
+              h.frameCount <= code->blockDepth && h.pc >= 0 && h.pc <= h.end && h.end <= code->count &&
+              h.loop >= -1 && h.loop < code->count && h.columns == (i->cellAt != NULL ? code->showCount : 0) &&
+              (h.input == -1) == (i->in == NULL) && h.output >= 0 && h.start >= -1 && h.cellsUsed >= 0;
+    ok = ok && readCheckpoint(i, f, &h);
+    fclose(f);
+    if (!ok) return false;
+
+    cp->resumed = true;
+    cp->frameCount = h.frameCount;
+    cp->pc = h.pc;
+    cp->end = h.end;
+    cp->loop = h.loop;
+    cp->steps = h.steps;
+    cp->iterations = h.iterations;
+    cp->output = h.output;
+    cp->shown = h.shown;
+    cp->start = h.start;
+    cp->device = h.device;
+    cp->inode = h.inode;
+    cp->next = h.iterations + cp->every;
+
+    // Whatever was shown before the run started, such as a CSV header, is already in the output saved.
+    i->shows->used = 0;
+    i->shows->total = 0;
+    return cutOutput(cp, i->shows);
+}
+
+// -----------------
+// Helpers
+// -----------------
+
+// FNV-1a hash of the nodes of a compact tree, field by field so padding never counts.
+uint64_t hashTree(CompactTree *code) {
+    uint64_t hash = 14695981039346656037ull;
+    for (int k = 0; k < code->count; k++) {
+        Node *node = code->nodes + k;
+        int64_t fields[5] = {node->tag, node->op, node->flags, node->a, node->integer};
+        for (int j = 0; j < 5; j++) {
+            for (int b = 0; b < 8; b++) {
+                hash ^= (uint8_t) ((uint64_t) fields[j] >> (8 * b));
+                hash *= 1099511628211ull;
+            }
+        }
+    }
+    return hash;
+}
+
+// A value as saved, a wide integer by its value.
+SavedValue saveValue(Interpreter *i, Lit v) {
+    if (LIT_TAG(v) == LIT_TAG(LIT_WIDE)) return (SavedValue) {(uint64_t) exactValue(i, v), 0, 0, 0, 0, 1};
+    return (SavedValue) {v, 0, 0, 0, 0, 0};
+}
+
+// A saved value as a Lit, boxing a wide integer again.
+Lit loadValue(Interpreter *i, SavedValue *v) {
+    return v->wide ? exactLit(i, (long long) v->value) : v->value;
+}
+
+// Write the header and everything after it.
+bool writeCheckpoint(Interpreter *i, FILE *f, CheckpointHeader *h) {
+    bool ok = fwrite(h, sizeof(*h), 1, f) == 1;
+    ok = ok && fwrite(i->frames, sizeof(Frame), h->frameCount, f) == (size_t) h->frameCount;
+    for (int s = 0; ok && s < h->slotCount; s++) {
+        Slot *cs = &i->env.slots[s];
+        SavedValue v = saveValue(i, cs->value);
+        v.declared = cs->declared;
+        v.type = cs->type;
+        ok = fwrite(&v, sizeof(v), 1, f) == 1;
+    }
+    for (int t = 0; ok && t < h->tempCount; t++) {
+        SavedValue v = saveValue(i, i->temps[t].value);
+        v.base = i->temps[t].base;
+        // An array expression's value only lives until the next expression, so it is worked out again.
+        Lit value = i->temps[t].value;
+        v.valid = i->temps[t].valid && !(IS_ARRAY(value) && ARRAY_INDEX(value) >= h->slotCount);
+        ok = fwrite(&v, sizeof(v), 1, f) == 1;
+    }
+    for (int s = 0; ok && s < h->slotCount; s++) {
+        if (!i->env.slots[s].declared || i->env.slots[s].type != ARRAY) continue;
+        Array *a = &i->arrays[s];
+        int32_t length = a->length;
+        ok = fwrite(&length, sizeof(length), 1, f) == 1 &&
+             (length == 0 || fwrite(a->data, sizeof(double), length, f) == (size_t) length);
+    }
+    for (int c = 0; ok && c < h->columns; c++) {
+        int64_t cell[2] = {i->cellAt[c], i->cellEnd[c]};
+        ok = fwrite(cell, sizeof(cell), 1, f) == 1;
+    }
+    return ok && (h->cellsUsed == 0 || fwrite(i->cells.data, 1, h->cellsUsed, f) == (size_t) h->cellsUsed);
+}
+
+// Read everything after the header into the interpreter.
+bool readCheckpoint(Interpreter *i, FILE *f, CheckpointHeader *h) {
+    bool ok = fread(i->frames, sizeof(Frame), h->frameCount, f) == (size_t) h->frameCount;
+    for (int s = 0; ok && s < h->slotCount; s++) {
+        SavedValue v;
+        ok = fread(&v, sizeof(v), 1, f) == 1;
+        i->env.slots[s] = (Slot) {v.declared, v.type, loadValue(i, &v)};
+    }
+    for (int t = 0; ok && t < h->tempCount; t++) {
+        SavedValue v;
+        ok = fread(&v, sizeof(v), 1, f) == 1;
+        i->temps[t] = (Temp) {v.valid, loadValue(i, &v), v.base};
+    }
+    for (int s = 0; ok && s < h->slotCount; s++) {
+        if (!i->env.slots[s].declared || i->env.slots[s].type != ARRAY) continue;
+        int32_t length;
+        ok = fread(&length, sizeof(length), 1, f) == 1 && length >= 0;
+        if (!ok) break;
+        growArrays(i, i->env.size);
+        sizeArray(&i->arrays[s], length);
+        ok = length == 0 || fread(i->arrays[s].data, sizeof(double), length, f) == (size_t) length;
+    }
+    for (int c = 0; ok && c < h->columns; c++) {
+        int64_t cell[2];
+        ok = fread(cell, sizeof(cell), 1, f) == 1;
+        i->cellAt[c] = cell[0];
+        i->cellEnd[c] = cell[1];
+    }
+    if (ok && h->cellsUsed > 0) {
+        char *row = malloc(h->cellsUsed);
+        ok = fread(row, 1, h->cellsUsed, f) == (size_t) h->cellsUsed;
+        if (ok) outWrite(&i->cells, row, h->cellsUsed);
+        free(row);
+    }
+    return ok && (i->in == NULL || skipInput(i->in, h->input));
+}
+
+// Where the next byte written to the regular file an output goes to lands, the end of the file when it
+// was opened to append, with the file's device and inode. -1 for any other sink.
+long sinkOffset(Output *o, uint64_t *device, uint64_t *inode) {
+    struct stat st;
+    if (o->sink == NULL || fstat(fileno(o->sink), &st) != 0 || !S_ISREG(st.st_mode)) return -1;
+    *device = st.st_dev;
+    *inode = st.st_ino;
+    if (fcntl(fileno(o->sink), F_GETFL) & O_APPEND) return st.st_size;
+    return lseek(fileno(o->sink), 0, SEEK_CUR);
+}
+
+// Cut what a killed run wrote after the checkpoint from the regular file a resumed run's output goes to,
+// so output appended to it carries on from there. Only bytes the checkpointed runs wrote after start are
+// cut. Returns false when the output is not the same file, or is a file shorter than the checkpoint
+// counts. Nothing is cut after a run whose output did not go to a regular file.
+bool cutOutput(Checkpoint *cp, Output *o) {
+    if (cp->start == -1) return true;
+    struct stat st;
+    long offset = cp->start + cp->output;
+    if (o->sink == NULL || fstat(fileno(o->sink), &st) != 0 || !S_ISREG(st.st_mode) || st.st_dev != cp->device ||
+        st.st_ino != cp->inode || st.st_size < offset) return false;
+    if (ftruncate(fileno(o->sink), offset) != 0) return false;
+    fseek(o->sink, offset, SEEK_SET);
+    return true;
+}
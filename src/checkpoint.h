@@ -0,0 +1,52 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "compact.h"
+#include "output.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// -----------------
+// Public Objects
+// -----------------
+
+typedef struct Interpreter Interpreter;
+
+#define CHECKPOINT_MAGIC "CAMCHKPT"
+#define CHECKPOINT_VERSION 2
+
+// Periodic saving of a run and the place a resumed run starts from. A checkpoint is written to path every
+// every back edges of the program's loops, NULL for none, the next once the run has taken next of them.
+// hash identifies the compact tree the run executes. A resumed run starts in the block pc .. end - 1,
+// tested as the while node loop, with frameCount frames below it already on the interpreter's frames,
+// having run steps statements, taken iterations back edges and written output bytes of shown values,
+// shown of them counted against the output limit. When shown values go to a regular file, start is the
+// offset the first run's output began at in the file device and inode, otherwise -1.
+typedef struct Checkpoint {
+    const char *path;
+    long every;
+    long next;
+    uint64_t hash;
+    bool resumed;
+    int frameCount;
+    int pc;
+    int end;
+    int loop;
+    long steps;
+    long iterations;
+    long output;
+    long shown;
+    long start;
+    uint64_t device;
+    uint64_t inode;
+} Checkpoint;
+
+// -----------------
+// Public Functions
+// -----------------
+
+void initCheckpoint(Checkpoint *cp, CompactTree *code, Output *shows, const char *path, long every);
+bool saveCheckpoint(Interpreter *i, int frameCount, int pc, int end, int loop);
+bool loadCheckpoint(Interpreter *i, const char *path);
+
+#endif
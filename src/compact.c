@@ -0,0 +1,634 @@
+// Compact tree for the CAM programming langauge.
+// After analysis and optimisation the pointer tree is lowered into one array of fixed size nodes.
+// Children are 32 bit indices instead of pointers and the statements of a block are laid out next
+// to each other, so a block is a range of nodes and walking it touches consecutive memory.
+// Expressions are laid out in post-order so the interpreter runs them as a flat loop over a value
+// stack. Lowering and printing use explicit stacks, so any depth of nesting is handled.
+// Names, operators, literal text and source lines are only needed for errors and printing, so they
+// live in a side table instead of the nodes.
+
+#include "compact.h"
+#include "memstats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A statement waiting to be lowered into the node reserved for it at 'at', depth blocks deep.
+typedef struct LowerItem {
+    void *stmt;
+    int at;
+    int depth;
+} LowerItem;
+
+// An expression node during post-order lowering. Its children are lowered while it waits with
+// done set, prefix being the REUSE or STEP node emitted ahead of them, or the ENTER emitted after the
+// arguments of an inlined call. Inside an inlined return expression base is the stack depth of the
+// first argument, -1 elsewhere.
+typedef struct ExprItem {
+    void *expr;
+    bool done;
+    int prefix;
+    int base;
+} ExprItem;
+
+// Work item of printCompact: a node still to be printed, or text to print once the items above it are done.
+typedef struct PrintItem {
+    int node;
+    const char *text;
+} PrintItem;
+
+// -----------------
+// Private Functions
+// -----------------
+
+int reserveNodes(CompactTree *t, int count);
+void *growStack(void *stack, int count, int *size, long elem);
+void lowerStmt(CompactTree *t, LowerItem item, LowerItem **items, int *count, int *size);
+int lowerExpr(CompactTree *t, void *expr, int line, int col, int stmt);
+int emit(CompactTree *t, Node n, int line, int col, int stmt, const char *text);
+int addText(CompactTree *t, const char *text);
+int addConsts(CompactTree *t, long long step, long long delta);
+int addRoots(CompactTree *t, int *roots, int count);
+void printNode(CompactTree *t, int n);
+
+// -----------------
+// Main Funcs
+// -----------------
+
+// Lower a resolved tree. The tree is only read and can be freed afterwards.
+CompactTree compactTree(ParseTree tree) {
+    CompactTree t = {0, 0, 0, 0, 0, NULL, NULL, NULL, 0, 0, NULL, 0, 0, NULL, 0, 0};
+    t.top = tree.index;
+    for (int j = 0; j < tree.index; j++) t.procCount += ((VarExpr *) tree.stmts[j])->s == PROC;
+    t.procs = malloc(sizeof(int) * (t.procCount ? t.procCount : 1));
+    int first = reserveNodes(&t, tree.index);
+    int count = 0, size = 0;
+    LowerItem *items = NULL;
+    for (int j = tree.index - 1; j >= 0; j--) {
+        items = growStack(items, count, &size, sizeof(LowerItem));
+        items[count++] = (LowerItem) {tree.stmts[j], first + j, 0};
+    }
+    while (count) {
+        LowerItem item = items[--count];
+        lowerStmt(&t, item, &items, &count, &size);
+    }
+    free(items);
+    MEM_HIGH(maxNodes, t.count);
+    MEM_HIGH(maxDepth, t.blockDepth);
+    return t;
+}
+
+// Display all statements in the same format as printTree.
+void printCompact(CompactTree *t) {
+    for (int n = 0; n < t->top; n++) {
+        printNode(t, n);
+        printf("\n");
+    }
+}
+
+// Release the node array and its side tables.
+void freeCompact(CompactTree *t) {
+    free(t->nodes);
+    free(t->sources);
+    free(t->consts);
+    free(t->text);
+    free(t->procs);
+}
+
+// -----------------
+// Lowering
+// -----------------
+
+// Append count uninitialised nodes and return the index of the first.
+int reserveNodes(CompactTree *t, int count) {
+    if (t->count + count > t->size) {
+        int old = t->size;
+        t->size = t->size ? t->size : 64;
+        while (t->count + count > t->size) t->size *= 2;
+        MEM_COUNT(MEM_NODES, (sizeof(Node) + sizeof(Source)) * (t->size - old));
+        t->nodes = realloc(t->nodes, sizeof(Node) * t->size);
+        t->sources = realloc(t->sources, sizeof(Source) * t->size);
+    }
+    int first = t->count;
+    t->count += count;
+    return first;
+}
+
+// Make room for one more element on a work stack, doubling its capacity when it is full.
+void *growStack(void *stack, int count, int *size, long elem) {
+    if (count < *size) return stack;
+    *size = *size ? *size * 2 : 16;
+    return realloc(stack, elem * *size);
+}
+
+// Fill the node reserved for a statement. Its expressions are lowered straight after it and the
+// statements of its body get a run of nodes of their own, queued on the work stack.
+void lowerStmt(CompactTree *t, LowerItem item, LowerItem **items, int *count, int *size) {
+    void *stmt = item.stmt;
+    Node n = {((VarExpr *) stmt)->s, 0, 0, -1, {{-1, -1}}};
+    int line = 0, col = 0;
+    const char *text = NULL;
+    switch (n.tag) {
+        case IF:
+        case WHILE: {
+            IfStmt *s = stmt;
+            line = s->line;
+            col = s->col;
+            n.a = t->count;
+            lowerExpr(t, s->cond, line, col, item.at);
+            n.b = reserveNodes(t, s->trueBranch.index);
+            n.c = s->trueBranch.index;
+            if (item.depth + 1 > t->blockDepth) t->blockDepth = item.depth + 1;
+            for (int j = n.c - 1; j >= 0; j--) {
+                *items = growStack(*items, *count, size, sizeof(LowerItem));
+                (*items)[(*count)++] = (LowerItem) {s->trueBranch.stmts[j], n.b + j, item.depth + 1};
+            }
+            break;
+        }
+        case HOIST: {
+            HoistStmt *h = stmt;
+            line = ((WhileStmt *) h->loop)->line;
+            col = ((WhileStmt *) h->loop)->col;
+            n.a = reserveNodes(t, 1);
+            n.b = h->first;
+            n.c = h->count;
+            *items = growStack(*items, *count, size, sizeof(LowerItem));
+            (*items)[(*count)++] = (LowerItem) {h->loop, n.a, item.depth};
+            break;
+        }
+        case VARDEC: {
+            VarDecStmt *s = stmt;
+            line = s->line;
+            col = s->col;
+            n.a = s->slot;
+            n.op = s->type;
+            n.b = s->length;
+            text = s->id;
+            break;
+        }
+        case VARASSIGN:
+        case NOP: {
+            VarAssignStmt *s = stmt;
+            line = s->line;
+            col = s->col;
+            n.a = s->slot;
+            if (n.tag == VARASSIGN) {
+                n.c = t->count;
+                n.b = lowerExpr(t, s->expr, line, col, item.at);
+            }
+            text = s->id;
+            break;
+        }
+        case READ: {
+            ReadStmt *s = stmt;
+            line = s->line;
+            col = s->col;
+            n.a = s->slot;
+            text = s->id;
+            break;
+        }
+        case STORE: {
+            // The index stays on the stack below the value, so the value needs one more slot.
+            StoreStmt *s = stmt;
+            int deepest = t->stackDepth;
+            line = s->line;
+            col = s->col;
+            n.a = s->slot;
+            n.c = t->count;
+            t->stackDepth = 0;
+            int index = lowerExpr(t, s->index, line, col, item.at);
+            if (t->stackDepth > deepest) deepest = t->stackDepth;
+            t->stackDepth = 0;
+            lowerExpr(t, s->expr, line, col, item.at);
+            if (t->stackDepth + 1 > deepest) deepest = t->stackDepth + 1;
+            t->stackDepth = deepest;
+            n.b = emit(t, (Node) {SET, 0, 0, s->slot, {{index, -1}}}, line, col, item.at, s->id);
+            text = s->id;
+            break;
+        }
+        case SHOW:
+        case RETURN:
+        case INVOKE: {
+            line = ((ShowStmt *) stmt)->line;
+            col = ((ShowStmt *) stmt)->col;
+            n.b = t->count;
+            n.a = lowerExpr(t, ((ShowStmt *) stmt)->expr, line, col, item.at);
+            if (n.tag == INVOKE && t->nodes[n.a].tag == CALL) t->nodes[n.a].flags |= NODE_DISCARD;
+            if (n.tag == SHOW) n.c = t->showCount++;
+            break;
+        }
+        case PROC: {
+            // Parameters and body are laid out like a block, the body nesting from depth 0 in its own frames.
+            ProcStmt *s = stmt;
+            line = s->line;
+            col = s->col;
+            text = s->id;
+            n.a = reserveNodes(t, s->params.index);
+            n.b = reserveNodes(t, s->body.index);
+            n.c = s->body.index;
+            if (s->redeclared) n.flags |= NODE_REDECLARED;
+            t->procs[s->index] = item.at;
+            for (int j = n.c - 1; j >= 0; j--) {
+                *items = growStack(*items, *count, size, sizeof(LowerItem));
+                (*items)[(*count)++] = (LowerItem) {s->body.stmts[j], n.b + j, 0};
+            }
+            for (int j = s->params.index - 1; j >= 0; j--) {
+                *items = growStack(*items, *count, size, sizeof(LowerItem));
+                (*items)[(*count)++] = (LowerItem) {s->params.stmts[j], n.a + j, 0};
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    t->nodes[item.at] = n;
+    t->sources[item.at] = (Source) {line, col, text ? addText(t, text) : -1, item.at};
+}
+
+// Lower an expression into a run of nodes in post-order and return the index of its root, the last
+// node of the run. Expressions take the line, column and index of their statement.
+// The return expression of an inlined procedure is lowered in place of each call, reading the
+// arguments left on the stack by the distance from the top.
+int lowerExpr(CompactTree *t, void *expr, int line, int col, int stmt) {
+    int count = 0, size = 0, rootCount = 0, rootSize = 0;
+    ExprItem *items = NULL;
+    int *roots = NULL;
+    int depth = 0;
+    items = growStack(items, count, &size, sizeof(ExprItem));
+    items[count++] = (ExprItem) {expr, false, -1, -1};
+    while (count) {
+        ExprItem item = items[--count];
+        void *e = item.expr;
+        Node n = {((VarExpr *) e)->s, 0, 0, -1, {{-1, -1}}};
+        const char *text = NULL;
+        void *kids[2] = {NULL, NULL};
+
+        if (!item.done && n.tag == CALL) {
+            ParseTree args = ((CallExpr *) e)->args;
+            item.done = true;
+            for (int k = 0; k <= args.index; k++) items = growStack(items, count + k, &size, sizeof(ExprItem));
+            items[count++] = item;
+            for (int j = args.index - 1; j >= 0; j--) items[count++] = (ExprItem) {args.stmts[j], false, -1, item.base};
+            continue;
+        }
+        if (!item.done) {
+            switch (n.tag) {
+                case BINOP:
+                    kids[0] = ((BinOpExpr *) e)->left;
+                    kids[1] = ((BinOpExpr *) e)->right;
+                    break;
+                case UNOP:
+                    kids[0] = ((UnOpExpr *) e)->right;
+                    break;
+                case BRACKET:
+                    kids[0] = ((BracketExpr *) e)->expr;
+                    break;
+                case INDEX:
+                    kids[0] = ((IndexExpr *) e)->index;
+                    break;
+                case REDUCE:
+                    kids[0] = ((ReduceExpr *) e)->expr;
+                    break;
+                case TEMP:
+                    item.prefix = emit(t, (Node) {REUSE, 0, 0, -1, {{((TempExpr *) e)->temp, -1}}}, line, col, stmt, NULL);
+                    kids[0] = ((TempExpr *) e)->expr;
+                    break;
+                case SAVE:
+                    kids[0] = ((TempExpr *) e)->expr;
+                    break;
+                case INDUCT:
+                    item.prefix = emit(t, (Node) {STEP, 0, 0, -1, {{-1, -1}}}, line, col, stmt, NULL);
+                    kids[0] = ((InductExpr *) e)->mul;
+                    break;
+                default:
+                    break;
+            }
+            if (kids[0] != NULL) {
+                item.done = true;
+                for (int k = 0; k < 3; k++) items = growStack(items, count + k, &size, sizeof(ExprItem));
+                items[count++] = item;
+                if (kids[1] != NULL) items[count++] = (ExprItem) {kids[1], false, -1, item.base};
+                items[count++] = (ExprItem) {kids[0], false, -1, item.base};
+                continue;
+            }
+        }
+
+        switch (n.tag) {
+            case BINOP: {
+                BinOpExpr *bin = e;
+                n.b = roots[--rootCount];
+                n.a = roots[--rootCount];
+                n.op = bin->opType;
+                if (bin->integral) n.flags |= NODE_INTEGRAL;
+                text = bin->op;
+                depth--;
+                break;
+            }
+            case UNOP:
+                n.a = roots[--rootCount];
+                text = ((UnOpExpr *) e)->op;
+                break;
+            case BRACKET:
+                n.a = roots[--rootCount];
+                break;
+            case INDEX:
+                n.b = roots[--rootCount];
+                n.a = ((IndexExpr *) e)->slot;
+                text = ((IndexExpr *) e)->id;
+                break;
+            case REDUCE:
+                n.a = roots[--rootCount];
+                n.op = ((ReduceExpr *) e)->kind;
+                text = ((ReduceExpr *) e)->op;
+                break;
+            case TEMP:
+            case SAVE:
+                n.a = roots[--rootCount];
+                n.b = ((TempExpr *) e)->temp;
+                break;
+            case INDUCT: {
+                InductExpr *ind = e;
+                n.a = roots[--rootCount];
+                n.b = ind->temp;
+                n.c = addConsts(t, ind->step, ind->delta);
+                if (ind->varLeft) n.flags |= NODE_VARLEFT;
+                break;
+            }
+            case LITERAL: {
+                LiteralExpr *lit = e;
+                n.op = lit->type;
+                if (lit->exact) {
+                    n.flags |= NODE_EXACT;
+                    n.integer = lit->integer;
+                } else {
+                    n.value = lit->value;
+                }
+                text = lit->val;
+                depth++;
+                break;
+            }
+            case VAR:
+                n.a = ((VarExpr *) e)->slot;
+                if (item.base != -1) {
+                    n.tag = ARG;
+                    n.a = depth - item.base - n.a;
+                }
+                text = ((VarExpr *) e)->id;
+                depth++;
+                break;
+            case ATEND:
+                depth++;
+                break;
+            case CALL: {
+                CallExpr *call = e;
+                int argc = call->args.index;
+                text = call->id;
+                if (call->proc != NULL && call->proc->inlined && argc == call->proc->params.index) {
+                    if (item.prefix == -1) {
+                        // The arguments are on the stack: enter the body, which reads them from depth - argc.
+                        rootCount -= argc;
+                        int args = addRoots(t, roots + rootCount, argc);
+                        item.prefix = emit(t, (Node) {ENTER, 0, 0, call->proc->index, {{argc, args}}}, line, col, stmt, text);
+                        items = growStack(items, count + 1, &size, sizeof(ExprItem));
+                        items[count++] = item;
+                        items[count++] = (ExprItem) {((ReturnStmt *) call->proc->body.stmts[0])->expr, false, -1, depth - argc};
+                        continue;
+                    }
+                    n = (Node) {LEAVE, 0, 0, argc, {{item.prefix, t->nodes[item.prefix].c}}};
+                    rootCount--;
+                    depth -= argc;
+                    break;
+                }
+                n.a = call->proc != NULL ? call->proc->index : -1;
+                n.b = argc;
+                rootCount -= argc;
+                n.c = addRoots(t, roots + rootCount, argc);
+                depth -= argc - 1;
+                break;
+            }
+            default:
+                break;
+        }
+        int at = emit(t, n, line, col, stmt, text);
+        if (n.tag == TEMP || n.tag == INDUCT) t->nodes[item.prefix].a = at;
+        if (n.tag == LEAVE) t->nodes[item.prefix].c = at;
+        if (depth > t->stackDepth) t->stackDepth = depth;
+        roots = growStack(roots, rootCount, &rootSize, sizeof(int));
+        roots[rootCount++] = at;
+    }
+    int root = roots[0];
+    free(items);
+    free(roots);
+    return root;
+}
+
+// Append a node with its source entry and return its index.
+int emit(CompactTree *t, Node n, int line, int col, int stmt, const char *text) {
+    int at = reserveNodes(t, 1);
+    t->nodes[at] = n;
+    t->sources[at] = (Source) {line, col, text ? addText(t, text) : -1, stmt};
+    return at;
+}
+
+// Copy a string into the text pool and return its offset.
+int addText(CompactTree *t, const char *text) {
+    long len = strlen(text) + 1;
+    if (t->textUsed + len > t->textSize) {
+        t->textSize = t->textSize ? t->textSize : 256;
+        while (t->textUsed + len > t->textSize) t->textSize *= 2;
+        t->text = realloc(t->text, t->textSize);
+    }
+    memcpy(t->text + t->textUsed, text, len);
+    t->textUsed += len;
+    return (int) (t->textUsed - len);
+}
+
+// Store an induction step and delta pair and return the index of the step.
+int addConsts(CompactTree *t, long long step, long long delta) {
+    if (t->constCount + 2 > t->constSize) {
+        t->constSize = t->constSize ? t->constSize * 2 : 8;
+        t->consts = realloc(t->consts, sizeof(long long) * t->constSize);
+    }
+    t->consts[t->constCount] = step;
+    t->consts[t->constCount + 1] = delta;
+    t->constCount += 2;
+    return t->constCount - 2;
+}
+
+// Store the roots of a call's arguments, for printing, and return the index of the first.
+int addRoots(CompactTree *t, int *roots, int count) {
+    while (t->constCount + count > t->constSize) {
+        t->constSize = t->constSize ? t->constSize * 2 : 8;
+        t->consts = realloc(t->consts, sizeof(long long) * t->constSize);
+    }
+    for (int j = 0; j < count; j++) t->consts[t->constCount + j] = roots[j];
+    t->constCount += count;
+    return t->constCount - count;
+}
+
+// -----------------
+// Output funcs
+// -----------------
+
+// Display a node in the format of printStmt, without recursing.
+void printNode(CompactTree *t, int n) {
+    int count = 0, size = 0;
+    PrintItem *items = NULL;
+    items = growStack(items, count, &size, sizeof(PrintItem));
+    items[count++] = (PrintItem) {n, NULL};
+    while (count) {
+        PrintItem item = items[--count];
+        if (item.text) {
+            printf("%s", item.text);
+            continue;
+        }
+        Node *node = &t->nodes[item.node];
+        char *text = t->sources[item.node].text == -1 ? "" : t->text + t->sources[item.node].text;
+        int extra = 6 + (node->tag == IF || node->tag == WHILE ? node->c : 0);
+        if (node->tag == PROC) extra += node->b - node->a + node->c;
+        if (node->tag == CALL || node->tag == LEAVE) extra += 2 * (node->tag == CALL ? node->b : node->a);
+        while (count + extra > size) items = growStack(items, size, &size, sizeof(PrintItem));
+        printf("(");
+        switch (node->tag) {
+            case IF:
+            case WHILE: {
+                printf("%s {", node->tag == IF ? "IF" : "WHILE");
+                items[count++] = (PrintItem) {-1, "})"};
+                for (int j = node->b + node->c - 1; j >= node->b; j--) items[count++] = (PrintItem) {j, NULL};
+                items[count++] = (PrintItem) {-1, " -> "};
+                items[count++] = (PrintItem) {node->b - 1, NULL};
+                break;
+            }
+            case SHOW:
+            case RETURN:
+            case INVOKE: {
+                printf("%s {", node->tag == SHOW ? "SHOW" : node->tag == RETURN ? "RETURN" : "INVOKE");
+                items[count++] = (PrintItem) {-1, "})"};
+                items[count++] = (PrintItem) {node->a, NULL};
+                break;
+            }
+            case PROC: {
+                printf("PROC {%s ", text);
+                items[count++] = (PrintItem) {-1, "})"};
+                for (int j = node->b + node->c - 1; j >= node->b; j--) items[count++] = (PrintItem) {j, NULL};
+                items[count++] = (PrintItem) {-1, " -> "};
+                for (int j = node->b - 1; j >= node->a; j--) items[count++] = (PrintItem) {j, NULL};
+                break;
+            }
+            case CALL:
+            case LEAVE: {
+                // An inlined call prints as the call it replaced.
+                int argc = node->tag == CALL ? node->b : node->a;
+                printf("CALL {%s", text);
+                items[count++] = (PrintItem) {-1, "})"};
+                for (int j = argc - 1; j >= 0; j--) {
+                    items[count++] = (PrintItem) {(int) t->consts[node->c + j], NULL};
+                    items[count++] = (PrintItem) {-1, " "};
+                }
+                break;
+            }
+            case VARDEC: {
+                if (node->op == ARRAY) {
+                    printf("VARDEC {%s NUM[%d]})", text, node->b);
+                } else {
+                    printf("VARDEC {%s %s})", text, node->op == NUM ? "NUM" : node->op == BOOL ? "BOOL" : "UNKNOWN");
+                }
+                break;
+            }
+            case VARASSIGN: {
+                printf("VARASSIGN {");
+                printf("%s <= ", text);
+                items[count++] = (PrintItem) {-1, "})"};
+                items[count++] = (PrintItem) {node->b, NULL};
+                break;
+            }
+            case STORE: {
+                printf("STORE {%s[", text);
+                items[count++] = (PrintItem) {-1, "})"};
+                items[count++] = (PrintItem) {node->b - 1, NULL};
+                items[count++] = (PrintItem) {-1, "] <= "};
+                items[count++] = (PrintItem) {t->nodes[node->b].b, NULL};
+                break;
+            }
+            case BRACKET: {
+                printf("BRACKETS {");
+                items[count++] = (PrintItem) {-1, "})"};
+                items[count++] = (PrintItem) {node->a, NULL};
+                break;
+            }
+            case BINOP: {
+                printf("BINOP {");
+                items[count++] = (PrintItem) {-1, "})"};
+                items[count++] = (PrintItem) {node->b, NULL};
+                items[count++] = (PrintItem) {-1, " "};
+                items[count++] = (PrintItem) {-1, text};
+                items[count++] = (PrintItem) {-1, " "};
+                items[count++] = (PrintItem) {node->a, NULL};
+                break;
+            }
+            case UNOP: {
+                printf("UNOP {");
+                printf("%s ", text);
+                items[count++] = (PrintItem) {-1, "})"};
+                items[count++] = (PrintItem) {node->a, NULL};
+                break;
+            }
+            case LITERAL: {
+                printf("LITERAL {%s})", text);
+                break;
+            }
+            case VAR:
+            case ARG: {
+                printf("VARIABLE {%s})", text);
+                break;
+            }
+            case INDEX: {
+                printf("INDEX {%s[", text);
+                items[count++] = (PrintItem) {-1, "]})"};
+                items[count++] = (PrintItem) {node->b, NULL};
+                break;
+            }
+            case REDUCE: {
+                printf("REDUCE {%s ", text);
+                items[count++] = (PrintItem) {-1, "})"};
+                items[count++] = (PrintItem) {node->a, NULL};
+                break;
+            }
+            case HOIST: {
+                printf("HOIST {");
+                items[count++] = (PrintItem) {-1, "})"};
+                items[count++] = (PrintItem) {node->a, NULL};
+                break;
+            }
+            case TEMP:
+            case SAVE: {
+                printf("%s %d {", node->tag == TEMP ? "TEMP" : "SAVE", node->b);
+                items[count++] = (PrintItem) {-1, "})"};
+                items[count++] = (PrintItem) {node->a, NULL};
+                break;
+            }
+            case INDUCT: {
+                printf("INDUCT %d {", node->b);
+                items[count++] = (PrintItem) {-1, "})"};
+                items[count++] = (PrintItem) {node->a, NULL};
+                break;
+            }
+            case NOP: {
+                printf("NOP {%s})", text);
+                break;
+            }
+            case READ: {
+                printf("READ {%s})", text);
+                break;
+            }
+            case ATEND: {
+                printf("EOF)");
+                break;
+            }
+            default:
+                printf(")");
+                break;
+        }
+    }
+    free(items);
+}
@@ -0,0 +1,120 @@
+#ifndef COMPACT_H
+#define COMPACT_H
+
+#include "parser.h"
+
+// -----------------
+// Public Objects
+// -----------------
+
+// Node flags.
+#define NODE_INTEGRAL 1
+#define NODE_EXACT 2
+#define NODE_VARLEFT 4
+#define NODE_DISCARD 8
+#define NODE_REDECLARED 16
+
+// Tags only found in compact trees: REUSE and STEP on the node placed before the expression of a TEMP
+// or INDUCT, SET at the root of the expression of a STORE, and ENTER, ARG and LEAVE for the return
+// expression of an inlined procedure, expanded in place of a call.
+#define REUSE (NOP + 1)
+#define STEP (NOP + 2)
+#define SET (NOP + 3)
+#define ENTER (NOP + 4)
+#define ARG (NOP + 5)
+#define LEAVE (NOP + 6)
+
+// One fixed size record of a compact tree. An expression is a run of consecutive nodes in post-order,
+// children before their parent, so it is evaluated left to right on a value stack and its root is the
+// last node of the run. The statements of a block are a run of consecutive nodes too.
+// What a, b and c hold depends on the tag:
+//   IF, WHILE           a first node of the condition, b first statement, c statement count;
+//                       the condition ends at b - 1
+//   HOIST               a loop, b first temporary, c temporary count
+//   VARDEC              a slot, op the declared type, b the length of an ARRAY
+//   VARASSIGN           a slot, b expression, c first node of the expression
+//   STORE               a slot, b its SET, c first node of the index; the value follows the index
+//   NOP, READ           a slot
+//   SHOW                a expression, b first node of the expression, c its column, the shows
+//                       being numbered 0 .. showCount - 1 in source order
+//   RETURN              a expression, b first node of the expression
+//   INVOKE              a expression, b first node of the expression, a CALL root flagged NODE_DISCARD
+//   PROC                a first parameter, a VARDEC, b first statement, c statement count;
+//                       flagged NODE_REDECLARED when an earlier procedure has its name
+//   CALL                a procedure index, -1 when there is none, b argument count, c index of the
+//                       argument roots in consts; the arguments are the values below it
+//   ENTER               a procedure index, b argument count, c its LEAVE
+//   ARG                 a distance down the value stack to the argument it reads
+//   LEAVE               a argument count, b its ENTER, c index of the argument roots in consts
+//   BRACKET, UNOP       a operand
+//   BINOP               a left, b right, op the operator
+//   VAR                 a slot
+//   ATEND               nothing, it pushes whether the input is used up
+//   INDEX               a slot, b index
+//   SET                 a slot, b index, the value being the node before it
+//   REDUCE              a operand, op the Reduction
+//   REUSE               a the TEMP it starts, b temporary
+//   TEMP, SAVE          a expression, b temporary
+//   STEP                a the INDUCT it starts
+//   INDUCT              a multiplication, b temporary, c index of step then delta in consts
+//   LITERAL             op the type, value or integer when NODE_EXACT is set
+// A REUSE jumps past its TEMP when the temporary is valid and a STEP always jumps past its INDUCT,
+// whose multiplication is only kept for printing and errors. An inlined call is its arguments, an ENTER,
+// the procedure's return expression reading the arguments through ARGs and a LEAVE dropping them.
+typedef struct Node {
+    unsigned char tag;
+    unsigned char op;
+    unsigned char flags;
+    int a;
+    union {
+        struct {
+            int b;
+            int c;
+        };
+        double value;
+        long long integer;
+    };
+} Node;
+
+// Cold data kept beside the nodes, one entry per node: the source line and column of the enclosing
+// statement, the offset of the node's name, operator or literal text in the text pool, -1 when it has
+// none, and the index of the enclosing statement, the node itself for a statement.
+typedef struct Source {
+    int line;
+    int col;
+    int text;
+    int stmt;
+} Source;
+
+// A resolved program as one contiguous array of nodes. The top level statements are nodes 0 .. top - 1.
+// stackDepth is the most values any expression needs on the stack and blockDepth the deepest nesting
+// of blocks, so the interpreter can size both of its stacks up front. procs holds the PROC node of each
+// procedure, by the index the analyser gave it. showCount is the number of show statements.
+typedef struct CompactTree {
+    int count;
+    int size;
+    int top;
+    int stackDepth;
+    int blockDepth;
+    Node *nodes;
+    Source *sources;
+    long long *consts;
+    int constCount;
+    int constSize;
+    char *text;
+    long textUsed;
+    long textSize;
+    int *procs;
+    int procCount;
+    int showCount;
+} CompactTree;
+
+// -----------------
+// Public Functions
+// -----------------
+
+CompactTree compactTree(ParseTree tree);
+void printCompact(CompactTree *t);
+void freeCompact(CompactTree *t);
+
+#endif
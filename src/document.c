@@ -0,0 +1,308 @@
+// Incremental lexing and parsing of edited sources for the CAM programming langauge.
+// An edit is re-lexed a whole line at a time starting at column 0 of a known line, exactly as the full
+// lexer would see those lines. The changed tokens are then re-parsed one top level statement at a time,
+// starting with the statement holding the first changed token, until a statement starts where an old one
+// did past the change. From there on the old statements are kept, their lines moved by the lines added.
+
+#include "document.h"
+#include "memstats.h"
+#include <stdlib.h>
+#include <string.h>
+
+// -----------------
+// Private Functions
+// -----------------
+
+void rebuild(Document *d);
+int reparse(Document *d, int k, int changed, int delta, int lineDelta);
+void shiftLine(void *node, int scope, int depth, void *data);
+void addLine(Document *d, long start);
+int lineOf(Document *d, long pos);
+int firstToken(Document *d, int line);
+int statementAt(Document *d, int token);
+
+// -----------------
+// Main Funcs
+// -----------------
+
+// Copy a source and lex and parse all of it. Errors are written to out.
+void openDocument(Document *d, const char *src, long len, Output *out) {
+    d->out = out;
+    d->size = len + 1;
+    d->src = malloc(d->size);
+    memcpy(d->src, src, len);
+    d->src[len] = '\0';
+    d->length = len;
+    d->lines = NULL;
+    d->lineCount = d->lineSize = 0;
+    d->tokens = NULL;
+    d->tokLength = d->tokSize = 0;
+    d->tree = (ParseTree) {0,5,NULL};
+    d->starts = NULL;
+    d->startSize = 0;
+    rebuild(d);
+}
+
+// Replace the bytes start .. end - 1 of the source with len bytes of text, then bring the tokens and
+// tree up to date. Lex and parse errors are written to the document's output as a full parse would.
+void editDocument(Document *d, long start, long end, const char *text, long len) {
+    int a = lineOf(d, start);
+    int b = lineOf(d, end);
+    bool last = b == d->lineCount - 1;
+    long from = d->lines[a];
+    long to = last ? d->length : d->lines[b + 1];
+    long grow = len - (end - start);
+
+    if (d->length + grow + 1 > d->size) {
+        d->size = (d->length + grow + 1) * 2;
+        d->src = realloc(d->src, d->size);
+    }
+    memmove(d->src + end + grow, d->src + end, d->length - end);
+    memcpy(d->src + start, text, len);
+    d->length += grow;
+    d->src[d->length] = '\0';
+    to += grow;
+    if (d->err || memchr(d->src + from, EOF, to - from) != NULL) {
+        rebuild(d);
+        return;
+    }
+
+    // Re-lex the touched lines on their own. An error is left for a full pass to report.
+    Output quiet;
+    initOutput(&quiet, NULL);
+    Lexer l;
+    initLexer(&l, d->src + from, to - from, &quiet);
+    l.line = a;
+    tokenize(&l);
+    freeOutput(&quiet);
+    if (l.err) {
+        free(l.tokens);
+        rebuild(d);
+        return;
+    }
+
+    // Newlines in the old and new text of the touched lines start lines a + 1 onwards.
+    int oldLines = last ? b - a : b - a + 1;
+    int newLines = 0;
+    for (long j = from; j < to; j++) newLines += d->src[j] == '\n';
+    int lineDelta = newLines - oldLines;
+    while (d->lineCount + lineDelta > d->lineSize) {
+        d->lineSize *= 2;
+        d->lines = realloc(d->lines, sizeof(long) * d->lineSize);
+    }
+    long *after = d->lines + a + 1 + oldLines;
+    memmove(after + lineDelta, after, sizeof(long) * (d->lineCount - a - 1 - oldLines));
+    d->lineCount += lineDelta;
+    for (int k = a + 1 + newLines; k < d->lineCount; k++) d->lines[k] += grow;
+    int line = a + 1;
+    for (long j = from; j < to; j++) {
+        if (d->src[j] == '\n') d->lines[line++] = j + 1;
+    }
+
+    // Swap the tokens of the touched lines, which include the END tokens when the last line is touched.
+    int ta = firstToken(d, a);
+    int tb = last ? d->tokLength + 1 : firstToken(d, b + 1);
+    int take = last ? l.tokLength + 1 : l.tokLength - 1;
+    int delta = take - (tb - ta);
+    if (d->tokLength + 1 + delta > d->tokSize) {
+        MEM_COUNT(MEM_TOKENS, sizeof(Token) * ((d->tokLength + 1 + delta) * 2 - d->tokSize));
+        d->tokSize = (d->tokLength + 1 + delta) * 2;
+        d->tokens = realloc(d->tokens, sizeof(Token) * d->tokSize);
+    }
+    memmove(d->tokens + tb + delta, d->tokens + tb, sizeof(Token) * (d->tokLength + 1 - tb));
+    memcpy(d->tokens + ta, l.tokens, sizeof(Token) * take);
+    free(l.tokens);
+    d->tokLength += delta;
+    if (lineDelta) {
+        for (int k = ta + take; k < d->tokLength + 1; k++) d->tokens[k].line += lineDelta;
+    }
+    d->relexed = take;
+    d->reparsed = reparse(d, statementAt(d, ta), ta + take, delta, lineDelta);
+}
+
+// Free the document and everything parsed from it.
+void closeDocument(Document *d) {
+    freeTree(d->tree);
+    free(d->src);
+    free(d->lines);
+    free(d->tokens);
+    free(d->starts);
+}
+
+// -----------------
+// Helpers
+// -----------------
+
+// Lex and parse the whole source again, dropping the old tokens and tree.
+void rebuild(Document *d) {
+    d->lineCount = 0;
+    addLine(d, 0);
+    for (long j = 0; j < d->length; j++) {
+        if (d->src[j] == '\n') addLine(d, j + 1);
+    }
+
+    Lexer l;
+    initLexer(&l, d->src, d->length, d->out);
+    tokenize(&l);
+    free(d->tokens);
+    d->tokens = l.tokens;
+    d->tokLength = l.tokLength;
+    d->tokSize = l.tokSize;
+    d->err = l.err;
+    d->relexed = l.tokLength + 1;
+
+    freeTree(d->tree);
+    d->tree = (ParseTree) {0,5,NULL};
+    d->reparsed = reparse(d, 0, 0, 0, 0);
+}
+
+// Parse top level statements starting with statement k, whose first token has not moved, until the tokens
+// end or a statement starts at or after token 'changed' where an old statement started, delta tokens
+// earlier. The old statements in between are freed, the later ones kept with their lines moved by
+// lineDelta. Returns the number of statements parsed.
+int reparse(Document *d, int k, int changed, int delta, int lineDelta) {
+    Lexer l = {.tokens = d->tokens, .out = d->out};
+    Parser p;
+    initParser(&p, &l);
+    int count = d->tree.index;
+    int old = k;
+    int at = k < count ? d->starts[k] : 0;
+    int fresh = 0, size = 0;
+    void **stmts = NULL;
+    int *starts = NULL;
+    while (true) {
+        while (old < count && d->starts[old] + delta < at) old++;
+        if (at >= changed && old < count && d->starts[old] + delta == at) break;
+        if (d->tokens[at].type == END) {
+            old = count;
+            break;
+        }
+        void *stmt = parseStatementAt(&p, at);
+        if (stmt == (void *) -1) {
+            d->err = d->err || p.err;
+            old = count;
+            break;
+        }
+        if (fresh == size) {
+            size = size ? size * 2 : 16;
+            stmts = realloc(stmts, sizeof(void *) * size);
+            starts = realloc(starts, sizeof(int) * size);
+        }
+        stmts[fresh] = stmt;
+        starts[fresh++] = at;
+        at = p.index - 1;
+        if (p.err) {
+            d->err = true;
+            old = count;
+            break;
+        }
+    }
+    endParse(&p);
+
+    // Splice the new statements in place of the old ones they replace.
+    for (int j = k; j < old; j++) freeStmt(d->tree.stmts[j]);
+    int kept = count - old;
+    int total = k + fresh + kept;
+    if (total > d->tree.size || d->tree.stmts == NULL) {
+        d->tree.size = total > 5 ? total * 2 : 5;
+        d->tree.stmts = realloc(d->tree.stmts, sizeof(void *) * d->tree.size);
+    }
+    if (total > d->startSize) {
+        d->startSize = d->tree.size;
+        d->starts = realloc(d->starts, sizeof(int) * d->startSize);
+    }
+    if (kept) {
+        memmove(d->tree.stmts + k + fresh, d->tree.stmts + old, sizeof(void *) * kept);
+        memmove(d->starts + k + fresh, d->starts + old, sizeof(int) * kept);
+    }
+    if (fresh) {
+        memcpy(d->tree.stmts + k, stmts, sizeof(void *) * fresh);
+        memcpy(d->starts + k, starts, sizeof(int) * fresh);
+    }
+    for (int j = k + fresh; j < total; j++) d->starts[j] += delta;
+    if (lineDelta && kept) walkTree((ParseTree) {kept, kept, d->tree.stmts + k + fresh}, shiftLine, &lineDelta);
+    d->tree.index = total;
+    if (total == 0) {
+        free(d->tree.stmts);
+        d->tree.stmts = NULL;
+    }
+    free(stmts);
+    free(starts);
+    return fresh;
+}
+
+// Visitor moving a statement's source line by *data lines.
+void shiftLine(void *node, int scope, int depth, void *data) {
+    int by = *(int *) data;
+    switch (((VarExpr *) node)->s) {
+        case IF:
+        case WHILE:
+            ((IfStmt *) node)->line += by;
+            break;
+        case SHOW:
+        case RETURN:
+        case INVOKE:
+            ((ShowStmt *) node)->line += by;
+            break;
+        case PROC:
+            ((ProcStmt *) node)->line += by;
+            break;
+        case READ:
+            ((ReadStmt *) node)->line += by;
+            break;
+        case VARDEC:
+            ((VarDecStmt *) node)->line += by;
+            break;
+        case VARASSIGN:
+            ((VarAssignStmt *) node)->line += by;
+            break;
+        case STORE:
+            ((StoreStmt *) node)->line += by;
+            break;
+        default:
+            break;
+    }
+}
+
+// Append the offset of a line start to the line table.
+void addLine(Document *d, long start) {
+    if (d->lineCount == d->lineSize) {
+        d->lineSize = d->lineSize ? d->lineSize * 2 : 64;
+        d->lines = realloc(d->lines, sizeof(long) * d->lineSize);
+    }
+    d->lines[d->lineCount++] = start;
+}
+
+// The line holding the byte at pos, or the last line for the end of the source.
+int lineOf(Document *d, long pos) {
+    int lo = 0, hi = d->lineCount - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (d->lines[mid] <= pos) lo = mid;
+        else hi = mid - 1;
+    }
+    return lo;
+}
+
+// Index of the first token on or after a line, not counting the END tokens.
+int firstToken(Document *d, int line) {
+    int lo = 0, hi = d->tokLength - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (d->tokens[mid].line < line) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// The last top level statement starting at or before a token, 0 when there are none.
+int statementAt(Document *d, int token) {
+    int lo = 0, hi = d->tree.index - 1;
+    if (hi < 0) return 0;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (d->starts[mid] <= token) lo = mid;
+        else hi = mid - 1;
+    }
+    return lo;
+}
@@ -0,0 +1,44 @@
+#ifndef DOCUMENT_H
+#define DOCUMENT_H
+
+#include <stdbool.h>
+#include "parser.h"
+
+// -----------------
+// Public Objects
+// -----------------
+
+// A source kept lexed and parsed across text edits, for editors that check a program on every keystroke.
+// No token or comment spans a newline, so an edit only re-lexes the lines it touches, and only the top
+// level statements overlapping the changed tokens are parsed again. Every other statement keeps its subtree.
+// lines holds the offset of the start of each line and starts the first token of each top level statement.
+// tokens ends with the END token and its copy, as tokenize leaves them. relexed and reparsed count the
+// tokens lexed and the statements parsed by the last edit. After an error the next edit starts from scratch.
+typedef struct Document {
+    char *src;
+    long length;
+    long size;
+    long *lines;
+    int lineCount;
+    int lineSize;
+    Token *tokens;
+    int tokLength;
+    int tokSize;
+    ParseTree tree;
+    int *starts;
+    int startSize;
+    bool err;
+    Output *out;
+    int relexed;
+    int reparsed;
+} Document;
+
+// -----------------
+// Public Functions
+// -----------------
+
+void openDocument(Document *d, const char *src, long len, Output *out);
+void editDocument(Document *d, long start, long end, const char *text, long len);
+void closeDocument(Document *d);
+
+#endif
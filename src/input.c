@@ -0,0 +1,238 @@
+// Input for the read statements of the CAM programming langauge.
+// Items are runs of bytes between blanks or commas. A regular file is mapped whole and anything else,
+// a pipe or terminal, is read through a large buffer, moving a part read item to the front before
+// the next read. Numbers are converted by hand: digits are gathered into a 64 bit mantissa and scaled
+// by an exact power of ten, which is correctly rounded for up to 19 digits and powers up to 22. Only
+// longer numbers or bigger powers are copied out and handed to strtod.
+
+#include "input.h"
+#include "memstats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// -----------------
+// Private Functions
+// -----------------
+
+InputStatus nextItem(Input *in, const char **item, long *len);
+bool refill(Input *in);
+bool isBlank(char c);
+InputStatus parseNumber(const char *s, long len, double *value, long long *integer, bool *exact);
+
+// -----------------
+// Main Funcs
+// -----------------
+
+// Open a file, or standard input for "-". Returns false when the file cannot be opened.
+bool openInput(Input *in, const char *path) {
+    *in = (Input) {NULL, 0, 0, NULL, 0, 0, false, false, 0};
+    if (strcmp(path, "-")) {
+        in->fd = open(path, O_RDONLY);
+        if (in->fd == -1) return false;
+    }
+    struct stat st;
+    if (fstat(in->fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        in->ended = true;
+        if (st.st_size == 0) return true;
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, in->fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            in->data = map;
+            in->length = st.st_size;
+            in->mapped = true;
+            return true;
+        }
+        in->ended = false;
+    }
+    return true;
+}
+
+// Take input from len bytes of memory, which must outlive the input.
+void memoryInput(Input *in, const char *data, long len) {
+    *in = (Input) {data, 0, len, NULL, 0, -1, false, true, 0};
+}
+
+// Whether only blanks are left.
+bool atInputEnd(Input *in) {
+    while (true) {
+        while (in->pos < in->length && isBlank(in->data[in->pos])) in->pos++;
+        if (in->pos < in->length || !refill(in)) return in->pos == in->length;
+    }
+}
+
+// Read the next item as a number. An item written without '.' or an exponent that fits 64 bits is an
+// exact integer, as a literal would be, otherwise value holds the nearest double.
+InputStatus readNumber(Input *in, double *value, long long *integer, bool *exact) {
+    const char *item;
+    long len;
+    InputStatus status = nextItem(in, &item, &len);
+    if (status != INPUT_OK) return status;
+    return parseNumber(item, len, value, integer, exact);
+}
+
+// Read the next item as 'true' or 'false'.
+InputStatus readBool(Input *in, bool *value) {
+    const char *item;
+    long len;
+    InputStatus status = nextItem(in, &item, &len);
+    if (status != INPUT_OK) return status;
+    if (len == 4 && !memcmp(item, "true", 4)) {
+        *value = true;
+    } else if (len == 5 && !memcmp(item, "false", 5)) {
+        *value = false;
+    } else {
+        return INPUT_BAD;
+    }
+    return INPUT_OK;
+}
+
+// How many bytes of the input have been taken.
+long inputOffset(Input *in) {
+    return in->base + in->pos;
+}
+
+// Take the input up to offset bytes from its start without reading items, reading a pipe as far as
+// needed. Returns false when the input is shorter.
+bool skipInput(Input *in, long offset) {
+    while (in->base + in->length < offset) {
+        in->pos = in->length;
+        if (!refill(in)) return false;
+    }
+    in->pos = offset - in->base;
+    return true;
+}
+
+// Unmap or free what the input holds and close its file. Standard input is left open.
+void closeInput(Input *in) {
+    if (in->mapped) munmap((void *) in->data, in->length);
+    free(in->buffer);
+    if (in->fd > 0) close(in->fd);
+}
+
+// -----------------
+// Helpers
+// -----------------
+
+// Find the next item, which stays in place until the input is read again.
+InputStatus nextItem(Input *in, const char **item, long *len) {
+    if (atInputEnd(in)) return INPUT_END;
+    long end = in->pos;
+    while (true) {
+        while (end < in->length && !isBlank(in->data[end])) end++;
+        if (end < in->length) break;
+        long taken = end - in->pos;
+        if (!refill(in)) break;
+        end = in->pos + taken;
+    }
+    *item = in->data + in->pos;
+    *len = end - in->pos;
+    in->pos = end;
+    return INPUT_OK;
+}
+
+// Move the bytes not taken yet to the front of the buffer and read more after them.
+// Returns false when nothing more can be read, or the buffer is full of one item.
+bool refill(Input *in) {
+    if (in->ended) return false;
+    if (in->buffer == NULL) {
+        in->size = INPUT_BUFFER;
+        in->buffer = malloc(in->size);
+        in->data = in->buffer;
+        MEM_COUNT(MEM_RUNTIME, in->size);
+    }
+    long kept = in->length - in->pos;
+    if (kept == in->size) return false;
+    memmove(in->buffer, in->buffer + in->pos, kept);
+    in->base += in->pos;
+    in->pos = 0;
+    in->length = kept;
+    while (true) {
+        ssize_t n = read(in->fd, in->buffer + kept, in->size - kept);
+        if (n > 0) {
+            in->length += n;
+            return true;
+        }
+        if (n == -1 && errno == EINTR) continue;
+        in->ended = true;
+        return false;
+    }
+}
+
+// Whether a byte separates items.
+bool isBlank(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == ',' || c == '\v' || c == '\f';
+}
+
+// Convert an optionally signed decimal number with an optional fraction and exponent.
+InputStatus parseNumber(const char *s, long len, double *value, long long *integer, bool *exact) {
+    static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    long k = 0;
+    bool negative = false;
+    if (k < len && (s[k] == '-' || s[k] == '+')) negative = s[k++] == '-';
+
+    // Up to 19 significant digits fit the mantissa, later ones only move the point or are dropped.
+    unsigned long long mantissa = 0;
+    int digits = 0, scale = 0;
+    bool any = false, dropped = false, whole = true;
+    for (; k < len && s[k] >= '0' && s[k] <= '9'; k++) {
+        any = true;
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (s[k] - '0');
+            digits += mantissa != 0;
+        } else {
+            scale++;
+            dropped = true;
+        }
+    }
+    if (k < len && s[k] == '.') {
+        whole = false;
+        for (k++; k < len && s[k] >= '0' && s[k] <= '9'; k++) {
+            any = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (s[k] - '0');
+                digits += mantissa != 0;
+                scale--;
+            } else if (s[k] != '0') {
+                dropped = true;
+            }
+        }
+    }
+    if (!any) return INPUT_BAD;
+    if (k < len && (s[k] == 'e' || s[k] == 'E')) {
+        bool down = false;
+        int exponent = 0;
+        whole = false;
+        k++;
+        if (k < len && (s[k] == '-' || s[k] == '+')) down = s[k++] == '-';
+        if (k == len || s[k] < '0' || s[k] > '9') return INPUT_BAD;
+        for (; k < len && s[k] >= '0' && s[k] <= '9'; k++) {
+            if (exponent < 100000) exponent = exponent * 10 + (s[k] - '0');
+        }
+        scale += down ? -exponent : exponent;
+    }
+    if (k != len) return INPUT_BAD;
+
+    *exact = whole && !dropped && mantissa <= (negative ? 9223372036854775808ull : 9223372036854775807ull);
+    if (*exact) {
+        *integer = negative ? (long long) (0 - mantissa) : (long long) mantissa;
+        *value = (double) *integer;
+        return INPUT_OK;
+    }
+    if (!dropped && mantissa < (1ull << 53) && scale >= -22 && scale <= 22) {
+        double v = scale < 0 ? (double) mantissa / powers[-scale] : (double) mantissa * powers[scale];
+        *value = negative ? -v : v;
+        return INPUT_OK;
+    }
+    if (len >= ITEM_LIMIT) return INPUT_BAD;
+    char text[ITEM_LIMIT];
+    memcpy(text, s, len);
+    text[len] = '\0';
+    *value = strtod(text, NULL);
+    return INPUT_OK;
+}
@@ -0,0 +1,50 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdbool.h>
+
+// -----------------
+// Public Objects
+// -----------------
+
+// Bytes read from a pipe or terminal at a time. Regular files are mapped whole instead.
+#define INPUT_BUFFER 1048576
+
+// Longest item handed to strtod when a number is off the fast path.
+#define ITEM_LIMIT 4096
+
+// What reading the next item of input found.
+typedef enum InputStatus {
+    INPUT_OK, INPUT_END, INPUT_BAD
+} InputStatus;
+
+// The values read statements take: numbers and bools separated by blanks. The bytes pos .. length - 1
+// of data are not taken yet. data is a mapped file, memory handed in or buffer, which is refilled from
+// fd until a read finds nothing more and ended is set. base counts the bytes refills dropped from the
+// front of buffer, so base + pos bytes of the input have been taken.
+typedef struct Input {
+    const char *data;
+    long pos;
+    long length;
+    char *buffer;
+    long size;
+    int fd;
+    bool mapped;
+    bool ended;
+    long base;
+} Input;
+
+// -----------------
+// Public Functions
+// -----------------
+
+bool openInput(Input *in, const char *path);
+void memoryInput(Input *in, const char *data, long len);
+bool atInputEnd(Input *in);
+InputStatus readNumber(Input *in, double *value, long long *integer, bool *exact);
+InputStatus readBool(Input *in, bool *value);
+long inputOffset(Input *in);
+bool skipInput(Input *in, long offset);
+void closeInput(Input *in);
+
+#endif
@@ -1,328 +1,1706 @@
 // Interpreter for the CAM programming langauge.
 
 #include "interpreter.h"
+#include "cache.h"
+#include "memstats.h"
+#include "perfcount.h"
+#include "optimiser.h"
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// A task of a parallel segment: an interpreter of its own over copies of the slots it uses, running the
+// top level statements the plan gives it with its messages and shown values buffered in out and shows.
+// ends holds where out and shows stood after each of its statements, done of them having run.
+typedef struct Task {
+    Interpreter i;
+    Output out;
+    Output shows;
+    int index;
+    int *slots;
+    int slotCount;
+    long *ends;
+    int done;
+    int merged;
+} Task;
+
+// The tasks of a segment, taken in order by the threads running them. failed is the first top level
+// statement that stopped with an error, INT_MAX until one has, and tasks give up at their next back edge
+// in a later statement.
+typedef struct TaskPool {
+    Interpreter *from;
+    Segment *segment;
+    Task *tasks;
+    int count;
+    int next;
+    int failed;
+} TaskPool;
 
 // -----------------
 // Private Functions
 // -----------------
 
-void interpret(Interpreter *i);
-Lit interpretStmt(Interpreter *i, void *stmt);
-void assignSymbol(Interpreter *i, char *id, Lit v);
-Symbol lookupSymbol(Interpreter *i, char *id);
-Lit getValueFromString(char *v);
-Lit binOpCases(Interpreter *i, char *op, Lit left, Lit right);
-void initInterpreter(Interpreter *i, Parser *p);
-SymCodes checkSymbol(SymbolTable *t, Symbol s);
-void addSymbol(Interpreter *i, Symbol s);
-void iError(Interpreter *i, char *msg, Token tok);
+bool runBlock(Interpreter *i, int pc, int end);
+bool runFrames(Interpreter *i, int f, Frame at);
+void runPlan(Interpreter *i);
+bool runTasks(Interpreter *i, Segment *s);
+void *taskWorker(void *arg);
+void runTask(TaskPool *pool, Task *t);
+void mergeSlots(Interpreter *i, Task *t);
+Lit callProc(Interpreter *i, Node *node, Lit *args);
+void checkArgs(Interpreter *i, Node *at, Node *head, Lit *args, int argc);
+void leaveCall(Interpreter *i);
+void growLocals(Interpreter *i, int count);
+long startBudget(Interpreter *i, long steps);
+long checkBudget(Interpreter *i, Node *loop, long steps);
+long nextWindow(Interpreter *i, long steps);
+void outputLimit(Interpreter *i, int at);
+double monotonicSeconds(void);
+Lit runExpr(Interpreter *i, int start, int root);
+Lit errorTail(Interpreter *i, int k, Lit *sp, int root);
+void finishError(Interpreter *i);
+Lit resumeExpr(Interpreter *i, int start, int at, int root);
+Lit literalValue(Interpreter *i, Node *node);
+Lit notValue(Interpreter *i, Node *node, Lit r);
+void assignSymbol(Interpreter *i, int slot, Node *node, Lit v);
+void readInput(Interpreter *i, Node *node);
+void traceStore(Interpreter *i, Node *node, Lit old, Lit v, int element);
+Lit lookupSymbol(Interpreter *i, int slot, Node *node);
+Lit binOpCases(Interpreter *i, Node *expr, Lit left, Lit right);
+Lit induction(Interpreter *i, Node *ind);
+char *nodeText(Interpreter *i, Node *node);
+Lit boxWide(Interpreter *i, long long n);
+void collectWides(Interpreter *i);
+void keepWide(Interpreter *i, Lit *v, long long *to, int *moved, int *count);
+void addSymbol(Interpreter *i, int slot, Type type, int length);
+void assignArray(Interpreter *i, int slot, Lit v);
+Lit arrayBinOp(Interpreter *i, Node *expr, Lit left, Lit right);
+Lit loadElement(Interpreter *i, Node *node, Lit index);
+Lit storeElement(Interpreter *i, Node *node, Lit index, Lit v);
+int elementIndex(Interpreter *i, Lit index, int length);
+Lit reduceValue(Interpreter *i, Node *node, Lit v);
+void showArray(Interpreter *i, Lit v);
+void showValue(Interpreter *i, Node *node, Lit val);
+void writeDoubles(Output *o, const double *d, int count);
+void putWord(char *to, uint32_t v);
+void showCell(Interpreter *i, int column, Lit val);
+void showHeader(Interpreter *i);
+void endRow(Interpreter *i);
+Lit newArray(Interpreter *i, int length);
+void iError(Interpreter *i, char *msg, char *id);
+Lit iRaise(Interpreter *i, char *msg, Node *node, Lit value);
+Lit iRaiseId(Interpreter *i, char *msg, char *id, Node *node, Lit value);
+void iErrorId(Interpreter *i, char *msg, char *id);
 
 // -----------------
 // Main Funcs
 // -----------------
 
-// Initialise the interpreter, symbol table and environment objects.
-void initInterpreter(Interpreter *i, Parser *p) {
-    i->err = p->err;
-    i->tree = p->tree;
-    SymbolTable s = {8, 0, NULL};
-    s.syms = malloc(sizeof(Symbol)*s.size);
-    i->env = (Environment) {0, s};
+// Initialise the interpreter and an environment with one slot per symbol in the resolved table.
+// With procedures the value stack and the frames have room for every call level.
+void initInterpreter(Interpreter *i, CompactTree *code, SymbolTable *table, Output *out) {
+    int levels = table->procCount ? CALL_LIMIT + 1 : 1;
+    long stack = (long) (code->stackDepth ? code->stackDepth : 1) * levels;
+    long frames = (long) (code->blockDepth ? code->blockDepth : 1) * levels;
+    i->err = false;
+    i->limits = (Limits) {0, 0, 0, 0};
+    i->code = code;
+    i->nodes = code->nodes;
+    i->table = table;
+    i->out = out;
+    i->env.size = table->index;
+    i->env.slots = calloc(table->index ? table->index : 1, sizeof(Slot));
+    i->temps = calloc(table->temps ? table->temps : 1, sizeof(Temp));
+    i->stack = calloc(stack, sizeof(Lit));
+    i->frames = malloc(sizeof(Frame) * frames);
+    MEM_COUNT(MEM_SYMBOLS, sizeof(Slot) * (table->index ? table->index : 1));
+    MEM_COUNT(MEM_RUNTIME, sizeof(Temp) * (table->temps ? table->temps : 1));
+    MEM_COUNT(MEM_RUNTIME, sizeof(Lit) * stack);
+    MEM_COUNT(MEM_RUNTIME, sizeof(Frame) * frames);
+    i->wides = NULL;
+    i->wideCount = 0;
+    i->wideSize = 0;
+    i->arrays = NULL;
+    i->arrayCount = table->index;
+    i->arraySize = 0;
+    i->globals = i->env.slots;
+    i->program = table;
+    i->locals = NULL;
+    i->localTop = i->localSize = 0;
+    i->frameAt = -1;
+    i->calls = table->procCount ? malloc(sizeof(Call) * CALL_LIMIT) : NULL;
+    i->callDepth = 0;
+    i->base = 0;
+    i->arrayFloor = table->index;
+    i->result = LIT_UNKNOWN;
+    i->errInlined = false;
+    i->in = NULL;
+    i->shows = out;
+    i->format = SHOW_TEXT;
+    i->tagLines = false;
+    i->cellAt = i->cellEnd = NULL;
+    i->trace = NULL;
+    i->plan = NULL;
+    i->threads = 1;
+    i->stopAt = NULL;
+    i->at = 0;
+    i->checkpoint = NULL;
+    i->saveDue = false;
+    initTier(&i->tier, code, TIER_HOT);
+}
+
+// Send shown values to shows in a format, each tagged with its line when tagLines is set. A CSV
+// header is written straight away.
+void setShowFormat(Interpreter *i, Output *shows, ShowFormat format, bool tagLines) {
+    i->shows = shows;
+    i->format = format;
+    i->tagLines = tagLines;
+    if (format == SHOW_CSV && i->cellAt == NULL) {
+        int columns = i->code->showCount ? i->code->showCount : 1;
+        i->cellAt = malloc(sizeof(long) * columns);
+        i->cellEnd = malloc(sizeof(long) * columns);
+        MEM_COUNT(MEM_RUNTIME, sizeof(long) * 2 * columns);
+        for (int c = 0; c < columns; c++) i->cellAt[c] = -1;
+        initOutput(&i->cells, NULL);
+        showHeader(i);
+    }
 }
 
-// Interpret statements in order.
+// Interpret the program. The first error unwinds back here and stops the program, so nothing on the way
+// checks for errors. However deep in calls it stopped, the program's own slots are current afterwards.
+// A run resumed from a checkpoint carries on in the block and frames it was saved in.
 void interpret(Interpreter *i) {
-    for (int j = 0; j < i->tree.index; j++) {
-        if (i->err) return;
-        interpretStmt(i, i->tree.stmts[j]);
-    }
-}
-
-// Interpret a single statement.
-Lit interpretStmt(Interpreter *i, void *stmt) {
-    if (i->err) return (Lit) {UNKNOWN, 0};
-    Stmt s = ((VarExpr *) stmt)->s;
-    switch (s) {
-        case IF: {
-            i->env.currentScope++;
-            if (interpretStmt(i, ((IfStmt *) stmt)->cond).value && !i->err) {
-                for (int j = 0; j < ((IfStmt *) stmt)->trueBranch.index; j++) {
-                    interpretStmt(i, ((IfStmt *) stmt)->trueBranch.stmts[j]);
+    Checkpoint *cp = i->checkpoint;
+    i->steps = cp != NULL && cp->resumed ? cp->steps : i->code->top;
+    i->fuel = startBudget(i, i->steps);
+    if (i->err) return;
+    i->errInlined = false;
+    if (setjmp(i->trap)) {
+        if (i->trace != NULL) TRACE_EVENT(i->trace, TRACE_ERROR, i->errAt, 0, 0, 0, 0);
+        finishError(i);
+        while (i->callDepth) leaveCall(i);
+    } else if (i->plan != NULL) {
+        runPlan(i);
+    } else if (cp != NULL && cp->resumed) {
+        runFrames(i, cp->frameCount, (Frame) {cp->pc, cp->end, cp->loop});
+    } else {
+        runBlock(i, 0, i->code->top);
+    }
+    if (i->format == SHOW_CSV) endRow(i);
+}
+
+// Run the statements pc .. end - 1 of the program or of a procedure body. Returns true when a return ran,
+// its value left in result.
+bool runBlock(Interpreter *i, int pc, int end) {
+    return runFrames(i, 0, (Frame) {pc, end, -1});
+}
+
+// Run the block at with f frames of the blocks enclosing it already saved. The block being run is held
+// in pc, end and loop, and the blocks enclosing it are saved on the frames of the current call.
+// Statements are counted a block at a time as blocks are entered and the limits are only looked at
+// once fuel back edges have been taken. A checkpoint falling due is written at the next back edge
+// outside any call. Returns true when a return ran, its value left in result.
+bool runFrames(Interpreter *i, int f, Frame at) {
+    Node *nodes = i->nodes;
+    Frame *frames = i->frames + i->callDepth * i->code->blockDepth;
+    int pc = at.pc;
+    int end = at.end;
+    int loop = at.loop;
+    while (true) {
+        if (pc == end) {
+            if (loop != -1) {
+                Node *w = nodes + loop;
+                Lit test = runExpr(i, w->a, w->b - 1);
+                bool taken = IS_TRUE(i, test);
+                if (i->trace != NULL) TRACE_EVENT(i->trace, TRACE_BRANCH, loop, taken, 0, 0, 0);
+                if (taken) {
+                    pc = w->b;
+                    i->steps += w->c;
+                    if (--i->fuel == 0) refuel(i, w);
+                    if (i->saveDue && i->callDepth == 0) saveCheckpoint(i, f, pc, end, loop);
+                    if (i->tier.hits != NULL && (i->tier.hits[loop] < 0 || ++i->tier.hits[loop] >= i->tier.after)) {
+                        TierExit *e = enterTier(i, loop);
+                        if (e != NULL) {
+                            memcpy(frames + f, e->frames, sizeof(Frame) * e->frameCount);
+                            f += e->frameCount;
+                            pc = e->pc;
+                            end = e->end;
+                            loop = e->loop;
+                        }
+                    }
+                    continue;
                 }
             }
-            i->env.currentScope--;
-            break;
+            if (f == 0) return false;
+            f--;
+            pc = frames[f].pc;
+            end = frames[f].end;
+            loop = frames[f].loop;
+            continue;
         }
-        case WHILE: {
-            i->env.currentScope++;
-            while (interpretStmt(i, ((WhileStmt *) stmt)->cond).value && !i->err) {
-                for (int j = 0; j < ((WhileStmt *) stmt)->trueBranch.index; j++) {
-                    interpretStmt(i, ((WhileStmt *) stmt)->trueBranch.stmts[j]);
+        int at = pc++;
+        Node *node = nodes + at;
+        while (node->tag == HOIST) {
+            for (int t = node->b; t < node->b + node->c; t++) i->temps[t].valid = false;
+            at = node->a;
+            node = nodes + at;
+        }
+        if (i->trace != NULL) TRACE_EVENT(i->trace, TRACE_STMT, at, 0, 0, 0, 0);
+        switch (node->tag) {
+            case IF:
+            case WHILE: {
+                Lit test = runExpr(i, node->a, node->b - 1);
+                bool taken = IS_TRUE(i, test);
+                if (i->trace != NULL) TRACE_EVENT(i->trace, TRACE_BRANCH, at, taken, 0, 0, 0);
+                if (taken) {
+                    frames[f++] = (Frame) {pc, end, loop};
+                    pc = node->b;
+                    end = node->b + node->c;
+                    loop = node->tag == WHILE ? at : -1;
+                    i->steps += node->c;
+                    if (loop == at && i->tier.hits != NULL && i->tier.hits[at] < 0) {
+                        TierExit *e = enterTier(i, at);
+                        if (e != NULL) {
+                            memcpy(frames + f, e->frames, sizeof(Frame) * e->frameCount);
+                            f += e->frameCount;
+                            pc = e->pc;
+                            end = e->end;
+                            loop = e->loop;
+                        }
+                    }
                 }
+                break;
             }
-            i->env.currentScope--;
-            break;
+            case SHOW: {
+                showResult(i, at, runExpr(i, node->b, node->a));
+                break;
+            }
+            case VARDEC: {
+                addSymbol(i, node->a, node->op, node->b);
+                break;
+            }
+            case VARASSIGN: {
+                Lit val = runExpr(i, node->c, node->b);
+                assignSymbol(i, node->a, node, val);
+                break;
+            }
+            case STORE: {
+                runExpr(i, node->c, node->b);
+                break;
+            }
+            case READ: {
+                readInput(i, node);
+                break;
+            }
+            case RETURN: {
+                i->result = runExpr(i, node->b, node->a);
+                return true;
+            }
+            case INVOKE: {
+                runExpr(i, node->b, node->a);
+                break;
+            }
+            case PROC: {
+                if (node->flags & NODE_REDECLARED) iError(i, "Procedure already declared.", nodeText(i, node));
+                break;
+            }
+            default:
+                break;
         }
-        case SHOW: {
-            Lit val = interpretStmt(i, ((ShowStmt *) stmt)->expr);
-            if (i->err) return (Lit) {UNKNOWN, 0};
-            //printf("%d\n", val.type);
-            if (val.type == NUM) {
-                printf("%f\n", val.value);
-            } else {
-                if (val.value) {
-                    printf("true\n");
+    }
+}
+
+// -----------------
+// Procedures
+// -----------------
+
+// Call the procedure of a CALL node on the arguments at args. The procedure gets a frame of its own on
+// the locals stack, its parameters bound in their slots, and runs its body with the value stack from
+// args. A call without a return has no value, which is only an error when the value is used.
+Lit callProc(Interpreter *i, Node *node, Lit *args) {
+    if (node->a == -1) return iRaise(i, "Procedure not declared.", node, LIT_UNKNOWN);
+    Procedure *proc = &i->program->procs[node->a];
+    Node *head = i->nodes + i->code->procs[node->a];
+    if (node->b != proc->params) return iRaise(i, "Wrong number of arguments.", node, LIT_UNKNOWN);
+    checkArgs(i, node, head, args, node->b);
+    if (i->callDepth == CALL_LIMIT) return iRaise(i, "Call depth limit exceeded.", node, LIT_UNKNOWN);
+    if (--i->fuel == 0) refuel(i, node);
+    i->steps += head->c;
+
+    int size = proc->frame.index;
+    if (i->locals == NULL || i->localTop + size > i->localSize) growLocals(i, i->localTop + size);
+    i->calls[i->callDepth++] = (Call) {i->frameAt, i->table, i->base, i->arrayFloor};
+    i->frameAt = i->localTop;
+    i->localTop += size;
+    Slot *slots = i->locals + i->frameAt;
+    memset(slots, 0, sizeof(Slot) * size);
+    for (int k = 0; k < node->b; k++) {
+        Node *param = i->nodes + head->a + k;
+        slots[param->a] = (Slot) {true, param->op, args[k]};
+    }
+    i->env.slots = slots;
+    i->table = &proc->frame;
+    i->base = args - i->stack;
+    i->arrayFloor = i->arrayCount;
+    bool returned = runBlock(i, head->b, head->b + head->c);
+    leaveCall(i);
+    if (returned) return i->result;
+    if (node->flags & NODE_DISCARD) return LIT_UNKNOWN;
+    return iRaise(i, "Procedure returned no value.", node, LIT_UNKNOWN);
+}
+
+// Check the argument values of a call or inlined call at node against the parameter types of the
+// procedure whose PROC node is head.
+void checkArgs(Interpreter *i, Node *at, Node *head, Lit *args, int argc) {
+    for (int k = 0; k < argc; k++) {
+        Node *param = i->nodes + head->a + k;
+        if (param->op == NUM ? !IS_NUM(args[k]) : !IS_BOOL(args[k])) {
+            iRaiseId(i, "Type mismatch", nodeText(i, param), at, LIT_UNKNOWN);
+            return;
+        }
+    }
+}
+
+// Return from the innermost call to what its caller was running with.
+void leaveCall(Interpreter *i) {
+    Call *c = &i->calls[--i->callDepth];
+    i->localTop = i->frameAt;
+    i->frameAt = c->frame;
+    i->env.slots = c->frame == -1 ? i->globals : i->locals + c->frame;
+    i->table = c->table;
+    i->base = c->base;
+    i->arrayFloor = c->arrayFloor;
+}
+
+// Make room for count slots on the locals stack. Frames are found by their offset, so moving them is safe.
+void growLocals(Interpreter *i, int count) {
+    int size = i->localSize ? i->localSize : 64;
+    while (size < count) size *= 2;
+    MEM_COUNT(MEM_RUNTIME, sizeof(Slot) * (size - i->localSize));
+    i->locals = realloc(i->locals, sizeof(Slot) * size);
+    i->localSize = size;
+}
+
+// -----------------
+// Budgets
+// -----------------
+
+// Start measuring a run that has counted steps statements against the limits and return the number
+// of back edges before the first check, LONG_MAX when nothing is limited or checkpointed. A resumed run
+// counts the back edges and output of the run it carries on.
+long startBudget(Interpreter *i, long steps) {
+    Limits *l = &i->limits;
+    Checkpoint *cp = i->checkpoint;
+    bool saving = cp != NULL && cp->path != NULL;
+    if (!l->statements && !l->iterations && !l->seconds && !l->output && !saving) return LONG_MAX;
+    bool resumed = cp != NULL && cp->resumed;
+    i->budget.iterations = resumed ? cp->iterations : 0;
+    i->budget.deadline = l->seconds ? monotonicSeconds() + l->seconds : 0;
+    i->budget.output = i->shows->total - (resumed ? cp->shown : 0);
+    i->budget.seen = i->shows->total;
+    return nextWindow(i, steps);
+}
+
+// Check the limits once the fuel runs out at the back edge or call at node, stopping the run when one
+// has been exceeded.
+// A parallel task only looks at whether an earlier statement has failed, and gives up quietly if so.
+void refuel(Interpreter *i, Node *node) {
+    if (i->stopAt != NULL) {
+        if (__atomic_load_n(i->stopAt, __ATOMIC_RELAXED) < i->at) longjmp(i->trap, 1);
+        i->fuel = BUDGET_WINDOW;
+        return;
+    }
+    i->fuel = checkBudget(i, node, i->steps);
+    if (i->fuel == 0) {
+        i->errAt = -1;
+        longjmp(i->trap, 1);
+    }
+}
+
+// Called when a window of back edges has been taken, the last one by loop, with steps statements run.
+// Returns the size of the next window, or 0 after reporting the limit that was exceeded.
+long checkBudget(Interpreter *i, Node *loop, long steps) {
+    Limits *l = &i->limits;
+    Budget *b = &i->budget;
+    b->iterations += b->window;
+    char *msg = NULL;
+    if (l->iterations && b->iterations > l->iterations) {
+        msg = "Loop iteration limit exceeded.";
+    } else if (l->statements && steps > l->statements) {
+        msg = "Statement limit exceeded.";
+    } else if (l->output && i->shows->total - b->output > l->output) {
+        msg = "Output limit exceeded.";
+    } else if (l->seconds && monotonicSeconds() > b->deadline) {
+        msg = "Time limit exceeded.";
+    }
+    if (msg != NULL) {
+        i->err = true;
+        outPrintf(i->out, "Error: %s - {line %d}\n", msg, i->code->sources[loop - i->nodes].line + 1);
+        return 0;
+    }
+
+    // A loop that showed nothing for a whole window may run on until a limit stops it, so what was
+    // shown before it goes out now rather than when the run ends.
+    if (i->shows->total == b->seen && i->shows->used) {
+        flushOutput(i->shows);
+        if (i->out != i->shows) flushOutput(i->out);
+    }
+    b->seen = i->shows->total;
+    Checkpoint *cp = i->checkpoint;
+    if (cp != NULL && cp->path != NULL && b->iterations >= cp->next) {
+        i->saveDue = true;
+        cp->next = b->iterations + cp->every;
+    }
+    return nextWindow(i, steps);
+}
+
+// Size the next window of back edges, narrowing it as the iteration and statement limits come near
+// so a run that keeps looping is stopped at the first back edge past either, and as the next checkpoint
+// comes near so it falls due on time. Every back edge runs at least one statement.
+long nextWindow(Interpreter *i, long steps) {
+    Limits *l = &i->limits;
+    Budget *b = &i->budget;
+    Checkpoint *cp = i->checkpoint;
+    b->window = BUDGET_WINDOW;
+    if (cp != NULL && cp->path != NULL && cp->next - b->iterations < b->window) b->window = cp->next - b->iterations;
+    if (l->iterations && l->iterations + 1 - b->iterations < b->window) b->window = l->iterations + 1 - b->iterations;
+    if (l->statements && l->statements + 1 - steps < b->window) b->window = l->statements + 1 - steps;
+    if (b->window < 1) b->window = 1;
+    return b->window;
+}
+
+// Stop a run whose show at node at has just taken its output past the limit, so it overshoots by one
+// value at most rather than by a window of back edges.
+void outputLimit(Interpreter *i, int at) {
+    i->err = true;
+    outPrintf(i->out, "Error: Output limit exceeded. - {line %d}\n", i->code->sources[at].line + 1);
+    i->errAt = -1;
+    longjmp(i->trap, 1);
+}
+
+// Seconds on a clock that only moves forward.
+double monotonicSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Release the environment.
+void freeInterpreter(Interpreter *i) {
+    for (int a = 0; a < i->arraySize; a++) freeArray(&i->arrays[a]);
+    free(i->arrays);
+    free(i->env.slots);
+    free(i->temps);
+    free(i->stack);
+    free(i->frames);
+    free(i->wides);
+    free(i->locals);
+    free(i->calls);
+    freeTier(&i->tier);
+    if (i->cellAt != NULL) {
+        free(i->cellAt);
+        free(i->cellEnd);
+        freeOutput(&i->cells);
+    }
+}
+
+// Evaluate the expression held in nodes start .. root, children before parents, on the value stack
+// from base. The array values of the last expression are dropped first. An error unwinds straight out
+// to interpret.
+Lit runExpr(Interpreter *i, int start, int root) {
+    Node *nodes = i->nodes;
+    Lit *sp = i->stack + i->base;
+    i->arrayCount = i->arrayFloor;
+    for (int k = start; k <= root; k++) {
+        Node *node = nodes + k;
+        switch (node->tag) {
+            case LITERAL: {
+                if ((node->flags & NODE_EXACT) && FITS_INT(node->integer)) {
+                    *sp++ = INT_LIT(node->integer);
                 } else {
-                    printf("false\n");
+                    *sp++ = literalValue(i, node);
                 }
+                break;
             }
-            break;
+            case VAR: {
+                *sp++ = lookupSymbol(i, node->a, node);
+                break;
+            }
+            case ATEND: {
+                *sp++ = BOOL_LIT(i->in == NULL || atInputEnd(i->in));
+                break;
+            }
+            case BINOP: {
+                sp--;
+                sp[-1] = binOpCases(i, node, sp[-1], sp[0]);
+                break;
+            }
+            case UNOP: {
+                sp[-1] = notValue(i, node, sp[-1]);
+                break;
+            }
+            case INDEX: {
+                sp[-1] = loadElement(i, node, sp[-1]);
+                break;
+            }
+            case REDUCE: {
+                sp[-1] = reduceValue(i, node, sp[-1]);
+                break;
+            }
+            case SET: {
+                sp--;
+                sp[-1] = storeElement(i, node, sp[-1], sp[0]);
+                break;
+            }
+            case REUSE: {
+                Temp *t = &i->temps[node->b];
+                if (t->valid) {
+                    *sp++ = t->value;
+                    k = node->a;
+                }
+                break;
+            }
+            case TEMP:
+            case SAVE: {
+                Temp *t = &i->temps[node->b];
+                t->valid = true;
+                t->value = sp[-1];
+                break;
+            }
+            case STEP: {
+                *sp++ = induction(i, nodes + node->a);
+                k = node->a;
+                break;
+            }
+            case CALL: {
+                sp -= node->b;
+                *sp = callProc(i, node, sp);
+                sp++;
+                break;
+            }
+            case ENTER: {
+                checkArgs(i, node, nodes + i->code->procs[node->a], sp - node->b, node->b);
+                break;
+            }
+            case ARG: {
+                *sp = sp[-node->a];
+                sp++;
+                break;
+            }
+            case LEAVE: {
+                sp -= node->a;
+                sp[-1] = sp[node->a - 1];
+                break;
+            }
+            default:
+                break;
         }
-        case VARDEC: {
-            Symbol sym = {i->env.currentScope, ((Token) {0, 0, END, ""}), "", ((VarDecStmt *) stmt)->type};
-            strcpy(sym.tok.lexeme, ((VarDecStmt *) stmt)->id);
-            //printf("%d\n", i->env.currentScope);
-            addSymbol(i, sym);
-            break;
+    }
+    return sp[-1];
+}
+
+// Finish an expression after node k reported an error, with the stack as it was just after k.
+// The nodes enclosing k had already been entered when it happened, so they still apply their
+// operator and may report more, while every other node left yields UNKNOWN without side effects.
+// Values below old on the stack come from nodes entered before the error, which is how an enclosing
+// node is recognised by its first operand. Calls left yield UNKNOWN without running, and an error inside
+// an inlined procedure ends the expression at its LEAVE, as an error inside a called one ends the run.
+Lit errorTail(Interpreter *i, int k, Lit *sp, int root) {
+    Lit *old = sp;
+    for (k++; k <= root; k++) {
+        Node *node = i->nodes + k;
+        switch (node->tag) {
+            case BINOP: {
+                sp--;
+                if (sp - 1 < old) {
+                    sp[-1] = binOpCases(i, node, sp[-1], sp[0]);
+                    old = sp;
+                } else {
+                    sp[-1] = LIT_UNKNOWN;
+                }
+                break;
+            }
+            case UNOP: {
+                if (sp - 1 < old) sp[-1] = notValue(i, node, sp[-1]);
+                break;
+            }
+            case INDEX: {
+                if (sp - 1 < old) sp[-1] = loadElement(i, node, sp[-1]);
+                break;
+            }
+            case REDUCE: {
+                if (sp - 1 < old) sp[-1] = reduceValue(i, node, sp[-1]);
+                break;
+            }
+            case SET: {
+                sp--;
+                if (sp - 1 < old) {
+                    sp[-1] = storeElement(i, node, sp[-1], sp[0]);
+                    old = sp;
+                } else {
+                    sp[-1] = LIT_UNKNOWN;
+                }
+                break;
+            }
+            case SAVE: {
+                if (sp - 1 < old) i->temps[node->b].valid = false;
+                break;
+            }
+            case REUSE:
+            case STEP: {
+                *sp++ = LIT_UNKNOWN;
+                k = node->a;
+                break;
+            }
+            case LITERAL:
+            case VAR:
+            case ARG:
+            case ATEND: {
+                *sp++ = LIT_UNKNOWN;
+                break;
+            }
+            case CALL:
+            case ENTER: {
+                sp -= node->b;
+                *sp++ = LIT_UNKNOWN;
+                if (node->tag == ENTER) k = node->c;
+                break;
+            }
+            case LEAVE: {
+                i->errInlined = true;
+                return sp[-1];
+            }
+            default:
+                break;
         }
+    }
+    return sp[-1];
+}
+
+// Finish the statement the first error unwound from. The expression holding the failed node is
+// completed and an assignment is still attempted, reporting the same follow on errors as evaluating
+// the rest of the statement would. Inside a procedure that is a statement of its body, and the callers
+// are not finished.
+void finishError(Interpreter *i) {
+    if (i->errAt == -1) return;
+    Node *stmt = i->nodes + i->code->sources[i->errAt].stmt;
+    switch (stmt->tag) {
+        case IF:
+        case WHILE:
+            resumeExpr(i, stmt->a, stmt->b - 1, i->errAt);
+            break;
+        case SHOW:
+        case RETURN:
+        case INVOKE:
+            resumeExpr(i, stmt->b, stmt->a, i->errAt);
+            break;
+        case STORE:
+            resumeExpr(i, stmt->c, stmt->b, i->errAt);
+            break;
         case VARASSIGN: {
-            Lit val = interpretStmt(i, ((VarAssignStmt *) stmt)->expr);
-            assignSymbol(i, ((VarAssignStmt *) stmt)->id, val);
+            Lit v = resumeExpr(i, stmt->c, stmt->b, i->errAt);
+            if (!i->errInlined) assignSymbol(i, stmt->a, stmt, v);
             break;
         }
-        case BRACKET: {
-            return interpretStmt(i, ((BracketExpr *) stmt)->expr);
-        }
-        case BINOP: {
-            Lit left = interpretStmt(i, ((BinOpExpr *) stmt)->left);
-            Lit right = interpretStmt(i, ((BinOpExpr *) stmt)->right);
-            return binOpCases(i, ((BinOpExpr *) stmt)->op, left, right);
-        }
-        case UNOP: {
-            Lit r = interpretStmt(i, ((UnOpExpr *) stmt)->right);
-            if (r.type != BOOL) {
-                Token tok = {0,0,END,""};
-                strcpy(tok.lexeme, "!");
-                iError(i, "'!' does not support non BOOL values.", tok);
-            } else if (!strcmp(((UnOpExpr *) stmt)->op, "!")) {
-                return (Lit) {BOOL, !(r.value)};    
-            }
+        default:
             break;
+    }
+}
+
+// Rebuild the value stack of the expression start .. root as it was when node at failed and finish it.
+// Values of the nodes before at are still on the stack, apart from the multiplication an INDUCT
+// skips, whose operands had not been evaluated and read as UNKNOWN. The failed node leaves errValue,
+// a failed ENTER for the whole inlined call.
+Lit resumeExpr(Interpreter *i, int start, int root, int at) {
+    Node *nodes = i->nodes;
+    Lit *sp = i->stack + i->base;
+    bool skipped = false;
+    for (int k = start; k < at; k++) {
+        switch (nodes[k].tag) {
+            case LITERAL:
+            case VAR:
+            case ARG:
+            case ATEND:
+                if (skipped) *sp = LIT_UNKNOWN;
+                sp++;
+                break;
+            case BINOP:
+                sp--;
+                break;
+            case CALL:
+                sp -= nodes[k].b - 1;
+                break;
+            case LEAVE:
+                sp -= nodes[k].a;
+                break;
+            case REUSE:
+            case STEP:
+                if (at > nodes[k].a) {
+                    sp++;
+                    k = nodes[k].a;
+                } else if (nodes[k].tag == STEP) {
+                    skipped = true;
+                }
+                break;
+            default:
+                break;
         }
-        case LITERAL: {
-            return getValueFromString(((LiteralExpr *) stmt)->val);
-        }
-        case VAR: {
-            Symbol symbol = lookupSymbol(i, ((VarExpr *) stmt)->id);
-            if (symbol.type == UNKNOWN) return (Lit) {UNKNOWN, 0};
-            return getValueFromString(symbol.value);
-        }
+    }
+    switch (nodes[at].tag) {
+        case VAR:
+            sp++;
+            break;
+        case BINOP:
+        case SET:
+            sp--;
+            break;
+        case CALL:
+        case ENTER:
+            sp -= nodes[at].b - 1;
+            break;
         default:
             break;
-     }
-     return (Lit) {UNKNOWN, 0};
+    }
+    sp[-1] = i->errValue;
+    return errorTail(i, nodes[at].tag == ENTER ? nodes[at].c : at, sp, root);
+}
+
+// Value of a literal node.
+Lit literalValue(Interpreter *i, Node *node) {
+    if (!(node->flags & NODE_EXACT)) return node->op == BOOL ? BOOL_LIT(node->value) : doubleLit(node->value);
+    return FITS_INT(node->integer) ? INT_LIT(node->integer) : boxWide(i, node->integer);
+}
+
+// Apply the '!' of node to a value.
+Lit notValue(Interpreter *i, Node *node, Lit r) {
+    if (!IS_BOOL(r)) return iRaise(i, "'!' does not support non BOOL values.", node, LIT_UNKNOWN);
+    return r ^ 1;
 }
 
 // ------------------
 // Symbol table Funcs
 // ------------------
 
-// Assign a value to an existing symbol.
-void assignSymbol(Interpreter *i, char *id, Lit v) {
-    for (int k = i->env.currentScope ; k >= 0; k--) {
-        for (int j = 0; j<i->env.table.index; j++) {
-            Symbol cs = i->env.table.syms[j];
-            if (!strcmp(cs.tok.lexeme, id) && cs.scope == k) {
-                if (cs.type != v.type) {
-                    iError(i, "Type mismatch", cs.tok);
-                    return;
-                }
-                char buf[30];
-                if (cs.type != BOOL) {
-                    strcpy(cs.value, gcvt(v.value, 11, buf));
-                } else {
-                    if (v.value) {
-                        strcpy(cs.value, "true");
-                    } else {
-                        strcpy(cs.value, "false");
-                    }
-                }
-                i->env.table.syms[j] = cs;
-                return;
-            }
-        }
+// Follow a resolved slot outwards to the innermost one that has been declared, or -1.
+int declaredSlot(Interpreter *i, int slot) {
+    while (slot != -1 && !i->env.slots[slot].declared) {
+        slot = i->table->syms[slot].outer;
     }
-    Token tok = (Token) {-1, -1, END, ""};
-    strcpy(tok.lexeme, id);
-    iError(i, "Variable not declared.", tok);
+    return slot;
 }
 
-// Retrieve a symbol from the symbol table.
-Symbol lookupSymbol(Interpreter *i, char *id) {
-    for (int k = i->env.currentScope ; k >= 0; k--) {
-        for (int j = 0; j<i->env.table.index; j++) {
-            Symbol cs = i->env.table.syms[j];
-            if (!strcmp(cs.tok.lexeme, id) && cs.scope == k) {
-                return cs;
-            }
+// Assign a value to an existing symbol. n is the assigning node, only read for errors.
+void assignSymbol(Interpreter *i, int slot, Node *node, Lit v) {
+    slot = declaredSlot(i, slot);
+    if (slot == -1) {
+        iError(i, "Variable not declared.", nodeText(i, node));
+        return;
+    }
+    Slot *cs = &i->env.slots[slot];
+    if (cs->type == NUM ? !IS_NUM(v) : cs->type != BOOL || !IS_BOOL(v)) {
+        if (cs->type == ARRAY) {
+            if (i->trace != NULL) traceStore(i, node, ARRAY_LIT(slot), ARRAY_LIT(slot), 0);
+            assignArray(i, slot, v);
+            return;
         }
+        iError(i, "Type mismatch", i->table->syms[slot].tok.lexeme);
+        return;
     }
-    Token tok = (Token) {-1, -1, END, ""};
-    strcpy(tok.lexeme, id);
-    iError(i, "Variable not declared.", tok);
-    return (Symbol) {0, ((Token) {0,0,END,""}), "", UNKNOWN};
+    if (i->trace != NULL) traceStore(i, node, cs->value, v, 0);
+    cs->value = v;
 }
 
-// Check if a symbol exists in the symbol table.
-SymCodes checkSymbol(SymbolTable *t, Symbol s) {
-    for (int i = 0; i < t->index; i++) {
-        if (!strcmp(t->syms[i].tok.lexeme, s.tok.lexeme) && s.scope == t->syms[i].scope) {
-            if (t->syms[i].type != s.type) return TYPECHANGE;
-            return IN;
+// Take the next item of input into the variable of a READ node, read as the variable's type.
+// An ARRAY takes one number per element.
+void readInput(Interpreter *i, Node *node) {
+    int slot = declaredSlot(i, node->a);
+    if (slot == -1) {
+        iError(i, "Variable not declared.", nodeText(i, node));
+        return;
+    }
+    Slot *cs = &i->env.slots[slot];
+    int count = cs->type == ARRAY ? i->arrays[slot].length : 1;
+    for (int k = 0; k < count; k++) {
+        InputStatus status = INPUT_END;
+        double value = 0;
+        long long integer = 0;
+        bool b = false, exact = false;
+        if (i->in != NULL) {
+            status = cs->type == BOOL ? readBool(i->in, &b) : readNumber(i->in, &value, &integer, &exact);
+        }
+        if (status == INPUT_END) iError(i, "Unexpected end of input.", nodeText(i, node));
+        if (status == INPUT_BAD) {
+            iError(i, cs->type == BOOL ? "Expected bool in input." : "Expected num in input.", nodeText(i, node));
         }
+        Lit old = cs->value;
+        if (cs->type == ARRAY) {
+            old = numLit(i->arrays[slot].data[k]);
+            i->arrays[slot].data[k] = exact ? (double) integer : value;
+            if (i->trace != NULL) traceStore(i, node, old, numLit(i->arrays[slot].data[k]), k);
+        } else if (cs->type == BOOL) {
+            cs->value = BOOL_LIT(b);
+        } else {
+            cs->value = exact ? exactLit(i, integer) : numLit(value);
+        }
+        if (i->trace != NULL && cs->type != ARRAY) traceStore(i, node, old, cs->value, 0);
+    }
+}
+
+// Record a store of v over old, with wide integers as their doubles since the wides move.
+void traceStore(Interpreter *i, Node *node, Lit old, Lit v, int element) {
+    if (LIT_TAG(old) == LIT_TAG(LIT_WIDE)) old = doubleLit((double) exactValue(i, old));
+    if (LIT_TAG(v) == LIT_TAG(LIT_WIDE)) v = doubleLit((double) exactValue(i, v));
+    TRACE_EVENT(i->trace, TRACE_STORE, node - i->nodes, 0, element, old, v);
+}
+
+// Retrieve the value of a symbol. Declared but unassigned symbols read as NUM 0.
+Lit lookupSymbol(Interpreter *i, int slot, Node *node) {
+    slot = declaredSlot(i, slot);
+    if (slot == -1) {
+        return iRaise(i, "Variable not declared.", node, LIT_UNKNOWN);
     }
-    return NOTIN;
+    return i->env.slots[slot].value;
 }
 
-// Add a new symbol to the symbol table.
-void addSymbol(Interpreter *i, Symbol s) {
-    SymCodes code = checkSymbol(&i->env.table, s);
-    switch (code) {
-        case IN: break;
-        case NOTIN: i->env.table.syms[i->env.table.index++] = s; break;
-        case TYPECHANGE: iError(i, "Redeclaration of existing variable with different type.", s.tok); break;
+// Declare a symbol in its slot, an ARRAY of length zeroed elements in the slot's own array.
+// Redeclaring with the same type, and length for an ARRAY, keeps the current value.
+void addSymbol(Interpreter *i, int slot, Type type, int length) {
+    Slot *cs = &i->env.slots[slot];
+    if (!cs->declared) {
+        cs->declared = true;
+        cs->type = type;
+        cs->value = LIT_INT;
+        if (type == ARRAY) {
+            growArrays(i, i->env.size);
+            sizeArray(&i->arrays[slot], length);
+            fillArray(&i->arrays[slot], 0);
+            cs->value = ARRAY_LIT(slot);
+        }
+    } else if (cs->type != type || (type == ARRAY && i->arrays[slot].length != length)) {
+        iError(i, "Redeclaration of existing variable with different type.", i->table->syms[slot].tok.lexeme);
     }
 }
 
 // -----------------
-// Helper Funcs
+// Parallel
 // -----------------
 
-// Error function
-void iError(Interpreter *i, char *msg, Token tok) {
-    i->err = true;
-    printf("Error: %s - {%s}\n", msg, tok.lexeme);
+// Run the top level statements segment by segment as the plan says, stopping at the first error or return.
+void runPlan(Interpreter *i) {
+    Plan *p = i->plan;
+    for (int k = 0; k < p->segmentCount; k++) {
+        Segment *s = &p->segments[k];
+        if (s->taskCount ? !runTasks(i, s) : runBlock(i, s->start, s->end)) return;
+    }
 }
 
-// Convert a literal string value to a Lit.
-Lit getValueFromString(char *v) {
-    if (!strcmp(v,"true")) {
-        return (Lit) {BOOL, 1};
-    } else if (!strcmp(v,"false")) {
-        return (Lit) {BOOL, 0};
-    } else {
-        return (Lit) {NUM, atof(v)};
+// Run the tasks of a segment on up to threads threads, this one included, then merge them: the output of
+// each statement is appended in program order and the slots the tasks write copied back. Returns false
+// when a statement failed, its output being the last appended.
+bool runTasks(Interpreter *i, Segment *s) {
+    Plan *p = i->plan;
+    TaskPool pool = {i, s, malloc(sizeof(Task) * s->taskCount), s->taskCount, 0, INT_MAX};
+    for (int k = 0; k < s->taskCount; k++) {
+        int at = s->firstTask + k;
+        int owned = 0;
+        for (int j = s->start; j < s->end; j++) owned += p->owners[j] == at;
+        pool.tasks[k] = (Task) {.index = at, .slots = p->slots + p->slotAt[at],
+                                .slotCount = p->slotAt[at + 1] - p->slotAt[at], .ends = malloc(sizeof(long) * 2 * owned)};
+    }
+    int threads = i->threads < s->taskCount ? i->threads : s->taskCount;
+    pthread_t *ids = malloc(sizeof(pthread_t) * threads);
+    for (int t = 1; t < threads; t++) pthread_create(&ids[t], NULL, taskWorker, &pool);
+    taskWorker(&pool);
+    for (int t = 1; t < threads; t++) pthread_join(ids[t], NULL);
+    free(ids);
+
+    bool split = i->shows != i->out;
+    for (int k = s->start; k < s->end && k <= pool.failed; k++) {
+        Task *t = &pool.tasks[p->owners[k] - s->firstTask];
+        if (t->merged == t->done) break;
+        long *from = t->merged ? t->ends + 2 * (t->merged - 1) : (long[2]) {0, 0};
+        long *to = t->ends + 2 * t->merged++;
+        outWrite(i->out, t->out.data + from[0], to[0] - from[0]);
+        if (split) outWrite(i->shows, t->shows.data + from[1], to[1] - from[1]);
     }
+    for (int k = 0; k < s->taskCount; k++) {
+        Task *t = &pool.tasks[k];
+        mergeSlots(i, t);
+        freeInterpreter(&t->i);
+        freeOutput(&t->out);
+        if (split) freeOutput(&t->shows);
+        free(t->ends);
+    }
+    free(pool.tasks);
+    if (pool.failed != INT_MAX) i->err = true;
+    return pool.failed == INT_MAX;
 }
 
-// Handle all possible binary operations.
-Lit binOpCases(Interpreter *i, char *op, Lit left, Lit right) {
-        Token tok = {0,0,END,""};
-        strcpy(tok.lexeme, op);
-        if (!strcmp("|", op)) {
-            if (left.type != BOOL || right.type != BOOL) {
-                iError(i, "'|' does not support non BOOL values.", tok);
-            } 
-            return (Lit) {BOOL, left.value || right.value};
+// Thread body: run the pool's next task until none are left.
+void *taskWorker(void *arg) {
+    TaskPool *pool = arg;
+    int k;
+    while ((k = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) < pool->count) runTask(pool, &pool->tasks[k]);
+    return NULL;
+}
+
+// Run a task on a copy of the slots of the interpreter it came from, which only ever reads them while
+// the tasks run. Wide integers are boxed again in the task and the arrays it uses copied.
+void runTask(TaskPool *pool, Task *t) {
+    Interpreter *from = pool->from;
+    Interpreter *ti = &t->i;
+    Segment *seg = pool->segment;
+    bool split = from->shows != from->out;
+    initOutput(&t->out, NULL);
+    if (split) initOutput(&t->shows, NULL);
+    initInterpreter(ti, from->code, from->table, &t->out);
+    setShowFormat(ti, split ? &t->shows : &t->out, from->format, from->tagLines);
+    ti->stopAt = &pool->failed;
+    if (from->tier.hits == NULL) freeTier(&ti->tier);
+    ti->tier.after = from->tier.after;
+
+    int size = from->env.size;
+    memcpy(ti->env.slots, from->env.slots, sizeof(Slot) * size);
+    for (int s = 0; s < size; s++) {
+        if (LIT_TAG(ti->env.slots[s].value) == LIT_TAG(LIT_WIDE)) ti->env.slots[s].value = LIT_INT;
+    }
+    for (int s = 0; s < size; s++) {
+        Lit v = from->env.slots[s].value;
+        if (LIT_TAG(v) == LIT_TAG(LIT_WIDE)) ti->env.slots[s].value = boxWide(ti, exactValue(from, v));
+    }
+    for (int k = 0; k < t->slotCount; k++) {
+        int s = t->slots[k] >> 1;
+        if (!from->env.slots[s].declared || from->env.slots[s].type != ARRAY) continue;
+        Array *a = &from->arrays[s];
+        growArrays(ti, size);
+        sizeArray(&ti->arrays[s], a->length);
+        memcpy(ti->arrays[s].data, a->data, sizeof(double) * a->length);
+    }
+
+    ti->steps = 0;
+    ti->fuel = BUDGET_WINDOW;
+    ti->at = seg->start;
+    if (setjmp(ti->trap)) {
+        if (!ti->err) return;
+        finishError(ti);
+        t->ends[2 * t->done] = t->out.used;
+        t->ends[2 * t->done++ + 1] = split ? t->shows.used : 0;
+        int failed = __atomic_load_n(&pool->failed, __ATOMIC_RELAXED);
+        while (ti->at < failed &&
+               !__atomic_compare_exchange_n(&pool->failed, &failed, ti->at, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
         }
-        if (!strcmp("&", op)) {
-            if (left.type != BOOL || right.type != BOOL) {
-                iError(i, "'&' does not support non BOOL values.", tok);
-            } 
-            return (Lit) {BOOL, left.value && right.value};
+        return;
+    }
+    for (; ti->at < seg->end; ti->at++) {
+        if (from->plan->owners[ti->at] != t->index) continue;
+        if (__atomic_load_n(&pool->failed, __ATOMIC_RELAXED) < ti->at) return;
+        runBlock(ti, ti->at, ti->at + 1);
+        t->ends[2 * t->done] = t->out.used;
+        t->ends[2 * t->done++ + 1] = split ? t->shows.used : 0;
+    }
+}
+
+// Copy the slots a finished task may have written back.
+void mergeSlots(Interpreter *i, Task *t) {
+    Interpreter *ti = &t->i;
+    for (int k = 0; k < t->slotCount; k++) {
+        if (!(t->slots[k] & 1)) continue;
+        int s = t->slots[k] >> 1;
+        Slot *ts = &ti->env.slots[s];
+        Slot *cs = &i->env.slots[s];
+        *cs = *ts;
+        if (LIT_TAG(ts->value) == LIT_TAG(LIT_WIDE)) {
+            cs->value = LIT_INT;
+            cs->value = boxWide(i, exactValue(ti, ts->value));
         }
-        if (!strcmp("==", op)) {
-            if (!((left.type == BOOL && right.type == BOOL) || (left.type == NUM && right.type == NUM))) {
-                iError(i, "'==' cannot handle different types.", tok);
-            } 
-            return (Lit) {BOOL, left.value == right.value};
+        if (ts->declared && ts->type == ARRAY) {
+            growArrays(i, i->env.size);
+            sizeArray(&i->arrays[s], ti->arrays[s].length);
+            memcpy(i->arrays[s].data, ti->arrays[s].data, sizeof(double) * ti->arrays[s].length);
         }
-        if (!strcmp("!=", op)){
-            if (!((left.type == BOOL && right.type == BOOL) || (left.type == NUM && right.type == NUM))) {
-                iError(i, "'!=' cannot handle different types.", tok);
-            } 
-            return (Lit) {BOOL, left.value != right.value};
+    }
+}
+
+// -----------------
+// Arrays
+// -----------------
+
+// Assign to an ARRAY slot: a NUM sets every element and an array of the same length is copied.
+// An array expression's value is swapped in rather than copied, since it is dropped afterwards anyway.
+void assignArray(Interpreter *i, int slot, Lit v) {
+    Array *a = &i->arrays[slot];
+    if (IS_NUM(v)) {
+        fillArray(a, NUM_VALUE(i, v));
+        return;
+    }
+    if (!IS_ARRAY(v)) {
+        iError(i, "Type mismatch", i->table->syms[slot].tok.lexeme);
+        return;
+    }
+    int from = ARRAY_INDEX(v);
+    Array *b = &i->arrays[from];
+    if (b->length != a->length) {
+        iError(i, "Array lengths differ.", i->table->syms[slot].tok.lexeme);
+        return;
+    }
+    if (from >= i->env.size) {
+        Array t = *a;
+        *a = *b;
+        *b = t;
+    } else if (from != slot) {
+        memcpy(a->data, b->data, sizeof(double) * a->length);
+    }
+}
+
+// Apply a binary operator with at least one array operand element by element. The other operand
+// may be an array of the same length or a NUM used for every element. An array expression operand
+// is overwritten with the result instead of taking a new array.
+Lit arrayBinOp(Interpreter *i, Node *expr, Lit left, Lit right) {
+    if (expr->op == OR || expr->op == AND) {
+        return iRaise(i, expr->op == OR ? "'|' does not support non BOOL values." : "'&' does not support non BOOL values.",
+                      expr, LIT_UNKNOWN);
+    }
+    if (!(IS_ARRAY(left) || IS_NUM(left)) || !(IS_ARRAY(right) || IS_NUM(right))) {
+        return iRaise(i, "Arrays only combine with arrays and NUM values.", expr, LIT_UNKNOWN);
+    }
+    int length = i->arrays[ARRAY_INDEX(IS_ARRAY(left) ? left : right)].length;
+    if (IS_ARRAY(left) && IS_ARRAY(right) && i->arrays[ARRAY_INDEX(right)].length != length) {
+        return iRaise(i, "Array lengths differ.", expr, LIT_UNKNOWN);
+    }
+    Lit r;
+    if (IS_ARRAY(left) && ARRAY_INDEX(left) >= i->env.size) {
+        r = left;
+    } else if (IS_ARRAY(right) && ARRAY_INDEX(right) >= i->env.size) {
+        r = right;
+    } else {
+        r = newArray(i, length);
+    }
+    const double *x = IS_ARRAY(left) ? i->arrays[ARRAY_INDEX(left)].data : NULL;
+    const double *y = IS_ARRAY(right) ? i->arrays[ARRAY_INDEX(right)].data : NULL;
+    arrayKernel(expr->op, x, x ? 0 : NUM_VALUE(i, left), y, y ? 0 : NUM_VALUE(i, right),
+                i->arrays[ARRAY_INDEX(r)].data, length);
+    return r;
+}
+
+// Read an element for an INDEX node.
+Lit loadElement(Interpreter *i, Node *node, Lit index) {
+    int slot = declaredSlot(i, node->a);
+    if (slot == -1) return iRaise(i, "Variable not declared.", node, LIT_UNKNOWN);
+    if (i->env.slots[slot].type != ARRAY) return iRaise(i, "Only arrays can be indexed.", node, LIT_UNKNOWN);
+    Array *a = &i->arrays[slot];
+    int at = elementIndex(i, index, a->length);
+    if (at == -1) return iRaise(i, "Array index out of range.", node, LIT_UNKNOWN);
+    return numLit(a->data[at]);
+}
+
+// Write an element for a SET node and return the value written.
+Lit storeElement(Interpreter *i, Node *node, Lit index, Lit v) {
+    int slot = declaredSlot(i, node->a);
+    if (slot == -1) return iRaise(i, "Variable not declared.", node, LIT_UNKNOWN);
+    if (i->env.slots[slot].type != ARRAY) return iRaise(i, "Only arrays can be indexed.", node, LIT_UNKNOWN);
+    Array *a = &i->arrays[slot];
+    int at = elementIndex(i, index, a->length);
+    if (at == -1) return iRaise(i, "Array index out of range.", node, LIT_UNKNOWN);
+    if (!IS_NUM(v)) return iRaise(i, "Type mismatch", node, LIT_UNKNOWN);
+    double old = a->data[at];
+    a->data[at] = NUM_VALUE(i, v);
+    if (i->trace != NULL) traceStore(i, node, numLit(old), numLit(a->data[at]), at);
+    return v;
+}
+
+// The element a NUM index names in an array of length elements, or -1 unless it is a whole
+// number from 0 to length - 1.
+int elementIndex(Interpreter *i, Lit index, int length) {
+    if (!IS_NUM(index)) return -1;
+    double d = NUM_VALUE(i, index);
+    if (!(d >= 0 && d < length) || d != (int) d) return -1;
+    return (int) d;
+}
+
+// Reduce an array value for a REDUCE node.
+Lit reduceValue(Interpreter *i, Node *node, Lit v) {
+    if (!IS_ARRAY(v)) return iRaise(i, "Reductions need an array.", node, LIT_UNKNOWN);
+    Array *a = &i->arrays[ARRAY_INDEX(v)];
+    return numLit(reduceArray(node->op, a->data, a->length));
+}
+
+// Show every element of an array on one line, separated by spaces.
+void showArray(Interpreter *i, Lit v) {
+    Array *a = &i->arrays[ARRAY_INDEX(v)];
+    for (int e = 0; e < a->length; e++) outPrintf(i->shows, e ? " %f" : "%f", a->data[e]);
+    outPrintf(i->shows, "\n");
+}
+
+// Show the value of the show statement at node at, stopping the run if it takes output past the limit.
+void showResult(Interpreter *i, int at, Lit val) {
+    if (i->format != SHOW_TEXT) {
+        showValue(i, i->nodes + at, val);
+    } else {
+        if (i->tagLines) outPrintf(i->shows, "%d: ", i->code->sources[at].line + 1);
+        if (IS_EXACT(val)) {
+            outPrintf(i->shows, "%lld.000000\n", exactValue(i, val));
+        } else if (IS_DOUBLE(val)) {
+            outPrintf(i->shows, "%f\n", numValue(i, val));
+        } else if (IS_ARRAY(val)) {
+            showArray(i, val);
+        } else if (val == LIT_TRUE) {
+            outPrintf(i->shows, "true\n");
+        } else {
+            outPrintf(i->shows, "false\n");
         }
-        if (!strcmp(">", op)) {
-            if (left.type != NUM || right.type != NUM) {
-                iError(i, "'>' does not support non NUM values.", tok);
-            } 
-            return (Lit) {BOOL, left.value > right.value};
+    }
+    if (i->limits.output && i->shows->total - i->budget.output > i->limits.output) outputLimit(i, at);
+}
+
+// Write a shown value in the binary, records or CSV format.
+void showValue(Interpreter *i, Node *node, Lit val) {
+    if (i->format == SHOW_CSV) {
+        showCell(i, node->c, val);
+        return;
+    }
+    const double *elements;
+    double d;
+    int count = 1;
+    char kind, flag;
+    if (IS_ARRAY(val)) {
+        Array *a = &i->arrays[ARRAY_INDEX(val)];
+        elements = a->data;
+        count = a->length;
+        kind = SHOW_ARRAY;
+    } else if (IS_BOOL(val)) {
+        flag = val == LIT_TRUE;
+        kind = SHOW_BOOL;
+    } else {
+        d = NUM_VALUE(i, val);
+        elements = &d;
+        kind = SHOW_NUM;
+    }
+    char head[9];
+    int used = 0;
+    if (i->format == SHOW_RECORDS) {
+        uint32_t bytes = kind == SHOW_BOOL ? 1 : sizeof(double) * count;
+        putWord(head, bytes + 1 + (i->tagLines ? 4 : 0));
+        head[4] = kind;
+        used = 5;
+    }
+    if (i->tagLines) {
+        putWord(head + used, i->code->sources[node - i->nodes].line + 1);
+        used += 4;
+    }
+    if (used) outWrite(i->shows, head, used);
+    if (kind == SHOW_BOOL) {
+        outWrite(i->shows, &flag, 1);
+    } else {
+        writeDoubles(i->shows, elements, count);
+    }
+}
+
+// Write doubles as little endian bytes, straight from memory on a little endian machine.
+void writeDoubles(Output *o, const double *d, int count) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for (int k = 0; k < count; k++) {
+        uint64_t bits;
+        memcpy(&bits, d + k, sizeof(bits));
+        bits = __builtin_bswap64(bits);
+        outWrite(o, &bits, sizeof(bits));
+    }
+#else
+    outWrite(o, d, sizeof(double) * count);
+#endif
+}
+
+// Store a 32 bit word as 4 little endian bytes.
+void putWord(char *to, uint32_t v) {
+    for (int b = 0; b < 4; b++) to[b] = (char) (v >> (8 * b));
+}
+
+// Put a value's text in a CSV column, writing out the current row first when the column is filled.
+// Numbers are written in full, an exact integer without a fraction, and an array's elements are
+// separated by spaces.
+void showCell(Interpreter *i, int column, Lit val) {
+    if (i->cellAt[column] != -1) endRow(i);
+    Output *o = &i->cells;
+    i->cellAt[column] = o->used;
+    if (IS_EXACT(val)) {
+        outPrintf(o, "%lld", exactValue(i, val));
+    } else if (IS_DOUBLE(val)) {
+        outPrintf(o, "%.17g", AS_DOUBLE(val));
+    } else if (IS_ARRAY(val)) {
+        Array *a = &i->arrays[ARRAY_INDEX(val)];
+        for (int e = 0; e < a->length; e++) outPrintf(o, e ? " %.17g" : "%.17g", a->data[e]);
+    } else {
+        outPrintf(o, val == LIT_TRUE ? "true" : "false");
+    }
+    i->cellEnd[column] = o->used;
+}
+
+// Write the CSV header. A column is named after the line of its show, "line12", and later shows on
+// the same line "line12_2" onwards.
+void showHeader(Interpreter *i) {
+    CompactTree *code = i->code;
+    int *lines = malloc(sizeof(int) * (code->showCount ? code->showCount : 1));
+    for (int k = 0; k < code->count; k++) {
+        if (code->nodes[k].tag == SHOW) lines[code->nodes[k].c] = code->sources[k].line + 1;
+    }
+    int same = 0;
+    for (int c = 0; c < code->showCount; c++) {
+        same = c && lines[c] == lines[c - 1] ? same + 1 : 1;
+        if (c) outWrite(i->shows, ",", 1);
+        if (same == 1) {
+            outPrintf(i->shows, "line%d", lines[c]);
+        } else {
+            outPrintf(i->shows, "line%d_%d", lines[c], same);
+        }
+    }
+    outWrite(i->shows, "\n", 1);
+    free(lines);
+}
+
+// Write the current CSV row when it has any cells and empty it.
+void endRow(Interpreter *i) {
+    int columns = i->code->showCount;
+    bool any = false;
+    for (int c = 0; c < columns; c++) any = any || i->cellAt[c] != -1;
+    if (!any) return;
+    for (int c = 0; c < columns; c++) {
+        if (c) outWrite(i->shows, ",", 1);
+        if (i->cellAt[c] == -1) continue;
+        outWrite(i->shows, i->cells.data + i->cellAt[c], i->cellEnd[c] - i->cellAt[c]);
+        i->cellAt[c] = -1;
+    }
+    outWrite(i->shows, "\n", 1);
+    i->cells.used = 0;
+}
+
+// Take the next free array for an expression's value, sized to length elements.
+Lit newArray(Interpreter *i, int length) {
+    growArrays(i, i->arrayCount + 1);
+    sizeArray(&i->arrays[i->arrayCount], length);
+    return ARRAY_LIT(i->arrayCount++);
+}
+
+// Make sure arrays has at least count entries, new ones empty.
+void growArrays(Interpreter *i, int count) {
+    if (count <= i->arraySize) return;
+    int size = i->arraySize ? i->arraySize : i->env.size + 8;
+    while (size < count) size *= 2;
+    MEM_COUNT(MEM_RUNTIME, sizeof(Array) * (size - i->arraySize));
+    i->arrays = realloc(i->arrays, sizeof(Array) * size);
+    memset(i->arrays + i->arraySize, 0, sizeof(Array) * (size - i->arraySize));
+    i->arraySize = size;
+}
+
+// -----------------
+// Helper Funcs
+// -----------------
+
+// Error function for a statement. The first error unwinds to interpret, later ones only report.
+void iError(Interpreter *i, char *msg, char *id) {
+    bool first = !i->err;
+    iErrorId(i, msg, id);
+    if (first) {
+        i->errAt = -1;
+        longjmp(i->trap, 1);
+    }
+}
+
+// Error function for an expression node, which would have produced value. The first error unwinds
+// to interpret, keeping node and value for finishError, later ones only report and return value.
+Lit iRaise(Interpreter *i, char *msg, Node *node, Lit value) {
+    return iRaiseId(i, msg, nodeText(i, node), node, value);
+}
+
+// iRaise reporting a name other than the node's own.
+Lit iRaiseId(Interpreter *i, char *msg, char *id, Node *node, Lit value) {
+    bool first = !i->err;
+    iErrorId(i, msg, id);
+    if (first) {
+        i->errAt = node - i->nodes;
+        i->errValue = value;
+        longjmp(i->trap, 1);
+    }
+    return value;
+}
+
+// Name, operator or literal text of a node.
+char *nodeText(Interpreter *i, Node *node) {
+    return i->code->text + i->code->sources[node - i->nodes].text;
+}
+
+// Error function for a bare name or operator.
+void iErrorId(Interpreter *i, char *msg, char *id) {
+    i->err = true;
+    outPrintf(i->out, "Error: %s - {%s}\n", msg, id);
+}
+
+// Handle all possible binary operations.
+// Two exact integers under an operator the analyser marked integral go through intCases first,
+// anything it cannot represent falls through to doubles.
+Lit binOpCases(Interpreter *i, Node *expr, Lit left, Lit right) {
+        if (expr->flags & NODE_INTEGRAL) {
+            long long wide;
+            Lit r = LIT_UNKNOWN;
+            if (BOTH_INT(left, right)) {
+                r = intCases(expr->op, INT_VALUE(left), INT_VALUE(right), &wide);
+            } else if (IS_EXACT(left) && IS_EXACT(right)) {
+                r = intCases(expr->op, exactValue(i, left), exactValue(i, right), &wide);
+            }
+            if (r == LIT_WIDE) return boxWide(i, wide);
+            if (r != LIT_UNKNOWN) return r;
         }
-        if (!strcmp(">=", op)) {
-            if (left.type != NUM || right.type != NUM) {
-                iError(i, "'>=' does not support non NUM values.", tok);
-            } 
-            return (Lit) {BOOL, left.value >= right.value};
+        if (IS_ARRAY(left) || IS_ARRAY(right)) return arrayBinOp(i, expr, left, right);
+        double x = NUM_VALUE(i, left);
+        double y = NUM_VALUE(i, right);
+        Lit r;
+        switch (expr->op) {
+            case OR:
+                r = BOOL_LIT(x || y);
+                if (!IS_BOOL(left) || !IS_BOOL(right)) iRaise(i, "'|' does not support non BOOL values.", expr, r);
+                return r;
+            case AND:
+                r = BOOL_LIT(x && y);
+                if (!IS_BOOL(left) || !IS_BOOL(right)) iRaise(i, "'&' does not support non BOOL values.", expr, r);
+                return r;
+            case EQEQUALS:
+                r = BOOL_LIT(x == y);
+                if (!((IS_BOOL(left) && IS_BOOL(right)) || (IS_NUM(left) && IS_NUM(right)))) iRaise(i, "'==' cannot handle different types.", expr, r);
+                return r;
+            case BANGEQ:
+                r = BOOL_LIT(x != y);
+                if (!((IS_BOOL(left) && IS_BOOL(right)) || (IS_NUM(left) && IS_NUM(right)))) iRaise(i, "'!=' cannot handle different types.", expr, r);
+                return r;
+            case GTHAN:
+                r = BOOL_LIT(x > y);
+                if (!IS_NUM(left) || !IS_NUM(right)) iRaise(i, "'>' does not support non NUM values.", expr, r);
+                return r;
+            case GTHANEQ:
+                r = BOOL_LIT(x >= y);
+                if (!IS_NUM(left) || !IS_NUM(right)) iRaise(i, "'>=' does not support non NUM values.", expr, r);
+                return r;
+            case LTHAN:
+                r = BOOL_LIT(x < y);
+                if (!IS_NUM(left) || !IS_NUM(right)) iRaise(i, "'<' does not support non NUM values.", expr, r);
+                return r;
+            case LTHANEQ:
+                r = BOOL_LIT(x <= y);
+                if (!IS_NUM(left) || !IS_NUM(right)) iRaise(i, "'<=' does not support non NUM values.", expr, r);
+                return r;
+            case PLUS:
+                r = doubleLit(x + y);
+                if (!IS_NUM(left) || !IS_NUM(right)) iRaise(i, "'+' does not support non NUM values.", expr, r);
+                return r;
+            case MINUS:
+                r = doubleLit(x - y);
+                if (!IS_NUM(left) || !IS_NUM(right)) iRaise(i, "'-' does not support non NUM values.", expr, r);
+                return r;
+            case STAR:
+                r = doubleLit(x * y);
+                if (!IS_NUM(left) || !IS_NUM(right)) iRaise(i, "'*' does not support non NUM values.", expr, r);
+                return r;
+            case SLASH:
+                r = doubleLit(x / y);
+                if (!IS_NUM(left) || !IS_NUM(right)) iRaise(i, "'/' does not support non NUM values.", expr, r);
+                return r;
+            default:
+                return LIT_UNKNOWN;
         }
-        if (!strcmp("<", op)) {
-            if (left.type != NUM || right.type != NUM) {
-                iError(i, "'<' does not support non NUM values.", tok);
-            } 
-            return (Lit) {BOOL, left.value < right.value};
+}
+
+// Integer arithmetic and comparisons on two exact NUMs.
+// Returns UNKNOWN when the result is not an exact integer: overflow, an inexact or zero divisor, or a
+// negative zero, which only the double path represents. A result too wide for a Lit is left in wide
+// for the caller to box and LIT_WIDE returned, so this never allocates.
+Lit intCases(TokenType op, long long a, long long b, long long *wide) {
+    long long r;
+    switch (op) {
+        case EQEQUALS:
+            return BOOL_LIT(a == b);
+        case BANGEQ:
+            return BOOL_LIT(a != b);
+        case GTHAN:
+            return BOOL_LIT(a > b);
+        case GTHANEQ:
+            return BOOL_LIT(a >= b);
+        case LTHAN:
+            return BOOL_LIT(a < b);
+        case LTHANEQ:
+            return BOOL_LIT(a <= b);
+        case PLUS:
+            if (__builtin_add_overflow(a, b, &r)) return LIT_UNKNOWN;
+            break;
+        case MINUS:
+            if (__builtin_sub_overflow(a, b, &r)) return LIT_UNKNOWN;
+            break;
+        case STAR:
+            if (__builtin_mul_overflow(a, b, &r) || (r == 0 && (a < 0 || b < 0))) return LIT_UNKNOWN;
+            break;
+        case SLASH:
+            if (b == 0 || (a == LLONG_MIN && b == -1) || a % b != 0 || (a == 0 && b < 0)) return LIT_UNKNOWN;
+            r = a / b;
+            break;
+        default:
+            return LIT_UNKNOWN;
+    }
+    if (FITS_INT(r)) return INT_LIT(r);
+    *wide = r;
+    return LIT_WIDE;
+}
+
+// Evaluate an induction variable times a constant. When the variable is an exact integer that has moved
+// by exactly one step since the last evaluation the product is updated by addition. Overflow and zero
+// results are recomputed so the result is always identical to the multiplication.
+Lit induction(Interpreter *i, Node *ind) {
+    Node *mul = &i->nodes[ind->a];
+    bool varLeft = ind->flags & NODE_VARLEFT;
+    long long step = i->code->consts[ind->c];
+    long long delta = i->code->consts[ind->c + 1];
+    Temp *t = &i->temps[ind->b];
+    Node *var = i->nodes + (varLeft ? mul->a : mul->b);
+    Lit v = lookupSymbol(i, var->a, var);
+    long long base = IS_INT(v) ? INT_VALUE(v) : IS_EXACT(v) ? exactValue(i, v) : 0;
+    long long moved, next;
+    if (t->valid && IS_EXACT(v) && !__builtin_sub_overflow(base, t->base, &moved) && moved == step &&
+        !__builtin_add_overflow(IS_INT(t->value) ? INT_VALUE(t->value) : exactValue(i, t->value), delta, &next) &&
+        next != 0) {
+        t->base = base;
+        t->value = exactLit(i, next);
+        return t->value;
+    }
+    Lit k = literalValue(i, i->nodes + (varLeft ? mul->b : mul->a));
+    Lit r = varLeft ? binOpCases(i, mul, v, k) : binOpCases(i, mul, k, v);
+    t->valid = IS_EXACT(v) && IS_EXACT(r);
+    t->base = base;
+    t->value = r;
+    return r;
+}
+
+// -----------------
+// Values
+// -----------------
+
+// A NUM holding any double. NaNs are folded to the default NaN of the same sign so they never look boxed.
+Lit numLit(double d) {
+    if (d != d) d = signbit(d) ? -NAN : NAN;
+    return doubleLit(d);
+}
+
+// A NUM holding a double that arithmetic produced, whose NaNs are always default ones.
+Lit doubleLit(double d) {
+    Lit v;
+    memcpy(&v, &d, sizeof(v));
+    return v;
+}
+
+// A NUM holding an exact integer, boxed in wides when it needs more than 48 bits.
+Lit exactLit(Interpreter *i, long long n) {
+    return FITS_INT(n) ? INT_LIT(n) : boxWide(i, n);
+}
+
+// The integer held by an exact NUM.
+long long exactValue(Interpreter *i, Lit v) {
+    return IS_INT(v) ? INT_VALUE(v) : i->wides[LIT_PAYLOAD(v)];
+}
+
+// A value as a double: NUMs as their value, BOOLs as 1 or 0 and UNKNOWN as 0.
+// i is only read for integers boxed in wides.
+double numValue(Interpreter *i, Lit v) {
+    if (IS_DOUBLE(v)) return AS_DOUBLE(v);
+    if (IS_EXACT(v)) return (double) exactValue(i, v);
+    return IS_BOOL(v) ? (double) (v & 1) : 0;
+}
+
+// The type of a value.
+Type litType(Lit v) {
+    if (IS_NUM(v)) return NUM;
+    if (IS_ARRAY(v)) return ARRAY;
+    return IS_BOOL(v) ? BOOL : UNKNOWN;
+}
+
+// Store a wide integer, compacting wides first when it is full and growing it when that frees
+// less than half.
+Lit boxWide(Interpreter *i, long long n) {
+    if (i->wideCount == i->wideSize) {
+        collectWides(i);
+        if (i->wideCount * 2 >= i->wideSize) {
+            MEM_COUNT(MEM_RUNTIME, sizeof(long long) * (i->wideSize ? i->wideSize : 64));
+            i->wideSize = i->wideSize ? i->wideSize * 2 : 64;
+            i->wides = realloc(i->wides, sizeof(long long) * i->wideSize);
         }
-        if (!strcmp("<=", op)) {
-            if (left.type != NUM || right.type != NUM) {
-                iError(i, "'<=' does not support non NUM values.", tok);
-            } 
-            return (Lit) {BOOL, left.value <= right.value};
+    }
+    i->wides[i->wideCount] = n;
+    return LIT_WIDE | i->wideCount++;
+}
+
+// Copy the wide integers still reachable from the variables, the frames of calls, temporaries and value
+// stack to the front of wides. The whole stack up to the current expression's room is scanned, so a
+// stale entry only keeps its integer a little longer.
+void collectWides(Interpreter *i) {
+    long long *to = malloc(sizeof(long long) * (i->wideSize ? i->wideSize : 1));
+    int *moved = calloc(i->wideSize ? i->wideSize : 1, sizeof(int));
+    int count = 0;
+    for (int s = 0; s < i->env.size; s++) keepWide(i, &i->globals[s].value, to, moved, &count);
+    for (int s = 0; s < i->localTop; s++) keepWide(i, &i->locals[s].value, to, moved, &count);
+    for (int t = 0; t < i->program->temps; t++) keepWide(i, &i->temps[t].value, to, moved, &count);
+    for (int k = 0; k < i->base + i->code->stackDepth; k++) keepWide(i, &i->stack[k], to, moved, &count);
+    keepWide(i, &i->errValue, to, moved, &count);
+    keepWide(i, &i->result, to, moved, &count);
+    free(moved);
+    free(i->wides);
+    i->wides = to;
+    i->wideCount = count;
+}
+
+// Move the wide integer a value refers to, if any, into to, once however many values share it.
+// moved holds one past the new index of each integer already moved.
+void keepWide(Interpreter *i, Lit *v, long long *to, int *moved, int *count) {
+    if (LIT_TAG(*v) != LIT_TAG(LIT_WIDE)) return;
+    uint64_t at = LIT_PAYLOAD(*v);
+    if (!moved[at]) {
+        to[*count] = i->wides[at];
+        moved[at] = ++*count;
+    }
+    *v = LIT_WIDE | (moved[at] - 1);
+}
+
+// -----------------
+// Running
+// -----------------
+
+// Lex, parse and interpret a program held in memory, writing all output and errors to out. When show
+// writes an encoding other than text to a sink, only the shown values go to out and messages to stderr.
+// Read statements take the input named in the options, none when it is NULL. A traced run writes its
+// events to the trace file once it stops.
+// When a cache directory is given the parsed program is looked up there first and stored there after parsing.
+void runProgram(char *src, long len, RunOptions *opts, Output *out) {
+    char *cacheDir = opts->cacheDir;
+    PerfCounters pc;
+    if (opts->perfCounters) openPerfCounters(&pc);
+    ParseTree tree;
+    bool err = false;
+
+    // Encoded values and messages would be mixed up on one stream, so messages go to stderr.
+    Output *shows = out;
+    Output errors;
+    if (opts->format != SHOW_TEXT && out->sink != NULL) {
+        initOutput(&errors, stderr);
+        out = &errors;
+    }
+    CacheImage image;
+    bool cached = cacheDir != NULL && loadCache(cacheDir, src, len, &tree, &image);
+    if (!cached) {
+        Lexer l;
+        initLexer(&l, src, len, out);
+        if (opts->lexThreads > 1) l.threads = opts->lexThreads;
+        if (opts->perfCounters) startPhase(&pc);
+        tokenize(&l);
+        if (opts->perfCounters) stopPhase(&pc, PHASE_LEX);
+
+        Parser p;
+        initParser(&p, &l);
+        if (opts->perfCounters) startPhase(&pc);
+        parse(&p);
+        if (opts->perfCounters) stopPhase(&pc, PHASE_PARSE);
+        //printTree(p.tree);
+        free(l.tokens);
+        tree = p.tree;
+        err = p.err;
+        if (cacheDir != NULL && !err) storeCache(cacheDir, src, len, tree);
+    }
+
+    Input in;
+    if (!err && opts->input != NULL && !openInput(&in, opts->input)) {
+        outPrintf(out, "Error: Could not open file '%s'.\n", opts->input);
+        err = true;
+    }
+    if (!err) {
+        SymbolTable table;
+        if (opts->perfCounters) startPhase(&pc);
+        resolve(tree, &table);
+        OptStats stats = {0};
+        if (!opts->noOpt) optimise(tree, &table, &stats);
+        CompactTree code = compactTree(tree);
+        if (opts->perfCounters) stopPhase(&pc, PHASE_PREPARE);
+        if (opts->stats) printStats(&stats);
+        //printCompact(&code);
+        Interpreter i;
+        initInterpreter(&i, &code, &table, out);
+        if (opts->tierAfter || opts->trace != NULL) {
+            freeTier(&i.tier);
+            initTier(&i.tier, &code, opts->trace != NULL ? 0 : opts->tierAfter);
         }
-        if (!strcmp("+", op)) {
-            if (left.type != NUM || right.type != NUM) {
-                iError(i, "'+' does not support non NUM values.", tok);
-            } 
-            return (Lit) {NUM, left.value + right.value};
+        i.limits = opts->limits;
+        i.in = opts->input != NULL ? &in : NULL;
+        setShowFormat(&i, shows, opts->format, opts->tagLines);
+        Limits *l = &opts->limits;
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        int threads = opts->threads > 0 ? opts->threads : cores > 0 ? (int) cores : 1;
+        Plan plan;
+        bool parallel = threads > 1 && !l->statements && !l->iterations && !l->seconds && !l->output &&
+                        opts->trace == NULL && opts->format != SHOW_CSV && opts->checkpoint == NULL &&
+                        opts->resume == NULL && planProgram(&plan, &code, &table);
+        if (parallel) {
+            i.plan = &plan;
+            i.threads = threads;
         }
-        if (!strcmp("-", op)) {
-            if (left.type != NUM || right.type != NUM) {
-                iError(i, "'-' does not support non NUM values.", tok);
-            } 
-            return (Lit) {NUM, left.value - right.value};
+        Trace trace;
+        if (opts->trace != NULL) {
+            initTrace(&trace);
+            i.trace = &trace;
         }
-        if (!strcmp("*", op)) {
-            if (left.type != NUM || right.type != NUM) {
-                iError(i, "'*' does not support non NUM values.", tok);
-            } 
-            return (Lit) {NUM, left.value * right.value};
+        Checkpoint cp;
+        bool run = true;
+        if (opts->checkpoint != NULL || opts->resume != NULL) {
+            initCheckpoint(&cp, &code, i.shows, opts->checkpoint, opts->checkpointEvery);
+            i.checkpoint = &cp;
+            if (opts->resume != NULL && !loadCheckpoint(&i, opts->resume)) {
+                outPrintf(out, "Error: Could not resume from '%s'.\n", opts->resume);
+                run = false;
+            }
         }
-        if (!strcmp("/", op)) {
-            if (left.type != NUM || right.type != NUM) {
-                iError(i, "'/' does not support non NUM values.", tok);
-            } 
-            return (Lit) {NUM, left.value / right.value};
+        if (opts->perfCounters) startPhase(&pc);
+        if (run) interpret(&i);
+        if (opts->perfCounters) stopPhase(&pc, PHASE_EXECUTE);
+        if (opts->trace != NULL) {
+            if (!writeTrace(&trace, &code, opts->trace)) outPrintf(out, "Error: Could not write trace '%s'.\n", opts->trace);
+            freeTrace(&trace);
         }
-        return (Lit) {UNKNOWN, 0};
+        freeInterpreter(&i);
+        if (parallel) freePlan(&plan);
+        freeCompact(&code);
+        freeSymbolTable(&table);
+        if (opts->input != NULL) closeInput(&in);
+    }
+    if (cached) {
+        unloadCache(&image, tree);
+    } else {
+        freeTree(tree);
+    }
+    if (out != shows) {
+        flushOutput(out);
+        freeOutput(out);
+    }
+    if (opts->perfCounters) {
+        printPerfCounters(&pc);
+        closePerfCounters(&pc);
+    }
 }
 
-// -----------------
-// Testing
-// -----------------
-
-// Test on test file.
-void execute() {
-    FILE *f = fopen("test.cam", "r");
-    if (f == NULL) return; 
-
-    Lexer *l = malloc(sizeof(Lexer));
-    initLexer(l, f);
-    tokenize(l);
-
-    Parser *p = malloc(sizeof(Parser));
-    initParser(p, l);
-    parse(p);
-    //printTree(p->tree);
-    
-    Interpreter *i = malloc(sizeof(Interpreter));
-    initInterpreter(i, p);
-    interpret(i);
-}
-
-// Run with no args.
-int main(int argc, char *argk[]) {
-    execute();
-    return 0;
+// Run a CAM source file.
+void execute(char *path, RunOptions *opts, Output *out) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        outPrintf(out, "Error: Could not open file '%s'.\n", path);
+        return;
+    }
+    long len;
+    char *src = readSource(f, &len);
+    fclose(f);
+    runProgram(src, len, opts, out);
+    free(src);
 }
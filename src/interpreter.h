@@ -1,40 +1,245 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
 #include "parser.h"
+#include "analyser.h"
+#include "compact.h"
+#include "array.h"
+#include "input.h"
+#include "trace.h"
+#include "parallel.h"
+#include "tier.h"
+#include "checkpoint.h"
 #include <stdbool.h>
+#include <stdint.h>
+#include <setjmp.h>
 
 // -----------------
 // Public Objects
 // -----------------
 
-typedef struct Symbol {
-    int scope;
-    Token tok;
-    char value[100];
+// A NaN boxed value in 8 bytes, so it travels in one register. A NUM that is not an exact integer is
+// its double. Everything else sits in the negative quiet NaNs with bit 50 set, which no arithmetic
+// produces, the top 16 bits giving the kind and the low 48 bits the payload:
+//   LIT_UNKNOWN   UNKNOWN, or with a non zero payload an ARRAY, the payload one past its index in
+//                 the interpreter's arrays
+//   LIT_FALSE     BOOL, the low bit holding its value
+//   LIT_INT       NUM exact integer in 48 bit two's complement
+//   LIT_WIDE      NUM exact integer too wide for 48 bits, the payload indexing the interpreter's wides
+typedef uint64_t Lit;
+
+#define LIT_UNKNOWN 0xFFFC000000000000ull
+#define LIT_FALSE 0xFFFD000000000000ull
+#define LIT_TRUE 0xFFFD000000000001ull
+#define LIT_INT 0xFFFE000000000000ull
+#define LIT_WIDE 0xFFFF000000000000ull
+#define LIT_TAG(v) ((v) >> 48)
+#define LIT_PAYLOAD(v) ((v) & 0xFFFFFFFFFFFFull)
+#define IS_DOUBLE(v) ((v) < LIT_UNKNOWN)
+#define IS_EXACT(v) ((v) >= LIT_INT)
+#define IS_NUM(v) ((v) >> 49 != LIT_UNKNOWN >> 49)
+#define IS_BOOL(v) (LIT_TAG(v) == LIT_TAG(LIT_FALSE))
+#define IS_INT(v) (LIT_TAG(v) == LIT_TAG(LIT_INT))
+#define BOTH_INT(a, b) ((((a) ^ LIT_INT) | ((b) ^ LIT_INT)) >> 48 == 0)
+#define FITS_INT(n) ((n) >= -(1ll << 47) && (n) < (1ll << 47))
+#define BOOL_LIT(b) ((b) ? LIT_TRUE : LIT_FALSE)
+#define INT_LIT(n) (LIT_INT | LIT_PAYLOAD((uint64_t) (n)))
+#define INT_VALUE(v) ((long long) ((v) << 16) >> 16)
+#define AS_DOUBLE(v) (((union {Lit l; double d;}) {(v)}).d)
+#define IS_ARRAY(v) ((v) > LIT_UNKNOWN && (v) < LIT_FALSE)
+#define ARRAY_LIT(n) (LIT_UNKNOWN + 1 + (uint64_t) (n))
+#define ARRAY_INDEX(v) ((int) ((v) - LIT_UNKNOWN - 1))
+
+// A value as a double like numValue, decoding all but wide integers in place.
+#define NUM_VALUE(i, v) (IS_DOUBLE(v) ? AS_DOUBLE(v) : IS_INT(v) ? (double) INT_VALUE(v) : \
+                         IS_BOOL(v) ? (double) ((v) & 1) : numValue(i, v))
+
+// Whether a condition holds: true, or a NUM other than 0.
+#define IS_TRUE(i, v) ((v) == LIT_TRUE || (IS_NUM(v) && NUM_VALUE(i, v) != 0))
+
+// Run time state of a symbol slot. Undeclared slots are skipped by lookups.
+typedef struct Slot {
+    bool declared;
     Type type;
-} Symbol;
+    Lit value;
+} Slot;
 
-typedef struct SymbolTable {
-    int size;
-    int index;
-    Symbol *syms;
-} SymbolTable;
+// Value cached by a TempExpr or InductExpr. base is the induction variable the value was computed from.
+typedef struct Temp {
+    bool valid;
+    Lit value;
+    long long base;
+} Temp;
 
 typedef struct Environment {
-    int currentScope;
-    SymbolTable table;
+    int size;
+    Slot *slots;
 } Environment;
 
+// A block whose run was interrupted by a nested block: the next statement, the end of the block and
+// the while node to test again when the end is reached, -1 for an if or the top level.
+typedef struct Frame {
+    int pc;
+    int end;
+    int loop;
+} Frame;
+
+// A procedure call in progress: what the caller was running with, restored when the call returns.
+// frame is the offset of the caller's slots in the locals stack, -1 for the program's own slots.
+typedef struct Call {
+    int frame;
+    SymbolTable *table;
+    int base;
+    int arrayFloor;
+} Call;
+
+// Deepest nesting of procedure calls.
+#define CALL_LIMIT 1000
+
+// Back edges taken between two looks at the limits.
+#define BUDGET_WINDOW 4096
 
+// Limits on one run, 0 for none: statements executed, times any while loop goes round, wall clock
+// seconds and bytes of output. Output is checked as each value is shown and the rest as loops go round.
+// Every call of a procedure that is not inlined counts as one time round a loop.
+typedef struct Limits {
+    long statements;
+    long iterations;
+    double seconds;
+    long output;
+} Limits;
+
+// Progress of a run against its limits: back edges up to the last check, back edges until the next,
+// the clock deadline, the output total when the run started and the output total at the last check.
+typedef struct Budget {
+    long iterations;
+    long window;
+    double deadline;
+    long output;
+    long seen;
+} Budget;
+
+// How show writes its values. SHOW_TEXT prints a line per value. SHOW_BINARY writes the raw little endian
+// value: a NUM as an 8 byte double, a BOOL as one byte 0 or 1 and an ARRAY as its elements' doubles.
+// SHOW_RECORDS writes each value as a record: a 4 byte little endian length of the rest, a kind byte,
+// SHOW_NUM, SHOW_BOOL or SHOW_ARRAY, and the value as SHOW_BINARY writes it. SHOW_CSV writes a header
+// naming a column per show statement by its line, then a row each time a show would fill a cell the
+// current row already has, and the last row when the run ends.
+typedef enum ShowFormat {
+    SHOW_TEXT, SHOW_BINARY, SHOW_RECORDS, SHOW_CSV
+} ShowFormat;
+
+// Kind bytes of SHOW_RECORDS.
+#define SHOW_NUM 0
+#define SHOW_BOOL 1
+#define SHOW_ARRAY 2
+
+// State of one run. The value stack and the frames are sized from the compact tree, so running never recurses.
 typedef struct Interpreter {
     Environment env;
-    ParseTree tree;
+    Temp *temps;
+    Lit *stack;
+    Frame *frames;
+    SymbolTable *table;
+    CompactTree *code;
+    Node *nodes;
+    // The first run time error jumps to trap, leaving the failed node in errAt, -1 for a statement.
     bool err;
+    jmp_buf trap;
+    int errAt;
+    Lit errValue;
+    // Exact integers too wide for a Lit, compacted when full.
+    long long *wides;
+    int wideCount;
+    int wideSize;
+    // Each ARRAY slot's storage at its own index, then the values of array expressions.
+    Array *arrays;
+    int arrayCount;
+    int arraySize;
+    Limits limits;
+    Budget budget;
+    Output *out;
+    // A call runs in a frame of slots on the locals stack, its expressions from base on the value stack.
+    Slot *globals;
+    SymbolTable *program;
+    Slot *locals;
+    int localTop;
+    int localSize;
+    int frameAt;
+    Call *calls;
+    int callDepth;
+    int base;
+    int arrayFloor;
+    Lit result;
+    bool errInlined;
+    long steps;
+    long fuel;
+    // Read statements take from in, NULL for none. Shown values go to shows in format.
+    Input *in;
+    Output *shows;
+    ShowFormat format;
+    bool tagLines;
+    // The current CSV row, cellAt -1 for an empty column.
+    Output cells;
+    long *cellAt;
+    long *cellEnd;
+    Trace *trace;
+    // Parallel top level statements. A task runs statement at and gives up once stopAt names an earlier one.
+    Plan *plan;
+    int threads;
+    int *stopAt;
+    int at;
+    Tier tier;
+    // NULL for none. saveDue is set once a save is due.
+    Checkpoint *checkpoint;
+    bool saveDue;
 } Interpreter;
 
-typedef struct Lit {
-    Type type;
-    double value;
-} Lit;
+// How a program is run from source. Zeroed options run optimised on one lexer thread without limits.
+typedef struct RunOptions {
+    char *cacheDir;
+    int lexThreads;
+    bool noOpt;
+    bool stats;
+    Limits limits;
+    bool perfCounters;
+    // File read statements take from, "-" for standard input and NULL for none.
+    char *input;
+    // With any format but text, messages go to stderr.
+    ShowFormat format;
+    bool tagLines;
+    // File a trace is written to, NULL for none.
+    char *trace;
+    // 0 for one per core. Limited, traced, CSV and checkpointed runs use one.
+    int threads;
+    // Back edges before a while loop is compiled, 0 for TIER_HOT and -1 for never.
+    int tierAfter;
+    // File saved every checkpointEvery back edges and file to carry on from, NULL for none.
+    char *checkpoint;
+    long checkpointEvery;
+    char *resume;
+} RunOptions;
+
+// -----------------
+// Public Functions
+// -----------------
+
+void initInterpreter(Interpreter *i, CompactTree *code, SymbolTable *table, Output *out);
+Lit numLit(double d);
+Lit doubleLit(double d);
+Lit intCases(TokenType op, long long a, long long b, long long *wide);
+int declaredSlot(Interpreter *i, int slot);
+void refuel(Interpreter *i, Node *node);
+void showResult(Interpreter *i, int at, Lit val);
+double numValue(Interpreter *i, Lit v);
+Lit exactLit(Interpreter *i, long long n);
+long long exactValue(Interpreter *i, Lit v);
+void growArrays(Interpreter *i, int count);
+Type litType(Lit v);
+void setShowFormat(Interpreter *i, Output *shows, ShowFormat format, bool tagLines);
+void interpret(Interpreter *i);
+void freeInterpreter(Interpreter *i);
+void runProgram(char *src, long len, RunOptions *opts, Output *out);
+void execute(char *path, RunOptions *opts, Output *out);
 
-typedef enum SymbolTableCodes {
-    TYPECHANGE, IN, NOTIN
-} SymCodes;
+#endif
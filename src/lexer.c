@@ -1,19 +1,41 @@
 // Lexer for the CAM programming langauge.
 
 #include "lexer.h"
+#include "memstats.h"
 #include <ctype.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
+// Fewest bytes a thread of the parallel lexer is given.
+#define LEX_CHUNK_MIN 4096
+
+// One line aligned slice of the source lexed by its own thread.
+typedef struct Chunk {
+    Lexer l;
+    Output out;
+    long start;
+    long end;
+    int lines;
+    int tokOffset;
+    Token *dest;
+} Chunk;
+
 // -----------------
 // Private Functions
 // -----------------
 
+void lexAll(Lexer *l);
+void tokenizeParallel(Lexer *l);
+void *countChunk(void *arg);
+void *lexChunk(void *arg);
+void *copyChunk(void *arg);
+void runChunks(Chunk *chunks, int n, void *(*work)(void *));
 void complexToken(Lexer *l);
 void numberToken(Lexer *l);
 void stringToken(Lexer *l);
-void error(Lexer *l);
+void lError(Lexer *l);
 void addToken(Lexer *l, TokenType t, char *lexeme);
 void printToken(Token t);
 void printTokenStream(Token in[]);
@@ -25,21 +47,64 @@ bool inArray(char *v, char *arr[], int len);
 // Main Funcs
 // ------------
 
-// Initialise a new lexer object.
-// Default values can be found here.
-void initLexer(Lexer *l, FILE *f) {
-    l->f = f;
+// Initialise a new lexer object over an in-memory source buffer.
+// Errors are written to out. Default values can be found here.
+void initLexer(Lexer *l, const char *src, long len, Output *out) {
+    l->out = out;
+    l->src = src;
+    l->srcLength = len;
+    l->pos = 0;
     l->err = false;
     l->line = 0;
     l->col = 0;
-    l->tokens = malloc(sizeof(Token) * 100);
+    l->tokSize = 100;
+    l->tokens = malloc(sizeof(Token) * l->tokSize);
+    MEM_COUNT(MEM_TOKENS, sizeof(Token) * l->tokSize);
     l->tokLength = 0;
-    l->lookahead = getc(f);
+    l->threads = 1;
+    l->lookahead = l->srcLength > 0 ? l->src[l->pos++] : EOF;
+}
+
+// Read the whole of a source file into memory.
+// The length is written to len and the buffer is NUL terminated.
+char *readSource(FILE *f, long *len) {
+    long size = 4096;
+    long used = 0;
+    char *buf = malloc(size);
+    size_t got;
+    while ((got = fread(buf + used, 1, size - used - 1, f)) > 0) {
+        used += got;
+        if (size - used - 1 == 0) {
+            size *= 2;
+            buf = realloc(buf, size);
+        }
+    }
+    buf[used] = '\0';
+    *len = used;
+    return buf;
 }
 
 // Converts an input file into a token stream ready for parsing.
-// One lookahead character is used.
+// Large sources are split across l->threads threads when more than one is set.
 void tokenize(Lexer *l) {
+    if (l->threads > 1 && l->srcLength >= PARALLEL_LEX_MIN) {
+        tokenizeParallel(l);
+    } else {
+        lexAll(l);
+    }
+    if (l->err) {
+        l->tokLength = 0;
+    }
+
+    // Add the end token, followed by a copy the parser may read as its lookahead.
+    addToken(l, END, "EOF");
+    addToken(l, END, "EOF");
+    l->tokLength--;
+    MEM_HIGH(maxTokens, l->tokLength);
+}
+
+// Lex every character of the source. One lookahead character is used.
+void lexAll(Lexer *l) {
     while (next(l) != EOF && !(l->err)) {
         switch (l->current) {
             case '\n': 
@@ -57,6 +122,15 @@ void tokenize(Lexer *l) {
             case ')':
                 addToken(l, RPAREN, ")");
                 break;
+            case '[':
+                addToken(l, LSQUARE, "[");
+                break;
+            case ']':
+                addToken(l, RSQUARE, "]");
+                break;
+            case ',':
+                addToken(l, COMMA, ",");
+                break;
             case ';':
                 addToken(l, SEMICOLON, ";");
                 break;
@@ -71,12 +145,12 @@ void tokenize(Lexer *l) {
                 break;
             case '/':
                 if (peek(l) == '/') {
-                    while (peek(l) != '\n') {
+                    while (peek(l) != '\n' && peek(l) != EOF) {
                         next(l);
                     }
                     next(l);
                     l->line++;
-                    l->col = 0;
+                    l->col = -1;
                 } else {
                     addToken(l, SLASH, "/");
                 }
@@ -124,12 +198,108 @@ void tokenize(Lexer *l) {
         }
         l->col++;
     }
-    if (l->err) {
-        l->tokLength = 0;
+}
+
+// -----------------
+// Parallel lexing
+// No token or comment spans a newline, so the source can be cut just after any newline and each
+// piece lexed independently, starting at column 0 of a known line.
+// -----------------
+
+// Lex the source in line aligned chunks on up to l->threads threads, each given at least
+// LEX_CHUNK_MIN bytes so a thread count near the source length never leaves a chunk empty.
+// The result, including the first error message and the final line and column, is the same as lexAll.
+void tokenizeParallel(Lexer *l) {
+    long most = l->srcLength / LEX_CHUNK_MIN;
+    int n = l->threads < most ? l->threads : most > 0 ? (int) most : 1;
+    Chunk *chunks = calloc(n, sizeof(Chunk));
+    long start = 0;
+    for (int c = 0; c < n; c++) {
+        long end = c == n - 1 ? l->srcLength : l->srcLength / n * (c + 1);
+        if (end < start) end = start;
+        while (end > 0 && end < l->srcLength && l->src[end - 1] != '\n') end++;
+        chunks[c].start = start;
+        chunks[c].end = end;
+        start = end;
     }
 
-    // Add the end token.
-    addToken(l, END, "EOF");
+    for (int c = 0; c < n; c++) {
+        initOutput(&chunks[c].out, NULL);
+        initLexer(&chunks[c].l, l->src + chunks[c].start, chunks[c].end - chunks[c].start, &chunks[c].out);
+    }
+
+    // Line numbers of each chunk come from the newlines before it.
+    runChunks(chunks, n, countChunk);
+    int line = l->line;
+    for (int c = 0; c < n; c++) {
+        chunks[c].l.line = line;
+        line += chunks[c].lines;
+    }
+    runChunks(chunks, n, lexChunk);
+
+    // Only the first error would have been seen by a serial lexer.
+    int total = 0;
+    for (int c = 0; c < n; c++) {
+        if (chunks[c].l.err) {
+            l->err = true;
+            outPrintf(l->out, "%.*s", (int) chunks[c].out.used, chunks[c].out.data);
+            l->line = chunks[c].l.line;
+            l->col = chunks[c].l.col;
+            break;
+        }
+        chunks[c].tokOffset = total;
+        total += chunks[c].l.tokLength;
+    }
+
+    if (!l->err) {
+        if (l->tokSize < total + 1) {
+            MEM_COUNT(MEM_TOKENS, sizeof(Token) * (total + 1 - l->tokSize));
+            l->tokSize = total + 1;
+            l->tokens = realloc(l->tokens, sizeof(Token) * l->tokSize);
+        }
+        for (int c = 0; c < n; c++) chunks[c].dest = l->tokens;
+        runChunks(chunks, n, copyChunk);
+        l->tokLength = total;
+        l->line = chunks[n - 1].l.line;
+        l->col = chunks[n - 1].l.col;
+    }
+    for (int c = 0; c < n; c++) {
+        free(chunks[c].l.tokens);
+        freeOutput(&chunks[c].out);
+    }
+    free(chunks);
+}
+
+// Count the newlines in a chunk.
+void *countChunk(void *arg) {
+    Chunk *c = arg;
+    int lines = 0;
+    for (long j = 0; j < c->l.srcLength; j++) {
+        if (c->l.src[j] == '\n') lines++;
+    }
+    c->lines = lines;
+    return NULL;
+}
+
+// Lex a chunk into its own token vector.
+void *lexChunk(void *arg) {
+    lexAll(&((Chunk *) arg)->l);
+    return NULL;
+}
+
+// Copy a chunk's tokens to their place in the final stream.
+void *copyChunk(void *arg) {
+    Chunk *c = arg;
+    memcpy(c->dest + c->tokOffset, c->l.tokens, sizeof(Token) * c->l.tokLength);
+    return NULL;
+}
+
+// Run one phase over every chunk, one thread per chunk.
+void runChunks(Chunk *chunks, int n, void *(*work)(void *)) {
+    pthread_t *ids = malloc(sizeof(pthread_t) * n);
+    for (int c = 0; c < n; c++) pthread_create(&ids[c], NULL, work, &chunks[c]);
+    for (int c = 0; c < n; c++) pthread_join(ids[c], NULL);
+    free(ids);
 }
 
 // Handle a character that is part of a complex lexeme.
@@ -139,7 +309,7 @@ void complexToken(Lexer *l) {
     } else if (isalpha(l->current)) {
         stringToken(l);
     } else {
-        error(l);
+        lError(l);
     }
 }
 
@@ -171,11 +341,12 @@ void stringToken(Lexer *l) {
     }
     str[index++] = '\0';
     
-    char *keywords[] = {"if", "let", "while", "be", "then", "endif", "endwhile", "do", "show"}; // Len 9
+    char *keywords[] = {"if", "let", "while", "be", "then", "endif", "endwhile", "do", "show",
+                        "proc", "endproc", "return", "read", "eof"}; // Len 14
     char *bools[] = {"true", "false"}; // Len 2
     char *types[] = {"num", "bool"}; // Len 2
 
-    if (inArray(str, keywords, 9)) {
+    if (inArray(str, keywords, 14)) {
         addToken(l, KEYWORD, str);
     } else if (inArray(str, bools, 2)) {
         addToken(l, BOOLEAN, str);
@@ -188,9 +359,9 @@ void stringToken(Lexer *l) {
 }
 
 // Print useful error message with line,col numbers and error.
-void error(Lexer *l) {
+void lError(Lexer *l) {
     l->err = true;
-    printf("Error (%d:%d): Unidentified character '%c'.\n", l->line+1, l->col+1, l->current);
+    outPrintf(l->out, "Error (%d:%d): Unidentified character '%c'.\n", l->line+1, l->col+1, l->current);
 }
 
 // ------------
@@ -201,6 +372,11 @@ void error(Lexer *l) {
 void addToken(Lexer *l, TokenType t, char *lexeme) {
     Token tok = {l->line, l->col, t, ""};
     strcpy(tok.lexeme, lexeme);
+    if (l->tokLength == l->tokSize) {
+        MEM_COUNT(MEM_TOKENS, sizeof(Token) * l->tokSize);
+        l->tokSize *= 2;
+        l->tokens = realloc(l->tokens, sizeof(Token) * l->tokSize);
+    }
     l->tokens[l->tokLength++] = tok; 
 }
 
@@ -218,10 +394,10 @@ void printTokenStream(Token in[]) {
     printToken(in[index]);
 }
 
-// Get the next character in the file.
+// Get the next character in the source buffer.
 char next(Lexer *l) {
     l->current = l->lookahead;
-    l->lookahead = getc(l->f);
+    l->lookahead = l->pos < l->srcLength ? l->src[l->pos++] : EOF;
     return l->current;
 }
 
@@ -246,9 +422,14 @@ bool inArray(char *v, char *arr[], int len) {
 void test() {
     FILE *f = fopen("/Users/cameron/OneDrive - University of Bristol/Imperative Programming/CAMlang/test.cam", "r");
     if (f == NULL) return; 
+    long len;
+    char *src = readSource(f, &len);
+    Output out;
+    initOutput(&out, stdout);
     Lexer *l = malloc(sizeof(Lexer));
-    initLexer(l, f);
+    initLexer(l, src, len, &out);
     tokenize(l);
+    flushOutput(&out);
     printTokenStream(l->tokens);
 }
 /*
@@ -1,5 +1,9 @@
+#ifndef LEXER_H
+#define LEXER_H
+
 #include <stdbool.h>
 #include <stdio.h>
+#include "output.h"
 
 // -----------------
 // Public Objects
@@ -8,7 +12,7 @@
 // Define all token types in the CAM language.
 typedef enum TokenType {
     END, ID, KEYWORD, NUMBER, BOOLEAN,
-    SEMICOLON, LPAREN, RPAREN, EQUALS,
+    SEMICOLON, LPAREN, RPAREN, LSQUARE, RSQUARE, COMMA, EQUALS,
     EQEQUALS, BANG, BANGEQ, LTHAN, GTHAN,
     GTHANEQ, LTHANEQ, STAR, PLUS, MINUS,
     SLASH, AND, OR, TYPES
@@ -24,19 +28,30 @@ typedef struct Token {
 
 // Lexer structure.
 typedef struct Lexer {
-    FILE *f;
+    const char *src;
+    long srcLength;
+    long pos;
     char current;
     char lookahead;
     bool err;
     int line;
     int col;
     int tokLength;
+    int tokSize;
     Token *tokens;   
+    Output *out;
+    int threads;
 } Lexer;
 
 // -----------------
 // Public Functions
 // -----------------
 
+// Sources smaller than this are always lexed on one thread.
+#define PARALLEL_LEX_MIN 65536
+
 void tokenize(Lexer *l);
-void initLexer(Lexer *l, FILE *f);
+void initLexer(Lexer *l, const char *src, long len, Output *out);
+char *readSource(FILE *f, long *len);
+
+#endif
@@ -0,0 +1,252 @@
+// Command line entry point for the CAM programming langauge.
+
+#include "interpreter.h"
+#include "batch.h"
+#include "cam.h"
+#include "memstats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// -----------------
+// Private Functions
+// -----------------
+
+int usage(void);
+int showFormat(char *name);
+bool runRows(char *path, char *csv);
+int splitFields(char *line, char **fields, int max);
+
+// Run with no args to execute test.cam.
+int main(int argc, char *argk[]) {
+    char *path = "test.cam";
+    RunOptions opts = {.cacheDir = NULL, .lexThreads = 1, .noOpt = false, .stats = false, .limits = {0, 0, 0, 0},
+                       .perfCounters = false, .input = "-", .format = SHOW_TEXT, .tagLines = false, .trace = NULL,
+                       .threads = 0, .tierAfter = 0, .checkpoint = NULL, .checkpointEvery = 0, .resume = NULL};
+    char *decode = NULL;
+    char *batch = NULL;
+    char *rows = NULL;
+    int threads = 0;
+    bool memStats = false;
+    for (int a = 1; a < argc; a++) {
+        if (!strcmp(argk[a], "--cache") && a + 1 < argc) {
+            opts.cacheDir = argk[++a];
+        } else if (!strcmp(argk[a], "--lex-threads") && a + 1 < argc) {
+            opts.lexThreads = atoi(argk[++a]);
+        } else if (!strcmp(argk[a], "--no-opt")) {
+            opts.noOpt = true;
+        } else if (!strcmp(argk[a], "--stats")) {
+            opts.stats = true;
+        } else if (!strcmp(argk[a], "--input") && a + 1 < argc) {
+            opts.input = argk[++a];
+        } else if (!strcmp(argk[a], "--show-format") && a + 1 < argc) {
+            int f = showFormat(argk[++a]);
+            if (f == -1) return usage();
+            opts.format = f;
+        } else if (!strcmp(argk[a], "--show-lines")) {
+            opts.tagLines = true;
+        } else if (!strcmp(argk[a], "--trace") && a + 1 < argc) {
+            opts.trace = argk[++a];
+        } else if (!strcmp(argk[a], "--decode-trace") && a + 1 < argc) {
+            decode = argk[++a];
+        } else if (!strcmp(argk[a], "--perf-counters")) {
+            opts.perfCounters = true;
+        } else if (!strcmp(argk[a], "--mem-stats")) {
+            memStats = true;
+        } else if (!strcmp(argk[a], "--batch") && a + 1 < argc) {
+            batch = argk[++a];
+        } else if (!strcmp(argk[a], "--threads") && a + 1 < argc) {
+            threads = atoi(argk[++a]);
+            opts.threads = threads;
+        } else if (!strcmp(argk[a], "--no-tier")) {
+            opts.tierAfter = -1;
+        } else if (!strcmp(argk[a], "--tier-after") && a + 1 < argc) {
+            opts.tierAfter = atoi(argk[++a]);
+            if (opts.tierAfter <= 0) return usage();
+        } else if (!strcmp(argk[a], "--checkpoint-every") && a + 1 < argc) {
+            opts.checkpointEvery = atol(argk[++a]);
+            if (opts.checkpointEvery <= 0) return usage();
+        } else if (!strcmp(argk[a], "--resume") && a + 1 < argc) {
+            opts.resume = argk[++a];
+        } else if (!strcmp(argk[a], "--rows") && a + 1 < argc) {
+            rows = argk[++a];
+        } else if (!strcmp(argk[a], "--max-statements") && a + 1 < argc) {
+            opts.limits.statements = atol(argk[++a]);
+        } else if (!strcmp(argk[a], "--max-iterations") && a + 1 < argc) {
+            opts.limits.iterations = atol(argk[++a]);
+        } else if (!strcmp(argk[a], "--max-seconds") && a + 1 < argc) {
+            opts.limits.seconds = atof(argk[++a]);
+        } else if (!strcmp(argk[a], "--max-output") && a + 1 < argc) {
+            opts.limits.output = atol(argk[++a]);
+        } else if (argk[a][0] != '-') {
+            path = argk[a];
+        } else {
+            return usage();
+        }
+    }
+    int status = 0;
+    if (decode != NULL) {
+        Output out;
+        initOutput(&out, stdout);
+        status = decodeTrace(decode, &out) ? 0 : 1;
+        flushOutput(&out);
+        freeOutput(&out);
+    } else if (batch != NULL) {
+        status = runBatch(batch, threads, &opts.limits) ? 0 : 1;
+    } else if (rows != NULL) {
+        status = runRows(path, rows) ? 0 : 1;
+    } else {
+        // Checkpoints of a program are written beside it.
+        if (opts.checkpointEvery) {
+            opts.checkpoint = malloc(strlen(path) + 6);
+            sprintf(opts.checkpoint, "%s.ckpt", path);
+        }
+        Output out;
+        initOutput(&out, stdout);
+        execute(path, &opts, &out);
+        flushOutput(&out);
+        freeOutput(&out);
+        free(opts.checkpoint);
+    }
+    if (memStats) printMemStats();
+    return status;
+}
+
+// Print the usage message.
+int usage(void) {
+    printf("Usage: cam [--cache dir] [--lex-threads n] [--no-opt] [--stats] [--mem-stats] [--perf-counters]\n"
+           "           [--input file] [--show-format text|binary|records|csv] [--show-lines] [--trace file]\n"
+           "           [--threads n] [--no-tier] [--tier-after n] [--checkpoint-every n] [--resume file]\n"
+           "           [limits] [file]\n"
+           "       cam --decode-trace file\n"
+           "       cam --batch dir|list [--threads n] [limits]\n"
+           "       cam --rows data.csv [file]\n"
+           "Limits: [--max-statements n] [--max-iterations n] [--max-seconds s] [--max-output bytes]\n");
+    return 1;
+}
+
+// The show format with a name, -1 for none.
+int showFormat(char *name) {
+    char *names[] = {"text", "binary", "records", "csv"};
+    for (int f = 0; f < 4; f++) {
+        if (!strcmp(name, names[f])) return f;
+    }
+    return -1;
+}
+
+// -----------------
+// Row mode
+// -----------------
+
+// Run a program once per row of a CSV file whose header names top level variables.
+// Prints a CSV of every top level variable after each row, leaving the cells of failed rows empty.
+bool runRows(char *path, char *csv) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        printf("Error: Could not open file '%s'.\n", path);
+        return false;
+    }
+    long len;
+    char *src = readSource(f, &len);
+    fclose(f);
+    char err[4096];
+    CamProgram *prog = camCompile(src, len, err, sizeof(err));
+    free(src);
+    if (prog == NULL) {
+        printf("%s", err);
+        return false;
+    }
+
+    f = fopen(csv, "r");
+    if (f == NULL) {
+        printf("Error: Could not open file '%s'.\n", csv);
+        camFreeProgram(prog);
+        return false;
+    }
+    char *data = readSource(f, &len);
+    fclose(f);
+
+    // Header line then one row per line.
+    char *line = strtok(data, "\n");
+    char *names[256];
+    int inCount = line != NULL ? splitFields(line, names, 256) : 0;
+    long rows = 0;
+    long size = 1024;
+    double **inputs = malloc(sizeof(double *) * (inCount + 1));
+    for (int k = 0; k < inCount; k++) inputs[k] = malloc(sizeof(double) * size);
+    while ((line = strtok(NULL, "\n")) != NULL) {
+        char *fields[256];
+        if (splitFields(line, fields, 256) == 0) continue;
+        if (rows == size) {
+            size *= 2;
+            for (int k = 0; k < inCount; k++) inputs[k] = realloc(inputs[k], sizeof(double) * size);
+        }
+        for (int k = 0; k < inCount; k++) {
+            char *v = fields[k] != NULL ? fields[k] : "0";
+            inputs[k][rows] = !strcmp(v, "true") ? 1 : !strcmp(v, "false") ? 0 : atof(v);
+        }
+        rows++;
+    }
+
+    const char *outNames[256];
+    bool isBool[256];
+    int outCount = camVariables(prog, outNames, isBool, 256);
+    if (outCount > 256) outCount = 256;
+    double **outputs = malloc(sizeof(double *) * (outCount + 1));
+    for (int k = 0; k < outCount; k++) outputs[k] = malloc(sizeof(double) * (rows + 1));
+
+    CamContext *ctx = camNewContext(prog);
+    long failed = camRunRows(ctx, rows, inCount, (const char **) names, (const double **) inputs,
+                             outCount, outNames, outputs);
+    if (failed < 0) {
+        printf("Error: CSV column is not a top level variable.\n");
+    } else {
+        Output out;
+        initOutput(&out, stdout);
+        for (int k = 0; k < outCount; k++) outPrintf(&out, k ? ",%s" : "%s", outNames[k]);
+        outPrintf(&out, "\n");
+        for (long r = 0; r < rows; r++) {
+            for (int k = 0; k < outCount; k++) {
+                double v = outputs[k][r];
+                if (k) outPrintf(&out, ",");
+                if (v != v) continue;
+                if (isBool[k]) {
+                    outPrintf(&out, v ? "true" : "false");
+                } else {
+                    outPrintf(&out, "%.17g", v);
+                }
+            }
+            outPrintf(&out, "\n");
+        }
+        flushOutput(&out);
+        freeOutput(&out);
+        if (failed) fprintf(stderr, "%ld rows failed.\n", failed);
+    }
+
+    camFreeContext(ctx);
+    camFreeProgram(prog);
+    for (int k = 0; k < inCount; k++) free(inputs[k]);
+    for (int k = 0; k < outCount; k++) free(outputs[k]);
+    free(inputs);
+    free(outputs);
+    free(data);
+    return failed == 0;
+}
+
+// Split a CSV line in place, trimming spaces. Missing fields are NULL.
+int splitFields(char *line, char **fields, int max) {
+    int n = 0;
+    for (int k = 0; k < max; k++) fields[k] = NULL;
+    char *field = line;
+    while (field != NULL && n < max) {
+        char *comma = strchr(field, ',');
+        if (comma != NULL) *comma = '\0';
+        while (*field == ' ') field++;
+        long end = strlen(field);
+        while (end > 0 && (field[end - 1] == ' ' || field[end - 1] == '\r')) field[--end] = '\0';
+        fields[n++] = field;
+        field = comma != NULL ? comma + 1 : NULL;
+    }
+    if (n == 1 && fields[0][0] == '\0') return 0;
+    return n;
+}
@@ -0,0 +1,51 @@
+// Memory and allocation statistics for the CAM programming langauge.
+// Allocation sites count themselves against a pool with relaxed atomic adds. Nothing walks the heap,
+// so the counters are cheap enough to always be on and only cost anything when they are read.
+
+#include "memstats.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+
+MemCounters memCounters;
+
+// -----------------
+// Main Funcs
+// -----------------
+
+// Raise a high water mark to n unless another thread got it higher first.
+void memHigh(long long *mark, long long n) {
+    long long seen = __atomic_load_n(mark, __ATOMIC_RELAXED);
+    while (n > seen && !__atomic_compare_exchange_n(mark, &seen, n, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+// Copy the counters, adding the peak resident set size of the process in kilobytes.
+void readMemStats(MemCounters *c) {
+    for (int p = 0; p < MEM_POOLS; p++) {
+        c->bytes[p] = __atomic_load_n(&memCounters.bytes[p], __ATOMIC_RELAXED);
+        c->allocs[p] = __atomic_load_n(&memCounters.allocs[p], __ATOMIC_RELAXED);
+    }
+    c->maxTokens = __atomic_load_n(&memCounters.maxTokens, __ATOMIC_RELAXED);
+    c->maxNodes = __atomic_load_n(&memCounters.maxNodes, __ATOMIC_RELAXED);
+    c->maxDepth = __atomic_load_n(&memCounters.maxDepth, __ATOMIC_RELAXED);
+    struct rusage usage;
+    c->peakRss = getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+}
+
+// Zero every counter. Not safe while other threads are allocating.
+void resetMemStats(void) {
+    memset(&memCounters, 0, sizeof(memCounters));
+}
+
+// Print the counters to stderr.
+void printMemStats(void) {
+    char *names[MEM_POOLS] = {"tokens", "nodes", "symbols", "output", "runtime"};
+    MemCounters c;
+    readMemStats(&c);
+    fprintf(stderr, "Memory: peak RSS %lld KB\n", c.peakRss);
+    for (int p = 0; p < MEM_POOLS; p++) {
+        fprintf(stderr, "  %-8s %12lld bytes %9lld allocations\n", names[p], c.bytes[p], c.allocs[p]);
+    }
+    fprintf(stderr, "  high water: %lld tokens, %lld nodes, depth %lld\n", c.maxTokens, c.maxNodes, c.maxDepth);
+}
@@ -0,0 +1,43 @@
+#ifndef MEMSTATS_H
+#define MEMSTATS_H
+
+// -----------------
+// Public Objects
+// -----------------
+
+// The parts of a run memory is counted against.
+typedef enum MemPool {
+    MEM_TOKENS, MEM_NODES, MEM_SYMBOLS, MEM_OUTPUT, MEM_RUNTIME, MEM_POOLS
+} MemPool;
+
+// Process wide allocation counters. bytes counts the bytes asked for, a growing realloc counting only
+// what it adds, and allocs the calls made. The max fields are high water marks of the longest token
+// stream, the largest lowered tree and its deepest block nesting. peakRss is filled in by readMemStats.
+typedef struct MemCounters {
+    long long bytes[MEM_POOLS];
+    long long allocs[MEM_POOLS];
+    long long maxTokens;
+    long long maxNodes;
+    long long maxDepth;
+    long long peakRss;
+} MemCounters;
+
+extern MemCounters memCounters;
+
+// Count an allocation of n bytes against a pool. Relaxed atomic adds, so batch threads can share them.
+#define MEM_COUNT(pool, n) (__atomic_fetch_add(&memCounters.bytes[pool], (long long) (n), __ATOMIC_RELAXED), \
+                            __atomic_fetch_add(&memCounters.allocs[pool], 1, __ATOMIC_RELAXED))
+
+// Raise a high water mark to n.
+#define MEM_HIGH(field, n) memHigh(&memCounters.field, n)
+
+// -----------------
+// Public Functions
+// -----------------
+
+void memHigh(long long *mark, long long n);
+void readMemStats(MemCounters *c);
+void resetMemStats(void);
+void printMemStats(void);
+
+#endif
@@ -0,0 +1,940 @@
+// Optimiser for the CAM programming langauge.
+// Runs on the resolved tree before interpreting. Expressions that a while loop never changes are kept in
+// temporaries for each entry into the loop, and products of an induction variable with a constant are
+// updated by addition as the variable steps. Assignments overwritten before being read are removed and
+// repeated expressions within a block reuse the first result. Procedures that only return an expression
+// of their parameters are marked for their calls to be expanded in place. Every rewrite leaves the output,
+// errors included, unchanged.
+
+#include "optimiser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Structural hash and node count of one expression node, stored in pre-order.
+typedef struct ExprInfo {
+    unsigned long long hash;
+    int size;
+} ExprInfo;
+
+// An expression available for reuse in the current block.
+typedef struct Value {
+    void **at;
+    void *expr;
+    unsigned long long hash;
+    long time;
+    int temp;
+    int next;
+} Value;
+
+// Expressions seen so far in a block, hashed by structure.
+typedef struct Numbering {
+    Value *values;
+    int count;
+    int size;
+    int *buckets;
+    int bucketCount;
+} Numbering;
+
+// What the loop being optimised does to each name. Names are identified by their outermost slot.
+typedef struct Opt {
+    SymbolTable *table;
+    OptStats *stats;
+    int *root;
+    int *assigns;
+    bool *declared;
+    bool *stepOk;
+    long long *step;
+    int *touched;
+    int touchedCount;
+    bool *definite;
+    bool *assigned;
+    Type *declType;
+    int *undo;
+    int undoCount;
+    int *overwrite;
+    long *killTime;
+    long clock;
+    ExprInfo *info;
+    int infoCount;
+    int infoSize;
+} Opt;
+
+// -----------------
+// Private Functions
+// -----------------
+
+void inlineProcs(SymbolTable *table, OptStats *stats);
+int inlineSize(void *expr, int params, int *sizes);
+void optimiseBlock(Opt *o, ParseTree tree);
+void *optimiseLoop(Opt *o, WhileStmt *loop);
+void markLoop(Opt *o, ParseTree body);
+void markName(Opt *o, int slot, bool declared, VarAssignStmt *assign);
+void clearLoop(Opt *o);
+bool killed(Opt *o, int slot);
+bool invariant(Opt *o, void *expr);
+bool worthHoisting(void *expr);
+void rewriteStmts(Opt *o, ParseTree body, void (*rewrite)(Opt *, void **));
+void hoistExpr(Opt *o, void **at);
+void reduceExpr(Opt *o, void **at);
+void deadBlock(Opt *o, ParseTree block);
+void markDeclared(Opt *o, int slot, Type type);
+Type safeType(Opt *o, void *expr);
+void clearReads(Opt *o, void *stmt);
+void setOverwrite(Opt *o, int root, int slot);
+void numberBlock(Opt *o, ParseTree block);
+void numberExpr(Opt *o, Numbering *vn, void **at, int *k);
+unsigned long long hashExpr(Opt *o, void *expr);
+unsigned long long mixHash(unsigned long long h);
+bool sameExpr(void *a, void *b);
+bool stillValid(Opt *o, void *expr, long time);
+void killSlot(Opt *o, int slot);
+Value *findValue(Numbering *vn, void *expr, unsigned long long hash);
+void addValue(Opt *o, Numbering *vn, void **at, void *expr, unsigned long long hash, long time);
+int countNodes(void *expr);
+bool inductionStep(VarAssignStmt *assign, long long *step);
+bool smallInteger(void *expr, long long *value);
+
+// -----------------
+// Main Funcs
+// -----------------
+
+// Optimise a resolved tree, allocating temporaries in table->temps. Trees deeper than DEPTH_LIMIT are
+// left alone since the passes recurse, and so are programs using arrays, whose values live in
+// scratch storage no temporary may keep. Loops are rewritten first, then dead stores are removed so no reused expression is lost with them.
+// Procedure bodies are left as they are.
+void optimise(ParseTree tree, SymbolTable *table, OptStats *stats) {
+    if (table->depth > DEPTH_LIMIT) return;
+    inlineProcs(table, stats);
+    if (table->arrays) return;
+    int n = table->index ? table->index : 1;
+    Opt o = {table, stats, malloc(sizeof(int) * n), calloc(n, sizeof(int)), calloc(n, sizeof(bool)),
+             calloc(n, sizeof(bool)), calloc(n, sizeof(long long)), malloc(sizeof(int) * n), 0,
+             calloc(n, sizeof(bool)), calloc(n, sizeof(bool)), calloc(n, sizeof(Type)),
+             malloc(sizeof(int) * n * 2), 0, malloc(sizeof(int) * n), calloc(n, sizeof(long)), 0,
+             NULL, 0, 0};
+    for (int s = 0; s < table->index; s++) {
+        int r = s;
+        while (table->syms[r].outer != -1) r = table->syms[r].outer;
+        o.root[s] = r;
+        o.overwrite[s] = -1;
+    }
+
+    optimiseBlock(&o, tree);
+    deadBlock(&o, tree);
+    numberBlock(&o, tree);
+
+    free(o.root);
+    free(o.assigns);
+    free(o.declared);
+    free(o.stepOk);
+    free(o.step);
+    free(o.touched);
+    free(o.definite);
+    free(o.assigned);
+    free(o.declType);
+    free(o.undo);
+    free(o.overwrite);
+    free(o.killTime);
+    free(o.info);
+}
+
+// Print the optimiser counts to stderr.
+void printStats(OptStats *stats) {
+    fprintf(stderr, "Optimiser: %d hoisted, %d strength reduced, %d dead stores removed (%d nodes), "
+            "%d common subexpressions reused (%d nodes), %d procedures inlined\n", stats->hoisted, stats->reduced,
+            stats->deadStores, stats->deadNodes, stats->common, stats->commonNodes, stats->inlined);
+}
+
+// -----------------
+// Inlining
+// -----------------
+
+// Mark the procedures whose body is a single return of arithmetic on the parameters and calls of
+// procedures already marked, at most INLINE_LIMIT nodes once those calls are expanded. Marking starts
+// from none and only builds on marked procedures, so no recursive procedure is ever marked.
+void inlineProcs(SymbolTable *table, OptStats *stats) {
+    int *sizes = calloc(table->procCount ? table->procCount : 1, sizeof(int));
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int k = 0; k < table->procCount; k++) {
+            Procedure *proc = &table->procs[k];
+            ReturnStmt *ret = proc->stmt->body.index == 1 ? proc->stmt->body.stmts[0] : NULL;
+            if (proc->stmt->inlined || ret == NULL || ret->s != RETURN) continue;
+            int size = inlineSize(ret->expr, proc->params, sizes);
+            if (size == -1 || size > INLINE_LIMIT) continue;
+            proc->stmt->inlined = true;
+            sizes[k] = size;
+            stats->inlined++;
+            changed = true;
+        }
+    }
+    free(sizes);
+}
+
+// Nodes in an expression with the calls in it expanded, or -1 when it reads anything but the first
+// params slots or calls a procedure that is not marked. sizes holds the size of each marked procedure.
+int inlineSize(void *expr, int params, int *sizes) {
+    switch (((VarExpr *) expr)->s) {
+        case LITERAL:
+            return 1;
+        case VAR: {
+            int slot = ((VarExpr *) expr)->slot;
+            return slot >= 0 && slot < params ? 1 : -1;
+        }
+        case BRACKET:
+        case UNOP: {
+            void *kid = ((VarExpr *) expr)->s == BRACKET ? ((BracketExpr *) expr)->expr : ((UnOpExpr *) expr)->right;
+            int size = inlineSize(kid, params, sizes);
+            return size == -1 ? -1 : size + 1;
+        }
+        case BINOP: {
+            int left = inlineSize(((BinOpExpr *) expr)->left, params, sizes);
+            int right = inlineSize(((BinOpExpr *) expr)->right, params, sizes);
+            return left == -1 || right == -1 ? -1 : left + right + 1;
+        }
+        case CALL: {
+            CallExpr *call = expr;
+            if (call->proc == NULL || !call->proc->inlined || call->args.index != call->proc->params.index) return -1;
+            int size = sizes[call->proc->index] + 2;
+            for (int j = 0; j < call->args.index; j++) {
+                int arg = inlineSize(call->args.stmts[j], params, sizes);
+                if (arg == -1) return -1;
+                size += arg;
+            }
+            return size;
+        }
+        default:
+            return -1;
+    }
+}
+
+// Optimise the loops in a list of statements, outermost first.
+void optimiseBlock(Opt *o, ParseTree tree) {
+    for (int j = 0; j < tree.index; j++) {
+        void *stmt = tree.stmts[j];
+        switch (((VarExpr *) stmt)->s) {
+            case WHILE:
+                tree.stmts[j] = optimiseLoop(o, stmt);
+                break;
+            case IF:
+                optimiseBlock(o, ((IfStmt *) stmt)->trueBranch);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// Hoist and strength reduce one loop, then its inner loops.
+// Returns the loop wrapped in a HoistStmt if it was given any temporaries.
+void *optimiseLoop(Opt *o, WhileStmt *loop) {
+    int first = o->table->temps;
+    markLoop(o, loop->trueBranch);
+    hoistExpr(o, &loop->cond);
+    rewriteStmts(o, loop->trueBranch, hoistExpr);
+    reduceExpr(o, &loop->cond);
+    rewriteStmts(o, loop->trueBranch, reduceExpr);
+    clearLoop(o);
+    int count = o->table->temps - first;
+
+    optimiseBlock(o, loop->trueBranch);
+    if (count == 0) return loop;
+    HoistStmt *h = newNode(sizeof(HoistStmt));
+    *h = (HoistStmt) {HOIST, loop, first, count};
+    return h;
+}
+
+// -----------------
+// Loop analysis
+// -----------------
+
+// Record every name assigned or declared anywhere in a loop body.
+void markLoop(Opt *o, ParseTree body) {
+    for (int j = 0; j < body.index; j++) {
+        void *stmt = body.stmts[j];
+        switch (((VarExpr *) stmt)->s) {
+            case IF:
+            case WHILE:
+                markLoop(o, ((IfStmt *) stmt)->trueBranch);
+                break;
+            case HOIST:
+                markLoop(o, ((WhileStmt *) ((HoistStmt *) stmt)->loop)->trueBranch);
+                break;
+            case VARDEC:
+                markName(o, ((VarDecStmt *) stmt)->slot, true, NULL);
+                break;
+            case VARASSIGN:
+                markName(o, ((VarAssignStmt *) stmt)->slot, false, stmt);
+                break;
+            case READ:
+                markName(o, ((ReadStmt *) stmt)->slot, false, NULL);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// Note a declaration or assignment of a name, assign being NULL for a read. A name is an induction
+// variable while its only assignment in the loop steps it by an integer constant.
+void markName(Opt *o, int slot, bool declared, VarAssignStmt *assign) {
+    if (slot == -1) return;
+    int r = o->root[slot];
+    if (!o->assigns[r] && !o->declared[r]) o->touched[o->touchedCount++] = r;
+    if (declared) {
+        o->declared[r] = true;
+        return;
+    }
+    if (o->assigns[r]++ == 0) {
+        o->stepOk[r] = assign != NULL && inductionStep(assign, &o->step[r]);
+    } else {
+        o->stepOk[r] = false;
+    }
+}
+
+// Forget the names recorded for the last loop.
+void clearLoop(Opt *o) {
+    for (int j = 0; j < o->touchedCount; j++) {
+        int r = o->touched[j];
+        o->assigns[r] = 0;
+        o->declared[r] = false;
+        o->stepOk[r] = false;
+    }
+    o->touchedCount = 0;
+}
+
+// Whether the loop may change what a use of this slot reads.
+bool killed(Opt *o, int slot) {
+    return slot == -1 || o->assigns[o->root[slot]] || o->declared[o->root[slot]];
+}
+
+// Whether an expression has the same value on every evaluation within one entry into the loop.
+bool invariant(Opt *o, void *expr) {
+    switch (((VarExpr *) expr)->s) {
+        case LITERAL:
+        case TEMP:
+            return true;
+        case VAR:
+            return !killed(o, ((VarExpr *) expr)->slot);
+        case BRACKET:
+            return invariant(o, ((BracketExpr *) expr)->expr);
+        case UNOP:
+            return invariant(o, ((UnOpExpr *) expr)->right);
+        case BINOP:
+            return invariant(o, ((BinOpExpr *) expr)->left) && invariant(o, ((BinOpExpr *) expr)->right);
+        case INDUCT:
+            return invariant(o, ((InductExpr *) expr)->mul);
+        default:
+            return false;
+    }
+}
+
+// Only expressions that do some arithmetic are worth a temporary.
+bool worthHoisting(void *expr) {
+    switch (((VarExpr *) expr)->s) {
+        case BINOP:
+        case UNOP:
+        case INDUCT:
+            return true;
+        case BRACKET:
+            return worthHoisting(((BracketExpr *) expr)->expr);
+        default:
+            return false;
+    }
+}
+
+// -----------------
+// Rewrites
+// -----------------
+
+// Apply an expression rewrite to every expression in a loop body, including nested bodies.
+void rewriteStmts(Opt *o, ParseTree body, void (*rewrite)(Opt *, void **)) {
+    for (int j = 0; j < body.index; j++) {
+        void *stmt = body.stmts[j];
+        switch (((VarExpr *) stmt)->s) {
+            case IF:
+            case WHILE:
+                rewrite(o, &((IfStmt *) stmt)->cond);
+                rewriteStmts(o, ((IfStmt *) stmt)->trueBranch, rewrite);
+                break;
+            case HOIST: {
+                WhileStmt *loop = ((HoistStmt *) stmt)->loop;
+                rewrite(o, &loop->cond);
+                rewriteStmts(o, loop->trueBranch, rewrite);
+                break;
+            }
+            case SHOW:
+                rewrite(o, &((ShowStmt *) stmt)->expr);
+                break;
+            case VARASSIGN:
+                rewrite(o, &((VarAssignStmt *) stmt)->expr);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// Replace the largest invariant subexpressions with temporaries.
+// A temporary is only filled by an evaluation without errors, so erroring expressions still repeat their messages.
+void hoistExpr(Opt *o, void **at) {
+    void *expr = *at;
+    if (invariant(o, expr) && worthHoisting(expr)) {
+        TempExpr *t = newNode(sizeof(TempExpr));
+        *t = (TempExpr) {TEMP, expr, o->table->temps++};
+        *at = t;
+        o->stats->hoisted++;
+        return;
+    }
+    switch (((VarExpr *) expr)->s) {
+        case BINOP:
+            hoistExpr(o, &((BinOpExpr *) expr)->left);
+            hoistExpr(o, &((BinOpExpr *) expr)->right);
+            break;
+        case UNOP:
+            hoistExpr(o, &((UnOpExpr *) expr)->right);
+            break;
+        case BRACKET:
+            hoistExpr(o, &((BracketExpr *) expr)->expr);
+            break;
+        default:
+            break;
+    }
+}
+
+// Replace products of an induction variable and an integer constant with InductExprs.
+void reduceExpr(Opt *o, void **at) {
+    void *expr = *at;
+    switch (((VarExpr *) expr)->s) {
+        case BINOP: {
+            BinOpExpr *bin = expr;
+            long long k;
+            if (bin->opType == STAR) {
+                bool varLeft = ((VarExpr *) bin->left)->s == VAR && smallInteger(bin->right, &k);
+                void *var = varLeft ? bin->left : bin->right;
+                if ((varLeft || (((VarExpr *) bin->right)->s == VAR && smallInteger(bin->left, &k))) && k != 0) {
+                    int slot = ((VarExpr *) var)->slot;
+                    long long step = slot != -1 ? o->step[o->root[slot]] : 0;
+                    if (slot != -1 && o->assigns[o->root[slot]] == 1 && !o->declared[o->root[slot]] &&
+                        o->stepOk[o->root[slot]]) {
+                        InductExpr *ind = newNode(sizeof(InductExpr));
+                        *ind = (InductExpr) {INDUCT, bin, varLeft, step, step * k, o->table->temps++};
+                        *at = ind;
+                        o->stats->reduced++;
+                        return;
+                    }
+                }
+            }
+            reduceExpr(o, &bin->left);
+            reduceExpr(o, &bin->right);
+            break;
+        }
+        case UNOP:
+            reduceExpr(o, &((UnOpExpr *) expr)->right);
+            break;
+        case BRACKET:
+            reduceExpr(o, &((BracketExpr *) expr)->expr);
+            break;
+        default:
+            break;
+    }
+}
+
+// -----------------
+// Dead stores
+// -----------------
+
+// Remove the assignments in a block that are overwritten by a later assignment in the same block
+// before anything can read them. Only assignments that cannot fail are removed, so error output is kept.
+// A slot is definitely declared once a declaration for it has run at this level or an enclosing one.
+void deadBlock(Opt *o, ParseTree block) {
+    int undoStart = o->undoCount;
+    bool *safe = malloc(sizeof(bool) * (block.index ? block.index : 1));
+    for (int j = 0; j < block.index; j++) {
+        void *stmt = block.stmts[j];
+        safe[j] = false;
+        switch (((VarExpr *) stmt)->s) {
+            case VARDEC:
+                markDeclared(o, ((VarDecStmt *) stmt)->slot, ((VarDecStmt *) stmt)->type);
+                break;
+            case VARASSIGN: {
+                int slot = ((VarAssignStmt *) stmt)->slot;
+                if (slot == -1 || !o->definite[slot]) break;
+                safe[j] = safeType(o, ((VarAssignStmt *) stmt)->expr) == o->declType[slot];
+                if (!o->assigned[slot]) {
+                    o->assigned[slot] = true;
+                    o->undo[o->undoCount++] = -1 - slot;
+                }
+                break;
+            }
+            case IF:
+            case WHILE:
+                deadBlock(o, ((IfStmt *) stmt)->trueBranch);
+                break;
+            case HOIST:
+                deadBlock(o, ((WhileStmt *) ((HoistStmt *) stmt)->loop)->trueBranch);
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Walk backwards tracking, per name, the slot a later assignment overwrites before any read.
+    int touchedStart = o->touchedCount;
+    for (int j = block.index - 1; j >= 0; j--) {
+        void *stmt = block.stmts[j];
+        switch (((VarExpr *) stmt)->s) {
+            case VARASSIGN: {
+                VarAssignStmt *assign = stmt;
+                if (assign->slot != -1 && safe[j] && o->overwrite[o->root[assign->slot]] == assign->slot) {
+                    assign->s = NOP;
+                    o->stats->deadStores++;
+                    o->stats->deadNodes += 1 + countNodes(assign->expr);
+                    break;
+                }
+                if (assign->slot != -1) setOverwrite(o, o->root[assign->slot], assign->slot);
+                clearReads(o, assign->expr);
+                break;
+            }
+            case VARDEC:
+                setOverwrite(o, o->root[((VarDecStmt *) stmt)->slot], -1);
+                break;
+            case NOP:
+                break;
+            default:
+                clearReads(o, stmt);
+                break;
+        }
+    }
+    for (int j = touchedStart; j < o->touchedCount; j++) o->overwrite[o->touched[j]] = -1;
+    o->touchedCount = touchedStart;
+
+    // Declarations made inside this block are not definite after it.
+    while (o->undoCount > undoStart) {
+        int u = o->undo[--o->undoCount];
+        if (u < 0) {
+            o->assigned[-1 - u] = false;
+        } else {
+            o->definite[u] = false;
+        }
+    }
+    free(safe);
+}
+
+// Note that a declaration has run.
+void markDeclared(Opt *o, int slot, Type type) {
+    if (o->definite[slot]) return;
+    o->definite[slot] = true;
+    o->declType[slot] = type;
+    o->undo[o->undoCount++] = slot;
+}
+
+// The type of an expression that cannot fail, or UNKNOWN if it might.
+// Declared variables that may be unassigned read as NUM 0, so BOOL variables must be assigned.
+Type safeType(Opt *o, void *expr) {
+    switch (((VarExpr *) expr)->s) {
+        case LITERAL:
+            return ((LiteralExpr *) expr)->type;
+        case VAR: {
+            int slot = ((VarExpr *) expr)->slot;
+            if (slot == -1 || !o->definite[slot]) return UNKNOWN;
+            if (o->declType[slot] == BOOL && !o->assigned[slot]) return UNKNOWN;
+            return o->declType[slot];
+        }
+        case BRACKET:
+            return safeType(o, ((BracketExpr *) expr)->expr);
+        case TEMP:
+        case SAVE:
+            return safeType(o, ((TempExpr *) expr)->expr);
+        case INDUCT:
+            return safeType(o, ((InductExpr *) expr)->mul);
+        case UNOP:
+            return safeType(o, ((UnOpExpr *) expr)->right) == BOOL ? BOOL : UNKNOWN;
+        case BINOP: {
+            BinOpExpr *bin = expr;
+            Type l = safeType(o, bin->left);
+            Type r = safeType(o, bin->right);
+            if (l == UNKNOWN || r == UNKNOWN) return UNKNOWN;
+            switch (bin->opType) {
+                case OR:
+                case AND:
+                    return l == BOOL && r == BOOL ? BOOL : UNKNOWN;
+                case EQEQUALS:
+                case BANGEQ:
+                    return l == r ? BOOL : UNKNOWN;
+                case GTHAN:
+                case GTHANEQ:
+                case LTHAN:
+                case LTHANEQ:
+                    return l == NUM && r == NUM ? BOOL : UNKNOWN;
+                case PLUS:
+                case MINUS:
+                case STAR:
+                case SLASH:
+                    return l == NUM && r == NUM ? NUM : UNKNOWN;
+                default:
+                    return UNKNOWN;
+            }
+        }
+        default:
+            return UNKNOWN;
+    }
+}
+
+// Forget pending overwrites of every name a statement or expression reads or declares.
+void clearReads(Opt *o, void *stmt) {
+    switch (((VarExpr *) stmt)->s) {
+        case IF:
+        case WHILE:
+            clearReads(o, ((IfStmt *) stmt)->cond);
+            for (int j = 0; j < ((IfStmt *) stmt)->trueBranch.index; j++) {
+                clearReads(o, ((IfStmt *) stmt)->trueBranch.stmts[j]);
+            }
+            break;
+        case HOIST:
+            clearReads(o, ((HoistStmt *) stmt)->loop);
+            break;
+        case SHOW:
+        case INVOKE:
+            clearReads(o, ((ShowStmt *) stmt)->expr);
+            break;
+        case VARASSIGN:
+            clearReads(o, ((VarAssignStmt *) stmt)->expr);
+            break;
+        case CALL:
+            for (int j = 0; j < ((CallExpr *) stmt)->args.index; j++) clearReads(o, ((CallExpr *) stmt)->args.stmts[j]);
+            break;
+        case VARDEC:
+            setOverwrite(o, o->root[((VarDecStmt *) stmt)->slot], -1);
+            break;
+        case VAR:
+        case READ:
+            if (((VarExpr *) stmt)->slot != -1) setOverwrite(o, o->root[((VarExpr *) stmt)->slot], -1);
+            break;
+        case BRACKET:
+            clearReads(o, ((BracketExpr *) stmt)->expr);
+            break;
+        case UNOP:
+            clearReads(o, ((UnOpExpr *) stmt)->right);
+            break;
+        case BINOP:
+            clearReads(o, ((BinOpExpr *) stmt)->left);
+            clearReads(o, ((BinOpExpr *) stmt)->right);
+            break;
+        case TEMP:
+        case SAVE:
+            clearReads(o, ((TempExpr *) stmt)->expr);
+            break;
+        case INDUCT:
+            clearReads(o, ((InductExpr *) stmt)->mul);
+            break;
+        default:
+            break;
+    }
+}
+
+// Set the pending overwrite of a name, -1 for none. Names are remembered the first time they are set
+// so they can be reset after the block, and marked -2 rather than -1 while cleared.
+void setOverwrite(Opt *o, int root, int slot) {
+    if (o->overwrite[root] == -1) {
+        if (slot == -1) return;
+        o->touched[o->touchedCount++] = root;
+    }
+    o->overwrite[root] = slot == -1 ? -2 : slot;
+}
+
+// -----------------
+// Common subexpressions
+// -----------------
+
+// Local value numbering over a block. The first evaluation of a repeated expression becomes a SAVE
+// and later ones TEMPs reading its temporary. Every statement of a block runs in order, so the SAVE
+// always runs before its TEMPs. While conditions are evaluated again after the body, so they are left alone.
+void numberBlock(Opt *o, ParseTree block) {
+    Numbering vn = {NULL, 0, 0, malloc(sizeof(int) * 16), 16};
+    for (int b = 0; b < vn.bucketCount; b++) vn.buckets[b] = -1;
+    for (int j = 0; j < block.index; j++) {
+        void *stmt = block.stmts[j];
+        void **at = NULL;
+        switch (((VarExpr *) stmt)->s) {
+            case SHOW:
+                at = &((ShowStmt *) stmt)->expr;
+                break;
+            case VARASSIGN:
+            case IF:
+                at = &((VarAssignStmt *) stmt)->expr;
+                if (((VarExpr *) stmt)->s == IF) at = &((IfStmt *) stmt)->cond;
+                break;
+            default:
+                break;
+        }
+        if (at != NULL) {
+            o->infoCount = 0;
+            hashExpr(o, *at);
+            int k = 0;
+            numberExpr(o, &vn, at, &k);
+        }
+        switch (((VarExpr *) stmt)->s) {
+            case VARASSIGN:
+                killSlot(o, ((VarAssignStmt *) stmt)->slot);
+                break;
+            case VARDEC:
+                killSlot(o, ((VarDecStmt *) stmt)->slot);
+                break;
+            case READ:
+                killSlot(o, ((ReadStmt *) stmt)->slot);
+                break;
+            case IF:
+            case WHILE:
+                numberBlock(o, ((IfStmt *) stmt)->trueBranch);
+                break;
+            case HOIST:
+                numberBlock(o, ((WhileStmt *) ((HoistStmt *) stmt)->loop)->trueBranch);
+                break;
+            default:
+                break;
+        }
+    }
+    free(vn.values);
+    free(vn.buckets);
+}
+
+// Number the expression at 'at' in evaluation order. k walks the pre-order info from hashExpr.
+void numberExpr(Opt *o, Numbering *vn, void **at, int *k) {
+    void *expr = *at;
+    ExprInfo info = o->info[*k];
+    switch (((VarExpr *) expr)->s) {
+        case BINOP:
+        case UNOP: {
+            Value *v = findValue(vn, expr, info.hash);
+            if (v != NULL && stillValid(o, v->expr, v->time)) {
+                if (v->temp == -1) {
+                    TempExpr *save = newNode(sizeof(TempExpr));
+                    v->temp = o->table->temps++;
+                    *save = (TempExpr) {SAVE, v->expr, v->temp};
+                    *v->at = save;
+                }
+                TempExpr *use = newNode(sizeof(TempExpr));
+                *use = (TempExpr) {TEMP, expr, v->temp};
+                *at = use;
+                o->stats->common++;
+                o->stats->commonNodes += info.size;
+                *k += info.size;
+                return;
+            }
+            addValue(o, vn, at, expr, info.hash, o->clock);
+            (*k)++;
+            if (((VarExpr *) expr)->s == BINOP) {
+                numberExpr(o, vn, &((BinOpExpr *) expr)->left, k);
+                numberExpr(o, vn, &((BinOpExpr *) expr)->right, k);
+            } else {
+                numberExpr(o, vn, &((UnOpExpr *) expr)->right, k);
+            }
+            break;
+        }
+        case BRACKET:
+            (*k)++;
+            numberExpr(o, vn, &((BracketExpr *) expr)->expr, k);
+            break;
+        default:
+            // Temporaries and induction products are not entered: their evaluation may be skipped.
+            *k += info.size;
+            break;
+    }
+}
+
+// Append the structural hash and size of every node of an expression to o->info in pre-order.
+// Brackets hash as their contents. Temporaries and induction products are single leaves.
+unsigned long long hashExpr(Opt *o, void *expr) {
+    if (o->infoCount == o->infoSize) {
+        o->infoSize = o->infoSize ? o->infoSize * 2 : 64;
+        o->info = realloc(o->info, sizeof(ExprInfo) * o->infoSize);
+    }
+    int at = o->infoCount++;
+    unsigned long long h = ((VarExpr *) expr)->s;
+    switch (((VarExpr *) expr)->s) {
+        case BINOP:
+            h = h * 31 + ((BinOpExpr *) expr)->opType;
+            h = h * 1099511628211ULL + hashExpr(o, ((BinOpExpr *) expr)->left);
+            h = h * 1099511628211ULL + hashExpr(o, ((BinOpExpr *) expr)->right);
+            break;
+        case UNOP:
+            h = h * 1099511628211ULL + hashExpr(o, ((UnOpExpr *) expr)->right);
+            break;
+        case BRACKET:
+            h = hashExpr(o, ((BracketExpr *) expr)->expr);
+            break;
+        case LITERAL: {
+            unsigned long long bits;
+            memcpy(&bits, &((LiteralExpr *) expr)->value, sizeof(bits));
+            h = h * 31 + ((LiteralExpr *) expr)->type * 2 + ((LiteralExpr *) expr)->exact;
+            h = h * 1099511628211ULL + bits;
+            break;
+        }
+        case VAR:
+            h = h * 1099511628211ULL + (unsigned) ((VarExpr *) expr)->slot;
+            break;
+        case TEMP:
+            h = h * 1099511628211ULL + (unsigned) ((TempExpr *) expr)->temp;
+            break;
+        default:
+            h = h * 1099511628211ULL + (unsigned long long) (size_t) expr;
+            break;
+    }
+    h = mixHash(h);
+    o->info[at] = (ExprInfo) {h, o->infoCount - at};
+    return h;
+}
+
+// Spread every bit of a hash into the low ones the buckets are picked by (the MurmurHash3 finaliser).
+// Without it literals, whose doubles mostly differ in their high bits, all share a bucket.
+unsigned long long mixHash(unsigned long long h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    return h ^ (h >> 33);
+}
+
+// Whether two expressions always compute the same value from the same variables.
+bool sameExpr(void *a, void *b) {
+    while (((VarExpr *) a)->s == BRACKET) a = ((BracketExpr *) a)->expr;
+    while (((VarExpr *) b)->s == BRACKET) b = ((BracketExpr *) b)->expr;
+    Stmt s = ((VarExpr *) a)->s;
+    if (s != ((VarExpr *) b)->s) return false;
+    switch (s) {
+        case BINOP:
+            return ((BinOpExpr *) a)->opType == ((BinOpExpr *) b)->opType &&
+                   sameExpr(((BinOpExpr *) a)->left, ((BinOpExpr *) b)->left) &&
+                   sameExpr(((BinOpExpr *) a)->right, ((BinOpExpr *) b)->right);
+        case UNOP:
+            return sameExpr(((UnOpExpr *) a)->right, ((UnOpExpr *) b)->right);
+        case LITERAL:
+            return ((LiteralExpr *) a)->type == ((LiteralExpr *) b)->type &&
+                   ((LiteralExpr *) a)->exact == ((LiteralExpr *) b)->exact &&
+                   !memcmp(&((LiteralExpr *) a)->value, &((LiteralExpr *) b)->value, sizeof(double));
+        case VAR:
+            return ((VarExpr *) a)->slot == ((VarExpr *) b)->slot;
+        case TEMP:
+            return ((TempExpr *) a)->temp == ((TempExpr *) b)->temp;
+        default:
+            return a == b;
+    }
+}
+
+// Whether no variable an expression reads has been assigned or declared since 'time'.
+bool stillValid(Opt *o, void *expr, long time) {
+    switch (((VarExpr *) expr)->s) {
+        case VAR:
+            return ((VarExpr *) expr)->slot == -1 || o->killTime[o->root[((VarExpr *) expr)->slot]] <= time;
+        case BINOP:
+            return stillValid(o, ((BinOpExpr *) expr)->left, time) && stillValid(o, ((BinOpExpr *) expr)->right, time);
+        case UNOP:
+            return stillValid(o, ((UnOpExpr *) expr)->right, time);
+        case BRACKET:
+            return stillValid(o, ((BracketExpr *) expr)->expr, time);
+        case TEMP:
+        case SAVE:
+            return stillValid(o, ((TempExpr *) expr)->expr, time);
+        case INDUCT:
+            return stillValid(o, ((InductExpr *) expr)->mul, time);
+        default:
+            return true;
+    }
+}
+
+// Invalidate the values reading a name. Nested blocks kill as they are numbered, so enclosing
+// blocks see every assignment made inside them.
+void killSlot(Opt *o, int slot) {
+    if (slot == -1) return;
+    o->killTime[o->root[slot]] = ++o->clock;
+}
+
+// Find the most recent value with the same structure.
+Value *findValue(Numbering *vn, void *expr, unsigned long long hash) {
+    for (int v = vn->buckets[hash & (vn->bucketCount - 1)]; v != -1; v = vn->values[v].next) {
+        if (vn->values[v].hash == hash && sameExpr(vn->values[v].expr, expr)) return &vn->values[v];
+    }
+    return NULL;
+}
+
+// Record an expression. When the table fills, the values an assignment has killed since are dropped,
+// as they can never be reused, and the buckets are only doubled if at least half the values still live.
+void addValue(Opt *o, Numbering *vn, void **at, void *expr, unsigned long long hash, long time) {
+    if (vn->count >= vn->bucketCount) {
+        int live = 0;
+        for (int v = 0; v < vn->count; v++) {
+            if (stillValid(o, vn->values[v].expr, vn->values[v].time)) vn->values[live++] = vn->values[v];
+        }
+        vn->count = live;
+        if (live >= vn->bucketCount / 2) {
+            vn->bucketCount *= 2;
+            vn->buckets = realloc(vn->buckets, sizeof(int) * vn->bucketCount);
+        }
+        for (int b = 0; b < vn->bucketCount; b++) vn->buckets[b] = -1;
+        for (int v = 0; v < vn->count; v++) {
+            int b = vn->values[v].hash & (vn->bucketCount - 1);
+            vn->values[v].next = vn->buckets[b];
+            vn->buckets[b] = v;
+        }
+    }
+    if (vn->count == vn->size) {
+        vn->size = vn->size ? vn->size * 2 : 16;
+        vn->values = realloc(vn->values, sizeof(Value) * vn->size);
+    }
+    int b = hash & (vn->bucketCount - 1);
+    vn->values[vn->count] = (Value) {at, expr, hash, time, -1, vn->buckets[b]};
+    vn->buckets[b] = vn->count++;
+}
+
+// Number of nodes in an expression.
+int countNodes(void *expr) {
+    switch (((VarExpr *) expr)->s) {
+        case BINOP:
+            return 1 + countNodes(((BinOpExpr *) expr)->left) + countNodes(((BinOpExpr *) expr)->right);
+        case UNOP:
+            return 1 + countNodes(((UnOpExpr *) expr)->right);
+        case BRACKET:
+            return 1 + countNodes(((BracketExpr *) expr)->expr);
+        case TEMP:
+        case SAVE:
+            return 1 + countNodes(((TempExpr *) expr)->expr);
+        case INDUCT:
+            return 1 + countNodes(((InductExpr *) expr)->mul);
+        default:
+            return 1;
+    }
+}
+
+// -----------------
+// Helpers
+// -----------------
+
+// Match 'v = v + c', 'v = c + v' or 'v = v - c' for an integer literal c, giving the step.
+bool inductionStep(VarAssignStmt *assign, long long *step) {
+    BinOpExpr *bin = assign->expr;
+    if (bin->s != BINOP || (bin->opType != PLUS && bin->opType != MINUS)) return false;
+    long long c;
+    VarExpr *left = bin->left;
+    VarExpr *right = bin->right;
+    if (left->s == VAR && left->slot == assign->slot && smallInteger(right, &c)) {
+        *step = bin->opType == PLUS ? c : -c;
+        return true;
+    }
+    if (bin->opType == PLUS && right->s == VAR && right->slot == assign->slot && smallInteger(left, &c)) {
+        *step = c;
+        return true;
+    }
+    return false;
+}
+
+// Whether an expression is an exact integer literal of at most 2^31 in magnitude, so step * k cannot overflow.
+bool smallInteger(void *expr, long long *value) {
+    LiteralExpr *lit = expr;
+    if (lit->s != LITERAL || !lit->exact) return false;
+    if (lit->integer > 2147483648LL || lit->integer < -2147483648LL) return false;
+    *value = lit->integer;
+    return true;
+}
@@ -0,0 +1,32 @@
+#ifndef OPTIMISER_H
+#define OPTIMISER_H
+
+#include "parser.h"
+#include "analyser.h"
+
+// -----------------
+// Public Objects
+// -----------------
+
+// Largest expression, in nodes with the calls in it expanded, a procedure's calls are replaced by.
+#define INLINE_LIMIT 64
+
+// Counts of the rewrites made by the optimiser. Node counts include the expressions below a removed node.
+typedef struct OptStats {
+    int hoisted;
+    int reduced;
+    int deadStores;
+    int deadNodes;
+    int common;
+    int commonNodes;
+    int inlined;
+} OptStats;
+
+// -----------------
+// Public Functions
+// -----------------
+
+void optimise(ParseTree tree, SymbolTable *table, OptStats *stats);
+void printStats(OptStats *stats);
+
+#endif
@@ -0,0 +1,113 @@
+// Buffered output for the CAM programming langauge.
+// Every lexer, parser and interpreter owns an Output so independent runs never share stdout.
+
+#include "output.h"
+#include "memstats.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define OUTPUT_FLUSH_SIZE 65536
+
+// -----------------
+// Private Functions
+// -----------------
+
+void writeAll(int fd, struct iovec *parts, int count);
+
+// Initialise an empty buffer. sink may be NULL to keep everything in memory.
+void initOutput(Output *o, FILE *sink) {
+    o->size = 256;
+    o->used = 0;
+    o->total = 0;
+    o->data = malloc(o->size);
+    MEM_COUNT(MEM_OUTPUT, o->size);
+    o->sink = sink;
+    o->terminal = sink != NULL && isatty(fileno(sink));
+}
+
+// Append formatted text to the buffer.
+void outPrintf(Output *o, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(o->data + o->used, o->size - o->used, fmt, args);
+    va_end(args);
+    if (n >= o->size - o->used) {
+        long old = o->size;
+        while (o->size - o->used <= n) o->size *= 2;
+        MEM_COUNT(MEM_OUTPUT, o->size - old);
+        o->data = realloc(o->data, o->size);
+        va_start(args, fmt);
+        vsnprintf(o->data + o->used, o->size - o->used, fmt, args);
+        va_end(args);
+    }
+    o->used += n;
+    o->total += n;
+    if (o->sink != NULL && (o->used >= OUTPUT_FLUSH_SIZE || (o->terminal && memchr(o->data + o->used - n, '\n', n)))) {
+        flushOutput(o);
+    }
+}
+
+// Append len raw bytes to the buffer. A run at least as big as a flush is not copied: it goes to the
+// sink after the buffered bytes in one writev.
+void outWrite(Output *o, const void *bytes, long len) {
+    if (o->sink != NULL && len >= OUTPUT_FLUSH_SIZE) {
+        fflush(o->sink);
+        struct iovec parts[2] = {{o->data, o->used}, {(void *) bytes, len}};
+        writeAll(fileno(o->sink), parts, 2);
+        o->used = 0;
+        o->total += len;
+        return;
+    }
+    if (o->size - o->used < len) {
+        long old = o->size;
+        while (o->size - o->used < len) o->size *= 2;
+        MEM_COUNT(MEM_OUTPUT, o->size - old);
+        o->data = realloc(o->data, o->size);
+    }
+    memcpy(o->data + o->used, bytes, len);
+    o->used += len;
+    o->total += len;
+    if (o->sink != NULL && (o->used >= OUTPUT_FLUSH_SIZE || (o->terminal && memchr(bytes, '\n', len)))) {
+        flushOutput(o);
+    }
+}
+
+// Write the buffered text to the sink and empty the buffer.
+void flushOutput(Output *o) {
+    if (o->sink == NULL) return;
+    fwrite(o->data, 1, o->used, o->sink);
+    fflush(o->sink);
+    o->used = 0;
+}
+
+// Release the buffer.
+void freeOutput(Output *o) {
+    free(o->data);
+    o->data = NULL;
+    o->size = 0;
+    o->used = 0;
+}
+
+// Write every byte of the parts to a file, carrying on after short writes.
+void writeAll(int fd, struct iovec *parts, int count) {
+    while (count) {
+        ssize_t n = writev(fd, parts, count);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        while (count && (size_t) n >= parts->iov_len) {
+            n -= parts->iov_len;
+            parts++;
+            count--;
+        }
+        if (count) {
+            parts->iov_base = (char *) parts->iov_base + n;
+            parts->iov_len -= n;
+        }
+    }
+}
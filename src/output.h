@@ -0,0 +1,33 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// -----------------
+// Public Objects
+// -----------------
+
+// Growable buffer that all program output and error messages are written to, as text or raw bytes.
+// When a sink is given the buffer is flushed to it once it fills, or at every newline when the sink is a
+// terminal, otherwise it keeps growing. total counts every byte ever written, flushed or not.
+typedef struct Output {
+    char *data;
+    long size;
+    long used;
+    long total;
+    FILE *sink;
+    bool terminal;
+} Output;
+
+// -----------------
+// Public Functions
+// -----------------
+
+void initOutput(Output *o, FILE *sink);
+void outPrintf(Output *o, const char *fmt, ...);
+void outWrite(Output *o, const void *bytes, long len);
+void flushOutput(Output *o);
+void freeOutput(Output *o);
+
+#endif
@@ -0,0 +1,316 @@
+// Plans for running independent top level statements of the CAM programming langauge at once.
+// Statements that read input, call procedures or return share state the slots do not show, so they always
+// run on their own and cut the others into regions. The statements of a region are grouped so that two
+// statements using a slot either of them may write fall in the same group; groups then share nothing
+// written and can run in any order. A use of a slot stands for every slot its name may resolve to through
+// outer scopes, since which one is declared is only known at run time. A region holding at least two
+// groups with loops runs at once, one task per such group and one more for the groups without loops, each
+// running its statements in program order. Everything else runs in order, so short programs pay nothing
+// but the plan.
+
+#include "parallel.h"
+#include "memstats.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Planning state. uses holds the open region's accesses, slot << 1 | written, starting at useAt[k] for
+// top level statement k, and loops which statements hold a while. written and firstUse mark the slots the
+// region writes and the first statement using each, touched lists the slots to clear, and parent and group
+// are the statement groups and the task of each group. seen maps a slot to its place in the slots of the
+// task being added.
+typedef struct Planner {
+    Plan *p;
+    CompactTree *code;
+    SymbolTable *table;
+    int *uses;
+    int useCount;
+    int useSize;
+    int *useAt;
+    bool *loops;
+    int regionStart;
+    bool *written;
+    int *firstUse;
+    int *touched;
+    int *parent;
+    int *group;
+    int *seen;
+    int *stack;
+    int stackSize;
+    int segmentSize;
+    int taskSize;
+    int slotSize;
+} Planner;
+
+// -----------------
+// Private Functions
+// -----------------
+
+bool scanStatement(Planner *pl, int k, bool *loop);
+bool scanExpr(Planner *pl, int from, int to);
+void addUse(Planner *pl, int slot, bool write);
+void closeRegion(Planner *pl, int end);
+int findGroup(Planner *pl, int k);
+void addSegment(Planner *pl, int start, int end, int tasks);
+void addTask(Planner *pl, int start, int end, int task);
+int *growInts(int *list, int count, int *size);
+
+// -----------------
+// Main Funcs
+// -----------------
+
+// Plan how the top level statements of a program run. Returns false, leaving nothing to free, when no
+// statements would run at once.
+bool planProgram(Plan *p, CompactTree *code, SymbolTable *table) {
+    int top = code->top;
+    int slots = table->index ? table->index : 1;
+    *p = (Plan) {NULL, 0, malloc(sizeof(int) * (top + 1)), NULL, 0, NULL, 0};
+    Planner pl = {p, code, table, NULL, 0, 0, malloc(sizeof(int) * (top + 1)), malloc(sizeof(bool) * (top + 1)),
+                  0, calloc(slots, sizeof(bool)), malloc(sizeof(int) * slots), malloc(sizeof(int) * slots),
+                  malloc(sizeof(int) * (top + 1)), malloc(sizeof(int) * (top + 1)), malloc(sizeof(int) * slots),
+                  NULL, 0, 0, 0, 0};
+    MEM_COUNT(MEM_RUNTIME, (sizeof(int) * 3 + sizeof(bool)) * slots + (sizeof(int) * 4 + sizeof(bool)) * (top + 1));
+    for (int s = 0; s < slots; s++) pl.firstUse[s] = pl.seen[s] = -1;
+    for (int k = 0; k <= top; k++) p->owners[k] = pl.group[k] = -1;
+
+    for (int k = 0; k < top; k++) {
+        int from = pl.useCount;
+        bool loop = false;
+        pl.useAt[k] = from;
+        if (!scanStatement(&pl, k, &loop)) {
+            pl.useCount = from;
+            closeRegion(&pl, k);
+            addSegment(&pl, k, k + 1, 0);
+            pl.useCount = 0;
+            pl.regionStart = k + 1;
+            continue;
+        }
+        pl.loops[k] = loop;
+    }
+    closeRegion(&pl, top);
+
+    free(pl.uses);
+    free(pl.useAt);
+    free(pl.loops);
+    free(pl.written);
+    free(pl.firstUse);
+    free(pl.touched);
+    free(pl.parent);
+    free(pl.group);
+    free(pl.seen);
+    free(pl.stack);
+    if (p->taskCount == 0) {
+        freePlan(p);
+        return false;
+    }
+    p->slotAt = growInts(p->slotAt, p->taskCount, &pl.taskSize);
+    p->slotAt[p->taskCount] = p->slotCount;
+    return true;
+}
+
+// Release a plan.
+void freePlan(Plan *p) {
+    free(p->segments);
+    free(p->owners);
+    free(p->slotAt);
+    free(p->slots);
+    *p = (Plan) {NULL, 0, NULL, NULL, 0, NULL, 0};
+}
+
+// -----------------
+// Helpers
+// -----------------
+
+// Add the slots top level statement k and the statements inside it use to the region's uses. loop is set
+// when it holds a while. Returns false when it must run on its own.
+bool scanStatement(Planner *pl, int k, bool *loop) {
+    Node *nodes = pl->code->nodes;
+    int count = 0;
+    pl->stack = growInts(pl->stack, count, &pl->stackSize);
+    pl->stack[count++] = k;
+    while (count) {
+        Node *node = nodes + pl->stack[--count];
+        switch (node->tag) {
+            case HOIST:
+                pl->stack = growInts(pl->stack, count, &pl->stackSize);
+                pl->stack[count++] = node->a;
+                break;
+            case IF:
+            case WHILE:
+                *loop = *loop || node->tag == WHILE;
+                if (!scanExpr(pl, node->a, node->b - 1)) return false;
+                for (int j = 0; j < node->c; j++) {
+                    pl->stack = growInts(pl->stack, count, &pl->stackSize);
+                    pl->stack[count++] = node->b + j;
+                }
+                break;
+            case VARDEC:
+                addUse(pl, node->a, true);
+                break;
+            case VARASSIGN:
+                addUse(pl, node->a, true);
+                if (!scanExpr(pl, node->c, node->b)) return false;
+                break;
+            case STORE:
+                if (!scanExpr(pl, node->c, node->b)) return false;
+                break;
+            case SHOW:
+                if (!scanExpr(pl, node->b, node->a)) return false;
+                break;
+            case READ:
+            case RETURN:
+            case INVOKE:
+                return false;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+// Add the slots the expression nodes from .. to use. Returns false when they call or read input.
+bool scanExpr(Planner *pl, int from, int to) {
+    Node *nodes = pl->code->nodes;
+    for (int k = from; k <= to; k++) {
+        switch (nodes[k].tag) {
+            case VAR:
+            case INDEX:
+                addUse(pl, nodes[k].a, false);
+                break;
+            case SET:
+                addUse(pl, nodes[k].a, true);
+                break;
+            case CALL:
+            case ENTER:
+            case ARG:
+            case LEAVE:
+            case ATEND:
+                return false;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+// Record a use of a slot and of every slot its name may resolve to further out.
+void addUse(Planner *pl, int slot, bool write) {
+    for (int s = slot; s != -1; s = pl->table->syms[s].outer) {
+        pl->uses = growInts(pl->uses, pl->useCount, &pl->useSize);
+        pl->uses[pl->useCount++] = s << 1 | write;
+    }
+}
+
+// Close the region of statements regionStart .. end - 1, adding it as tasks when two groups or more hold
+// loops and to be run in order otherwise.
+void closeRegion(Planner *pl, int end) {
+    int start = pl->regionStart;
+    pl->useAt[end] = pl->useCount;
+    int loops = 0;
+    for (int k = start; k < end; k++) loops += pl->loops[k];
+    if (loops < 2) {
+        if (end > start) addSegment(pl, start, end, 0);
+        return;
+    }
+
+    // Join the statements using each slot the region writes.
+    int touchedCount = 0;
+    for (int u = 0; u < pl->useCount; u++) {
+        int s = pl->uses[u] >> 1;
+        if (pl->uses[u] & 1 && !pl->written[s]) {
+            pl->written[s] = true;
+            pl->touched[touchedCount++] = s;
+        }
+    }
+    for (int k = start; k < end; k++) pl->parent[k] = k;
+    for (int k = start; k < end; k++) {
+        for (int u = pl->useAt[k]; u < pl->useAt[k + 1]; u++) {
+            int s = pl->uses[u] >> 1;
+            if (!pl->written[s]) continue;
+            if (pl->firstUse[s] == -1) {
+                pl->firstUse[s] = k;
+            } else {
+                pl->parent[findGroup(pl, k)] = findGroup(pl, pl->firstUse[s]);
+            }
+        }
+    }
+    for (int t = 0; t < touchedCount; t++) {
+        pl->written[pl->touched[t]] = false;
+        pl->firstUse[pl->touched[t]] = -1;
+    }
+
+    // Number the groups with loops, which run as tasks 0 .. groups - 1 with the rest as task groups.
+    int groups = 0;
+    for (int k = start; k < end; k++) {
+        int g = findGroup(pl, k);
+        if (pl->loops[k] && pl->group[g] == -1) pl->group[g] = groups++;
+    }
+    if (groups < 2) {
+        addSegment(pl, start, end, 0);
+    } else {
+        int first = pl->p->taskCount;
+        bool rest = false;
+        for (int k = start; k < end; k++) {
+            int g = pl->group[findGroup(pl, k)];
+            rest = rest || g == -1;
+            pl->p->owners[k] = first + (g == -1 ? groups : g);
+        }
+        int tasks = groups + rest;
+        addSegment(pl, start, end, tasks);
+        for (int t = 0; t < tasks; t++) addTask(pl, start, end, first + t);
+    }
+    for (int k = start; k < end; k++) pl->group[k] = -1;
+}
+
+// The statement standing for the group of top level statement k.
+int findGroup(Planner *pl, int k) {
+    while (pl->parent[k] != k) {
+        pl->parent[k] = pl->parent[pl->parent[k]];
+        k = pl->parent[k];
+    }
+    return k;
+}
+
+// Add a segment of statements start .. end - 1 run as tasks tasks, merging statements run in order
+// with the segment before them.
+void addSegment(Planner *pl, int start, int end, int tasks) {
+    Plan *p = pl->p;
+    Segment *last = p->segmentCount ? &p->segments[p->segmentCount - 1] : NULL;
+    if (!tasks && last != NULL && !last->taskCount && last->end == start) {
+        last->end = end;
+        return;
+    }
+    if (p->segmentCount == pl->segmentSize) {
+        pl->segmentSize = pl->segmentSize ? pl->segmentSize * 2 : 16;
+        p->segments = realloc(p->segments, sizeof(Segment) * pl->segmentSize);
+    }
+    p->segments[p->segmentCount++] = (Segment) {start, end, p->taskCount, tasks};
+}
+
+// Add task 'task', running the statements start .. end - 1 it owns, with each slot they use once.
+void addTask(Planner *pl, int start, int end, int task) {
+    Plan *p = pl->p;
+    p->slotAt = growInts(p->slotAt, p->taskCount, &pl->taskSize);
+    p->slotAt[p->taskCount++] = p->slotCount;
+    int first = p->slotCount;
+    for (int k = start; k < end; k++) {
+        if (p->owners[k] != task) continue;
+        for (int u = pl->useAt[k]; u < pl->useAt[k + 1]; u++) {
+            int s = pl->uses[u] >> 1;
+            if (pl->seen[s] != -1) {
+                p->slots[pl->seen[s]] |= pl->uses[u] & 1;
+                continue;
+            }
+            p->slots = growInts(p->slots, p->slotCount, &pl->slotSize);
+            pl->seen[s] = p->slotCount;
+            p->slots[p->slotCount++] = pl->uses[u];
+        }
+    }
+    for (int k = first; k < p->slotCount; k++) pl->seen[p->slots[k] >> 1] = -1;
+}
+
+// Make room for one more int after count, doubling the list when it is full.
+int *growInts(int *list, int count, int *size) {
+    if (count < *size) return list;
+    *size = *size ? *size * 2 : 16;
+    return realloc(list, sizeof(int) * *size);
+}
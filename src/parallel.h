@@ -0,0 +1,42 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "analyser.h"
+#include "compact.h"
+#include <stdbool.h>
+
+// -----------------
+// Public Objects
+// -----------------
+
+// Top level statements start .. end - 1, run in order when taskCount is 0. Otherwise they run at once as
+// the tasks firstTask .. firstTask + taskCount - 1 of the plan.
+typedef struct Segment {
+    int start;
+    int end;
+    int firstTask;
+    int taskCount;
+} Segment;
+
+// How the top level statements of a program are run. owners gives the task running each top level
+// statement of a parallel segment, -1 for the others; a task runs its statements in program order. The
+// slots task k uses are slots[slotAt[k] .. slotAt[k + 1] - 1], each the slot << 1 with the low bit set
+// when the task may write it.
+typedef struct Plan {
+    Segment *segments;
+    int segmentCount;
+    int *owners;
+    int *slotAt;
+    int taskCount;
+    int *slots;
+    int slotCount;
+} Plan;
+
+// -----------------
+// Public Functions
+// -----------------
+
+bool planProgram(Plan *p, CompactTree *code, SymbolTable *table);
+void freePlan(Plan *p);
+
+#endif
@@ -1,6 +1,7 @@
 // LL(1) parser for the CAM programming langauge.
 
 #include "parser.h"
+#include "memstats.h"
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
@@ -18,20 +19,26 @@ bool matchKeyword(Parser *p, char *str);
 bool match(Parser *p, TokenType t);
 bool require(Parser *p, TokenType t, char *msg);
 bool requireKeyword(Parser *p, char *str, char *msg);
+void *grow(void *stack, int count, int *size, long elem);
 void printStmt(void *stmt);
+void freeNode(void *node, int scope, int depth, void *data);
 void *statement(Parser *p);
 void *varDecStmt(Parser *p);
 void *varAssignStmt(Parser *p);
-void *ifStmt(Parser *p);
-void *whileStmt(Parser *p);
-void *showStmt(Parser *p);
+void *openBlock(Parser *p, Stmt s, char *keyword, char *msg);
+void *procStmt(Parser *p);
+bool inProc(Parser *p);
+void *exprStmt(Parser *p, Stmt s);
+void *readStmt(Parser *p);
+void *invokeStmt(Parser *p);
 void *expression(Parser *p);
-void *equ(Parser *p);
-void *comp(Parser *p);
-void *adds(Parser *p);
-void *mul(Parser *p);
-void *unary(Parser *p);
+int precedence(TokenType t);
+void pushPending(Parser *p, Token op);
+void pushValue(Parser *p, void *val);
+void reduce(Parser *p, int prec);
+void closeGroup(Parser *p);
 void *primary(Parser *p);
+int reductionKind(char *name);
 
 // -----------------
 // Main funcs
@@ -39,19 +46,47 @@ void *primary(Parser *p);
 
 void initParser(Parser *p, Lexer *l) {
     p->tokStream = l->tokens;
+    p->out = l->out;
     p->err = l->err;
     p->index = 1;
     p->current = l->tokens[0];
     p->lookahead = l->tokens[1];
     p->tree = (ParseTree) {0,5,NULL};
+    p->ops = NULL;
+    p->opCount = p->opSize = 0;
+    p->vals = NULL;
+    p->valCount = p->valSize = 0;
+    p->blocks = NULL;
+    p->blockCount = p->blockSize = 0;
 }
 
 void parse(Parser *p) {
     while (!(p->err || p->current.type == END)) {
         void *stmt = statement(p);
-        if (stmt == (void *)-1) return;
+        if (stmt == (void *)-1) break;
         add(&p->tree, stmt);
     }
+    endParse(p);
+}
+
+// Parse the one top level statement starting at token 'at', returning (void *) -1 on error.
+// Afterwards p->index - 1 is the token following it. Used to re-parse part of an edited program.
+void *parseStatementAt(Parser *p, int at) {
+    p->index = at + 1;
+    p->current = p->tokStream[at];
+    p->lookahead = p->tokStream[at + 1];
+    return statement(p);
+}
+
+// Free the parser's working stacks.
+void endParse(Parser *p) {
+    free(p->ops);
+    free(p->vals);
+    free(p->blocks);
+    p->ops = NULL;
+    p->vals = NULL;
+    p->blocks = NULL;
+    p->opSize = p->valSize = p->blockSize = 0;
 }
 
 // -----------------
@@ -59,227 +94,517 @@ void parse(Parser *p) {
 // These functions follow the EBNF grammar that can be found in the readme.txt.
 // -----------------
 
+// Parse one statement. If, while and proc statements push an open block and carry on with their body,
+// so nested bodies are parsed by this loop rather than by recursion.
 void *statement(Parser *p) {
-    if (matchKeyword(p, "let")) {
-        return varDecStmt(p);
-    } else if (match(p, ID)) {
-        return varAssignStmt(p);
-    } else if (matchKeyword(p, "if")) {
-        return ifStmt(p);
-    } else if (matchKeyword(p, "while")) {
-        return whileStmt(p);
-    } else if (matchKeyword(p, "show")) {
-        return showStmt(p);
-    } else {
-        if (p->current.type != END) pError(p, "Unrecognised syntax.");
-        return (void *) -1;
+    int maxRepeat = 100000;
+    p->blockCount = 0;
+    while (true) {
+        void *stmt;
+        if (matchKeyword(p, "let")) {
+            stmt = varDecStmt(p);
+            if (stmt != (void *) -1 && ((VarDecStmt *) stmt)->type == ARRAY && inProc(p)) {
+                pError(p, "Procedures cannot declare arrays.");
+                freeStmt(stmt);
+                stmt = (void *) -1;
+            }
+        } else if (p->current.type == ID && p->lookahead.type == LPAREN && reductionKind(p->current.lexeme) == -1) {
+            stmt = invokeStmt(p);
+        } else if (match(p, ID)) {
+            stmt = varAssignStmt(p);
+        } else if (matchKeyword(p, "proc")) {
+            if (p->blockCount) {
+                pError(p, "Procedures must be declared at the top level.");
+                stmt = (void *) -1;
+            } else {
+                stmt = procStmt(p);
+                if (stmt != (void *) -1) continue;
+            }
+        } else if (matchKeyword(p, "return")) {
+            if (inProc(p)) {
+                stmt = exprStmt(p, RETURN);
+            } else {
+                pError(p, "Unexpected 'return' outside a procedure.");
+                stmt = (void *) -1;
+            }
+        } else if (matchKeyword(p, "if")) {
+            stmt = openBlock(p, IF, "then", "Expected 'then' after condition.");
+            if (stmt != (void *) -1) continue;
+        } else if (matchKeyword(p, "while")) {
+            stmt = openBlock(p, WHILE, "do", "Expected 'do' after condition.");
+            if (stmt != (void *) -1) continue;
+        } else if (matchKeyword(p, "show")) {
+            stmt = exprStmt(p, SHOW);
+        } else if (matchKeyword(p, "read")) {
+            stmt = readStmt(p);
+        } else {
+            if (p->current.type != END) pError(p, "Unrecognised syntax.");
+            stmt = (void *) -1;
+        }
+
+        // Hand the statement to the innermost open block, closing every block that ends here.
+        // A failed statement fails each enclosing block in turn, which only reports the missing end
+        // once it already holds a statement.
+        while (true) {
+            if (p->blockCount == 0) return stmt;
+            OpenBlock *b = &p->blocks[p->blockCount - 1];
+            Stmt kind = ((VarExpr *) b->stmt)->s;
+            char *end = kind == IF ? "endif" : kind == WHILE ? "endwhile" : "endproc";
+            char *msg = kind == IF ? "Expected 'endif' closing if statement." :
+                        kind == WHILE ? "Expected 'endwhile' closing while statement." :
+                        "Expected 'endproc' closing procedure.";
+            if (stmt == (void *) -1) {
+                if (b->body->index) pError(p, msg);
+                freeStmt(b->stmt);
+                p->blockCount--;
+                continue;
+            }
+            add(b->body, stmt);
+            bool closed = matchKeyword(p, end);
+            if (!closed && b->repeats != maxRepeat) {
+                b->repeats++;
+                break;
+            }
+            if (b->repeats == maxRepeat) pError(p, msg);
+            stmt = b->stmt;
+            p->blockCount--;
+        }
     }
 }
 
 void *varDecStmt(Parser *p) {
+    int col = prev(p).col;
     if(!require(p, ID, "Expected identifier.")) return (void *) -1;
     Token id = prev(p);
     if(!requireKeyword(p, "be", "Expected 'be'.")) return (void *) -1;
     if(!require(p, TYPES, "Expected type.")) return (void *) -1;
     Token type = prev(p);
+    int length = 0;
+    if (match(p, LSQUARE)) {
+        char *end;
+        long n = strtol(p->current.lexeme, &end, 10);
+        if (strcmp(type.lexeme, "num")) {
+            pError(p, "Arrays must hold num.");
+            return (void *) -1;
+        }
+        if (p->current.type != NUMBER || *end != '\0' || n < 1 || n > ARRAY_LIMIT) {
+            pError(p, "Expected array length.");
+            return (void *) -1;
+        }
+        pNext(p);
+        if(!require(p, RSQUARE, "Expected ']' after array length.")) return (void *) -1;
+        length = (int) n;
+    }
     if(!require(p, SEMICOLON, "Expected semicolon.")) return (void *) -1;
     Type t;
-    if (!strcmp(type.lexeme, "bool")) {
+    if (length) {
+        t = ARRAY;
+    } else if (!strcmp(type.lexeme, "bool")) {
         t = BOOL;
     } else if (!strcmp(type.lexeme, "num")) {
         t = NUM;
     } else {
         t = UNKNOWN;
-    }  
-    VarDecStmt *stmt = malloc(sizeof(VarDecStmt));
+    }
+    VarDecStmt *stmt = newNode(sizeof(VarDecStmt));
     strcpy(stmt->id, id.lexeme);
     stmt->type = t;
+    stmt->length = length;
+    stmt->slot = -1;
+    stmt->line = id.line;
+    stmt->col = col;
     stmt->s = VARDEC;
     return (void *) stmt;
 }
 
+// An assignment to a variable or, with an index, to one element of an array.
 void *varAssignStmt(Parser *p) {
     Token id = prev(p);
-    if (!require(p, EQUALS, "Missing '=' for assignment.")) return (void *) -1;
+    void *index = NULL;
+    if (match(p, LSQUARE)) {
+        index = expression(p);
+        if (!require(p, RSQUARE, "Missing ']' after index.")) {
+            freeStmt(index);
+            return (void *) -1;
+        }
+    }
+    if (!require(p, EQUALS, "Missing '=' for assignment.")) {
+        freeStmt(index);
+        return (void *) -1;
+    }
     void *expr = expression(p);
-    if (!require(p, SEMICOLON, "Expected semicolon.")) return (void *) -1;
-    VarAssignStmt *stmt = malloc(sizeof(VarAssignStmt));
+    if (!require(p, SEMICOLON, "Expected semicolon.")) {
+        freeStmt(index);
+        freeStmt(expr);
+        return (void *) -1;
+    }
+    if (index != NULL) {
+        StoreStmt *store = newNode(sizeof(StoreStmt));
+        strcpy(store->id, id.lexeme);
+        store->expr = expr;
+        store->index = index;
+        store->slot = -1;
+        store->line = id.line;
+        store->col = id.col;
+        store->s = STORE;
+        return (void *) store;
+    }
+    VarAssignStmt *stmt = newNode(sizeof(VarAssignStmt));
     strcpy(stmt->id, id.lexeme);
     stmt->expr = expr;
+    stmt->slot = -1;
+    stmt->line = id.line;
+    stmt->col = id.col;
     stmt->s = VARASSIGN;
     return (void *) stmt;
 }
 
-void *ifStmt(Parser *p) {
+// Parse the head of an if or while statement and push it as an open block.
+// The body is parsed by statement, which pops the block at its 'endif' or 'endwhile'.
+void *openBlock(Parser *p, Stmt s, char *keyword, char *msg) {
+    int line = prev(p).line;
+    int col = prev(p).col;
     void *cond = expression(p);
-    if (!requireKeyword(p, "then", "Expected 'then' after condition.")) return (void *) -1;
-    IfStmt *stmt = malloc(sizeof(IfStmt));
+    if (!requireKeyword(p, keyword, msg)) {
+        freeStmt(cond);
+        return (void *) -1;
+    }
+    IfStmt *stmt = newNode(sizeof(IfStmt));
     stmt->cond = cond;
-    stmt->s = IF;
+    stmt->line = line;
+    stmt->col = col;
+    stmt->s = s;
     stmt->trueBranch = (ParseTree) {0,5,NULL};
-    void *tb = statement(p);
-    if (tb == (void *)-1) return tb;
-    add(&stmt->trueBranch, tb);
-    int maxRepeat = 100000;
-    int repeats = 0;
-    while(!matchKeyword(p, "endif") && (repeats != maxRepeat)) {
-        repeats++;
-        tb = statement(p);
-        if (tb == (void *)-1) {
-            pError(p, "Expected 'endif' closing if statement.");
-            return tb;
-        }
-        add(&stmt->trueBranch, tb);
-    }
-    if (repeats == maxRepeat) pError(p, "Expected 'endif' closing if statement.");
+    p->blocks = grow(p->blocks, p->blockCount, &p->blockSize, sizeof(OpenBlock));
+    p->blocks[p->blockCount++] = (OpenBlock) {stmt, &stmt->trueBranch, 0};
     return (void *) stmt;
 }
 
-void *whileStmt(Parser *p) {
-    void *cond = expression(p);
-    if (!requireKeyword(p, "do", "Expected 'do' after condition.")) return (void *) -1;
-    WhileStmt *stmt = malloc(sizeof(WhileStmt));
-    stmt->cond = cond;
-    stmt->s = WHILE;
-    stmt->trueBranch = (ParseTree) {0,5,NULL};
-    void *tb = statement(p);
-    if (tb == (void *)-1) return tb;
-    add(&stmt->trueBranch, tb);
-    int maxRepeat = 100000;
-    int repeats = 0;
-    while(!matchKeyword(p, "endwhile") && (repeats != maxRepeat)) {
-        repeats++;
-        tb = statement(p);
-        if (tb == (void *)-1) {
-            pError(p, "Expected 'endwhile' closing while statement.");
-            return tb;
+// Parse the head of a procedure, 'proc name(a be num, b be bool)', and push it as an open block
+// whose body ends at 'endproc'.
+void *procStmt(Parser *p) {
+    int line = prev(p).line;
+    int col = prev(p).col;
+    if (!require(p, ID, "Expected procedure name.")) return (void *) -1;
+    Token id = prev(p);
+    if (!require(p, LPAREN, "Expected '(' after procedure name.")) return (void *) -1;
+    ProcStmt *stmt = newNode(sizeof(ProcStmt));
+    strcpy(stmt->id, id.lexeme);
+    stmt->params = (ParseTree) {0,5,NULL};
+    stmt->body = (ParseTree) {0,5,NULL};
+    stmt->line = line;
+    stmt->col = col;
+    stmt->index = -1;
+    stmt->redeclared = false;
+    stmt->inlined = false;
+    stmt->s = PROC;
+    bool closed = match(p, RPAREN);
+    while (!closed) {
+        if (!require(p, ID, "Expected parameter name.")) break;
+        Token name = prev(p);
+        if (!requireKeyword(p, "be", "Expected 'be'.")) break;
+        if (!require(p, TYPES, "Expected type.")) break;
+        bool duplicate = false;
+        for (int j = 0; j < stmt->params.index; j++) {
+            if (!strcmp(((VarDecStmt *) stmt->params.stmts[j])->id, name.lexeme)) duplicate = true;
         }
-        add(&stmt->trueBranch, tb);
+        if (duplicate) {
+            pError(p, "Duplicate parameter.");
+            break;
+        }
+        VarDecStmt *param = newNode(sizeof(VarDecStmt));
+        strcpy(param->id, name.lexeme);
+        param->type = strcmp(prev(p).lexeme, "bool") ? NUM : BOOL;
+        param->length = 0;
+        param->slot = -1;
+        param->line = name.line;
+        param->col = name.col;
+        param->s = VARDEC;
+        add(&stmt->params, param);
+        closed = match(p, RPAREN);
+        if (!closed && !require(p, COMMA, "Expected ',' or ')' after parameter.")) break;
+    }
+    if (!closed) {
+        freeStmt(stmt);
+        return (void *) -1;
     }
-    if (repeats == maxRepeat) pError(p, "Expected 'endwhile' closing while statement.");
+    p->blocks = grow(p->blocks, p->blockCount, &p->blockSize, sizeof(OpenBlock));
+    p->blocks[p->blockCount++] = (OpenBlock) {stmt, &stmt->body, 0};
     return (void *) stmt;
 }
 
-void *showStmt(Parser *p) {
+// Whether the statement being parsed is inside a procedure, which can only be the outermost block.
+bool inProc(Parser *p) {
+    return p->blockCount && ((VarExpr *) p->blocks[0].stmt)->s == PROC;
+}
+
+// A keyword followed by an expression: show, or return inside a procedure.
+void *exprStmt(Parser *p, Stmt s) {
+    int line = prev(p).line;
+    int col = prev(p).col;
     void *expr = expression(p);
+    if (!require(p, SEMICOLON, "Expected semicolon.")) {
+        freeStmt(expr);
+        return (void *) -1;
+    }
+    ShowStmt *stmt = newNode(sizeof(ShowStmt));
+    stmt->s = s;
+    stmt->expr = expr;
+    stmt->line = line;
+    stmt->col = col;
+    return (void *) stmt;
+}
+
+// 'read name;'.
+void *readStmt(Parser *p) {
+    int col = prev(p).col;
+    if (!require(p, ID, "Expected identifier.")) return (void *) -1;
+    Token id = prev(p);
     if (!require(p, SEMICOLON, "Expected semicolon.")) return (void *) -1;
-    ShowStmt *stmt = malloc(sizeof(ShowStmt));
-    stmt->s = SHOW;
+    ReadStmt *stmt = newNode(sizeof(ReadStmt));
+    strcpy(stmt->id, id.lexeme);
+    stmt->slot = -1;
+    stmt->line = id.line;
+    stmt->col = col;
+    stmt->s = READ;
+    return (void *) stmt;
+}
+
+// A call used as a statement, its value dropped.
+void *invokeStmt(Parser *p) {
+    int line = p->current.line;
+    int col = p->current.col;
+    void *expr = expression(p);
+    if (expr != (void *) -1 && ((VarExpr *) expr)->s != CALL) {
+        pError(p, "Only calls can be used as statements.");
+        freeStmt(expr);
+        return (void *) -1;
+    }
+    if (!require(p, SEMICOLON, "Expected semicolon.")) {
+        freeStmt(expr);
+        return (void *) -1;
+    }
+    InvokeStmt *stmt = newNode(sizeof(InvokeStmt));
+    stmt->s = INVOKE;
     stmt->expr = expr;
+    stmt->line = line;
+    stmt->col = col;
     return (void *) stmt;
 }
 
+// Parse an expression by precedence climbing over explicit operator and operand stacks.
+// Builds the same tree, and reports the same errors at the same tokens, as the precedence
+// levels of the grammar: '!' binds tightest, then * /, + -, comparisons, == != and finally & |,
+// every binary operator associating to the left. The index of a[...], the operand of a reduction
+// and the arguments of a call are groups like a parenthesis, so they nest without recursion too.
 void *expression(Parser *p) {
-    void *left = equ(p);
-    while (match(p, AND) || match(p, OR)) {
-        Token op = prev(p);
-        void *right = equ(p);
-        BinOpExpr *expr = malloc(sizeof(BinOpExpr));
-        expr->s = BINOP;
-        strcpy(expr->op, op.lexeme);
-        expr->left = left;
-        expr->right = right;
-        left = (void *) expr;
+    p->opCount = 0;
+    p->valCount = 0;
+    while (true) {
+        // Operand position: prefix operators and open groups wait for what follows.
+        if (match(p, BANG) || match(p, LPAREN)) {
+            pushPending(p, prev(p));
+            continue;
+        }
+        if (p->current.type == ID && p->lookahead.type == LSQUARE) {
+            IndexExpr *index = newNode(sizeof(IndexExpr));
+            strcpy(index->id, p->current.lexeme);
+            index->slot = -1;
+            index->index = NULL;
+            index->s = INDEX;
+            pushValue(p, (void *) index);
+            pNext(p);
+            pushPending(p, p->current);
+            pNext(p);
+            continue;
+        }
+        if (p->current.type == ID && p->lookahead.type == LPAREN && reductionKind(p->current.lexeme) != -1) {
+            pushPending(p, p->current);
+            pNext(p);
+            pNext(p);
+            continue;
+        }
+        if (p->current.type == ID && p->lookahead.type == LPAREN) {
+            CallExpr *call = newNode(sizeof(CallExpr));
+            strcpy(call->id, p->current.lexeme);
+            call->args = (ParseTree) {0,5,NULL};
+            call->proc = NULL;
+            call->s = CALL;
+            pushValue(p, (void *) call);
+            pNext(p);
+            pNext(p);
+            if (!match(p, RPAREN)) {
+                pushPending(p, (Token) {0, 0, COMMA, ","});
+                continue;
+            }
+        } else {
+            pushValue(p, primary(p));
+        }
+
+        // Operator position: finish what the operand completes, then take the next binary operator.
+        while (true) {
+            while (p->opCount && p->ops[p->opCount - 1].type == BANG) {
+                UnOpExpr *expr = newNode(sizeof(UnOpExpr));
+                expr->s = UNOP;
+                expr->right = p->vals[p->valCount - 1];
+                strcpy(expr->op, p->ops[--p->opCount].op);
+                p->vals[p->valCount - 1] = (void *) expr;
+            }
+            int prec = precedence(p->current.type);
+            if (prec) {
+                reduce(p, prec);
+                match(p, p->current.type);
+                pushPending(p, prev(p));
+                break;
+            }
+            reduce(p, 1);
+            if (p->opCount && p->ops[p->opCount - 1].type == COMMA && match(p, COMMA)) {
+                void *arg = p->vals[--p->valCount];
+                add(&((CallExpr *) p->vals[p->valCount - 1])->args, arg);
+                break;
+            }
+            if (p->opCount == 0) return p->vals[--p->valCount];
+            closeGroup(p);
+        }
     }
-    return left;
 }
 
-void *equ(Parser *p) {
-    void *left = comp(p);
-    while (match(p, EQEQUALS) || match(p, BANGEQ)) {
-        Token op = prev(p);
-        void *right = comp(p);
-        BinOpExpr *expr = malloc(sizeof(BinOpExpr));
-        expr->s = BINOP;
-        strcpy(expr->op, op.lexeme);
-        expr->left = left;
-        expr->right = right;
-        left = (void *) expr;
+// Close the innermost group, replacing the operand on top of the value stack with the finished
+// node: brackets, an index, a reduction or a call taking its last argument.
+void closeGroup(Parser *p) {
+    Pending open = p->ops[--p->opCount];
+    void *expr = p->vals[p->valCount - 1];
+    if (open.type == COMMA) {
+        CallExpr *call = p->vals[--p->valCount - 1];
+        add(&call->args, expr);
+        if (!require(p, RPAREN, "Expected ',' or ')' after argument.")) {
+            freeStmt(call);
+            p->vals[p->valCount - 1] = (void *) -1;
+        }
+        return;
+    }
+    if (open.type == LSQUARE) {
+        IndexExpr *index = p->vals[--p->valCount - 1];
+        if (!require(p, RSQUARE, "Missing ']' after index.")) {
+            freeStmt(expr);
+            freeStmt(index);
+            p->vals[p->valCount - 1] = (void *) -1;
+            return;
+        }
+        index->index = expr;
+        return;
+    }
+    if (!require(p, RPAREN, "Missing closing parenthesis on expression.")) {
+        freeStmt(expr);
+        p->vals[p->valCount - 1] = (void *) -1;
+        return;
+    }
+    if (open.type == ID) {
+        ReduceExpr *reduction = newNode(sizeof(ReduceExpr));
+        reduction->s = REDUCE;
+        reduction->expr = expr;
+        strcpy(reduction->op, open.op);
+        reduction->kind = reductionKind(open.op);
+        p->vals[p->valCount - 1] = (void *) reduction;
+        return;
     }
-    return left;
+    BracketExpr *brackets = newNode(sizeof(BracketExpr));
+    brackets->s = BRACKET;
+    brackets->expr = expr;
+    p->vals[p->valCount - 1] = (void *) brackets;
 }
 
-void *comp(Parser *p) {
-    void *left = adds(p);
-    while (match(p, LTHAN) || match(p, LTHANEQ) || match(p, GTHAN) || match(p, GTHANEQ)) {
-        Token op = prev(p);
-        void *right = adds(p);
-        BinOpExpr *expr = malloc(sizeof(BinOpExpr));
-        expr->s = BINOP;
-        strcpy(expr->op, op.lexeme);
-        expr->left = left;
-        expr->right = right;
-        left = (void *) expr;
+// Binding strength of a binary operator, 0 for any other token.
+int precedence(TokenType t) {
+    switch (t) {
+        case AND:
+        case OR:
+            return 1;
+        case EQEQUALS:
+        case BANGEQ:
+            return 2;
+        case LTHAN:
+        case LTHANEQ:
+        case GTHAN:
+        case GTHANEQ:
+            return 3;
+        case PLUS:
+        case MINUS:
+            return 4;
+        case STAR:
+        case SLASH:
+            return 5;
+        default:
+            return 0;
     }
-    return left;
 }
 
-void *adds(Parser *p) {
-    void *left = mul(p);
-    while (match(p, PLUS) || match(p, MINUS)) {
-        Token op = prev(p);
-        void *right = mul(p);
-        BinOpExpr *expr = malloc(sizeof(BinOpExpr));
-        expr->s = BINOP;
-        strcpy(expr->op, op.lexeme);
-        expr->left = left;
-        expr->right = right;
-        left = (void *) expr;
-    }
-    return left;
+// Push an operator token onto the pending stack.
+void pushPending(Parser *p, Token op) {
+    p->ops = grow(p->ops, p->opCount, &p->opSize, sizeof(Pending));
+    Pending *pending = &p->ops[p->opCount++];
+    pending->type = op.type;
+    strcpy(pending->op, op.lexeme);
 }
 
-void *mul(Parser *p) {
-    void *left = unary(p);
-    while (match(p, STAR) || match(p, SLASH)) {
-        Token op = prev(p);
-        void *right = unary(p);
-        BinOpExpr *expr = malloc(sizeof(BinOpExpr));
-        expr->s = BINOP;
-        strcpy(expr->op, op.lexeme);
-        expr->left = left;
-        expr->right = right;
-        left = (void *) expr;
-    }
-    return left;
+// Push an operand onto the value stack.
+void pushValue(Parser *p, void *val) {
+    p->vals = grow(p->vals, p->valCount, &p->valSize, sizeof(void *));
+    p->vals[p->valCount++] = val;
 }
 
-void *unary(Parser *p) {
-    if (match(p, BANG)) {
-        Token op = prev(p);
-        UnOpExpr *expr = malloc(sizeof(UnOpExpr));
-        expr->s = UNOP;
-        expr->right = unary(p);
-        strcpy(expr->op, op.lexeme);
-        return (void *) expr;
+// Combine pending binary operators binding at least as tightly as prec with their operands,
+// stopping at an open parenthesis.
+void reduce(Parser *p, int prec) {
+    while (p->opCount && precedence(p->ops[p->opCount - 1].type) >= prec) {
+        Pending *op = &p->ops[--p->opCount];
+        BinOpExpr *expr = newNode(sizeof(BinOpExpr));
+        expr->s = BINOP;
+        strcpy(expr->op, op->op);
+        expr->opType = op->type;
+        expr->integral = false;
+        expr->right = p->vals[--p->valCount];
+        expr->left = p->vals[p->valCount - 1];
+        p->vals[p->valCount - 1] = (void *) expr;
     }
-    return primary(p);
 }
 
+// A name, literal or 'eof'. Parenthesised expressions are handled by expression.
 void *primary(Parser *p) {
-    if (match(p, ID)) {
-        VarExpr *expr = malloc(sizeof(VarExpr));
+    if (matchKeyword(p, "eof")) {
+        AtEndExpr *expr = newNode(sizeof(AtEndExpr));
+        expr->s = ATEND;
+        return (void *) expr;
+    } else if (match(p, ID)) {
+        VarExpr *expr = newNode(sizeof(VarExpr));
         strcpy(expr->id, prev(p).lexeme);
+        expr->slot = -1;
         expr->s = VAR;
         return (void *) expr;
     } else if (match(p, NUMBER) || match(p, BOOLEAN)) {
-        LiteralExpr *expr = malloc(sizeof(LiteralExpr));
+        LiteralExpr *expr = newNode(sizeof(LiteralExpr));
         strcpy(expr->val, prev(p).lexeme);
+        expr->type = UNKNOWN;
+        expr->value = 0;
+        expr->exact = false;
+        expr->integer = 0;
         expr->s = LITERAL;
         return (void *) expr;
-    } else if (match(p, LPAREN)) {
-        void *expr = expression(p);
-        if(!require(p, RPAREN, "Missing closing parenthesis on expression.")) return (void *) -1;
-        BracketExpr *brackets = malloc(sizeof(BracketExpr));
-        brackets->s = BRACKET;
-        brackets->expr = expr;
-        return (void *) brackets;
     } else {
         pError(p, "Expected expression.");
         return (void *) -1;
     }
 }
 
+// The reduction a name calls, or -1. The names are only reductions when followed by '(', so they
+// remain usable as variables.
+int reductionKind(char *name) {
+    if (!strcmp(name, "sum")) return SUM_OF;
+    if (!strcmp(name, "min")) return MIN_OF;
+    if (!strcmp(name, "max")) return MAX_OF;
+    return -1;
+}
+
 // -----------------
 // Helper funcs
 // -----------------
@@ -288,16 +613,31 @@ void *primary(Parser *p) {
 void add(ParseTree *tree, void *stmt) {
     if (tree->index != 0) {
         if (tree->size <= tree->index) {
+            MEM_COUNT(MEM_NODES, sizeof(void*) * tree->size);
             tree->size *= 2;
             tree->stmts = realloc(tree->stmts, sizeof(void*) * tree->size);
         }
         tree->stmts[tree->index++] = stmt;
     } else {
         tree->stmts = malloc(sizeof(void*) * tree->size);
+        MEM_COUNT(MEM_NODES, sizeof(void*) * tree->size);
         tree->stmts[tree->index++] = stmt;
     }
 } 
 
+// Allocate a tree node, counting it against the node pool.
+void *newNode(long size) {
+    MEM_COUNT(MEM_NODES, size);
+    return malloc(size);
+}
+
+// Make room for one more element on a stack, doubling its capacity when it is full.
+void *grow(void *stack, int count, int *size, long elem) {
+    if (count < *size) return stack;
+    *size = *size ? *size * 2 : 16;
+    return realloc(stack, elem * *size);
+}
+
 // Get the next token.
 Token pNext(Parser *p) {
     p->current = p->lookahead;
@@ -313,7 +653,7 @@ Token prev(Parser *p) {
 // Signal an error.
 void pError(Parser *p, char *msg) {
     p->err = true;
-    printf("Error (%d:%d): %s\n", p->current.line+1, p->current.col+1, msg);
+    outPrintf(p->out, "Error (%d:%d): %s\n", p->current.line+1, p->current.col+1, msg);
 }
 
 // Failure to match results in error.
@@ -351,96 +691,189 @@ bool matchKeyword(Parser *p, char *key) {
 // -----------------
 
 // Convert data type to string.
-char *typeToString(Type t) {
-    char *type = malloc(sizeof(char) * 20);  
+const char *typeToString(Type t) {
     switch(t) {
         case NUM:
-            strcpy(type, "NUM");
-            break;
+            return "NUM";
         case BOOL:
-            strcpy(type, "BOOL");
-            break;
+            return "BOOL";
+        case ARRAY:
+            return "ARRAY";
         default:
-            strcpy(type, "UNKNOWN");
-            break;
+            return "UNKNOWN";
     }
-    return type;
 }
 
+// Work item of printStmt: a node still to be printed, or text to print once the items above it are done.
+typedef struct PrintItem {
+    void *node;
+    const char *text;
+} PrintItem;
+
 // Display a statement in a somewhat human readable format.
+// Each node prints its opening part straight away and pushes what follows its first child,
+// so arbitrarily deep trees are printed without recursion.
 void printStmt(void *stmt) {
-     Stmt s = ((VarExpr *) stmt)->s;
-     printf("(");
-     switch (s) {
-        case IF: {
-            printf("IF {");
-            printStmt(((IfStmt *) stmt)->cond);
-            printf(" -> ");
-            for (int i = 0; i < ((IfStmt *) stmt)->trueBranch.index; i++) {
-                printStmt(((IfStmt *) stmt)->trueBranch.stmts[i]);
-            }
-            printf("}");
-            break;
-        }
-        case WHILE: {
-            printf("WHILE {");
-            printStmt(((WhileStmt *) stmt)->cond);
-            printf(" -> ");
-            for (int i = 0; i < ((WhileStmt *) stmt)->trueBranch.index; i++) {
-                printStmt(((WhileStmt *) stmt)->trueBranch.stmts[i]);
-            }
-            printf("}");
-            break;
+    int count = 0, size = 0;
+    PrintItem *items = NULL;
+    items = grow(items, count, &size, sizeof(PrintItem));
+    items[count++] = (PrintItem) {stmt, NULL};
+    while (count) {
+        PrintItem item = items[--count];
+        if (item.text) {
+            printf("%s", item.text);
+            continue;
         }
-        case SHOW: {
-            printf("SHOW {");
-            printStmt(((ShowStmt *) stmt)->expr);
-            printf("}");
-            break;
-        }
-        case VARDEC: {
-            printf("VARDEC {%s %s}", ((VarDecStmt *) stmt)->id, typeToString(((VarDecStmt *) stmt)->type));
-            break;
-        }
-        case VARASSIGN: {
-            printf("VARASSIGN {");
-            printf("%s <= ", ((VarAssignStmt *) stmt)->id);
-            printStmt(((VarAssignStmt *) stmt)->expr);
-            printf("}");
-            break;
-        }
-        case BRACKET: {
-            printf("BRACKETS {");
-            printStmt(((BracketExpr *) stmt)->expr);
-            printf("}");
-            break;
-        }
-        case BINOP: {
-            printf("BINOP {");
-            printStmt(((BinOpExpr *) stmt)->left);
-            printf(" %s ", ((BinOpExpr *) stmt)->op);
-            printStmt(((BinOpExpr *) stmt)->right);
-            printf("}");
-            break;
-        }
-        case UNOP: {
-            printf("UNOP {");
-            printf("%s ", ((UnOpExpr *) stmt)->op);
-            printStmt(((UnOpExpr *) stmt)->right);
-            printf("}");
-            break;
-        }
-        case LITERAL: {
-            printf("LITERAL {%s}", ((LiteralExpr *) stmt)->val);
-            break;
-        }
-        case VAR: {
-            printf("VARIABLE {%s}", ((VarExpr *) stmt)->id);
+        void *node = item.node;
+        int extra = 6;
+        if (((VarExpr *) node)->s == IF || ((VarExpr *) node)->s == WHILE) extra += ((IfStmt *) node)->trueBranch.index;
+        if (((VarExpr *) node)->s == PROC) extra += ((ProcStmt *) node)->params.index + ((ProcStmt *) node)->body.index;
+        if (((VarExpr *) node)->s == CALL) extra += 2 * ((CallExpr *) node)->args.index;
+        while (count + extra > size) items = grow(items, size, &size, sizeof(PrintItem));
+        printf("(");
+        switch (((VarExpr *) node)->s) {
+            case IF:
+            case WHILE: {
+                ParseTree body = ((IfStmt *) node)->trueBranch;
+                printf("%s {", ((VarExpr *) node)->s == IF ? "IF" : "WHILE");
+                items[count++] = (PrintItem) {NULL, "})"};
+                for (int j = body.index - 1; j >= 0; j--) items[count++] = (PrintItem) {body.stmts[j], NULL};
+                items[count++] = (PrintItem) {NULL, " -> "};
+                items[count++] = (PrintItem) {((IfStmt *) node)->cond, NULL};
+                break;
+            }
+            case SHOW:
+            case RETURN:
+            case INVOKE: {
+                Stmt s = ((VarExpr *) node)->s;
+                printf("%s {", s == SHOW ? "SHOW" : s == RETURN ? "RETURN" : "INVOKE");
+                items[count++] = (PrintItem) {NULL, "})"};
+                items[count++] = (PrintItem) {((ShowStmt *) node)->expr, NULL};
+                break;
+            }
+            case PROC: {
+                ProcStmt *proc = node;
+                printf("PROC {%s ", proc->id);
+                items[count++] = (PrintItem) {NULL, "})"};
+                for (int j = proc->body.index - 1; j >= 0; j--) items[count++] = (PrintItem) {proc->body.stmts[j], NULL};
+                items[count++] = (PrintItem) {NULL, " -> "};
+                for (int j = proc->params.index - 1; j >= 0; j--) items[count++] = (PrintItem) {proc->params.stmts[j], NULL};
+                break;
+            }
+            case CALL: {
+                CallExpr *call = node;
+                printf("CALL {%s", call->id);
+                items[count++] = (PrintItem) {NULL, "})"};
+                for (int j = call->args.index - 1; j >= 0; j--) {
+                    items[count++] = (PrintItem) {call->args.stmts[j], NULL};
+                    items[count++] = (PrintItem) {NULL, " "};
+                }
+                break;
+            }
+            case VARDEC: {
+                VarDecStmt *dec = node;
+                if (dec->type == ARRAY) {
+                    printf("VARDEC {%s NUM[%d]})", dec->id, dec->length);
+                } else {
+                    printf("VARDEC {%s %s})", dec->id, typeToString(dec->type));
+                }
+                break;
+            }
+            case VARASSIGN: {
+                printf("VARASSIGN {");
+                printf("%s <= ", ((VarAssignStmt *) node)->id);
+                items[count++] = (PrintItem) {NULL, "})"};
+                items[count++] = (PrintItem) {((VarAssignStmt *) node)->expr, NULL};
+                break;
+            }
+            case STORE: {
+                printf("STORE {%s[", ((StoreStmt *) node)->id);
+                items[count++] = (PrintItem) {NULL, "})"};
+                items[count++] = (PrintItem) {((StoreStmt *) node)->expr, NULL};
+                items[count++] = (PrintItem) {NULL, "] <= "};
+                items[count++] = (PrintItem) {((StoreStmt *) node)->index, NULL};
+                break;
+            }
+            case BRACKET: {
+                printf("BRACKETS {");
+                items[count++] = (PrintItem) {NULL, "})"};
+                items[count++] = (PrintItem) {((BracketExpr *) node)->expr, NULL};
+                break;
+            }
+            case BINOP: {
+                printf("BINOP {");
+                items[count++] = (PrintItem) {NULL, "})"};
+                items[count++] = (PrintItem) {((BinOpExpr *) node)->right, NULL};
+                items[count++] = (PrintItem) {NULL, " "};
+                items[count++] = (PrintItem) {NULL, ((BinOpExpr *) node)->op};
+                items[count++] = (PrintItem) {NULL, " "};
+                items[count++] = (PrintItem) {((BinOpExpr *) node)->left, NULL};
+                break;
+            }
+            case UNOP: {
+                printf("UNOP {");
+                printf("%s ", ((UnOpExpr *) node)->op);
+                items[count++] = (PrintItem) {NULL, "})"};
+                items[count++] = (PrintItem) {((UnOpExpr *) node)->right, NULL};
+                break;
+            }
+            case LITERAL: {
+                printf("LITERAL {%s})", ((LiteralExpr *) node)->val);
+                break;
+            }
+            case VAR: {
+                printf("VARIABLE {%s})", ((VarExpr *) node)->id);
+                break;
+            }
+            case READ: {
+                printf("READ {%s})", ((ReadStmt *) node)->id);
+                break;
+            }
+            case ATEND: {
+                printf("EOF)");
+                break;
+            }
+            case INDEX: {
+                printf("INDEX {%s[", ((IndexExpr *) node)->id);
+                items[count++] = (PrintItem) {NULL, "]})"};
+                items[count++] = (PrintItem) {((IndexExpr *) node)->index, NULL};
+                break;
+            }
+            case REDUCE: {
+                printf("REDUCE {%s ", ((ReduceExpr *) node)->op);
+                items[count++] = (PrintItem) {NULL, "})"};
+                items[count++] = (PrintItem) {((ReduceExpr *) node)->expr, NULL};
+                break;
+            }
+            case HOIST: {
+                printf("HOIST {");
+                items[count++] = (PrintItem) {NULL, "})"};
+                items[count++] = (PrintItem) {((HoistStmt *) node)->loop, NULL};
+                break;
+            }
+            case TEMP:
+            case SAVE: {
+                printf("%s %d {", ((VarExpr *) node)->s == TEMP ? "TEMP" : "SAVE", ((TempExpr *) node)->temp);
+                items[count++] = (PrintItem) {NULL, "})"};
+                items[count++] = (PrintItem) {((TempExpr *) node)->expr, NULL};
+                break;
+            }
+            case INDUCT: {
+                printf("INDUCT %d {", ((InductExpr *) node)->temp);
+                items[count++] = (PrintItem) {NULL, "})"};
+                items[count++] = (PrintItem) {((InductExpr *) node)->mul, NULL};
+                break;
+            }
+            case NOP: {
+                printf("NOP {%s})", ((VarAssignStmt *) node)->id);
+                break;
+            }
+            default:
+                printf(")");
+                break;
         }
-        default:
-            break;
-     }
-     printf(")");
+    }
+    free(items);
 }
 
 // Display all statements in the program.
@@ -451,6 +884,145 @@ void printTree(ParseTree t) {
     }
 }
 
+// -----------------
+// Tree walking
+// -----------------
+
+// A node waiting to be visited by walkTree.
+typedef struct WalkItem {
+    void *node;
+    int scope;
+    int depth;
+} WalkItem;
+
+// Visit every node of a tree in pre-order, children in source order, using an explicit stack.
+// The children of a node are taken before it is visited so the visitor may free it.
+// Nodes left half built by a parse error may hold (void *) -1 children which are skipped.
+void walkTree(ParseTree t, Visitor visit, void *data) {
+    int count = 0, size = 0;
+    WalkItem *items = NULL;
+    for (int j = t.index - 1; j >= 0; j--) {
+        items = grow(items, count, &size, sizeof(WalkItem));
+        items[count++] = (WalkItem) {t.stmts[j], 0, 0};
+    }
+    while (count) {
+        WalkItem item = items[--count];
+        void *node = item.node;
+        if (node == NULL || node == (void *) -1) continue;
+        void *kids[2] = {NULL, NULL};
+        int scope = item.scope;
+        switch (((VarExpr *) node)->s) {
+            case IF:
+            case WHILE: {
+                ParseTree body = ((IfStmt *) node)->trueBranch;
+                scope++;
+                for (int j = body.index - 1; j >= 0; j--) {
+                    items = grow(items, count, &size, sizeof(WalkItem));
+                    items[count++] = (WalkItem) {body.stmts[j], scope, item.depth + 1};
+                }
+                kids[0] = ((IfStmt *) node)->cond;
+                break;
+            }
+            case PROC: {
+                ParseTree body = ((ProcStmt *) node)->body;
+                ParseTree params = ((ProcStmt *) node)->params;
+                for (int j = body.index - 1; j >= 0; j--) {
+                    items = grow(items, count, &size, sizeof(WalkItem));
+                    items[count++] = (WalkItem) {body.stmts[j], scope, item.depth + 1};
+                }
+                for (int j = params.index - 1; j >= 0; j--) {
+                    items = grow(items, count, &size, sizeof(WalkItem));
+                    items[count++] = (WalkItem) {params.stmts[j], scope, item.depth + 1};
+                }
+                break;
+            }
+            case CALL: {
+                ParseTree args = ((CallExpr *) node)->args;
+                for (int j = args.index - 1; j >= 0; j--) {
+                    items = grow(items, count, &size, sizeof(WalkItem));
+                    items[count++] = (WalkItem) {args.stmts[j], scope, item.depth + 1};
+                }
+                break;
+            }
+            case SHOW:
+            case RETURN:
+            case INVOKE:
+                kids[0] = ((ShowStmt *) node)->expr;
+                break;
+            case VARASSIGN:
+            case NOP:
+                kids[0] = ((VarAssignStmt *) node)->expr;
+                break;
+            case STORE:
+                kids[0] = ((StoreStmt *) node)->index;
+                kids[1] = ((StoreStmt *) node)->expr;
+                break;
+            case INDEX:
+                kids[0] = ((IndexExpr *) node)->index;
+                break;
+            case REDUCE:
+                kids[0] = ((ReduceExpr *) node)->expr;
+                break;
+            case BRACKET:
+                kids[0] = ((BracketExpr *) node)->expr;
+                break;
+            case BINOP:
+                kids[0] = ((BinOpExpr *) node)->left;
+                kids[1] = ((BinOpExpr *) node)->right;
+                break;
+            case UNOP:
+                kids[0] = ((UnOpExpr *) node)->right;
+                break;
+            case HOIST:
+                kids[0] = ((HoistStmt *) node)->loop;
+                break;
+            case TEMP:
+            case SAVE:
+                kids[0] = ((TempExpr *) node)->expr;
+                break;
+            case INDUCT:
+                kids[0] = ((InductExpr *) node)->mul;
+                break;
+            default:
+                break;
+        }
+        for (int k = 1; k >= 0; k--) {
+            if (kids[k] == NULL) continue;
+            items = grow(items, count, &size, sizeof(WalkItem));
+            items[count++] = (WalkItem) {kids[k], scope, item.depth + 1};
+        }
+        visit(node, item.scope, item.depth, data);
+    }
+    free(items);
+}
+
+// -----------------
+// Cleanup funcs
+// -----------------
+
+// Visitor freeing a node. Its children have already been queued by walkTree.
+void freeNode(void *node, int scope, int depth, void *data) {
+    Stmt s = ((VarExpr *) node)->s;
+    if (s == IF || s == WHILE) free(((IfStmt *) node)->trueBranch.stmts);
+    if (s == PROC) {
+        free(((ProcStmt *) node)->params.stmts);
+        free(((ProcStmt *) node)->body.stmts);
+    }
+    if (s == CALL) free(((CallExpr *) node)->args.stmts);
+    free(node);
+}
+
+// Free a statement or expression and everything below it.
+void freeStmt(void *stmt) {
+    walkTree((ParseTree) {1, 1, &stmt}, freeNode, NULL);
+}
+
+// Free every statement in a tree along with the statement array.
+void freeTree(ParseTree t) {
+    walkTree(t, freeNode, NULL);
+    free(t.stmts);
+}
+
 // -----------------
 // Testing
 // -----------------
@@ -459,13 +1031,18 @@ void printTree(ParseTree t) {
 void run() {
     FILE *f = fopen("/Users/cameron/OneDrive - University of Bristol/Imperative Programming/CAMlang/test.cam", "r");
     if (f == NULL) return; 
+    long len;
+    char *src = readSource(f, &len);
+    Output out;
+    initOutput(&out, stdout);
     Lexer *l = malloc(sizeof(Lexer));
-    initLexer(l, f);
+    initLexer(l, src, len, &out);
     tokenize(l);
 
     Parser *p = malloc(sizeof(Parser));
     initParser(p, l);
     parse(p);
+    flushOutput(&out);
     printTree(p->tree);
 }
 /*
@@ -1,3 +1,6 @@
+#ifndef PARSER_H
+#define PARSER_H
+
 #include <stdbool.h>
 #include "lexer.h"
 
@@ -5,16 +8,25 @@
 // Public Objects
 // -----------------
 
-// Represents the types a variable can take;
+// Longest array a declaration may ask for.
+#define ARRAY_LIMIT 16777216
+
+// Represents the types a variable can take; ARRAY is a fixed size num[N].
 typedef enum Type {
-    NUM, BOOL, UNKNOWN
+    NUM, BOOL, UNKNOWN, ARRAY
 } Type;
 
 // All possible statements;
 typedef enum Stmt {
-    IF, WHILE, VARDEC, VARASSIGN, SHOW, BINOP, UNOP, BRACKET, LITERAL, VAR
+    IF, WHILE, VARDEC, VARASSIGN, STORE, SHOW, BINOP, UNOP, BRACKET, LITERAL, VAR, INDEX, REDUCE,
+    PROC, RETURN, INVOKE, CALL, READ, ATEND, HOIST, TEMP, INDUCT, SAVE, NOP
 } Stmt;
 
+// The reductions of a whole array to one NUM.
+typedef enum Reduction {
+    SUM_OF, MIN_OF, MAX_OF
+} Reduction;
+
 // Not really a tree but a dynamic array containing all statements in the program, in order of execution.
 typedef struct ParseTree {
     int index;
@@ -24,42 +36,72 @@ typedef struct ParseTree {
 
 // ----------------
 // Statement types
+// Statements record the zero based source line and column they start on.
 // ----------------
 
 typedef struct IfStmt {
     Stmt s;
     void *cond;
     ParseTree trueBranch;
+    int line;
+    int col;
 } IfStmt;
 
 typedef struct WhileStmt {
     Stmt s;
     void *cond;
     ParseTree trueBranch;
+    int line;
+    int col;
 } WhileStmt;
 
 typedef struct ShowStmt {
     Stmt s;
     void *expr;
+    int line;
+    int col;
 } ShowStmt;
 
+// Variable nodes carry the symbol slot assigned by the analyser, -1 until resolved.
+// length is the element count of an ARRAY declaration and 0 otherwise.
 typedef struct VarDecStmt {
     Stmt s;
     char id[100];
     Type type;
+    int slot;
+    int line;
+    int col;
+    int length;
 } VarDecStmt;
 
 typedef struct VarAssignStmt {
     Stmt s;
     char id[100];
     void *expr;
+    int slot;
+    int line;
+    int col;
 } VarAssignStmt;
 
+// Assignment to one element, a[index] = expr. Starts like a VarAssignStmt.
+typedef struct StoreStmt {
+    Stmt s;
+    char id[100];
+    void *expr;
+    int slot;
+    int line;
+    int col;
+    void *index;
+} StoreStmt;
+
+// integral is set by the analyser when both operands are expected to hold exact integers.
 typedef struct BinOpExpr {
     Stmt s;
     void *left;
     void *right;
     char op[5];
+    TokenType opType;
+    bool integral;
 } BinOpExpr;
 
 typedef struct UnOpExpr {
@@ -73,17 +115,144 @@ typedef struct BracketExpr {
     void *expr;
 } BracketExpr;
 
+// The analyser decodes the literal text into type and value.
+// NUM literals written without a '.' that fit in 64 bits are exact integers.
 typedef struct LiteralExpr {
     Stmt s;
     char val[100];
+    Type type;
+    double value;
+    bool exact;
+    long long integer;
 } LiteralExpr;
 
 typedef struct VarExpr {
     Stmt s;
     char id[100];
+    int slot;
 } VarExpr;
 
+// One element of an array, a[index]. Starts like a VarExpr.
+typedef struct IndexExpr {
+    Stmt s;
+    char id[100];
+    int slot;
+    void *index;
+} IndexExpr;
+
+// sum, min or max of an array expression.
+typedef struct ReduceExpr {
+    Stmt s;
+    void *expr;
+    char op[5];
+    Reduction kind;
+} ReduceExpr;
+
+// A procedure, only found at the top level. params holds a VarDecStmt per parameter. The analyser sets
+// index, its position among the program's procedures, and redeclared when an earlier procedure has the
+// same name. inlined is set by the optimiser when calls are replaced by the body's return expression.
+typedef struct ProcStmt {
+    Stmt s;
+    char id[100];
+    ParseTree params;
+    ParseTree body;
+    int line;
+    int col;
+    int index;
+    bool redeclared;
+    bool inlined;
+} ProcStmt;
+
+// 'return expr;' inside a procedure and a call used as a statement. Both start like a ShowStmt.
+typedef struct ReturnStmt {
+    Stmt s;
+    void *expr;
+    int line;
+    int col;
+} ReturnStmt;
+
+typedef struct InvokeStmt {
+    Stmt s;
+    void *expr;
+    int line;
+    int col;
+} InvokeStmt;
+
+// 'read name;', taking the next value of the input into a variable. Starts like a VarExpr.
+typedef struct ReadStmt {
+    Stmt s;
+    char id[100];
+    int slot;
+    int line;
+    int col;
+} ReadStmt;
+
+// 'eof', true once only blanks are left in the input.
+typedef struct AtEndExpr {
+    Stmt s;
+} AtEndExpr;
+
+// A call of a procedure. proc is set by the analyser, NULL when no procedure has the name.
+typedef struct CallExpr {
+    Stmt s;
+    char id[100];
+    ParseTree args;
+    ProcStmt *proc;
+} CallExpr;
+
+// ----------------
+// Optimiser nodes
+// Added by the optimiser after analysis, never produced by the parser.
+// ----------------
+
+// Wraps a loop whose temporaries first .. first + count - 1 are reset each time it is entered.
+typedef struct HoistStmt {
+    Stmt s;
+    void *loop;
+    int first;
+    int count;
+} HoistStmt;
+
+// Expression whose value is kept in a temporary once it has been evaluated without error.
+// A SAVE always evaluates and refreshes the temporary, a TEMP reuses it when it is valid.
+typedef struct TempExpr {
+    Stmt s;
+    void *expr;
+    int temp;
+} TempExpr;
+
+// Induction variable times an integer constant. While the variable is an exact integer stepping by
+// 'step' the product is updated by adding 'delta' instead of multiplying.
+typedef struct InductExpr {
+    Stmt s;
+    BinOpExpr *mul;
+    bool varLeft;
+    long long step;
+    long long delta;
+    int temp;
+} InductExpr;
+
+// A dead VarAssignStmt is turned into a NOP in place, keeping its fields.
+
+// An operator still waiting for its operand: a binary operator with its left operand on the value
+// stack, a prefix '!', an open parenthesis, the '[' of an index whose IndexExpr is on the value stack,
+// the '(' of a reduction, held as an ID with the reduction's name, or the open argument list of a
+// call whose CallExpr is on the value stack, held as a COMMA.
+typedef struct Pending {
+    TokenType type;
+    char op[5];
+} Pending;
+
+// An if, while or proc statement whose body is still being parsed.
+typedef struct OpenBlock {
+    void *stmt;
+    ParseTree *body;
+    int repeats;
+} OpenBlock;
+
 // LL(1) parser object.
+// Pending operators, operands and open blocks live on explicit stacks rather than the C stack,
+// so the nesting depth of the input is only limited by memory.
 typedef struct Parser {
     int index;
     Token lookahead;
@@ -91,12 +260,34 @@ typedef struct Parser {
     bool err;
     ParseTree tree;
     Token *tokStream;
+    Output *out;
+    Pending *ops;
+    int opCount;
+    int opSize;
+    void **vals;
+    int valCount;
+    int valSize;
+    OpenBlock *blocks;
+    int blockCount;
+    int blockSize;
 } Parser;
 
+// Called by walkTree for every node. scope counts the if and while statements the node is evaluated
+// inside, the way the analyser nests scopes, and depth counts all the nodes above it.
+typedef void (*Visitor)(void *node, int scope, int depth, void *data);
+
 // -----------------
 // Public Functions
 // -----------------
 
 void initParser(Parser *p, Lexer *l);
 void parse(Parser *p);
+void *parseStatementAt(Parser *p, int at);
+void *newNode(long size);
+void endParse(Parser *p);
 void printTree(ParseTree t);
+void walkTree(ParseTree t, Visitor visit, void *data);
+void freeStmt(void *stmt);
+void freeTree(ParseTree t);
+
+#endif
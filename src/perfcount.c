@@ -0,0 +1,133 @@
+// Hardware performance counters for the CAM programming langauge.
+// Counts cycles, instructions, branch misses and cache misses around the phases of a run with
+// Linux perf_event_open, falling back to plain phase times wherever the counters are unavailable.
+
+#include "perfcount.h"
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// -----------------
+// Private Functions
+// -----------------
+
+int openEvent(unsigned int type, unsigned long long config);
+double phaseClock(void);
+void printCount(PerfCounters *pc, Phase phase, PerfEvent event);
+
+// -----------------
+// Main Funcs
+// -----------------
+
+// Open a counter for every event, remembering the first errno when one is refused.
+void openPerfCounters(PerfCounters *pc) {
+    unsigned long long l1 = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    memset(pc, 0, sizeof(PerfCounters));
+    pc->fds[PERF_CYCLES] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    pc->fds[PERF_INSTRUCTIONS] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    pc->fds[PERF_BRANCH_MISSES] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    pc->fds[PERF_L1D_MISSES] = openEvent(PERF_TYPE_HW_CACHE, l1);
+    pc->fds[PERF_LLC_MISSES] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        if (pc->fds[e] == -1 && !pc->error) pc->error = errno;
+    }
+}
+
+// Reset and enable every counter at the start of a phase.
+void startPhase(PerfCounters *pc) {
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        if (pc->fds[e] == -1) continue;
+        ioctl(pc->fds[e], PERF_EVENT_IOC_RESET, 0);
+        ioctl(pc->fds[e], PERF_EVENT_IOC_ENABLE, 0);
+    }
+    pc->started = phaseClock();
+}
+
+// Disable the counters and add what they counted to a phase.
+void stopPhase(PerfCounters *pc, Phase phase) {
+    pc->seconds[phase] += phaseClock() - pc->started;
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        if (pc->fds[e] == -1) continue;
+        ioctl(pc->fds[e], PERF_EVENT_IOC_DISABLE, 0);
+        unsigned long long v[3];
+        if (read(pc->fds[e], v, sizeof(v)) != sizeof(v)) continue;
+        if (v[2] && v[2] < v[1]) v[0] = (unsigned long long) ((double) v[0] * v[1] / v[2]);
+        pc->counts[phase][e] += v[0];
+    }
+}
+
+// Print a table of every phase to stderr.
+void printPerfCounters(PerfCounters *pc) {
+    char *phases[PHASES] = {"lex", "parse", "prepare", "execute"};
+    fprintf(stderr, "%-8s %10s %14s %14s %6s %12s %12s %12s\n", "phase", "ms", "cycles", "instructions",
+            "IPC", "br-misses", "L1d-misses", "LLC-misses");
+    for (int p = 0; p < PHASES; p++) {
+        fprintf(stderr, "%-8s %10.3f", phases[p], pc->seconds[p] * 1e3);
+        printCount(pc, p, PERF_CYCLES);
+        printCount(pc, p, PERF_INSTRUCTIONS);
+        if (pc->fds[PERF_CYCLES] != -1 && pc->fds[PERF_INSTRUCTIONS] != -1 && pc->counts[p][PERF_CYCLES]) {
+            fprintf(stderr, " %6.2f", (double) pc->counts[p][PERF_INSTRUCTIONS] / pc->counts[p][PERF_CYCLES]);
+        } else {
+            fprintf(stderr, " %6s", "n/a");
+        }
+        printCount(pc, p, PERF_BRANCH_MISSES);
+        printCount(pc, p, PERF_L1D_MISSES);
+        printCount(pc, p, PERF_LLC_MISSES);
+        fprintf(stderr, "\n");
+    }
+    int open = 0;
+    for (int e = 0; e < PERF_EVENTS; e++) open += pc->fds[e] != -1;
+    if (pc->error) {
+        fprintf(stderr, "%s hardware counters are unavailable (%s). Check /proc/sys/kernel/perf_event_paranoid.\n",
+                open ? "Some" : "The", strerror(pc->error));
+    }
+}
+
+// Close the counters.
+void closePerfCounters(PerfCounters *pc) {
+    for (int e = 0; e < PERF_EVENTS; e++) {
+        if (pc->fds[e] != -1) close(pc->fds[e]);
+    }
+}
+
+// -----------------
+// Helpers
+// -----------------
+
+// Open one disabled user space counter on this thread, or return -1.
+int openEvent(unsigned int type, unsigned long long config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Monotonic seconds for phase times.
+double phaseClock(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Print one count column, n/a when its counter could not be opened.
+void printCount(PerfCounters *pc, Phase phase, PerfEvent event) {
+    int width = event == PERF_CYCLES || event == PERF_INSTRUCTIONS ? 14 : 12;
+    if (pc->fds[event] == -1) {
+        fprintf(stderr, " %*s", width, "n/a");
+    } else {
+        fprintf(stderr, " %*lld", width, pc->counts[phase][event]);
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef PERFCOUNT_H
+#define PERFCOUNT_H
+
+#include <stdbool.h>
+
+// -----------------
+// Public Objects
+// -----------------
+
+// Phases of a run that are measured separately. Prepare covers resolving, optimising and lowering.
+typedef enum Phase {
+    PHASE_LEX, PHASE_PARSE, PHASE_PREPARE, PHASE_EXECUTE, PHASES
+} Phase;
+
+// Hardware events counted in every phase.
+typedef enum PerfEvent {
+    PERF_CYCLES, PERF_INSTRUCTIONS, PERF_BRANCH_MISSES, PERF_L1D_MISSES, PERF_LLC_MISSES, PERF_EVENTS
+} PerfEvent;
+
+// One perf_event_open counter per event, user space only and inherited by the lexer threads, enabled
+// around each phase in turn. An event the kernel refuses has fd -1 and prints as n/a, so a container
+// or a high perf_event_paranoid still gets the phase times. Counts are scaled up when the kernel
+// multiplexed a counter for part of a phase.
+typedef struct PerfCounters {
+    int fds[PERF_EVENTS];
+    long long counts[PHASES][PERF_EVENTS];
+    double seconds[PHASES];
+    double started;
+    int error;
+} PerfCounters;
+
+// -----------------
+// Public Functions
+// -----------------
+
+void openPerfCounters(PerfCounters *pc);
+void startPhase(PerfCounters *pc);
+void stopPhase(PerfCounters *pc, Phase phase);
+void printPerfCounters(PerfCounters *pc);
+void closePerfCounters(PerfCounters *pc);
+
+#endif
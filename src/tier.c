@@ -0,0 +1,871 @@
+// Compiled hot loops for the CAM programming langauge.
+// The tree walker counts the back edges of every while loop, and one taken TIER_HOT times is compiled
+// into typed op trees: names resolved to the slots they were declared in when it got hot, values kept
+// unboxed as integers, doubles or bools where the types seen so far allow, and conditions compiled to
+// compare and branch. The compiled loop is entered at the start of its body, either at the back edge
+// that made it hot or whenever the tree walker enters the loop later. Guards at entry check every name
+// still resolves the same way and holds the type it was compiled for. Anything the compiled code does
+// not expect, an index out of range, an integer growing past 48 bits or a temporary of another type,
+// goes back to the tree walker at the start of the statement running, with the frames of the blocks
+// enclosing it, so errors are always reported by the tree walker. Statements are only ever restarted
+// after side effects that repeat the same way, so output is the same either way.
+
+#include "tier.h"
+#include "interpreter.h"
+#include "memstats.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Compilation state. types holds the type assumed for each slot, useAt and arrayAt where a slot is in
+// the loop's uses and arrays, -1 when it is not. context holds the frames of the blocks enclosing the
+// statement being compiled and stack the ops of the expression being compiled. changed is set when a
+// pass widened a type, so the loop has to be compiled again.
+typedef struct TierCompiler {
+    Interpreter *i;
+    LoopCode *lc;
+    Node *nodes;
+    unsigned char *types;
+    int *useAt;
+    int *arrayAt;
+    Frame *context;
+    int depth;
+    int contextSize;
+    int *stack;
+    int stackSize;
+    bool changed;
+} TierCompiler;
+
+// A compiled loop running. A guard that fails jumps to trap.
+typedef struct TierRun {
+    Interpreter *i;
+    LoopCode *lc;
+    TierOp *ops;
+    Slot *slots;
+    Temp *temps;
+    jmp_buf trap;
+} TierRun;
+
+// -----------------
+// Private Functions
+// -----------------
+
+bool compileLoop(Interpreter *i, int loop, LoopCode *lc);
+int compileBlock(TierCompiler *c, int from, int count, int loop);
+bool compileStmt(TierCompiler *c, int s, int p, int end, int loop);
+int compileExpr(TierCompiler *c, int from, int to);
+int compileOps(TierCompiler *c, int from, int to);
+int compileBinary(TierCompiler *c, Node *node, int l, int r);
+int compileInduct(TierCompiler *c, Node *ind);
+int addOp(TierCompiler *c, TierCode code, TierType type, int a, int b);
+int addExit(TierCompiler *c, int pc, int end, int loop);
+int resolveSlot(TierCompiler *c, int slot);
+int resolveArray(TierCompiler *c, int slot);
+bool joinType(TierCompiler *c, int slot, TierType type);
+bool isNumType(int type);
+bool checkUses(Interpreter *i, LoopCode *lc);
+void freeLoopCode(LoopCode *lc);
+void *tierGrow(void *list, int count, int *size, size_t item);
+void runLoop(TierRun *r);
+void runStmts(TierRun *r, int first, int count);
+Lit tierValue(TierRun *r, int k);
+double tierNum(TierRun *r, int k);
+long long tierInt(TierRun *r, int k);
+bool tierTest(TierRun *r, int k);
+int tierElement(TierRun *r, int array, int index);
+Lit tierTemp(TierRun *r, TierOp *op);
+Lit tierInduct(TierRun *r, TierOp *op);
+bool tierArith(TokenType op, bool integral, Lit l, Lit r, Lit *out);
+bool tierCompare(TokenType op, double x, double y);
+bool tierCompareInt(TokenType op, long long x, long long y);
+void deopt(TierRun *r);
+
+// -----------------
+// Main Funcs
+// -----------------
+
+// Start counting the back edges of the while loops in code, compiling a loop after after of them.
+// after 0 or less never compiles anything.
+void initTier(Tier *t, CompactTree *code, int after) {
+    *t = (Tier) {NULL, NULL, 0, 0, after};
+    if (after <= 0) return;
+    t->hits = calloc(code->count ? code->count : 1, sizeof(int));
+    MEM_COUNT(MEM_RUNTIME, sizeof(int) * (code->count ? code->count : 1));
+}
+
+// Run the while loop at node loop compiled, from the start of its body: the tree walker has tested it,
+// counted its statements and pushed its frame. Returns where the tree walker carries on, or NULL when
+// the loop cannot run compiled and the tree walker runs the body itself.
+TierExit *enterTier(Interpreter *i, int loop) {
+    Tier *t = &i->tier;
+    if (t->hits[loop] == TIER_NEVER) return NULL;
+    if (t->hits[loop] > 0) {
+        t->loops = tierGrow(t->loops, t->loopCount, &t->loopSize, sizeof(LoopCode));
+        LoopCode *lc = &t->loops[t->loopCount];
+        memset(lc, 0, sizeof(LoopCode));
+        if (!compileLoop(i, loop, lc)) {
+            freeLoopCode(lc);
+            t->hits[loop] = TIER_NEVER;
+            return NULL;
+        }
+        t->hits[loop] = -1 - t->loopCount++;
+    }
+    LoopCode *lc = &t->loops[-1 - t->hits[loop]];
+    if (!checkUses(i, lc)) {
+        if (lc->compiles == TIER_COMPILES || !compileLoop(i, loop, lc)) {
+            t->hits[loop] = TIER_NEVER;
+            return NULL;
+        }
+    }
+    for (int a = 0; a < lc->arrayCount; a++) {
+        lc->data[a] = i->arrays[lc->arrays[a]].data;
+        lc->lengths[a] = i->arrays[lc->arrays[a]].length;
+    }
+
+    TierRun r = {i, lc, lc->ops, i->env.slots, i->temps};
+    if (setjmp(r.trap)) {
+        if (++lc->deopts == TIER_DEOPTS) t->hits[loop] = TIER_NEVER;
+        return &lc->exits[lc->exit];
+    }
+    runLoop(&r);
+    return &lc->exits[0];
+}
+
+// Release the compiled loops.
+void freeTier(Tier *t) {
+    for (int k = 0; k < t->loopCount; k++) freeLoopCode(&t->loops[k]);
+    free(t->loops);
+    free(t->hits);
+    *t = (Tier) {NULL, NULL, 0, 0, 0};
+}
+
+// -----------------
+// Compiling
+// -----------------
+
+// Compile the while loop at node loop into lc, compiling it again until the types of its slots settle.
+// Returns false when it holds anything only the tree walker runs.
+bool compileLoop(Interpreter *i, int loop, LoopCode *lc) {
+    int slots = i->table->index ? i->table->index : 1;
+    TierCompiler c = {i, lc, i->nodes, calloc(slots, 1), malloc(sizeof(int) * slots), malloc(sizeof(int) * slots),
+                      NULL, 0, 0, NULL, 0, false};
+    for (int s = 0; s < slots; s++) c.useAt[s] = c.arrayAt[s] = -1;
+    Node *w = i->nodes + loop;
+    lc->loop = loop;
+    lc->compiles++;
+    bool ok = false;
+    for (int pass = 0; pass < TIER_PASSES; pass++) {
+        for (int u = 0; u < lc->useCount; u++) c.useAt[lc->uses[u].slot] = -1;
+        for (int a = 0; a < lc->arrayCount; a++) c.arrayAt[lc->arrays[a]] = -1;
+        lc->opCount = lc->stmtCount = lc->exitCount = lc->frameCount = lc->useCount = lc->arrayCount = 0;
+        c.changed = false;
+        addExit(&c, w->b + w->c, w->b + w->c, loop);
+        lc->op = compileExpr(&c, w->a, w->b - 1);
+        if (lc->op == -1 || lc->ops[lc->op].type != TIER_BOOL) break;
+        lc->first = compileBlock(&c, w->b, w->c, loop);
+        lc->count = w->c;
+        if (lc->first == -1) break;
+        if (!c.changed) {
+            ok = true;
+            break;
+        }
+    }
+    if (ok) {
+        lc->frames = tierGrow(lc->frames, lc->frameCount, &lc->frameSize, sizeof(Frame));
+        for (int u = 0; u < lc->useCount; u++) lc->uses[u].type = c.types[lc->uses[u].declared];
+        for (int e = 0; e < lc->exitCount; e++) lc->exits[e].frames = lc->frames + lc->exits[e].frameAt;
+        lc->data = realloc(lc->data, sizeof(double *) * (lc->arrayCount ? lc->arrayCount : 1));
+        lc->lengths = realloc(lc->lengths, sizeof(int) * (lc->arrayCount ? lc->arrayCount : 1));
+    }
+    free(c.types);
+    free(c.useAt);
+    free(c.arrayAt);
+    free(c.context);
+    free(c.stack);
+    return ok;
+}
+
+// Compile the count statements of a block from node from, run as the while loop at node loop or -1 for
+// an if. Returns the first of its compiled statements, or -1.
+int compileBlock(TierCompiler *c, int from, int count, int loop) {
+    LoopCode *lc = c->lc;
+    int first = lc->stmtCount;
+    for (int k = 0; k < count; k++) {
+        lc->stmts = tierGrow(lc->stmts, lc->stmtCount, &lc->stmtSize, sizeof(TierStmt));
+        lc->stmtCount++;
+    }
+    for (int k = 0; k < count; k++) {
+        if (!compileStmt(c, first + k, from + k, from + count, loop)) return -1;
+    }
+    return first;
+}
+
+// Compile the statement at node p of a block ending at end into compiled statement s.
+bool compileStmt(TierCompiler *c, int s, int p, int end, int loop) {
+    Node *nodes = c->nodes;
+    int at = p;
+    TierStmt st = {TIER_SKIP, p, -1, -1, -1, 0, 0, 0, 0, 0, 0};
+    if (nodes[at].tag == HOIST) {
+        st.temps = nodes[at].b;
+        st.tempCount = nodes[at].c;
+        at = nodes[at].a;
+        if (nodes[at].tag == HOIST) return false;
+    }
+    Node *node = nodes + at;
+    st.node = at;
+    st.exit = addExit(c, p, end, loop);
+    switch (node->tag) {
+        case VARASSIGN: {
+            int slot = resolveSlot(c, node->a);
+            if (slot == -1 || c->types[slot] == TIER_ARRAY) return false;
+            st.op = compileExpr(c, node->c, node->b);
+            if (st.op == -1) return false;
+            TierType type = c->lc->ops[st.op].type;
+            if ((c->i->env.slots[slot].type == BOOL) != (type == TIER_BOOL)) return false;
+            if (!joinType(c, slot, type)) return false;
+            st.kind = TIER_ASSIGN;
+            st.slot = slot;
+            break;
+        }
+        case STORE: {
+            st.slot = resolveArray(c, nodes[node->b].a);
+            if (st.slot == -1 || compileOps(c, node->c, node->b - 1) != 2) return false;
+            st.index = c->stack[0];
+            st.op = c->stack[1];
+            if (!isNumType(c->lc->ops[st.index].type) || !isNumType(c->lc->ops[st.op].type)) return false;
+            st.kind = TIER_STORE;
+            break;
+        }
+        case SHOW: {
+            st.op = compileExpr(c, node->b, node->a);
+            if (st.op == -1) return false;
+            st.kind = TIER_SHOW;
+            break;
+        }
+        case IF:
+        case WHILE: {
+            st.op = compileExpr(c, node->a, node->b - 1);
+            if (st.op == -1 || c->lc->ops[st.op].type != TIER_BOOL) return false;
+            c->context = tierGrow(c->context, c->depth, &c->contextSize, sizeof(Frame));
+            c->context[c->depth++] = (Frame) {p + 1, end, loop};
+            if (node->tag == WHILE) st.test = addExit(c, node->b + node->c, node->b + node->c, at);
+            st.first = compileBlock(c, node->b, node->c, node->tag == WHILE ? at : -1);
+            c->depth--;
+            if (st.first == -1) return false;
+            st.count = node->c;
+            st.kind = node->tag == IF ? TIER_IF : TIER_WHILE;
+            break;
+        }
+        case VARDEC: {
+            Slot *cs = &c->i->env.slots[node->a];
+            if (!cs->declared || cs->type != node->op || cs->type == ARRAY) return false;
+            if (resolveSlot(c, node->a) != node->a) return false;
+            break;
+        }
+        case NOP:
+            break;
+        default:
+            return false;
+    }
+    c->lc->stmts[s] = st;
+    return true;
+}
+
+// Compile the expression in nodes from .. to, returning its root op or -1.
+int compileExpr(TierCompiler *c, int from, int to) {
+    return compileOps(c, from, to) == 1 ? c->stack[0] : -1;
+}
+
+// Compile the nodes from .. to, leaving the ops of the values they push on the stack. Returns how many
+// there are, or -1 when a node cannot be compiled.
+int compileOps(TierCompiler *c, int from, int to) {
+    Node *nodes = c->nodes;
+    int depth = 0;
+    for (int k = from; k <= to; k++) {
+        Node *node = nodes + k;
+        int op;
+        switch (node->tag) {
+            case LITERAL: {
+                if (node->flags & NODE_EXACT) {
+                    if (!FITS_INT(node->integer)) return -1;
+                    op = addOp(c, OP_CONST, TIER_INT, 0, 0);
+                    c->lc->ops[op].value = INT_LIT(node->integer);
+                } else if (node->op == BOOL) {
+                    op = addOp(c, OP_CONST, TIER_BOOL, 0, 0);
+                    c->lc->ops[op].value = BOOL_LIT(node->value);
+                } else {
+                    op = addOp(c, OP_CONST, TIER_DBL, 0, 0);
+                    c->lc->ops[op].value = doubleLit(node->value);
+                }
+                break;
+            }
+            case VAR: {
+                int slot = resolveSlot(c, node->a);
+                if (slot == -1 || c->types[slot] == TIER_ARRAY) return -1;
+                op = addOp(c, OP_SLOT, c->types[slot], slot, 0);
+                break;
+            }
+            case BINOP: {
+                depth--;
+                op = compileBinary(c, node, c->stack[depth - 1], c->stack[depth]);
+                if (op == -1) return -1;
+                depth--;
+                break;
+            }
+            case UNOP: {
+                if (c->lc->ops[c->stack[depth - 1]].type != TIER_BOOL) return -1;
+                op = addOp(c, OP_NOT, TIER_BOOL, c->stack[--depth], 0);
+                break;
+            }
+            case INDEX: {
+                int array = resolveArray(c, node->a);
+                if (array == -1 || !isNumType(c->lc->ops[c->stack[depth - 1]].type)) return -1;
+                op = addOp(c, OP_ELEM, TIER_DBL, array, c->stack[--depth]);
+                break;
+            }
+            case TEMP:
+            case SAVE: {
+                int sub = c->stack[--depth];
+                op = addOp(c, node->tag == TEMP ? OP_REUSE : OP_SAVE, c->lc->ops[sub].type, node->b, sub);
+                break;
+            }
+            case STEP: {
+                op = compileInduct(c, nodes + node->a);
+                if (op == -1) return -1;
+                k = node->a;
+                break;
+            }
+            case BRACKET:
+            case REUSE:
+                continue;
+            default:
+                return -1;
+        }
+        c->stack = tierGrow(c->stack, depth, &c->stackSize, sizeof(int));
+        c->stack[depth++] = op;
+    }
+    return depth;
+}
+
+// Compile a binary operator node on the ops l and r, typed as binOpCases would run it. Returns -1 for
+// operands it would report an error on.
+int compileBinary(TierCompiler *c, Node *node, int l, int r) {
+    int x = c->lc->ops[l].type;
+    int y = c->lc->ops[r].type;
+    bool integral = node->flags & NODE_INTEGRAL;
+    int op;
+    switch (node->op) {
+        case PLUS:
+        case MINUS:
+        case STAR:
+        case SLASH: {
+            if (!isNumType(x) || !isNumType(y)) return -1;
+            if (!integral || x == TIER_DBL || y == TIER_DBL) {
+                TierCode code = node->op == PLUS ? OP_ADD_D : node->op == MINUS ? OP_SUB_D : node->op == STAR ? OP_MUL_D : OP_DIV_D;
+                op = addOp(c, code, TIER_DBL, l, r);
+            } else if (x == TIER_INT && y == TIER_INT) {
+                TierCode code = node->op == PLUS ? OP_ADD_I : node->op == MINUS ? OP_SUB_I : node->op == STAR ? OP_MUL_I : OP_DIV_I;
+                op = addOp(c, code, code == OP_DIV_I ? TIER_NUM : TIER_INT, l, r);
+            } else {
+                op = addOp(c, OP_ARITH, TIER_NUM, l, r);
+            }
+            break;
+        }
+        case GTHAN:
+        case GTHANEQ:
+        case LTHAN:
+        case LTHANEQ:
+        case EQEQUALS:
+        case BANGEQ: {
+            if (x == TIER_BOOL && y == TIER_BOOL && (node->op == EQEQUALS || node->op == BANGEQ)) {
+                op = addOp(c, OP_EQ_B, TIER_BOOL, l, r);
+            } else if (isNumType(x) && isNumType(y)) {
+                op = addOp(c, x == TIER_INT && y == TIER_INT ? OP_CMP_I : OP_CMP_D, TIER_BOOL, l, r);
+            } else {
+                return -1;
+            }
+            break;
+        }
+        case AND:
+        case OR: {
+            if (x != TIER_BOOL || y != TIER_BOOL) return -1;
+            op = addOp(c, node->op == AND ? OP_AND : OP_OR, TIER_BOOL, l, r);
+            break;
+        }
+        default:
+            return -1;
+    }
+    c->lc->ops[op].op = node->op;
+    c->lc->ops[op].integral = integral;
+    return op;
+}
+
+// Compile the INDUCT node ind, an induction variable times a constant.
+int compileInduct(TierCompiler *c, Node *ind) {
+    Node *mul = c->nodes + ind->a;
+    bool varLeft = ind->flags & NODE_VARLEFT;
+    Node *var = c->nodes + (varLeft ? mul->a : mul->b);
+    Node *k = c->nodes + (varLeft ? mul->b : mul->a);
+    if (var->tag != VAR || k->tag != LITERAL || k->op == BOOL) return -1;
+    if ((k->flags & NODE_EXACT) && !FITS_INT(k->integer)) return -1;
+    int slot = resolveSlot(c, var->a);
+    if (slot == -1 || !isNumType(c->types[slot])) return -1;
+    int op = addOp(c, OP_INDUCT, TIER_NUM, ind - c->nodes, slot);
+    c->lc->ops[op].value = k->flags & NODE_EXACT ? INT_LIT(k->integer) : doubleLit(k->value);
+    return op;
+}
+
+// Add an op, returning its index.
+int addOp(TierCompiler *c, TierCode code, TierType type, int a, int b) {
+    LoopCode *lc = c->lc;
+    lc->ops = tierGrow(lc->ops, lc->opCount, &lc->opSize, sizeof(TierOp));
+    lc->ops[lc->opCount] = (TierOp) {code, type, 0, 0, a, b, 0};
+    return lc->opCount++;
+}
+
+// Add an exit resuming the tree walker at statement pc of the block ending at end, with the frames of
+// the blocks enclosing it. Returns its index.
+int addExit(TierCompiler *c, int pc, int end, int loop) {
+    LoopCode *lc = c->lc;
+    lc->exits = tierGrow(lc->exits, lc->exitCount, &lc->exitSize, sizeof(TierExit));
+    lc->exits[lc->exitCount] = (TierExit) {pc, end, loop, lc->frameCount, c->depth, NULL};
+    for (int f = 0; f < c->depth; f++) {
+        lc->frames = tierGrow(lc->frames, lc->frameCount, &lc->frameSize, sizeof(Frame));
+        lc->frames[lc->frameCount++] = c->context[f];
+    }
+    return lc->exitCount++;
+}
+
+// Resolve a name's slot to the one declared now, recording it as a use and taking the type of its
+// current value the first time. Returns -1 when it is undeclared or its value cannot be compiled.
+int resolveSlot(TierCompiler *c, int slot) {
+    LoopCode *lc = c->lc;
+    int declared = declaredSlot(c->i, slot);
+    if (declared == -1) return -1;
+    if (c->useAt[slot] == -1) {
+        lc->uses = tierGrow(lc->uses, lc->useCount, &lc->useSize, sizeof(TierUse));
+        lc->uses[lc->useCount] = (TierUse) {slot, declared, TIER_NONE};
+        c->useAt[slot] = lc->useCount++;
+    }
+    if (c->types[declared] == TIER_NONE) {
+        Slot *cs = &c->i->env.slots[declared];
+        Lit v = cs->value;
+        if (cs->type == ARRAY) {
+            c->types[declared] = TIER_ARRAY;
+        } else if (cs->type == BOOL) {
+            if (!IS_BOOL(v)) return -1;
+            c->types[declared] = TIER_BOOL;
+        } else if (IS_INT(v)) {
+            c->types[declared] = TIER_INT;
+        } else if (IS_DOUBLE(v)) {
+            c->types[declared] = TIER_DBL;
+        } else {
+            return -1;
+        }
+    }
+    return declared;
+}
+
+// Resolve a name to the array declared for it, returning its index in the loop's arrays or -1.
+int resolveArray(TierCompiler *c, int slot) {
+    LoopCode *lc = c->lc;
+    int declared = resolveSlot(c, slot);
+    if (declared == -1 || c->types[declared] != TIER_ARRAY) return -1;
+    if (c->arrayAt[declared] == -1) {
+        lc->arrays = tierGrow(lc->arrays, lc->arrayCount, &lc->arraySize, sizeof(int));
+        lc->arrays[lc->arrayCount] = declared;
+        c->arrayAt[declared] = lc->arrayCount++;
+    }
+    return c->arrayAt[declared];
+}
+
+// Widen the type of a slot to hold values of type too. Returns false when it would hold a BOOL and a NUM.
+bool joinType(TierCompiler *c, int slot, TierType type) {
+    int was = c->types[slot];
+    if (was == type || (was == TIER_NUM && isNumType(type))) return true;
+    if (!isNumType(was) || !isNumType(type)) return false;
+    c->types[slot] = TIER_NUM;
+    c->changed = true;
+    return true;
+}
+
+// Whether a compiled type is a NUM.
+bool isNumType(int type) {
+    return type == TIER_INT || type == TIER_DBL || type == TIER_NUM;
+}
+
+// Check the names of a compiled loop resolve as they did when it was compiled and hold values of the
+// types it was compiled for.
+bool checkUses(Interpreter *i, LoopCode *lc) {
+    for (int u = 0; u < lc->useCount; u++) {
+        TierUse *use = &lc->uses[u];
+        if (declaredSlot(i, use->slot) != use->declared) return false;
+        Slot *cs = &i->env.slots[use->declared];
+        Lit v = cs->value;
+        bool ok;
+        switch (use->type) {
+            case TIER_INT:
+                ok = cs->type == NUM && IS_INT(v);
+                break;
+            case TIER_DBL:
+                ok = cs->type == NUM && IS_DOUBLE(v);
+                break;
+            case TIER_NUM:
+                ok = cs->type == NUM && (IS_INT(v) || IS_DOUBLE(v));
+                break;
+            case TIER_BOOL:
+                ok = cs->type == BOOL && IS_BOOL(v);
+                break;
+            default:
+                ok = cs->type == ARRAY;
+                break;
+        }
+        if (!ok) return false;
+    }
+    return true;
+}
+
+// Release what a compiled loop holds.
+void freeLoopCode(LoopCode *lc) {
+    free(lc->ops);
+    free(lc->stmts);
+    free(lc->exits);
+    free(lc->frames);
+    free(lc->uses);
+    free(lc->arrays);
+    free(lc->data);
+    free(lc->lengths);
+}
+
+// Make room for one more item of item bytes after count, doubling the list when it is full.
+void *tierGrow(void *list, int count, int *size, size_t item) {
+    if (count < *size) return list;
+    *size = *size ? *size * 2 : 16;
+    MEM_COUNT(MEM_RUNTIME, item * (*size - count));
+    return realloc(list, item * *size);
+}
+
+// -----------------
+// Running
+// -----------------
+
+// Run the body of a compiled loop and test the loop after it until the test is false. Once a checkpoint
+// is due the tree walker tests it instead, writing the checkpoint at its back edge.
+void runLoop(TierRun *r) {
+    Interpreter *i = r->i;
+    LoopCode *lc = r->lc;
+    Node *w = i->nodes + lc->loop;
+    while (true) {
+        runStmts(r, lc->first, lc->count);
+        lc->exit = 0;
+        if (i->saveDue && i->callDepth == 0) return;
+        if (!tierTest(r, lc->op)) return;
+        i->steps += w->c;
+        if (--i->fuel == 0) refuel(i, w);
+    }
+}
+
+// Run count compiled statements from first, setting the exit to take before each of them.
+void runStmts(TierRun *r, int first, int count) {
+    Interpreter *i = r->i;
+    LoopCode *lc = r->lc;
+    for (TierStmt *st = lc->stmts + first; st < lc->stmts + first + count; st++) {
+        lc->exit = st->exit;
+        for (int t = st->temps; t < st->temps + st->tempCount; t++) r->temps[t].valid = false;
+        switch (st->kind) {
+            case TIER_ASSIGN:
+                r->slots[st->slot].value = tierValue(r, st->op);
+                break;
+            case TIER_STORE: {
+                int at = tierElement(r, st->slot, st->index);
+                double v = tierNum(r, st->op);
+                lc->data[st->slot][at] = v;
+                break;
+            }
+            case TIER_SHOW:
+                showResult(i, st->node, tierValue(r, st->op));
+                break;
+            case TIER_IF:
+                if (tierTest(r, st->op)) {
+                    i->steps += st->count;
+                    runStmts(r, st->first, st->count);
+                }
+                break;
+            case TIER_WHILE:
+                if (!tierTest(r, st->op)) break;
+                i->steps += st->count;
+                while (true) {
+                    runStmts(r, st->first, st->count);
+                    lc->exit = st->test;
+                    if (!tierTest(r, st->op)) break;
+                    i->steps += st->count;
+                    if (--i->fuel == 0) refuel(i, i->nodes + st->node);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// The value of op k boxed as the tree walker holds it.
+Lit tierValue(TierRun *r, int k) {
+    TierOp *op = r->ops + k;
+    switch (op->code) {
+        case OP_CONST:
+            return op->value;
+        case OP_SLOT:
+            return r->slots[op->a].value;
+        case OP_DIV_I: {
+            long long x = tierInt(r, op->a);
+            long long y = tierInt(r, op->b);
+            if (y == 0 || x % y != 0 || (x == 0 && y < 0)) return doubleLit((double) x / (double) y);
+            return INT_LIT(x / y);
+        }
+        case OP_ARITH: {
+            Lit x = tierValue(r, op->a);
+            Lit y = tierValue(r, op->b);
+            Lit v;
+            if (!tierArith(op->op, op->integral, x, y, &v)) deopt(r);
+            return v;
+        }
+        case OP_REUSE:
+        case OP_SAVE:
+            return tierTemp(r, op);
+        case OP_INDUCT:
+            return tierInduct(r, op);
+        default:
+            switch (op->type) {
+                case TIER_INT:
+                    return INT_LIT(tierInt(r, k));
+                case TIER_BOOL:
+                    return BOOL_LIT(tierTest(r, k));
+                default:
+                    return doubleLit(tierNum(r, k));
+            }
+    }
+}
+
+// The value of NUM op k as a double.
+double tierNum(TierRun *r, int k) {
+    TierOp *op = r->ops + k;
+    switch (op->code) {
+        case OP_CONST:
+        case OP_SLOT: {
+            Lit v = op->code == OP_CONST ? op->value : r->slots[op->a].value;
+            return IS_DOUBLE(v) ? AS_DOUBLE(v) : (double) INT_VALUE(v);
+        }
+        case OP_ELEM: {
+            double d = r->lc->data[op->a][tierElement(r, op->a, op->b)];
+            return d == d ? d : AS_DOUBLE(numLit(d));
+        }
+        case OP_ADD_D:
+            return tierNum(r, op->a) + tierNum(r, op->b);
+        case OP_SUB_D:
+            return tierNum(r, op->a) - tierNum(r, op->b);
+        case OP_MUL_D:
+            return tierNum(r, op->a) * tierNum(r, op->b);
+        case OP_DIV_D:
+            return tierNum(r, op->a) / tierNum(r, op->b);
+        case OP_DIV_I:
+            return (double) tierInt(r, op->a) / (double) tierInt(r, op->b);
+        case OP_ADD_I:
+        case OP_SUB_I:
+        case OP_MUL_I:
+            return (double) tierInt(r, k);
+        default: {
+            Lit v = tierValue(r, k);
+            return IS_DOUBLE(v) ? AS_DOUBLE(v) : (double) INT_VALUE(v);
+        }
+    }
+}
+
+// The value of INT op k, leaving when the result no longer fits a Lit or the tree walker would have
+// gone to doubles.
+long long tierInt(TierRun *r, int k) {
+    TierOp *op = r->ops + k;
+    long long x, y, v;
+    switch (op->code) {
+        case OP_CONST:
+            return INT_VALUE(op->value);
+        case OP_SLOT:
+            return INT_VALUE(r->slots[op->a].value);
+        case OP_ADD_I:
+            v = tierInt(r, op->a) + tierInt(r, op->b);
+            break;
+        case OP_SUB_I:
+            v = tierInt(r, op->a) - tierInt(r, op->b);
+            break;
+        case OP_MUL_I:
+            x = tierInt(r, op->a);
+            y = tierInt(r, op->b);
+            if (__builtin_mul_overflow(x, y, &v) || (v == 0 && (x < 0 || y < 0))) deopt(r);
+            break;
+        default:
+            return INT_VALUE(tierValue(r, k));
+    }
+    if (!FITS_INT(v)) deopt(r);
+    return v;
+}
+
+// The value of BOOL op k.
+bool tierTest(TierRun *r, int k) {
+    TierOp *op = r->ops + k;
+    switch (op->code) {
+        case OP_CMP_I:
+            return tierCompareInt(op->op, tierInt(r, op->a), tierInt(r, op->b));
+        case OP_CMP_D:
+            return tierCompare(op->op, tierNum(r, op->a), tierNum(r, op->b));
+        case OP_EQ_B: {
+            bool x = tierTest(r, op->a);
+            bool y = tierTest(r, op->b);
+            return op->op == EQEQUALS ? x == y : x != y;
+        }
+        case OP_AND: {
+            bool x = tierTest(r, op->a);
+            return tierTest(r, op->b) && x;
+        }
+        case OP_OR: {
+            bool x = tierTest(r, op->a);
+            return tierTest(r, op->b) || x;
+        }
+        case OP_NOT:
+            return !tierTest(r, op->a);
+        default:
+            return tierValue(r, k) == LIT_TRUE;
+    }
+}
+
+// The element of compiled array array that op index names, leaving unless it is in range.
+int tierElement(TierRun *r, int array, int index) {
+    int length = r->lc->lengths[array];
+    if (r->ops[index].type == TIER_INT) {
+        long long n = tierInt(r, index);
+        if (n < 0 || n >= length) deopt(r);
+        return (int) n;
+    }
+    double d = tierNum(r, index);
+    if (!(d >= 0 && d < length) || d != (int) d) deopt(r);
+    return (int) d;
+}
+
+// A REUSE takes its temporary when valid and computes it otherwise, a SAVE always computes it.
+Lit tierTemp(TierRun *r, TierOp *op) {
+    Temp *t = &r->temps[op->a];
+    if (op->code == OP_REUSE && t->valid) {
+        Lit v = t->value;
+        bool ok = op->type == TIER_INT ? IS_INT(v) : op->type == TIER_DBL ? IS_DOUBLE(v) :
+                  op->type == TIER_BOOL ? IS_BOOL(v) : IS_INT(v) || IS_DOUBLE(v);
+        if (!ok) deopt(r);
+        return v;
+    }
+    Lit v = tierValue(r, op->b);
+    t->valid = true;
+    t->value = v;
+    return v;
+}
+
+// Evaluate an induction variable times a constant as induction does, leaving rather than box a wide
+// integer.
+Lit tierInduct(TierRun *r, TierOp *op) {
+    Interpreter *i = r->i;
+    Node *ind = i->nodes + op->a;
+    Node *mul = i->nodes + ind->a;
+    bool varLeft = ind->flags & NODE_VARLEFT;
+    long long step = i->code->consts[ind->c];
+    long long delta = i->code->consts[ind->c + 1];
+    Temp *t = &r->temps[ind->b];
+    Lit v = r->slots[op->b].value;
+    long long base = IS_INT(v) ? INT_VALUE(v) : 0;
+    long long moved, next;
+    if (t->valid && IS_INT(v) && !__builtin_sub_overflow(base, t->base, &moved) && moved == step) {
+        if (!IS_INT(t->value)) deopt(r);
+        if (!__builtin_add_overflow(INT_VALUE(t->value), delta, &next) && next != 0) {
+            if (!FITS_INT(next)) deopt(r);
+            t->base = base;
+            t->value = INT_LIT(next);
+            return t->value;
+        }
+    }
+    Lit product;
+    if (!tierArith(mul->op, mul->flags & NODE_INTEGRAL, varLeft ? v : op->value, varLeft ? op->value : v, &product)) {
+        deopt(r);
+    }
+    t->valid = IS_EXACT(v) && IS_EXACT(product);
+    t->base = base;
+    t->value = product;
+    return product;
+}
+
+// Apply an arithmetic operator to two NUMs as binOpCases does. Returns false for a wide integer, which
+// is left to the tree walker.
+bool tierArith(TokenType op, bool integral, Lit l, Lit r, Lit *out) {
+    if (integral && BOTH_INT(l, r)) {
+        long long wide;
+        Lit v = intCases(op, INT_VALUE(l), INT_VALUE(r), &wide);
+        if (v == LIT_WIDE) return false;
+        if (v != LIT_UNKNOWN) {
+            *out = v;
+            return true;
+        }
+    }
+    if (!(IS_INT(l) || IS_DOUBLE(l)) || !(IS_INT(r) || IS_DOUBLE(r))) return false;
+    double x = IS_DOUBLE(l) ? AS_DOUBLE(l) : (double) INT_VALUE(l);
+    double y = IS_DOUBLE(r) ? AS_DOUBLE(r) : (double) INT_VALUE(r);
+    switch (op) {
+        case PLUS:
+            *out = doubleLit(x + y);
+            return true;
+        case MINUS:
+            *out = doubleLit(x - y);
+            return true;
+        case STAR:
+            *out = doubleLit(x * y);
+            return true;
+        case SLASH:
+            *out = doubleLit(x / y);
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Compare two doubles.
+bool tierCompare(TokenType op, double x, double y) {
+    switch (op) {
+        case GTHAN:
+            return x > y;
+        case GTHANEQ:
+            return x >= y;
+        case LTHAN:
+            return x < y;
+        case LTHANEQ:
+            return x <= y;
+        case EQEQUALS:
+            return x == y;
+        default:
+            return x != y;
+    }
+}
+
+// Compare two integers.
+bool tierCompareInt(TokenType op, long long x, long long y) {
+    switch (op) {
+        case GTHAN:
+            return x > y;
+        case GTHANEQ:
+            return x >= y;
+        case LTHAN:
+            return x < y;
+        case LTHANEQ:
+            return x <= y;
+        case EQEQUALS:
+            return x == y;
+        default:
+            return x != y;
+    }
+}
+
+// Leave the compiled loop for the tree walker, which starts the current statement again.
+void deopt(TierRun *r) {
+    longjmp(r->trap, 1);
+}
@@ -0,0 +1,151 @@
+#ifndef TIER_H
+#define TIER_H
+
+#include "compact.h"
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// -----------------
+// Public Objects
+// -----------------
+
+typedef struct Interpreter Interpreter;
+typedef struct Frame Frame;
+
+// Back edges a while loop takes in the tree walker before it is compiled, unless the run asks otherwise.
+#define TIER_HOT 1000
+// Guard failures a compiled loop may take before it is dropped for good.
+#define TIER_DEOPTS 16
+// Times a loop is compiled again when the types or declarations it was compiled for have changed.
+#define TIER_COMPILES 4
+// Times a loop's statements are compiled while the types of its slots settle.
+#define TIER_PASSES 8
+// Back edge count of a loop that is never compiled.
+#define TIER_NEVER INT_MIN
+
+// Types of compiled values. TIER_NUM is an exact integer or a double only known at run time; the
+// others hold one kind of value throughout the loop.
+typedef enum TierType {
+    TIER_NONE, TIER_INT, TIER_DBL, TIER_NUM, TIER_BOOL, TIER_ARRAY
+} TierType;
+
+// What a compiled op computes. The _I ops work on exact integers, the _D ops on doubles and the rest on
+// values of any type; CMP ops compare two NUMs and EQ_B two BOOLs by op.
+typedef enum TierCode {
+    OP_CONST, OP_SLOT, OP_ELEM, OP_ADD_D, OP_SUB_D, OP_MUL_D, OP_DIV_D, OP_ADD_I, OP_SUB_I, OP_MUL_I,
+    OP_DIV_I, OP_ARITH, OP_CMP_I, OP_CMP_D, OP_EQ_B, OP_AND, OP_OR, OP_NOT, OP_REUSE, OP_SAVE, OP_INDUCT
+} TierCode;
+
+// A node of a compiled expression, a tree of ops whose children come before them. a and b are the
+// operand ops of operators, the resolved slot of a SLOT, the array of an ELEM with b its index op, or
+// the temporary of a REUSE and SAVE with b the op computing it. An INDUCT keeps its INDUCT node in a
+// and its slot in b. value is the Lit of a CONST or the constant of an INDUCT. op is the operator of a
+// CMP, EQ_B or ARITH, integral set when its node is NODE_INTEGRAL.
+typedef struct TierOp {
+    unsigned char code;
+    unsigned char type;
+    unsigned char op;
+    unsigned char integral;
+    int a;
+    int b;
+    uint64_t value;
+} TierOp;
+
+// Kinds of compiled statements.
+typedef enum TierKind {
+    TIER_ASSIGN, TIER_STORE, TIER_SHOW, TIER_IF, TIER_WHILE, TIER_SKIP
+} TierKind;
+
+// A compiled statement: an assignment of op to the resolved slot, a store of op at index into array
+// slot, a show of op by compact node, or an if or while testing op with its body the count statements
+// from first. A while may first invalidate the count temporaries from temps, as a HOIST does. exit is
+// where the tree walker resumes when the statement cannot finish, and test where it resumes to test a
+// while again.
+typedef struct TierStmt {
+    unsigned char kind;
+    int node;
+    int op;
+    int index;
+    int slot;
+    int first;
+    int count;
+    int temps;
+    int tempCount;
+    int exit;
+    int test;
+} TierStmt;
+
+// A place the tree walker resumes at: the statement pc of the block ending at end, tested as the while
+// loop when it ends, -1 for an if, after pushing frameCount frames, the blocks enclosing it inside the
+// compiled loop. frames points into the loop's frames from frameAt once it is compiled.
+typedef struct TierExit {
+    int pc;
+    int end;
+    int loop;
+    int frameAt;
+    int frameCount;
+    Frame *frames;
+} TierExit;
+
+// A name the loop reads or writes, the slot it resolved to when compiled and the type of that slot.
+typedef struct TierUse {
+    int slot;
+    int declared;
+    unsigned char type;
+} TierUse;
+
+// One compiled while loop, testing op. Its body is the statements of stmts from first, count of them.
+// Exit 0 tests the loop itself again, and exit is the one to take should the statement running fail.
+// arrays lists the array slots elements are read or written in, whose data and lengths are looked up
+// each time the loop is entered.
+typedef struct LoopCode {
+    int loop;
+    int op;
+    TierOp *ops;
+    int opCount;
+    int opSize;
+    TierStmt *stmts;
+    int stmtCount;
+    int stmtSize;
+    int first;
+    int count;
+    TierExit *exits;
+    int exitCount;
+    int exitSize;
+    Frame *frames;
+    int frameCount;
+    int frameSize;
+    TierUse *uses;
+    int useCount;
+    int useSize;
+    int *arrays;
+    double **data;
+    int *lengths;
+    int arrayCount;
+    int arraySize;
+    int exit;
+    int deopts;
+    int compiles;
+} LoopCode;
+
+// Tiering state of a run. hits counts each while node's back edges, becomes -1 - k once the loop is
+// compiled as loops[k] and TIER_NEVER when it cannot be. after is the count that compiles a loop. hits
+// is NULL when loops are never compiled.
+typedef struct Tier {
+    int *hits;
+    LoopCode *loops;
+    int loopCount;
+    int loopSize;
+    int after;
+} Tier;
+
+// -----------------
+// Public Functions
+// -----------------
+
+void initTier(Tier *t, CompactTree *code, int after);
+TierExit *enterTier(Interpreter *i, int loop);
+void freeTier(Tier *t);
+
+#endif
@@ -0,0 +1,203 @@
+// Execution tracing for the CAM programming langauge.
+// A traced run records fixed size events into a ring in memory: statements started, conditions tested
+// and values stored, each naming its compact node. Recording is a masked index and one store, so the
+// ring can stay on for long loops. When the run ends, normally or with an error, the kept events are
+// written to a file with the nodes, the line and column of their statements and the text pool, which
+// decodeTrace prints later without the program.
+
+#include "trace.h"
+#include "interpreter.h"
+#include "memstats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Start of a trace file. The nodes, their sources, the text pool and kept events follow, oldest first.
+typedef struct TraceHeader {
+    char magic[8];
+    int32_t version;
+    int32_t nodeCount;
+    int64_t textUsed;
+    uint64_t count;
+    uint64_t kept;
+} TraceHeader;
+
+// -----------------
+// Private Functions
+// -----------------
+
+void printEvent(Output *out, TraceEvent *e, Node *nodes, Source *sources, const char *text, int count);
+void printTraced(Output *out, uint64_t v);
+const char *tracedName(Node *node);
+
+// -----------------
+// Main Funcs
+// -----------------
+
+// Allocate an empty ring of TRACE_EVENTS events.
+void initTrace(Trace *t) {
+    t->events = calloc(TRACE_EVENTS, sizeof(TraceEvent));
+    MEM_COUNT(MEM_RUNTIME, sizeof(TraceEvent) * TRACE_EVENTS);
+    t->count = 0;
+    t->mask = TRACE_EVENTS - 1;
+}
+
+// Write the kept events and the program they refer to. The file is written under a temporary name and
+// renamed, so a reader never sees part of a trace. Returns false when it cannot be written.
+bool writeTrace(Trace *t, CompactTree *code, const char *path) {
+    uint64_t size = t->mask + 1;
+    uint64_t kept = t->count < size ? t->count : size;
+    uint64_t first = (t->count - kept) & t->mask;
+    uint64_t head = first + kept > size ? size - first : kept;
+    TraceHeader h = {TRACE_MAGIC, TRACE_VERSION, code->count, code->textUsed, t->count, kept};
+
+    char tmp[4200];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int) getpid());
+    FILE *f = fopen(tmp, "wb");
+    if (f == NULL) return false;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    ok = ok && fwrite(code->nodes, sizeof(Node), code->count, f) == (size_t) code->count;
+    ok = ok && fwrite(code->sources, sizeof(Source), code->count, f) == (size_t) code->count;
+    ok = ok && fwrite(code->text, 1, code->textUsed, f) == (size_t) code->textUsed;
+    ok = ok && fwrite(t->events + first, sizeof(TraceEvent), head, f) == head;
+    ok = ok && fwrite(t->events, sizeof(TraceEvent), kept - head, f) == kept - head;
+    ok = fclose(f) == 0 && ok;
+    if (ok) ok = rename(tmp, path) == 0;
+    if (!ok) remove(tmp);
+    return ok;
+}
+
+// Print a trace file, one event per line. Returns false when the file is missing or not a trace.
+bool decodeTrace(const char *path, Output *out) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        outPrintf(out, "Error: Could not open file '%s'.\n", path);
+        return false;
+    }
+    TraceHeader h;
+    Node *nodes = NULL;
+    Source *sources = NULL;
+    char *text = NULL;
+    TraceEvent *events = NULL;
+    bool ok = fread(&h, sizeof(h), 1, f) == 1 && !memcmp(h.magic, TRACE_MAGIC, 8) &&
+              h.version == TRACE_VERSION && h.nodeCount >= 0 && h.textUsed >= 0 && h.kept <= TRACE_EVENTS;
+    if (ok) {
+        nodes = malloc(sizeof(Node) * (h.nodeCount + 1));
+        sources = malloc(sizeof(Source) * (h.nodeCount + 1));
+        text = malloc(h.textUsed + 1);
+        events = malloc(sizeof(TraceEvent) * (h.kept + 1));
+        ok = fread(nodes, sizeof(Node), h.nodeCount, f) == (size_t) h.nodeCount &&
+             fread(sources, sizeof(Source), h.nodeCount, f) == (size_t) h.nodeCount &&
+             fread(text, 1, h.textUsed, f) == (size_t) h.textUsed &&
+             fread(events, sizeof(TraceEvent), h.kept, f) == h.kept;
+        if (ok) text[h.textUsed] = '\0';
+    }
+    fclose(f);
+    if (ok) {
+        outPrintf(out, "%llu events recorded, the last %llu kept\n", (unsigned long long) h.count,
+                  (unsigned long long) h.kept);
+        for (uint64_t k = 0; k < h.kept; k++) {
+            outPrintf(out, "%llu ", (unsigned long long) (h.count - h.kept + k));
+            printEvent(out, &events[k], nodes, sources, text, h.nodeCount);
+        }
+    } else {
+        outPrintf(out, "Error: '%s' is not a trace file.\n", path);
+    }
+    free(nodes);
+    free(sources);
+    free(text);
+    free(events);
+    return ok;
+}
+
+// Release the ring.
+void freeTrace(Trace *t) {
+    free(t->events);
+    t->events = NULL;
+}
+
+// -----------------
+// Helpers
+// -----------------
+
+// Print one event as its line and column, what ran and any values, e.g. "line 4 col 1: x = 2 (was 1)".
+void printEvent(Output *out, TraceEvent *e, Node *nodes, Source *sources, const char *text, int count) {
+    if (e->node < 0 || e->node >= count) {
+        outPrintf(out, e->kind == TRACE_ERROR ? "error in the last statement\n" : "unknown node %d\n", e->node);
+        return;
+    }
+    Node *node = nodes + e->node;
+    Source *s = sources + e->node;
+    const char *id = s->text >= 0 ? text + s->text : "";
+    outPrintf(out, "line %d col %d: ", s->line + 1, s->col + 1);
+    switch (e->kind) {
+        case TRACE_STMT:
+            outPrintf(out, "%s%s%s\n", tracedName(node), *id ? " " : "", id);
+            break;
+        case TRACE_BRANCH:
+            outPrintf(out, "%s %s\n", tracedName(node), e->taken ? "taken" : "not taken");
+            break;
+        case TRACE_STORE:
+            if (node->tag == SET) {
+                outPrintf(out, "%s[%d] = ", id, e->element);
+            } else {
+                outPrintf(out, "%s = ", id);
+            }
+            printTraced(out, e->value);
+            outPrintf(out, " (was ");
+            printTraced(out, e->old);
+            outPrintf(out, ")\n");
+            break;
+        case TRACE_ERROR:
+            outPrintf(out, "error at %s%s%s\n", tracedName(node), *id ? " " : "", id);
+            break;
+        default:
+            outPrintf(out, "unknown event %d\n", e->kind);
+            break;
+    }
+}
+
+// Print a recorded value.
+void printTraced(Output *out, uint64_t v) {
+    if (IS_DOUBLE(v)) {
+        outPrintf(out, "%.17g", AS_DOUBLE(v));
+    } else if (IS_INT(v)) {
+        outPrintf(out, "%lld", INT_VALUE(v));
+    } else if (IS_BOOL(v)) {
+        outPrintf(out, v == LIT_TRUE ? "true" : "false");
+    } else if (IS_ARRAY(v)) {
+        outPrintf(out, "[array]");
+    } else {
+        outPrintf(out, "unset");
+    }
+}
+
+// The keyword of a statement node, or the kind of an expression node.
+const char *tracedName(Node *node) {
+    switch (node->tag) {
+        case IF:
+            return "if";
+        case WHILE:
+            return "while";
+        case VARDEC:
+            return "let";
+        case VARASSIGN:
+        case STORE:
+            return "assign";
+        case SHOW:
+            return "show";
+        case PROC:
+            return "proc";
+        case RETURN:
+            return "return";
+        case INVOKE:
+            return "call";
+        case READ:
+            return "read";
+        case NOP:
+            return "nop";
+        default:
+            return "expression";
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "compact.h"
+#include "output.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// -----------------
+// Public Objects
+// -----------------
+
+// Events kept by a run's ring, a power of two. Older events are overwritten.
+#define TRACE_EVENTS 65536
+
+#define TRACE_MAGIC "CAMTRACE"
+#define TRACE_VERSION 2
+
+// What an event records:
+//   TRACE_STMT     a statement node was started
+//   TRACE_BRANCH   the condition of an IF or WHILE node was tested, taken when it was true; a WHILE
+//                  records one each time round
+//   TRACE_STORE    a VARASSIGN or READ node stored value over old, or a SET node stored into element
+//   TRACE_ERROR    the run stopped with an error at the node, -1 for an error in the statement itself
+//                  or a limit
+typedef enum TraceKind {
+    TRACE_STMT, TRACE_BRANCH, TRACE_STORE, TRACE_ERROR
+} TraceKind;
+
+// One fixed size event. Values are Lits, with wide integers recorded as their doubles, so they decode
+// without the interpreter. A whole array is recorded as an ARRAY Lit without its elements.
+typedef struct TraceEvent {
+    uint64_t old;
+    uint64_t value;
+    int32_t node;
+    int32_t element;
+    uint8_t kind;
+    uint8_t taken;
+} TraceEvent;
+
+// The ring. Event count & mask is the next to write, so count events have been recorded and the last
+// min(count, mask + 1) of them are kept.
+typedef struct Trace {
+    TraceEvent *events;
+    uint64_t count;
+    uint64_t mask;
+} Trace;
+
+// Record an event, overwriting the oldest once the ring is full.
+#define TRACE_EVENT(t, k, n, take, e, o, v) do { \
+        TraceEvent *ev_ = (t)->events + ((t)->count++ & (t)->mask); \
+        *ev_ = (TraceEvent) {(o), (v), (n), (e), (k), (take)}; \
+    } while (0)
+
+// -----------------
+// Public Functions
+// -----------------
+
+void initTrace(Trace *t);
+bool writeTrace(Trace *t, CompactTree *code, const char *path);
+bool decodeTrace(const char *path, Output *out);
+void freeTrace(Trace *t);
+
+#endif
@@ -0,0 +1,370 @@
+// Data parallel evaluator for the CAM programming langauge.
+// Runs one program over a block of independent rows at once. Every NUM and BOOL variable is
+// held as a structure of arrays with one lane per row, and each BinOpExpr is a single SIMD
+// kernel over the block. Divergent if and while statements are handled with execution masks:
+// a statement only writes the lanes that are active, and a loop keeps going while any lane
+// still wants another iteration.
+//
+// Only programs that can never raise a run time error are vectorised: every declaration is at
+// the top level with one type per variable, every expression is well typed and every condition
+// is a BOOL. The one error that depends on the data, reading a BOOL variable before it is
+// assigned, makes the block bail out so the caller can run those rows through the scalar
+// interpreter instead. So does any NUM reaching 2^53, past which the interpreter's exact integers
+// and plain doubles part ways.
+
+#include "vector.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Machine vectors per block. LANES and the lane types come from array.h.
+#define VECS (VECTOR_BLOCK / LANES)
+
+// Smallest magnitude a double cannot hold every integer below.
+#define EXACT_LIMIT 9007199254740992.0
+
+// A value for every row in the block.
+typedef struct Lanes {
+    VNum v[VECS];
+} Lanes;
+
+typedef struct Masks {
+    VMask m[VECS];
+} Masks;
+
+typedef struct VectorState {
+    SymbolTable *table;
+    Lanes *vars;
+    Masks *assigned;
+} VectorState;
+
+// -----------------
+// Private Functions
+// -----------------
+
+bool checkStmts(SymbolTable *table, ParseTree tree, int depth, bool *declared);
+bool checkStmt(SymbolTable *table, void *stmt, int depth, bool *declared);
+Type checkExpr(SymbolTable *table, void *expr, bool *declared);
+bool execStmts(VectorState *st, ParseTree tree, Masks *active);
+bool execStmt(VectorState *st, void *stmt, Masks *active);
+bool evalExpr(VectorState *st, void *expr, Masks *active, Lanes *out);
+void binOpKernel(TokenType op, Lanes *left, Lanes *right, Lanes *out);
+bool anyLane(Masks *m);
+bool outOfRange(Lanes *v, Masks *active);
+VMask truthy(VNum v);
+
+// -----------------
+// Main Funcs
+// -----------------
+
+// Check whether a resolved program can run on the vector evaluator. Trees deeper than DEPTH_LIMIT
+// are refused since the checks and the evaluator recurse, and so are programs using arrays or procedures.
+bool canVectorise(ParseTree tree, SymbolTable *table) {
+    if (table->depth > DEPTH_LIMIT || table->arrays || table->procCount) return false;
+    bool *declared = calloc(table->index ? table->index : 1, sizeof(bool));
+    bool ok = checkStmts(table, tree, 0, declared);
+    free(declared);
+    return ok;
+}
+
+// Run up to VECTOR_BLOCK rows of a program accepted by canVectorise. inputs are the slots
+// every row starts from, then column k of the inputs is bound to slot inSlots[k]. The final
+// value of slot outSlots[k] is written to output column k.
+// Returns false without writing anything if the block has to bail out.
+bool runVectorBlock(ParseTree tree, SymbolTable *table, Slot *inputs, long rows,
+                    int inCount, const int *inSlots, const double **inCols,
+                    int outCount, const int *outSlots, double **outCols) {
+    for (int s = 0; s < table->index; s++) {
+        if (inputs[s].declared && inputs[s].type != table->syms[s].type) return false;
+        if (inputs[s].declared && inputs[s].type == NUM && fabs(numValue(NULL, inputs[s].value)) >= EXACT_LIMIT) {
+            return false;
+        }
+    }
+    for (int c = 0; c < inCount; c++) {
+        for (long r = 0; r < rows; r++) {
+            if (fabs(inCols[c][r]) >= EXACT_LIMIT) return false;
+        }
+    }
+    int n = table->index ? table->index : 1;
+    VectorState st = {table, aligned_alloc(32, sizeof(Lanes) * n), aligned_alloc(32, sizeof(Masks) * n)};
+    Masks active;
+    long long *activeLanes = (long long *) active.m;
+    for (long r = 0; r < VECTOR_BLOCK; r++) activeLanes[r] = r < rows ? -1 : 0;
+
+    for (int s = 0; s < table->index; s++) {
+        double v = inputs[s].declared ? numValue(NULL, inputs[s].value) : 0;
+        long long set = inputs[s].declared ? -1 : 0;
+        for (int k = 0; k < VECS; k++) {
+            st.vars[s].v[k] = splat(v);
+            st.assigned[s].m[k] = (VMask) (splat(0) == splat(0)) & set;
+        }
+    }
+    for (int c = 0; c < inCount; c++) {
+        double *lanes = (double *) st.vars[inSlots[c]].v;
+        bool isBool = table->syms[inSlots[c]].type == BOOL;
+        for (long r = 0; r < rows; r++) lanes[r] = isBool ? inCols[c][r] != 0 : inCols[c][r];
+        for (int k = 0; k < VECS; k++) st.assigned[inSlots[c]].m[k] = splat(0) == splat(0);
+    }
+
+    bool ok = execStmts(&st, tree, &active);
+    if (ok) {
+        for (int c = 0; c < outCount; c++) {
+            if (outSlots[c] == -1) {
+                for (long r = 0; r < rows; r++) outCols[c][r] = NAN;
+            } else {
+                memcpy(outCols[c], st.vars[outSlots[c]].v, sizeof(double) * rows);
+            }
+        }
+    }
+    free(st.vars);
+    free(st.assigned);
+    return ok;
+}
+
+// -----------------
+// Static checks
+// -----------------
+
+// Check statements in program order so every use follows its declaration.
+bool checkStmts(SymbolTable *table, ParseTree tree, int depth, bool *declared) {
+    for (int j = 0; j < tree.index; j++) {
+        if (!checkStmt(table, tree.stmts[j], depth, declared)) return false;
+    }
+    return true;
+}
+
+bool checkStmt(SymbolTable *table, void *stmt, int depth, bool *declared) {
+    switch (((VarExpr *) stmt)->s) {
+        case IF:
+        case WHILE: {
+            if (checkExpr(table, ((IfStmt *) stmt)->cond, declared) != BOOL) return false;
+            return checkStmts(table, ((IfStmt *) stmt)->trueBranch, depth + 1, declared);
+        }
+        case SHOW: {
+            return checkExpr(table, ((ShowStmt *) stmt)->expr, declared) != UNKNOWN;
+        }
+        case VARDEC: {
+            VarDecStmt *dec = stmt;
+            if (depth != 0 || table->syms[dec->slot].type != dec->type) return false;
+            declared[dec->slot] = true;
+            return true;
+        }
+        case VARASSIGN: {
+            VarAssignStmt *assign = stmt;
+            if (assign->slot == -1 || !declared[assign->slot]) return false;
+            return checkExpr(table, assign->expr, declared) == table->syms[assign->slot].type;
+        }
+        default:
+            return false;
+    }
+}
+
+// Return the static type of an expression, or UNKNOWN if evaluating it could raise an error.
+Type checkExpr(SymbolTable *table, void *expr, bool *declared) {
+    switch (((VarExpr *) expr)->s) {
+        case LITERAL: {
+            LiteralExpr *lit = expr;
+            return lit->type == NUM && fabs(lit->value) >= EXACT_LIMIT ? UNKNOWN : lit->type;
+        }
+        case VAR: {
+            int slot = ((VarExpr *) expr)->slot;
+            return slot != -1 && declared[slot] ? table->syms[slot].type : UNKNOWN;
+        }
+        case BRACKET:
+            return checkExpr(table, ((BracketExpr *) expr)->expr, declared);
+        case UNOP:
+            return checkExpr(table, ((UnOpExpr *) expr)->right, declared) == BOOL ? BOOL : UNKNOWN;
+        case BINOP: {
+            BinOpExpr *bin = expr;
+            Type l = checkExpr(table, bin->left, declared);
+            Type r = checkExpr(table, bin->right, declared);
+            if (l == UNKNOWN || l != r) return UNKNOWN;
+            switch (bin->opType) {
+                case OR:
+                case AND:
+                    return l == BOOL ? BOOL : UNKNOWN;
+                case EQEQUALS:
+                case BANGEQ:
+                    return BOOL;
+                case GTHAN:
+                case GTHANEQ:
+                case LTHAN:
+                case LTHANEQ:
+                    return l == NUM ? BOOL : UNKNOWN;
+                case PLUS:
+                case MINUS:
+                case STAR:
+                case SLASH:
+                    return l == NUM ? NUM : UNKNOWN;
+                default:
+                    return UNKNOWN;
+            }
+        }
+        default:
+            return UNKNOWN;
+    }
+}
+
+// -----------------
+// Execution
+// -----------------
+
+bool execStmts(VectorState *st, ParseTree tree, Masks *active) {
+    for (int j = 0; j < tree.index; j++) {
+        if (!execStmt(st, tree.stmts[j], active)) return false;
+    }
+    return true;
+}
+
+// Execute a statement for the active lanes.
+// Show prints nothing in row mode but its expression is still checked for a bail out.
+bool execStmt(VectorState *st, void *stmt, Masks *active) {
+    switch (((VarExpr *) stmt)->s) {
+        case IF: {
+            Lanes cond;
+            if (!evalExpr(st, ((IfStmt *) stmt)->cond, active, &cond)) return false;
+            Masks taken;
+            for (int k = 0; k < VECS; k++) taken.m[k] = active->m[k] & truthy(cond.v[k]);
+            if (!anyLane(&taken)) return true;
+            return execStmts(st, ((IfStmt *) stmt)->trueBranch, &taken);
+        }
+        case WHILE: {
+            Masks looping = *active;
+            Lanes cond;
+            while (true) {
+                if (!evalExpr(st, ((WhileStmt *) stmt)->cond, &looping, &cond)) return false;
+                for (int k = 0; k < VECS; k++) looping.m[k] &= truthy(cond.v[k]);
+                if (!anyLane(&looping)) return true;
+                if (!execStmts(st, ((WhileStmt *) stmt)->trueBranch, &looping)) return false;
+            }
+        }
+        case VARASSIGN: {
+            VarAssignStmt *assign = stmt;
+            Lanes val;
+            if (!evalExpr(st, assign->expr, active, &val)) return false;
+            Lanes *var = &st->vars[assign->slot];
+            Masks *assigned = &st->assigned[assign->slot];
+            for (int k = 0; k < VECS; k++) {
+                VMask m = active->m[k];
+                var->v[k] = (VNum) (((VMask) val.v[k] & m) | ((VMask) var->v[k] & ~m));
+                assigned->m[k] |= m;
+            }
+            return true;
+        }
+        case SHOW: {
+            Lanes val;
+            return evalExpr(st, ((ShowStmt *) stmt)->expr, active, &val);
+        }
+        default:
+            return true;
+    }
+}
+
+// Evaluate an expression for every lane. Inactive lanes hold garbage that is never stored.
+bool evalExpr(VectorState *st, void *expr, Masks *active, Lanes *out) {
+    switch (((VarExpr *) expr)->s) {
+        case LITERAL: {
+            VNum v = splat(((LiteralExpr *) expr)->value);
+            for (int k = 0; k < VECS; k++) out->v[k] = v;
+            return true;
+        }
+        case VAR: {
+            int slot = ((VarExpr *) expr)->slot;
+            // An unassigned BOOL reads as NUM 0 in the scalar interpreter, which is a type error here.
+            if (st->table->syms[slot].type == BOOL) {
+                Masks missing;
+                for (int k = 0; k < VECS; k++) missing.m[k] = active->m[k] & ~st->assigned[slot].m[k];
+                if (anyLane(&missing)) return false;
+            }
+            *out = st->vars[slot];
+            return true;
+        }
+        case BRACKET:
+            return evalExpr(st, ((BracketExpr *) expr)->expr, active, out);
+        case UNOP: {
+            if (!evalExpr(st, ((UnOpExpr *) expr)->right, active, out)) return false;
+            for (int k = 0; k < VECS; k++) out->v[k] = fromMask(~truthy(out->v[k]));
+            return true;
+        }
+        case BINOP: {
+            Lanes right;
+            if (!evalExpr(st, ((BinOpExpr *) expr)->left, active, out)) return false;
+            if (!evalExpr(st, ((BinOpExpr *) expr)->right, active, &right)) return false;
+            binOpKernel(((BinOpExpr *) expr)->opType, out, &right, out);
+            return !outOfRange(out, active);
+        }
+        default:
+            return false;
+    }
+}
+
+// One SIMD kernel per operator. Comparisons give 1.0 or 0.0 lanes like the scalar BOOL values.
+void binOpKernel(TokenType op, Lanes *left, Lanes *right, Lanes *out) {
+    switch (op) {
+        case PLUS:
+            for (int k = 0; k < VECS; k++) out->v[k] = left->v[k] + right->v[k];
+            break;
+        case MINUS:
+            for (int k = 0; k < VECS; k++) out->v[k] = left->v[k] - right->v[k];
+            break;
+        case STAR:
+            for (int k = 0; k < VECS; k++) out->v[k] = left->v[k] * right->v[k];
+            break;
+        case SLASH:
+            for (int k = 0; k < VECS; k++) out->v[k] = left->v[k] / right->v[k];
+            break;
+        case OR:
+            for (int k = 0; k < VECS; k++) out->v[k] = fromMask(truthy(left->v[k]) | truthy(right->v[k]));
+            break;
+        case AND:
+            for (int k = 0; k < VECS; k++) out->v[k] = fromMask(truthy(left->v[k]) & truthy(right->v[k]));
+            break;
+        case EQEQUALS:
+            for (int k = 0; k < VECS; k++) out->v[k] = fromMask(left->v[k] == right->v[k]);
+            break;
+        case BANGEQ:
+            for (int k = 0; k < VECS; k++) out->v[k] = fromMask(left->v[k] != right->v[k]);
+            break;
+        case GTHAN:
+            for (int k = 0; k < VECS; k++) out->v[k] = fromMask(left->v[k] > right->v[k]);
+            break;
+        case GTHANEQ:
+            for (int k = 0; k < VECS; k++) out->v[k] = fromMask(left->v[k] >= right->v[k]);
+            break;
+        case LTHAN:
+            for (int k = 0; k < VECS; k++) out->v[k] = fromMask(left->v[k] < right->v[k]);
+            break;
+        case LTHANEQ:
+            for (int k = 0; k < VECS; k++) out->v[k] = fromMask(left->v[k] <= right->v[k]);
+            break;
+        default:
+            break;
+    }
+}
+
+// -----------------
+// Helpers
+// -----------------
+
+// True if any lane of the mask is set.
+bool anyLane(Masks *m) {
+    VMask acc = m->m[0];
+    for (int k = 1; k < VECS; k++) acc |= m->m[k];
+    long long any = 0;
+    for (int l = 0; l < LANES; l++) any |= acc[l];
+    return any != 0;
+}
+
+// True if any active lane holds a NUM of magnitude 2^53 or more.
+bool outOfRange(Lanes *v, Masks *active) {
+    Masks far;
+    for (int k = 0; k < VECS; k++) {
+        far.m[k] = active->m[k] & ((v->v[k] >= splat(EXACT_LIMIT)) | (v->v[k] <= splat(-EXACT_LIMIT)));
+    }
+    return anyLane(&far);
+}
+
+// Lanes whose value is non-zero, as the scalar interpreter tests conditions.
+VMask truthy(VNum v) {
+    return v != splat(0);
+}
@@ -0,0 +1,22 @@
+#ifndef VECTOR_H
+#define VECTOR_H
+
+#include "interpreter.h"
+
+// -----------------
+// Public Objects
+// -----------------
+
+// Rows evaluated together by one pass over the tree.
+#define VECTOR_BLOCK 64
+
+// -----------------
+// Public Functions
+// -----------------
+
+bool canVectorise(ParseTree tree, SymbolTable *table);
+bool runVectorBlock(ParseTree tree, SymbolTable *table, Slot *inputs, long rows,
+                    int inCount, const int *inSlots, const double **inCols,
+                    int outCount, const int *outSlots, double **outCols);
+
+#endif
@@ -0,0 +1,32 @@
+#!/bin/sh
+# A batch prints the same bytes, scripts in order and errors included, whatever the thread count,
+# and the same as the scripts run one at a time.
+#
+# Usage: tests/check_batch.sh [cam]
+
+CAM=${1:-./cam}
+TMP=${TMPDIR:-/tmp}/cambatch.$$
+
+mkdir -p "$TMP.dir"
+n=0
+while [ $n -lt 24 ]; do
+    name=$(printf '%s/s%02d.cam' "$TMP.dir" $n)
+    if [ $((n % 5)) -eq 3 ]; then
+        printf 'let t be bool;\nt = true;\nshow %d;\nshow t + 1;\nshow 0;\n' $n > "$name"
+    else
+        printf 'let i be num;\nlet s be num;\ni = 0;\ns = 0;\nwhile i < %d do\n    s = s + i;\n    show s;\n    i = i + 1;\nendwhile\n' $((n * 37 % 50)) > "$name"
+    fi
+    n=$((n + 1))
+done
+
+failed=0
+: > "$TMP.expect"
+for script in "$TMP.dir"/*.cam; do
+    $CAM "$script" >> "$TMP.expect" 2>&1
+done
+for threads in 1 2 3 8; do
+    $CAM --batch "$TMP.dir" --threads $threads > "$TMP.out" 2> /dev/null
+    cmp -s "$TMP.expect" "$TMP.out" || { echo "$threads threads:"; diff "$TMP.expect" "$TMP.out" | head -5; failed=1; }
+done
+rm -rf "$TMP.dir" "$TMP.expect" "$TMP.out"
+exit $failed
@@ -0,0 +1,65 @@
+#!/bin/sh
+# A cached image is only run when it is sound. A corrupt, truncated or stale image, or one holding
+# another program's source under this program's key, is rejected: the program prints what it would
+# without a cache and the image is rebuilt.
+#
+# Usage: tests/check_cache.sh [cam]
+
+CAM=${1:-./cam}
+TMP=${TMPDIR:-/tmp}/camcache.$$
+
+cat > "$TMP.cam" <<'PROGRAM'
+let i be num;
+i = 0;
+while i < 3 do
+    show i * 2;
+    i = i + 1;
+endwhile
+PROGRAM
+
+cat > "$TMP.other.cam" <<'PROGRAM'
+let i be num;
+i = 7;
+show i;
+PROGRAM
+
+failed=0
+mkdir -p "$TMP.cache" "$TMP.othercache"
+$CAM "$TMP.cam" > "$TMP.expect" 2>&1
+$CAM --cache "$TMP.cache" "$TMP.cam" > /dev/null 2>&1
+$CAM --cache "$TMP.othercache" "$TMP.other.cam" > /dev/null 2>&1
+image=$(ls "$TMP.cache"/*.camc)
+other=$(ls "$TMP.othercache"/*.camc)
+cp "$image" "$TMP.good"
+size=$(wc -c < "$TMP.good")
+
+# Replace the image with a damaged copy, then run twice: once to reject and rebuild it and once
+# from the rebuilt image.
+check() {
+    for run in rebuild reuse; do
+        $CAM --cache "$TMP.cache" "$TMP.cam" > "$TMP.out" 2>&1
+        cmp -s "$TMP.expect" "$TMP.out" || { echo "$1 image, $run run:"; diff "$TMP.expect" "$TMP.out" | head -5; failed=1; }
+    done
+    cmp -s "$TMP.good" "$image" || { echo "$1 image was not rebuilt"; failed=1; }
+}
+
+# Eight bytes of the tree, just past the 80 byte header.
+cp "$TMP.good" "$image"
+printf '\377\377\377\377\377\377\377\377' | dd of="$image" bs=1 seek=88 conv=notrunc 2> /dev/null
+check corrupt
+
+head -c $((size / 2)) "$TMP.good" > "$image"
+check truncated
+
+# The format number follows the 4 byte magic.
+cp "$TMP.good" "$image"
+printf '\377' | dd of="$image" bs=1 seek=4 conv=notrunc 2> /dev/null
+check stale
+
+# The other program's image with this program's key, which the checksum does not cover.
+cp "$other" "$image"
+dd if="$TMP.good" of="$image" bs=1 skip=8 seek=8 count=8 conv=notrunc 2> /dev/null
+check mismatched
+
+rm -rf "$TMP.cam" "$TMP.other.cam" "$TMP.cache" "$TMP.othercache" "$TMP.good" "$TMP.expect" "$TMP.out"
+exit $failed
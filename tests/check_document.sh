@@ -0,0 +1,17 @@
+#!/bin/sh
+# Builds tests/document.c against the library sources and checks that a document kept up to date
+# edit by edit matches the same text parsed afresh. The interpreter argument is not used.
+#
+# Usage: tests/check_document.sh [cam]
+
+ROOT=$(dirname "$0")/..
+TMP=${TMPDIR:-/tmp}/camdoc.$$
+LIB=$(sed -n 's/^LIB = //p' "$ROOT/makefile")
+
+(cd "$ROOT" && ${CC:-cc} -std=c11 -O1 -D_DEFAULT_SOURCE -pthread -Isrc $LIB tests/document.c -o "$TMP" -lm) || exit 1
+failed=0
+"$TMP" fresh > "$TMP.expect" || failed=1
+"$TMP" incremental > "$TMP.out" || failed=1
+cmp -s "$TMP.expect" "$TMP.out" || { diff "$TMP.expect" "$TMP.out" | head -5; failed=1; }
+rm -f "$TMP" "$TMP.expect" "$TMP.out"
+exit $failed
@@ -0,0 +1,33 @@
+#!/bin/sh
+# Output shown before a long loop is not held back until the run ends: to a terminal it goes out at
+# each newline, and to a file as soon as a loop under a limit goes a window without showing anything.
+#
+# Usage: tests/check_flush.sh [cam]
+
+CAM=${1:-./cam}
+TMP=${TMPDIR:-/tmp}/camflush.$$
+
+cat > "$TMP.cam" <<'PROGRAM'
+let i be num;
+show 42;
+i = 0;
+while i < 100000000000 do
+    i = i + 1;
+endwhile
+PROGRAM
+
+failed=0
+$CAM --max-seconds 30 "$TMP.cam" > "$TMP.out" 2>&1 &
+pid=$!
+sleep 1
+grep -q "^42" "$TMP.out" || { echo "output before a limited loop was held back"; failed=1; }
+kill $pid
+wait
+
+# The terminal half needs util-linux script to run cam on a pseudo terminal.
+if script --version 2> /dev/null | grep -q util-linux; then
+    timeout 2 script -qc "$CAM $TMP.cam" /dev/null > "$TMP.tty" 2>&1
+    grep -q "^42" "$TMP.tty" || { echo "output to a terminal was held back"; failed=1; }
+fi
+rm -f "$TMP.cam" "$TMP.out" "$TMP.tty"
+exit $failed
@@ -0,0 +1,28 @@
+#!/bin/sh
+# A source just long enough to be lexed in parallel prints the same on one thread as on more threads
+# than it has lines, or bytes.
+#
+# Usage: tests/check_lex.sh [cam]
+
+CAM=${1:-./cam}
+TMP=${TMPDIR:-/tmp}/camlex.$$
+
+{
+    echo "let s be num;"
+    echo "s = 0;"
+    i=0
+    while [ $i -lt 4000 ]; do
+        echo "s = s + $i * 3 - 2; // running total"
+        i=$((i + 1))
+    done
+    echo "show s;"
+} > "$TMP.cam"
+
+failed=0
+$CAM --lex-threads 1 "$TMP.cam" > "$TMP.expect" 2>&1
+for threads in 3 5000 200000; do
+    $CAM --lex-threads $threads "$TMP.cam" > "$TMP.out" 2>&1
+    cmp -s "$TMP.expect" "$TMP.out" || { echo "$threads threads:"; diff "$TMP.expect" "$TMP.out" | head -5; failed=1; }
+done
+rm -f "$TMP.cam" "$TMP.expect" "$TMP.out"
+exit $failed
@@ -0,0 +1,15 @@
+#!/bin/sh
+# Builds tests/library.c against the library sources and runs it, with a time limit since a broken
+# limit check loops forever. The interpreter argument is not used.
+#
+# Usage: tests/check_library.sh [cam]
+
+ROOT=$(dirname "$0")/..
+TMP=${TMPDIR:-/tmp}/camlib.$$
+LIB=$(sed -n 's/^LIB = //p' "$ROOT/makefile")
+
+(cd "$ROOT" && ${CC:-cc} -std=c11 -O1 -D_DEFAULT_SOURCE -pthread -Isrc $LIB tests/library.c -o "$TMP" -lm) || exit 1
+timeout 60 "$TMP"
+status=$?
+rm -f "$TMP"
+exit $status
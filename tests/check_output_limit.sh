@@ -0,0 +1,27 @@
+#!/bin/sh
+# The output limit stops a run within one show of the limit. A loop shows numbers of a few bytes each
+# under --max-output 100; what it printed before the error must be over 100 bytes but no more than one
+# more value past it, and the error must name the line of the show.
+#
+# Usage: tests/check_output_limit.sh [cam]
+
+CAM=${1:-./cam}
+TMP=${TMPDIR:-/tmp}/camout.$$
+
+cat > "$TMP.cam" <<'PROGRAM'
+let i be num;
+i = 0;
+while i < 100000 do
+    show i;
+    i = i + 1;
+endwhile
+PROGRAM
+
+for opts in "--no-tier" "--tier-after 1"; do
+    $CAM $opts --max-output 100 "$TMP.cam" > "$TMP.out" 2>&1
+    shown=$(grep -v "^Error" "$TMP.out" | wc -c)
+    echo "$opts: $shown bytes shown, $(grep "^Error" "$TMP.out")"
+    grep -q "^Error: Output limit exceeded. - {line 4}$" "$TMP.out" || { rm -f "$TMP.cam" "$TMP.out"; exit 1; }
+    [ "$shown" -gt 100 ] && [ "$shown" -le 110 ] || { rm -f "$TMP.cam" "$TMP.out"; exit 1; }
+done
+rm -f "$TMP.cam" "$TMP.out"
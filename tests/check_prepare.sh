@@ -0,0 +1,31 @@
+#!/bin/sh
+# Prepare time should grow about linearly with program size. Times the prepare phase of a straight
+# line program of assignments full of literals, the shape common subexpression elimination once took
+# quadratic time over, at n and 4n statements and fails if the larger one took over 8 times longer.
+#
+# Usage: tests/check_prepare.sh [cam]
+
+CAM=${1:-./cam}
+TMP=${TMPDIR:-/tmp}/camprep.$$
+N=${N:-10000}
+
+program() {
+    awk -v n="$1" 'BEGIN {
+        for (v = 0; v < 8; v++) printf "let x%c be num;\nx%c = %d;\n", 97 + v, 97 + v, v
+        for (k = 0; k < n; k++) {
+            printf "x%c = x%c * %d.5 + %d - x%c / 7;\n", 97 + k % 8, 97 + (k + 1) % 8, k, k % 97, 97 + (k + 3) % 8
+        }
+        print "show xa;"
+    }'
+}
+
+prepare() {
+    program "$1" > "$TMP.cam"
+    $CAM --perf-counters "$TMP.cam" 2>&1 > /dev/null | awk '$1 == "prepare" { print $2 }'
+}
+
+small=$(prepare "$N")
+large=$(prepare $((N * 4)))
+rm -f "$TMP.cam"
+echo "prepare $N statements: $small ms, $((N * 4)) statements: $large ms"
+awk -v s="$small" -v l="$large" 'BEGIN { exit !(s > 0 && l > 0 && l < 8 * s) }'
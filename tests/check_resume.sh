@@ -0,0 +1,38 @@
+#!/bin/sh
+# Resuming a run that appends to a log which already held lines keeps them: only what the stopped run
+# wrote after its checkpoint is cut, and the log ends up as its old lines followed by an uninterrupted
+# run. Resuming into a different file, or one shorter than the checkpoint counts, is refused.
+#
+# Usage: tests/check_resume.sh [cam]
+
+CAM=${1:-./cam}
+TMP=${TMPDIR:-/tmp}/camresume.$$
+
+cat > "$TMP.cam" <<'PROGRAM'
+let i be num;
+i = 0;
+while i < 1000 do
+    show i;
+    i = i + 1;
+endwhile
+PROGRAM
+
+failed=0
+$CAM "$TMP.cam" > "$TMP.full" 2>&1
+printf 'earlier line one\nearlier line two\n' > "$TMP.log"
+cp "$TMP.log" "$TMP.expect"
+cat "$TMP.full" >> "$TMP.expect"
+
+$CAM --checkpoint-every 100 --max-iterations 550 "$TMP.cam" >> "$TMP.log" 2>&1
+cp "$TMP.log" "$TMP.stopped"
+$CAM --resume "$TMP.cam.ckpt" "$TMP.cam" > "$TMP.other" 2>&1
+grep -q "^Error: Could not resume from" "$TMP.other" || { echo "resumed into another file"; failed=1; }
+head -n 5 "$TMP.stopped" > "$TMP.short"
+$CAM --resume "$TMP.cam.ckpt" "$TMP.cam" >> "$TMP.short" 2>&1
+grep -q "^Error: Could not resume from" "$TMP.short" || { echo "resumed into a shorter file"; failed=1; }
+cmp -s "$TMP.log" "$TMP.stopped" || { echo "refused resumes changed the log"; failed=1; }
+
+$CAM --checkpoint-every 100 --resume "$TMP.cam.ckpt" "$TMP.cam" >> "$TMP.log" 2>&1
+cmp -s "$TMP.expect" "$TMP.log" || { echo "resumed log differs"; diff "$TMP.expect" "$TMP.log" | head -5; failed=1; }
+rm -f "$TMP.cam" "$TMP.cam.ckpt" "$TMP.full" "$TMP.log" "$TMP.expect" "$TMP.stopped" "$TMP.other" "$TMP.short"
+exit $failed
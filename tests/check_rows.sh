@@ -0,0 +1,43 @@
+#!/bin/sh
+# Row mode prints what the interpreter would for every row. The same program with an unused procedure
+# skips row mode, so the two runs are compared. The program tests a NUM as a condition and works
+# with integers past 2^53, where exact integers and doubles part ways.
+#
+# Usage: tests/check_rows.sh [cam]
+
+CAM=${1:-./cam}
+TMP=${TMPDIR:-/tmp}/camrows.$$
+
+cat > "$TMP.cam" <<'PROGRAM'
+let x be num;
+let y be num;
+let z be num;
+let w be num;
+let big be bool;
+w = 1048576;
+z = w * w * w + 1 - w * w * w;
+w = x * x * x + 1 - x * x * x;
+if y then
+    z = z + 10;
+endif
+big = x * x > 1000000;
+PROGRAM
+
+{ cat "$TMP.cam"; printf 'proc unused()\n    return 0;\nendproc\n'; } > "$TMP.scalar.cam"
+
+{
+    echo "x,y"
+    i=0
+    while [ $i -lt 40 ]; do
+        echo "$((i * 1000)),$((i % 3 - 1))"
+        echo "$((1048576 + i)),0.5"
+        i=$((i + 1))
+    done
+} > "$TMP.csv"
+
+failed=0
+$CAM --rows "$TMP.csv" "$TMP.cam" > "$TMP.rows" 2>&1
+$CAM --rows "$TMP.csv" "$TMP.scalar.cam" > "$TMP.expect" 2>&1
+cmp -s "$TMP.expect" "$TMP.rows" || { diff "$TMP.expect" "$TMP.rows" | head -5; failed=1; }
+rm -f "$TMP.cam" "$TMP.scalar.cam" "$TMP.csv" "$TMP.rows" "$TMP.expect"
+exit $failed
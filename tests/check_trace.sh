@@ -0,0 +1,37 @@
+#!/bin/sh
+# A decoded trace names the line and column of each event's statement, whether the program was parsed
+# fresh or loaded from the cache.
+#
+# Usage: tests/check_trace.sh [cam]
+
+CAM=${1:-./cam}
+TMP=${TMPDIR:-/tmp}/camtrace.$$
+
+cat > "$TMP.cam" <<'PROGRAM'
+let x be num;
+x = 2;
+if x > 1 then
+    x = 3;
+endif
+PROGRAM
+
+cat > "$TMP.expect" <<'EVENTS'
+7 events recorded, the last 7 kept
+0 line 1 col 1: let x
+1 line 2 col 1: assign x
+2 line 2 col 1: x = 2 (was 0)
+3 line 3 col 1: if
+4 line 3 col 1: if taken
+5 line 4 col 5: assign x
+6 line 4 col 5: x = 3 (was 2)
+EVENTS
+
+failed=0
+mkdir -p "$TMP.cache"
+for run in fresh cached; do
+    $CAM --no-opt --cache "$TMP.cache" --trace "$TMP.trace" "$TMP.cam" > /dev/null 2>&1
+    $CAM --decode-trace "$TMP.trace" > "$TMP.out" 2>&1
+    cmp -s "$TMP.expect" "$TMP.out" || { echo "$run:"; diff "$TMP.expect" "$TMP.out"; failed=1; }
+done
+rm -rf "$TMP.cam" "$TMP.expect" "$TMP.trace" "$TMP.out" "$TMP.cache"
+exit $failed
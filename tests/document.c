@@ -0,0 +1,159 @@
+// Checks of incremental document parsing, built and run by check_document.sh. A list of edits is
+// applied to a source and after each one the tokens, tree, statement positions and messages are
+// printed: with 'incremental' as editDocument leaves them, with 'fresh' from parsing the edited text
+// from scratch. The two outputs must match.
+
+#include "document.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Replace the first occurrence of find with replace.
+typedef struct Edit {
+    const char *find;
+    const char *replace;
+} Edit;
+
+// -----------------
+// Private Functions
+// -----------------
+
+void printDocument(Document *d, Output *out);
+void printPosition(void *node, int scope, int depth, void *data);
+
+// -----------------
+// Main Funcs
+// -----------------
+
+int main(int argc, char **argv) {
+    const char *src =
+        "// A program edited line by line.\n"
+        "let i be num;\n"
+        "let s be num;\n"
+        "i = 0;\n"
+        "s = 0;\n"
+        "while i < 10 do\n"
+        "    s = s + i * 2;\n"
+        "    i = i + 1;\n"
+        "endwhile\n"
+        "if s > 50 then\n"
+        "    show s;\n"
+        "endif\n"
+        "proc twice(n be num)\n"
+        "    return n * 2;\n"
+        "endproc\n"
+        "show twice(s);\n";
+    Edit edits[] = {
+        {"s = 0;", "s = 5;"},
+        {"i = 0;\n", "i = 0;\nlet t be bool;\nt = true;\n"},
+        {"let t be bool;\n", ""},
+        {"s + i * 2", "s + i * (2 + i)"},
+        {"    show s;\nendif\n", "    show s;\n"},
+        {"    show s;\n", "    show s;\nendif\n"},
+        {"i = i + 1;", "i = i + 1 % 2;"},
+        {" % 2", ""},
+        {"t = true;\n", "t = true; show t;\n"},
+        {"show twice(s);\n", "show twice(s);\nshow i;"},
+        {"// A program", "let u be num;\n// A program"},
+        {"let s be num;", "// let s be num;"},
+        {"// let s be num;", "let s be num;"},
+        {"    return n * 2;\n", "    return n * 2 +\n        1;\n"},
+    };
+    int count = sizeof(edits) / sizeof(edits[0]);
+    bool incremental = argc > 1 && !strcmp(argv[1], "incremental");
+
+    Output out;
+    initOutput(&out, NULL);
+    Document d;
+    openDocument(&d, src, (long) strlen(src), &out);
+    printDocument(&d, &out);
+    int failed = 0;
+    for (int k = 0; k < count; k++) {
+        char *at = strstr(d.src, edits[k].find);
+        if (at == NULL) {
+            printf("edit %d: '%s' not found\n", k, edits[k].find);
+            failed++;
+            continue;
+        }
+        long start = at - d.src;
+        long end = start + (long) strlen(edits[k].find);
+        if (incremental) {
+            out.used = 0;
+            editDocument(&d, start, end, edits[k].replace, (long) strlen(edits[k].replace));
+            if (k == 0 && d.reparsed != 1) {
+                fprintf(stderr, "a one statement edit re-parsed %d statements\n", d.reparsed);
+                failed++;
+            }
+        } else {
+            long len = d.length - (end - start) + (long) strlen(edits[k].replace);
+            char *text = malloc(len + 1);
+            sprintf(text, "%.*s%s%s", (int) start, d.src, edits[k].replace, d.src + end);
+            closeDocument(&d);
+            out.used = 0;
+            openDocument(&d, text, len, &out);
+            free(text);
+        }
+        printf("-- edit %d\n", k);
+        printDocument(&d, &out);
+    }
+    closeDocument(&d);
+    freeOutput(&out);
+    return failed;
+}
+
+// -----------------
+// Helpers
+// -----------------
+
+// Print the messages, tokens, tree and statement positions of a document.
+void printDocument(Document *d, Output *out) {
+    printf("%.*s", (int) out->used, out->data);
+    printf("err %d\n", d->err);
+    for (int t = 0; t < d->tokLength; t++) {
+        printf("%d:%d %d '%s'\n", d->tokens[t].line, d->tokens[t].col, d->tokens[t].type, d->tokens[t].lexeme);
+    }
+    if (d->err) return;
+    printTree(d->tree);
+    walkTree(d->tree, printPosition, NULL);
+}
+
+// Print the line and column of a statement.
+void printPosition(void *node, int scope, int depth, void *data) {
+    int line, col;
+    switch (((VarExpr *) node)->s) {
+        case IF:
+        case WHILE:
+            line = ((IfStmt *) node)->line;
+            col = ((IfStmt *) node)->col;
+            break;
+        case SHOW:
+        case RETURN:
+        case INVOKE:
+            line = ((ShowStmt *) node)->line;
+            col = ((ShowStmt *) node)->col;
+            break;
+        case PROC:
+            line = ((ProcStmt *) node)->line;
+            col = ((ProcStmt *) node)->col;
+            break;
+        case READ:
+            line = ((ReadStmt *) node)->line;
+            col = ((ReadStmt *) node)->col;
+            break;
+        case VARDEC:
+            line = ((VarDecStmt *) node)->line;
+            col = ((VarDecStmt *) node)->col;
+            break;
+        case VARASSIGN:
+            line = ((VarAssignStmt *) node)->line;
+            col = ((VarAssignStmt *) node)->col;
+            break;
+        case STORE:
+            line = ((StoreStmt *) node)->line;
+            col = ((StoreStmt *) node)->col;
+            break;
+        default:
+            return;
+    }
+    printf("%d %d:%d\n", depth, line, col);
+}
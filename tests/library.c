@@ -0,0 +1,92 @@
+// Checks of the libcam API that the command line cannot reach, built and run by check_library.sh.
+// Each check prints a line when it fails and main returns the number of failures.
+
+#include "cam.h"
+#include <stdio.h>
+#include <string.h>
+
+// -----------------
+// Private Functions
+// -----------------
+
+CamProgram *compileOrSay(const char *src);
+int checkRowLimits(void);
+int checkBindTypes(void);
+
+// -----------------
+// Main Funcs
+// -----------------
+
+int main(void) {
+    int failed = 0;
+    failed += checkRowLimits();
+    failed += checkBindTypes();
+    return failed;
+}
+
+// -----------------
+// Checks
+// -----------------
+
+// Limits set on a context stop each row of camRunRows as they stop camRun, rather than row mode
+// looping forever.
+int checkRowLimits(void) {
+    CamProgram *prog = compileOrSay("let x be num;\nwhile true do\n    x = x + 1;\nendwhile\n");
+    if (prog == NULL) return 1;
+    CamContext *ctx = camNewContext(prog);
+    camSetLimits(ctx, 0, 1000, 0, 0);
+    int failed = 0;
+    if (camRun(ctx) || strstr(camOutput(ctx, NULL), "Loop iteration limit exceeded") == NULL) {
+        printf("camRun was not stopped by the iteration limit\n");
+        failed++;
+    }
+    double in[3] = {1, 2, 3}, out[3];
+    const double *inputs[1] = {in};
+    double *outputs[1] = {out};
+    const char *names[1] = {"x"};
+    if (camRunRows(ctx, 3, 1, names, inputs, 1, names, outputs) != 3) {
+        printf("camRunRows rows were not stopped by the iteration limit\n");
+        failed++;
+    }
+    camFreeContext(ctx);
+    camFreeProgram(prog);
+    return failed;
+}
+
+// Binding a value of the wrong type is refused and leaves the variable as it was, so a run never
+// reads a BOOL slot holding a NUM or the other way round.
+int checkBindTypes(void) {
+    CamProgram *prog = compileOrSay("let n be num;\nlet b be bool;\nlet a be num[2];\n");
+    if (prog == NULL) return 1;
+    CamContext *ctx = camNewContext(prog);
+    int failed = 0;
+    if (camBindNum(ctx, "b", 1) || camBindBool(ctx, "n", true) || camBindNum(ctx, "a", 1)) {
+        printf("a binding of the wrong type was accepted\n");
+        failed++;
+    }
+    if (!camBindNum(ctx, "n", 5) || !camBindBool(ctx, "b", true)) {
+        printf("a binding of the right type was refused\n");
+        failed++;
+    }
+    double n;
+    bool b;
+    if (!camRun(ctx) || !camGetNum(ctx, "n", &n) || n != 5 || !camGetBool(ctx, "b", &b) || !b) {
+        printf("bound values did not reach the run\n");
+        failed++;
+    }
+    camFreeContext(ctx);
+    camFreeProgram(prog);
+    return failed;
+}
+
+// -----------------
+// Helpers
+// -----------------
+
+// Compile a program, printing why when it does not compile.
+CamProgram *compileOrSay(const char *src) {
+    char err[512];
+    CamProgram *prog = camCompile(src, (long) strlen(src), err, sizeof(err));
+    if (prog == NULL) printf("does not compile: %s", err);
+    return prog;
+}
@@ -0,0 +1,55 @@
+#!/bin/sh
+# Golden output tests for the CAM interpreter.
+# Runs every tests/*.cam and compares what it prints, messages included, with the .out file beside it.
+# Each program is run unoptimised, optimised, without compiled loops, compiling every loop at once and
+# on one and four threads, so the optimiser, the loop compiler and parallel loops are held to the output
+# of the plain evaluator. A .in file beside a program is its --input and a .args file holds more
+# options for it. Then runs every tests/check_*.sh with the interpreter. Prints a line per failure and
+# exits 1 if there were any.
+# Build with 'make' first, or run 'make test'.
+#
+# Usage: tests/run.sh [cam]
+# UPDATE=1 rewrites the .out files from the unoptimised runs instead of comparing.
+
+CAM=${1:-./cam}
+DIR=$(dirname "$0")
+TMP=${TMPDIR:-/tmp}/camtest.$$
+ASAN_OPTIONS=${ASAN_OPTIONS:-detect_leaks=0}
+export ASAN_OPTIONS
+failed=0
+count=0
+
+for prog in "$DIR"/*.cam; do
+    expect=${prog%.cam}.out
+    extra=
+    [ -f "${prog%.cam}.in" ] && extra="--input ${prog%.cam}.in"
+    [ -f "${prog%.cam}.args" ] && extra="$extra $(cat "${prog%.cam}.args")"
+    if [ -n "$UPDATE" ]; then
+        $CAM --no-opt $extra "$prog" > "$expect" 2>&1
+        continue
+    fi
+    for opts in "--no-opt" "" "--no-tier" "--tier-after 1" "--threads 1" "--threads 4"; do
+        count=$((count + 1))
+        $CAM $opts $extra "$prog" > "$TMP.out" 2>&1
+        if ! cmp -s "$expect" "$TMP.out"; then
+            echo "FAIL $prog $opts"
+            diff "$expect" "$TMP.out" | head -5
+            failed=$((failed + 1))
+        fi
+    done
+done
+[ -z "$UPDATE" ] || exit 0
+
+for check in "$DIR"/check_*.sh; do
+    [ -f "$check" ] || continue
+    count=$((count + 1))
+    if ! sh "$check" "$CAM" > "$TMP.out" 2>&1; then
+        echo "FAIL $check"
+        head -5 "$TMP.out"
+        failed=$((failed + 1))
+    fi
+done
+
+rm -f "$TMP.out"
+echo "$((count - failed)) of $count passed"
+[ $failed -eq 0 ]
@@ -0,0 +1,316 @@
+// Synthetic program generator for the CAM programming langauge.
+// Writes a valid, type correct CAM program to stdout from a handful of size knobs, for scaling and
+// stress benchmarks. The same seed and knobs always give the same program, byte for byte.
+// Programs are streamed, so a size of several gigabytes needs no more memory than a small one.
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// What to generate. Every knob has a default so any subset can be given.
+typedef struct Knobs {
+    long statements;
+    int vars;
+    int exprDepth;
+    int nesting;
+    int commentPercent;
+    int ifPercent;
+    int whilePercent;
+    long trips;
+    long long bytes;
+    unsigned long long seed;
+} Knobs;
+
+// Generator state: the knobs, the random stream, the line being built and the bytes written so far.
+typedef struct Gen {
+    Knobs k;
+    unsigned long long state;
+    long long written;
+    char *line;
+    long size;
+    long used;
+} Gen;
+
+// -----------------
+// Private Functions
+// -----------------
+
+int usage(void);
+unsigned long long nextRandom(Gen *g);
+int below(Gen *g, int n);
+void emit(Gen *g, const char *fmt, ...);
+void emitName(Gen *g, char kind, int n);
+void endLine(Gen *g, int indent);
+void indentLine(Gen *g, int indent);
+void numExpr(Gen *g, int depth);
+void boolExpr(Gen *g, int depth);
+void statement(Gen *g, int indent, int level);
+void prologue(Gen *g);
+
+// Parse the knobs and write one program.
+int main(int argc, char *argv[]) {
+    Gen g;
+    memset(&g, 0, sizeof(g));
+    g.k = (Knobs) {1000, 16, 3, 3, 10, 10, 10, 10, 0, 1};
+    for (int a = 1; a < argc; a++) {
+        if (a + 1 >= argc) return usage();
+        char *knob = argv[a];
+        char *value = argv[++a];
+        if (!strcmp(knob, "--statements")) g.k.statements = atol(value);
+        else if (!strcmp(knob, "--vars")) g.k.vars = atoi(value);
+        else if (!strcmp(knob, "--expr-depth")) g.k.exprDepth = atoi(value);
+        else if (!strcmp(knob, "--nesting")) g.k.nesting = atoi(value);
+        else if (!strcmp(knob, "--comments")) g.k.commentPercent = atoi(value);
+        else if (!strcmp(knob, "--ifs")) g.k.ifPercent = atoi(value);
+        else if (!strcmp(knob, "--whiles")) g.k.whilePercent = atoi(value);
+        else if (!strcmp(knob, "--trips")) g.k.trips = atol(value);
+        else if (!strcmp(knob, "--bytes")) g.k.bytes = atoll(value);
+        else if (!strcmp(knob, "--seed")) g.k.seed = strtoull(value, NULL, 10);
+        else return usage();
+    }
+    if (g.k.vars < 1) g.k.vars = 1;
+    if (g.k.nesting < 0) g.k.nesting = 0;
+    g.state = g.k.seed;
+    g.size = 4096;
+    g.line = malloc(g.size);
+
+    prologue(&g);
+    for (long s = 0; g.k.bytes ? g.written < g.k.bytes : s < g.k.statements; s++) statement(&g, 0, 0);
+    fflush(stdout);
+    free(g.line);
+    return 0;
+}
+
+// Print the usage message.
+int usage(void) {
+    fprintf(stderr, "Usage: camgen [--statements n] [--vars n] [--expr-depth n] [--nesting n] [--comments pct]\n"
+                    "              [--ifs pct] [--whiles pct] [--trips n] [--bytes n] [--seed n]\n"
+                    "--bytes keeps adding top level statements until the program is at least that long,\n"
+                    "in place of --statements. Every while loop runs --trips times.\n");
+    return 1;
+}
+
+// -----------------
+// Program structure
+// -----------------
+
+// Declare and set every variable. Names starting x are NUMs and q BOOLs shared by all statements.
+// Loop counters start k and are kept apart so no generated statement can stop a loop from ending.
+// No keyword starts with x, q or k.
+void prologue(Gen *g) {
+    emit(g, "// camgen seed %llu", g->k.seed);
+    endLine(g, 0);
+    for (int v = 0; v < g->k.vars; v++) {
+        emit(g, "let ");
+        emitName(g, 'x', v);
+        emit(g, " be num; ");
+        emitName(g, 'x', v);
+        emit(g, " = %d;", below(g, 100));
+        endLine(g, 0);
+    }
+    for (int b = 0; b < g->k.vars / 4 + 1; b++) {
+        emit(g, "let ");
+        emitName(g, 'q', b);
+        emit(g, " be bool; ");
+        emitName(g, 'q', b);
+        emit(g, " = %s;", below(g, 2) ? "true" : "false");
+        endLine(g, 0);
+    }
+    for (int c = 0; c < g->k.nesting; c++) {
+        emit(g, "let ");
+        emitName(g, 'k', c);
+        emit(g, " be num;");
+        endLine(g, 0);
+    }
+}
+
+// One statement at a nesting level, with any if or while body below it.
+void statement(Gen *g, int indent, int level) {
+    int pick = below(g, 100);
+    if (level < g->k.nesting && pick < g->k.whilePercent) {
+        indentLine(g, indent);
+        emitName(g, 'k', level);
+        emit(g, " = 0;");
+        endLine(g, indent);
+        indentLine(g, indent);
+        emit(g, "while ");
+        emitName(g, 'k', level);
+        emit(g, " < %ld do", g->k.trips);
+        endLine(g, indent);
+        int body = 1 + below(g, 4);
+        for (int s = 0; s < body; s++) statement(g, indent + 1, level + 1);
+        indentLine(g, indent + 1);
+        emitName(g, 'k', level);
+        emit(g, " = ");
+        emitName(g, 'k', level);
+        emit(g, " + 1;");
+        endLine(g, indent + 1);
+        indentLine(g, indent);
+        emit(g, "endwhile");
+        endLine(g, indent);
+    } else if (level < g->k.nesting && pick < g->k.whilePercent + g->k.ifPercent) {
+        indentLine(g, indent);
+        emit(g, "if ");
+        boolExpr(g, g->k.exprDepth);
+        emit(g, " then");
+        endLine(g, indent);
+        int body = 1 + below(g, 4);
+        for (int s = 0; s < body; s++) statement(g, indent + 1, level + 1);
+        indentLine(g, indent);
+        emit(g, "endif");
+        endLine(g, indent);
+    } else if (pick % 8 == 0) {
+        indentLine(g, indent);
+        emit(g, "show ");
+        if (below(g, 4)) numExpr(g, g->k.exprDepth);
+        else boolExpr(g, g->k.exprDepth);
+        emit(g, ";");
+        endLine(g, indent);
+    } else if (pick % 8 == 1) {
+        indentLine(g, indent);
+        emitName(g, 'q', below(g, g->k.vars / 4 + 1));
+        emit(g, " = ");
+        boolExpr(g, g->k.exprDepth);
+        emit(g, ";");
+        endLine(g, indent);
+    } else {
+        indentLine(g, indent);
+        emitName(g, 'x', below(g, g->k.vars));
+        emit(g, " = ");
+        numExpr(g, g->k.exprDepth);
+        emit(g, ";");
+        endLine(g, indent);
+    }
+}
+
+// -----------------
+// Expressions
+// -----------------
+
+// A NUM expression at most depth operators deep. Division is only by a non zero literal so no
+// program can fail at run time.
+void numExpr(Gen *g, int depth) {
+    int pick = depth > 0 ? below(g, 6) : 4 + below(g, 2);
+    switch (pick) {
+        case 0:
+        case 1:
+        case 2: {
+            char *ops[] = {" + ", " - ", " * "};
+            bool brackets = below(g, 3) == 0;
+            if (brackets) emit(g, "(");
+            numExpr(g, depth - 1);
+            emit(g, "%s", ops[pick]);
+            numExpr(g, depth - 1);
+            if (brackets) emit(g, ")");
+            break;
+        }
+        case 3:
+            numExpr(g, depth - 1);
+            emit(g, " / %d", 1 + below(g, 9));
+            break;
+        case 4:
+            emitName(g, 'x', below(g, g->k.vars));
+            break;
+        default:
+            if (below(g, 4)) emit(g, "%d", below(g, 1000));
+            else emit(g, "%d.%d", below(g, 100), below(g, 100));
+            break;
+    }
+}
+
+// A BOOL expression at most depth operators deep.
+void boolExpr(Gen *g, int depth) {
+    int pick = depth > 0 ? below(g, 6) : 4 + below(g, 2);
+    switch (pick) {
+        case 0: {
+            char *ops[] = {" < ", " <= ", " > ", " >= ", " == ", " != "};
+            numExpr(g, depth - 1);
+            emit(g, "%s", ops[below(g, 6)]);
+            numExpr(g, depth - 1);
+            break;
+        }
+        case 1:
+        case 2:
+            emit(g, "(");
+            boolExpr(g, depth - 1);
+            emit(g, pick == 1 ? " & " : " | ");
+            boolExpr(g, depth - 1);
+            emit(g, ")");
+            break;
+        case 3:
+            emit(g, "!");
+            boolExpr(g, 0);
+            break;
+        case 4:
+            emitName(g, 'q', below(g, g->k.vars / 4 + 1));
+            break;
+        default:
+            emit(g, below(g, 2) ? "true" : "false");
+            break;
+    }
+}
+
+// -----------------
+// Helpers
+// -----------------
+
+// splitmix64, so a seed gives the same stream on every platform.
+unsigned long long nextRandom(Gen *g) {
+    unsigned long long z = (g->state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// A random integer in 0 .. n - 1.
+int below(Gen *g, int n) {
+    return n > 0 ? (int) (nextRandom(g) % n) : 0;
+}
+
+// Append text to the current line, growing it as deep expressions need.
+void emit(Gen *g, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(g->line + g->used, g->size - g->used, fmt, args);
+    va_end(args);
+    if (n >= g->size - g->used) {
+        while (n >= g->size - g->used) g->size *= 2;
+        g->line = realloc(g->line, g->size);
+        va_start(args, fmt);
+        vsnprintf(g->line + g->used, g->size - g->used, fmt, args);
+        va_end(args);
+    }
+    g->used += n;
+}
+
+// Append a variable name: its kind letter then n in base 26 written with letters, as CAM names
+// may not hold digits.
+void emitName(Gen *g, char kind, int n) {
+    char name[16];
+    int len = 0;
+    do {
+        name[len++] = 'a' + n % 26;
+        n /= 26;
+    } while (n);
+    emit(g, "%c", kind);
+    while (len) emit(g, "%c", name[--len]);
+}
+
+// Start a line with four spaces per level.
+void indentLine(Gen *g, int indent) {
+    for (int i = 0; i < indent; i++) emit(g, "    ");
+}
+
+// Finish the current line, sometimes adding a comment line after it, and write it out.
+void endLine(Gen *g, int indent) {
+    emit(g, "\n");
+    if (below(g, 100) < g->k.commentPercent) {
+        indentLine(g, indent);
+        emit(g, "// note %llu\n", nextRandom(g) % 100000);
+    }
+    fwrite(g->line, 1, g->used, stdout);
+    g->written += g->used;
+    g->used = 0;
+}